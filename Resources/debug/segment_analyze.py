@@ -0,0 +1,211 @@
+# coding=utf-8
+#
+# segment_analyze.py - reconstruct motion from a segment trace and flag motion quality problems
+#
+# The trace is the binary dump of the firmware's mst structure (see "Segment Trace" in
+# g2core/planner.h and segment_trace.gdb). Each record is one call to st_prep_line().
+#
+# Velocity is reconstructed per segment from travel steps and segment time. Acceleration and
+# jerk are taken as finite differences between segment midpoints. All values are in the
+# firmware's units: mm (or degrees) and minutes. Jerk is also shown divided by 1,000,000 so
+# it can be compared directly with the axis jm settings.
+#
+# Reported problems:
+#   JERK  - path jerk within a block exceeds the block's planned jerk (bf->jerk) * tolerance
+#   DV    - path velocity step at a block boundary is larger than the largest step between
+#           neighboring segments inside either block * factor
+#
+# usage: python segment_analyze.py segtrace.bin [--jerk-tolerance 1.1] [--dv-factor 2.0] [--csv out.csv]
+
+from __future__ import print_function
+import argparse
+import math
+import struct
+import sys
+
+SEGMENT_TRACE_MAGIC = 0x31544753
+SEGMENT_TRACE_VERSION = 1
+JERK_MULTIPLIER = 1000000.0
+AXIS_NAMES = 'XYZUVWABC'
+
+
+def load_trace(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    magic, version, motors, capacity, count, armed = struct.unpack_from('<6I', data, 0)
+    if magic != SEGMENT_TRACE_MAGIC:
+        sys.exit("%s: bad magic 0x%08x - was the capture ever armed?" % (filename, magic))
+    if version != SEGMENT_TRACE_VERSION:
+        sys.exit("%s: trace version %i, expected %i" % (filename, version, SEGMENT_TRACE_VERSION))
+
+    offset = 6 * 4
+    motor_map = struct.unpack_from('<%iI' % motors, data, offset)
+    offset += motors * 4
+    steps_per_unit = struct.unpack_from('<%if' % motors, data, offset)
+    offset += motors * 4
+
+    record_format = '<2I2f%if%if' % (motors, motors)
+    record_size = struct.calcsize(record_format)
+    count = min(count, capacity, (len(data) - offset) // record_size)
+
+    records = []
+    for i in range(count):
+        fields = struct.unpack_from(record_format, data, offset + i * record_size)
+        records.append({
+            'block': fields[0],
+            'linenum': fields[1],
+            'jerk': fields[2],
+            'segment_time': fields[3],
+            'travel_steps': fields[4:4 + motors],
+            'following_error': fields[4 + motors:4 + 2 * motors],
+        })
+
+    return {
+        'motors': motors,
+        'motor_map': motor_map,
+        'steps_per_unit': steps_per_unit,
+        'armed': armed,
+        'records': records,
+    }
+
+
+def axis_motors(trace):
+    # use the first motor mapped to each axis - gantry slaves would double count
+    axes = {}
+    for m in range(trace['motors']):
+        axis = trace['motor_map'][m]
+        if axis < len(AXIS_NAMES) and axis not in axes and trace['steps_per_unit'][m] != 0:
+            axes[axis] = m
+    return sorted(axes.items())
+
+
+def reconstruct(trace):
+    axes = axis_motors(trace)
+    segs = []
+    t = 0.0
+    for r in trace['records']:
+        T = r['segment_time']
+        v = {}
+        for axis, m in axes:
+            v[axis] = r['travel_steps'][m] / trace['steps_per_unit'][m] / T if T > 0 else 0.0
+        segs.append({
+            'r': r,
+            't': t + T / 2,                                     # segment midpoint
+            'v': v,
+            'speed': math.sqrt(sum(x * x for x in v.values())),
+            'accel': None,                                      # at midpoint between this and previous segment
+            'jerk': None,
+        })
+        t += T
+
+    for i in range(1, len(segs)):
+        dt = segs[i]['t'] - segs[i - 1]['t']
+        if dt > 0:
+            segs[i]['accel'] = (segs[i]['speed'] - segs[i - 1]['speed']) / dt
+            segs[i]['ta'] = (segs[i]['t'] + segs[i - 1]['t']) / 2
+    for i in range(2, len(segs)):
+        if segs[i]['accel'] is None or segs[i - 1]['accel'] is None:
+            continue
+        dt = segs[i]['ta'] - segs[i - 1]['ta']
+        if dt > 0:
+            segs[i]['jerk'] = (segs[i]['accel'] - segs[i - 1]['accel']) / dt
+    return axes, segs
+
+
+def check_jerk(segs, tolerance):
+    problems = []
+    for i in range(2, len(segs)):
+        s = segs[i]
+        if s['jerk'] is None:
+            continue
+        if not (segs[i - 2]['r']['block'] == segs[i - 1]['r']['block'] == s['r']['block']):
+            continue                                            # corners are governed by junction deviation
+        limit = s['r']['jerk']
+        if limit > 0 and abs(s['jerk']) > limit * tolerance:
+            problems.append((i, "JERK line %i: %.3f > %.3f (x%.2f)" % (
+                s['r']['linenum'], abs(s['jerk']) / JERK_MULTIPLIER, limit / JERK_MULTIPLIER, abs(s['jerk']) / limit)))
+    return problems
+
+
+def check_velocity(segs, factor):
+    # largest speed step between neighboring segments within each block
+    max_step = {}
+    for i in range(1, len(segs)):
+        block = segs[i]['r']['block']
+        if segs[i - 1]['r']['block'] == block:
+            step = abs(segs[i]['speed'] - segs[i - 1]['speed'])
+            max_step[block] = max(max_step.get(block, 0.0), step)
+
+    problems = []
+    for i in range(1, len(segs)):
+        prev, s = segs[i - 1], segs[i]
+        if prev['r']['block'] == s['r']['block']:
+            continue
+        step = abs(s['speed'] - prev['speed'])
+        allowed = max(max_step.get(prev['r']['block'], 0.0), max_step.get(s['r']['block'], 0.0)) * factor
+        if step > allowed and step > 1e-3:
+            problems.append((i, "DV   line %i -> %i: %.3f -> %.3f (step %.3f, allowed %.3f)" % (
+                prev['r']['linenum'], s['r']['linenum'], prev['speed'], s['speed'], step, allowed)))
+    return problems
+
+
+def write_csv(filename, axes, segs, motors):
+    with open(filename, 'w') as f:
+        columns = ['index', 'block', 'linenum', 't', 'segment_time', 'speed', 'accel', 'jerk', 'block_jerk']
+        columns += ['v%s' % AXIS_NAMES[axis] for axis, m in axes]
+        columns += ['fe%i' % (m + 1) for m in range(motors)]
+        f.write(','.join(columns) + '\n')
+        for i, s in enumerate(segs):
+            r = s['r']
+            row = [i, r['block'], r['linenum'], s['t'], r['segment_time'], s['speed'],
+                   '' if s['accel'] is None else s['accel'],
+                   '' if s['jerk'] is None else s['jerk'], r['jerk']]
+            row += [s['v'][axis] for axis, m in axes]
+            row += list(r['following_error'])
+            f.write(','.join(str(x) for x in row) + '\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Analyze a g2core segment trace')
+    parser.add_argument('trace', help='binary dump of mst (see segment_trace.gdb)')
+    parser.add_argument('--jerk-tolerance', type=float, default=1.10,
+                        help='flag jerk above block jerk times this (default 1.10)')
+    parser.add_argument('--dv-factor', type=float, default=2.0,
+                        help='flag block boundary velocity steps above in-block steps times this (default 2.0)')
+    parser.add_argument('--csv', help='write the per-segment reconstruction to this file')
+    args = parser.parse_args()
+
+    trace = load_trace(args.trace)
+    axes, segs = reconstruct(trace)
+    if not segs:
+        sys.exit("no records captured")
+
+    blocks = len(set(s['r']['block'] for s in segs))
+    total_time = sum(s['r']['segment_time'] for s in segs)
+    print("records: %i  blocks: %i  time: %.3f sec%s" % (
+        len(segs), blocks, total_time * 60, '  (still armed - capture incomplete)' if trace['armed'] else ''))
+    print("axes: %s" % ' '.join('%s=m%i' % (AXIS_NAMES[axis], m + 1) for axis, m in axes))
+    print("peak speed: %.3f /min" % max(s['speed'] for s in segs))
+    accels = [abs(s['accel']) for s in segs if s['accel'] is not None]
+    if accels:
+        print("peak accel: %.3f /min^2" % max(accels))
+    ratios = [abs(s['jerk']) / s['r']['jerk'] for s in segs if s['jerk'] is not None and s['r']['jerk'] > 0]
+    if ratios:
+        print("peak jerk / block jerk: %.3f" % max(ratios))
+    for m in range(trace['motors']):
+        print("motor %i max following error: %.2f steps" % (
+            m + 1, max(abs(s['r']['following_error'][m]) for s in segs)))
+
+    problems = check_jerk(segs, args.jerk_tolerance) + check_velocity(segs, args.dv_factor)
+    problems.sort()
+    for i, text in problems:
+        print("%6i %s" % (i, text))
+    print("%i problems found" % len(problems))
+
+    if args.csv:
+        write_csv(args.csv, axes, segs, trace['motors'])
+
+
+if __name__ == '__main__':
+    main()
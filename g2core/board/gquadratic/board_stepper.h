@@ -71,6 +71,9 @@ extern StepDirStepper<Motate::kSocket2_StepPinNumber,
 //    Motate::kSocket6_Microstep_2PinNumber,
 //    Motate::kSocket6_VrefPinNumber> motor_6 {};
 
+// Motors in motor order - must match Motors[]. The DDA interrupt is generated from this list.
+#define BOARD_STEPPERS motor_1, motor_2, motor_3
+
 extern Stepper* Motors[MOTORS];
 
 void board_stepper_init();
@@ -65,6 +65,9 @@ extern Trinamic2130<SPIBus_used_t::SPIBusDevice,
                     Motate::kSocket5_EnablePinNumber>
     motor_5;
 
+// Motors in motor order - must match Motors[]. The DDA interrupt is generated from this list.
+#define BOARD_STEPPERS motor_1, motor_2, motor_3, motor_4, motor_5
+
 extern Stepper* Motors[MOTORS];
 
 void board_stepper_init();
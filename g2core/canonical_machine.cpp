@@ -98,7 +98,9 @@
 
 #include "plan_arc.h"
 #include "planner.h"
+#include "plan_shaper.h"
 #include "stepper.h"
+#include "kinematics.h"
 #include "encoder.h"
 //#include "toolhead.h"
 #include "spindle.h"
@@ -106,6 +108,7 @@
 #include "pwm.h"
 #include "report.h"
 #include "gpio.h"
+#include "persistence.h"
 #include "temperature.h"
 #include "hardware.h"
 #include "util.h"
@@ -142,8 +145,8 @@ static int8_t _axis(const nvObj_t *nv);     // return axis number from token/gro
 
 void canonical_machine_inits()
 {
-    planner_init(&mp1, &mr1, mp1_queue, PLANNER_QUEUE_SIZE);
-    planner_init(&mp2, &mr2, mp2_queue, SECONDARY_QUEUE_SIZE);
+    planner_init(&mp1, &mr1, mp1_queue, mp1_state, PLANNER_QUEUE_SIZE);
+    planner_init(&mp2, &mr2, mp2_queue, mp2_state, SECONDARY_QUEUE_SIZE);
     canonical_machine_init(&cm1, &mp1); // primary canonical machine
     canonical_machine_init(&cm2, &mp2); // secondary canonical machine
     cm = &cm1;                          // set global canonical machine pointer to primary machine
@@ -174,7 +177,7 @@ void canonical_machine_reset(cmMachine_t *_cm)
     cm_set_units_mode(cm->default_units_mode);
     cm_set_coord_system(cm->default_coord_system);   // NB: queues a block to the planner with the coordinates
     cm_select_plane(cm->default_select_plane);
-    cm_set_path_control(MODEL, cm->default_path_control);
+    cm_set_path_control(MODEL, cm->default_path_control, 0, false);
     cm_set_distance_mode(cm->default_distance_mode);
     cm_set_arc_distance_mode(INCREMENTAL_DISTANCE_MODE); // always the default
     cm_set_feed_rate_mode(UNITS_PER_MINUTE_MODE);   // always the default
@@ -258,6 +261,7 @@ void cm_set_motion_state(const cmMotionState motion_state)
 {
     cm->motion_state = motion_state;
     ACTIVE_MODEL = ((motion_state == MOTION_STOP) ? MODEL : RUNTIME);
+    sr_flag_change(SR_SOURCE_MODEL);                // model fields now come from the other model
 }
 
 /*
@@ -522,13 +526,17 @@ void cm_update_model_position()
 /****************************************************************************************
  * cm_deferred_write_callback() - write any changed G10 values back to persistence
  *
- *  Only runs if there is G10 data to write, there is no movement, and the serial queues 
- *  are quiescent.
+ *  Only runs if there is no movement. Queues G10 data if there is any to write,
+ *  then commits pending persistence writes to NVM. The commit writes one flash page
+ *  per pass and returns STAT_EAGAIN until it's done, which holds off new commands.
  */
 
 stat_t cm_deferred_write_callback()
 {
-    if ((cm->cycle_type == CYCLE_NONE) && (cm->deferred_write_flag == true)) {
+    if (cm->cycle_type != CYCLE_NONE) {
+        return (STAT_OK);
+    }
+    if (cm->deferred_write_flag == true) {
         cm->deferred_write_flag = false;
         nvObj_t nv;
         for (uint8_t i=1; i<=COORDS; i++) {
@@ -540,7 +548,7 @@ stat_t cm_deferred_write_callback()
             }
         }
     }
-    return (STAT_OK);
+    return (persistence_commit());
 }
 
 /****************************************************************************************
@@ -1264,11 +1272,22 @@ stat_t cm_set_feed_rate_mode(const uint8_t mode)
 
 /****************************************************************************************
  * cm_set_path_control() - G61, G61.1, G64
+ *
+ *  G64 P<tolerance> turns on corner blending: corners between feed moves are rounded off
+ *  with an arc that stays within the tolerance of the programmed corner (see plan_line.cpp).
+ *  G64 without a P word, G61 and G61.1 turn it off.
  */
 
-stat_t cm_set_path_control(GCodeState_t *gcode_state, const uint8_t mode)
+stat_t cm_set_path_control(GCodeState_t *gcode_state, const uint8_t mode, const float P_word, const bool P_flag)
 {
     gcode_state->path_control = (cmPathControl)mode;
+    gcode_state->path_tolerance = 0;
+    if ((mode == PATH_CONTINUOUS) && P_flag) {
+        if (P_word < 0) {
+            return (STAT_INPUT_LESS_THAN_MIN_VALUE);
+        }
+        gcode_state->path_tolerance = (gcode_state->units_mode == INCHES) ? P_word * MM_PER_INCH : P_word;
+    }
     return (STAT_OK);
 }
 
@@ -1312,7 +1331,12 @@ stat_t cm_straight_feed(const float *target, const bool *flags, const uint8_t mo
     ritorno (cm_test_soft_limits(cm->gm.target));   // test soft limits; exit if thrown
     cm_set_display_offsets(&cm->gm);                // capture the fully resolved offsets to the state
     cm_cycle_start();                               // required for homing & other cycles
-    stat_t status = mp_aline(&cm->gm);              // send the move to the planner
+    stat_t status;                                  // send the move to the planner, or hold it for merging/blending
+    if (motion_profile == PROFILE_NORMAL) {
+        status = mp_merge_line(&cm->gm, cm->gmx.position);
+    } else {
+        status = mp_aline(&cm->gm);
+    }
     cm_update_model_position();                     // <-- ONLY safe because we don't care about status...
 
     if (status == STAT_MINIMUM_LENGTH_MOVE) {
@@ -2125,6 +2149,7 @@ stat_t cm_set_am(nvObj_t *nv)        // axis mode
     }
     nv->valuetype = TYPE_INTEGER;
     cm->a[_axis(nv)].axis_mode = (cmAxisMode)nv->value_int;
+    kn_config_changed();                // inhibited axes are left out of the motor map
     return(STAT_OK);    
 }
 
@@ -2250,6 +2275,78 @@ stat_t cm_set_lb(nvObj_t *nv) { return (set_float(nv, cm->a[_axis(nv)].latch_bac
 stat_t cm_get_zb(nvObj_t *nv) { return (get_float(nv, cm->a[_axis(nv)].zero_backoff)); }
 stat_t cm_set_zb(nvObj_t *nv) { return (set_float(nv, cm->a[_axis(nv)].zero_backoff)); }
 
+/**** Axis Input Shaping Settings
+ * cm_get_st() - get input shaper type
+ * cm_set_st() - set input shaper type
+ * cm_get_sf() - get input shaper frequency
+ * cm_set_sf() - set input shaper frequency
+ * cm_get_sd() - get input shaper damping ratio
+ * cm_set_sd() - set input shaper damping ratio
+ *
+ *  Each setting re-sizes the axis shaper (see plan_shaper.h). If the shaper can't be
+ *  built - the frequency is too low for the shaper history - the old value is put back.
+ *  Settings are refused while a cycle is running or the shaper is settling.
+ */
+
+static stat_t _shaper_idle()
+{
+    if ((cm->cycle_type != CYCLE_NONE) || mp_shaper_busy()) {
+        return (STAT_COMMAND_NOT_ACCEPTED);
+    }
+    return (STAT_OK);
+}
+
+static stat_t _set_shaper(const uint8_t axis)
+{
+    cfgAxis_t *a = &cm->a[axis];
+    return (mp_shaper_set_axis(axis, a->shaper_type, a->shaper_frequency, a->shaper_damping));
+}
+
+stat_t cm_get_st(nvObj_t *nv) { return (get_integer(nv, cm->a[_axis(nv)].shaper_type)); }
+stat_t cm_set_st(nvObj_t *nv)
+{
+    ritorno(_shaper_idle());
+    uint8_t axis = _axis(nv);
+    uint8_t previous = cm->a[axis].shaper_type;
+    ritorno(set_integer(nv, cm->a[axis].shaper_type, SHAPER_NONE, SHAPER_EI));
+    stat_t status = _set_shaper(axis);
+    if (status != STAT_OK) {
+        cm->a[axis].shaper_type = previous;
+        _set_shaper(axis);
+    }
+    return (status);
+}
+
+stat_t cm_get_sf(nvObj_t *nv) { return (get_float(nv, cm->a[_axis(nv)].shaper_frequency)); }
+stat_t cm_set_sf(nvObj_t *nv)
+{
+    ritorno(_shaper_idle());
+    uint8_t axis = _axis(nv);
+    float previous = cm->a[axis].shaper_frequency;
+    ritorno(set_float_range(nv, cm->a[axis].shaper_frequency, 0, SHAPER_FREQUENCY_MAX));
+    stat_t status = _set_shaper(axis);
+    if (status != STAT_OK) {
+        cm->a[axis].shaper_frequency = previous;
+        _set_shaper(axis);
+    }
+    return (status);
+}
+
+stat_t cm_get_sd(nvObj_t *nv) { return (get_float(nv, cm->a[_axis(nv)].shaper_damping)); }
+stat_t cm_set_sd(nvObj_t *nv)
+{
+    ritorno(_shaper_idle());
+    uint8_t axis = _axis(nv);
+    float previous = cm->a[axis].shaper_damping;
+    ritorno(set_float_range(nv, cm->a[axis].shaper_damping, 0, SHAPER_DAMPING_MAX));
+    stat_t status = _set_shaper(axis);
+    if (status != STAT_OK) {
+        cm->a[axis].shaper_damping = previous;
+        _set_shaper(axis);
+    }
+    return (status);
+}
+
 
 /*** Canonical Machine Global Settings ***/
 /*
@@ -2257,6 +2354,8 @@ stat_t cm_set_zb(nvObj_t *nv) { return (set_float(nv, cm->a[_axis(nv)].zero_back
  * cm_set_jt()  - set junction integration time
  * cm_get_ct()  - get chordal tolerance
  * cm_set_ct()  - set chordal tolerance
+ * cm_get_mlt() - get line merge tolerance
+ * cm_set_mlt() - set line merge tolerance
  * cm_get_sl()  - get soft limit enable
  * cm_set_sl()  - set soft limit enable
  * cm_get_lim() - get hard limit enable
@@ -2280,6 +2379,9 @@ stat_t cm_set_jt(nvObj_t *nv)
 stat_t cm_get_ct(nvObj_t *nv) { return(get_float(nv, cm->chordal_tolerance)); }
 stat_t cm_set_ct(nvObj_t *nv) { return(set_float_range(nv, cm->chordal_tolerance, CHORDAL_TOLERANCE_MIN, 10000000)); }
 
+stat_t cm_get_mlt(nvObj_t *nv) { return(get_float(nv, cm->merge_tolerance)); }
+stat_t cm_set_mlt(nvObj_t *nv) { return(set_float_range(nv, cm->merge_tolerance, 0, 10000000)); }
+
 stat_t cm_get_zl(nvObj_t *nv) { return(get_float(nv, cm->feedhold_z_lift)); }
 stat_t cm_set_zl(nvObj_t *nv) { return(set_float(nv, cm->feedhold_z_lift)); }
 
@@ -2416,6 +2518,7 @@ void cm_print_gdi(nvObj_t *nv) { text_print(nv, fmt_gdi);}  // TYPE_INT
 
 static const char fmt_jt[] = "[jt]  junction integration time%7.2f\n";
 static const char fmt_ct[] = "[ct]  chordal tolerance%17.4f%s\n";
+static const char fmt_mlt[] = "[mlt] line merge tolerance%15.4f%s\n";
 static const char fmt_zl[] = "[zl]  Z lift on feedhold%16.3f%s\n";
 static const char fmt_sl[] = "[sl]  soft limit enable%12d [0=disable,1=enable]\n";
 static const char fmt_lim[] ="[lim] limit switch enable%10d [0=disable,1=enable]\n";
@@ -2423,6 +2526,7 @@ static const char fmt_saf[] ="[saf] safety interlock enable%6d [0=disable,1=enab
 
 void cm_print_jt(nvObj_t *nv) { text_print(nv, fmt_jt);}        // TYPE FLOAT
 void cm_print_ct(nvObj_t *nv) { text_print_flt_units(nv, fmt_ct, GET_UNITS(ACTIVE_MODEL));}
+void cm_print_mlt(nvObj_t *nv) { text_print_flt_units(nv, fmt_mlt, GET_UNITS(ACTIVE_MODEL));}
 void cm_print_zl(nvObj_t *nv) { text_print_flt_units(nv, fmt_zl, GET_UNITS(ACTIVE_MODEL));}
 void cm_print_sl(nvObj_t *nv) { text_print(nv, fmt_sl);}        // TYPE_INT
 void cm_print_lim(nvObj_t *nv){ text_print(nv, fmt_lim);}       // TYPE_INT
@@ -2464,6 +2568,9 @@ void cm_print_nxln(nvObj_t *nv) { text_print(nv, fmt_nxln);};   // TYPE INT
  *    cm_print_lv()
  *    cm_print_lb()
  *    cm_print_zb()
+ *    cm_print_st()
+ *    cm_print_sf()
+ *    cm_print_sd()
  *
  *    cm_print_pos() - print position with unit displays for MM or Inches
  *    cm_print_mpo() - print position with fixed unit display - always in Degrees or MM
@@ -2484,6 +2591,9 @@ static const char fmt_Xsv[] = "[%s%s] %s search velocity%12.0f%s/min\n";
 static const char fmt_Xlv[] = "[%s%s] %s latch velocity%13.2f%s/min\n";
 static const char fmt_Xlb[] = "[%s%s] %s latch backoff%18.3f%s\n";
 static const char fmt_Xzb[] = "[%s%s] %s zero backoff%19.3f%s\n";
+static const char fmt_Xst[] = "[%s%s] %s input shaper%15d [0=off, 1=ZV, 2=ZVD, 3=EI]\n";
+static const char fmt_Xsf[] = "[%s%s] %s shaper frequency%14.2f Hz\n";
+static const char fmt_Xsd[] = "[%s%s] %s shaper damping%16.3f\n";
 static const char fmt_cofs[] = "[%s%s] %s %s offset%20.3f%s\n";
 static const char fmt_cpos[] = "[%s%s] %s %s position%18.3f%s\n";
 
@@ -2561,6 +2671,9 @@ void cm_print_sv(nvObj_t *nv) { _print_axis_flt(nv, fmt_Xsv);}
 void cm_print_lv(nvObj_t *nv) { _print_axis_flt(nv, fmt_Xlv);}
 void cm_print_lb(nvObj_t *nv) { _print_axis_flt(nv, fmt_Xlb);}
 void cm_print_zb(nvObj_t *nv) { _print_axis_flt(nv, fmt_Xzb);}
+void cm_print_st(nvObj_t *nv) { _print_axis_ui8(nv, fmt_Xst);}
+void cm_print_sf(nvObj_t *nv) { _print_axis_flt(nv, fmt_Xsf);}
+void cm_print_sd(nvObj_t *nv) { _print_axis_flt(nv, fmt_Xsd);}
 
 void cm_print_cofs(nvObj_t *nv) { _print_axis_coord_flt(nv, fmt_cofs);}
 void cm_print_cpos(nvObj_t *nv) { _print_axis_coord_flt(nv, fmt_cpos);}
@@ -208,6 +208,11 @@ typedef struct cmAxis {
     float travel_max;                       // max work envelope for soft limits
     float radius;                           // radius in mm for rotary axis modes
 
+    // input shaping - X, Y and Z only (see plan_shaper.h)
+    uint8_t shaper_type;                    // mpShaperType: 0=off, 1=ZV, 2=ZVD, 3=EI
+    float shaper_frequency;                 // resonant frequency to cancel in Hz
+    float shaper_damping;                   // damping ratio of the resonance
+
     // internal derived variables - computed during data entry and cached for computational efficiency
     float recip_velocity_max;
     float recip_feedrate_max;
@@ -262,6 +267,7 @@ typedef struct cmMachine {                  // struct to manage canonical machin
     // System group settings
     float junction_integration_time;        // how aggressively will the machine corner? 1.6 or so is about the upper limit
     float chordal_tolerance;                // arc chordal accuracy setting in mm
+    float merge_tolerance;                  // G1 line merging tolerance in mm, 0 = off
     float feedhold_z_lift;                  // mm to move Z axis on feedhold, or 0 to disable
     bool soft_limit_enable;                 // true to enable soft limit testing on Gcode inputs
     bool limit_enable;                      // true to enable limit switches (disabled is same as override)
@@ -443,7 +449,8 @@ stat_t cm_goto_g30_position(const float target[], const bool flags[]);      // G
 // Machining Attributes (4.3.5)
 stat_t cm_set_feed_rate(const float feed_rate);                             // F parameter
 stat_t cm_set_feed_rate_mode(const uint8_t mode);                           // G93, G94, (G95 unimplemented)
-stat_t cm_set_path_control(GCodeState_t *gcode_state, const uint8_t mode);  // G61, G61.1, G64
+stat_t cm_set_path_control(GCodeState_t *gcode_state, const uint8_t mode,
+                           const float P_word, const bool P_flag);  // G61, G61.1, G64
 
 // Machining Functions (4.3.6)
 stat_t cm_straight_feed(const float *target, const bool *flags, const uint8_t motion_profile); //G1
@@ -508,9 +515,6 @@ stat_t cm_homing_cycle_start_no_set(const float axes[], const bool flags[]); //
 stat_t cm_homing_cycle_callback(void);                          // G28.2/.4 main loop callback
 stat_t cm_reset_encoders();        // G28.5
 
-stat_t cm_special_function();        // by hamed
-stat_t cm_check_encoder();        // by hamed
-
 // Probe cycles
 stat_t cm_straight_probe(float target[], bool flags[],          // G38.x
                          bool trip_sense, bool alarm_flag);
@@ -627,11 +631,19 @@ stat_t cm_get_lb(nvObj_t *nv);          // get homing latch backoff
 stat_t cm_set_lb(nvObj_t *nv);          // set homing latch backoff
 stat_t cm_get_zb(nvObj_t *nv);          // get homing zero backoff
 stat_t cm_set_zb(nvObj_t *nv);          // set homing zero backoff
+stat_t cm_get_st(nvObj_t *nv);          // get input shaper type
+stat_t cm_set_st(nvObj_t *nv);          // set input shaper type
+stat_t cm_get_sf(nvObj_t *nv);          // get input shaper frequency
+stat_t cm_set_sf(nvObj_t *nv);          // set input shaper frequency
+stat_t cm_get_sd(nvObj_t *nv);          // get input shaper damping ratio
+stat_t cm_set_sd(nvObj_t *nv);          // set input shaper damping ratio
 
 stat_t cm_get_jt(nvObj_t *nv);          // get junction integration time constant
 stat_t cm_set_jt(nvObj_t *nv);          // set junction integration time constant
 stat_t cm_get_ct(nvObj_t *nv);          // get chordal tolerance
 stat_t cm_set_ct(nvObj_t *nv);          // set chordal tolerance
+stat_t cm_get_mlt(nvObj_t *nv);         // get line merge tolerance
+stat_t cm_set_mlt(nvObj_t *nv);         // set line merge tolerance
 stat_t cm_get_zl(nvObj_t *nv);          // get feedhold Z lift
 stat_t cm_set_zl(nvObj_t *nv);          // set feedhold Z lift
 stat_t cm_get_sl(nvObj_t *nv);          // get soft limit enable
@@ -709,6 +721,7 @@ stat_t cm_set_gdi(nvObj_t *nv);         // set gcode default distance mode
 
     void cm_print_jt(nvObj_t *nv);          // global CM settings
     void cm_print_ct(nvObj_t *nv);
+    void cm_print_mlt(nvObj_t *nv);
     void cm_print_zl(nvObj_t *nv);
     void cm_print_sl(nvObj_t *nv);
     void cm_print_lim(nvObj_t *nv);
@@ -738,6 +751,9 @@ stat_t cm_set_gdi(nvObj_t *nv);         // set gcode default distance mode
     void cm_print_lv(nvObj_t *nv);
     void cm_print_lb(nvObj_t *nv);
     void cm_print_zb(nvObj_t *nv);
+    void cm_print_st(nvObj_t *nv);
+    void cm_print_sf(nvObj_t *nv);
+    void cm_print_sd(nvObj_t *nv);
     void cm_print_cofs(nvObj_t *nv);
     void cm_print_cpos(nvObj_t *nv);
 
@@ -777,6 +793,7 @@ stat_t cm_set_gdi(nvObj_t *nv);         // set gcode default distance mode
 
     #define cm_print_jt tx_print_stub       // global CM settings
     #define cm_print_ct tx_print_stub
+    #define cm_print_mlt tx_print_stub
     #define cm_print_zl tx_print_stub
     #define cm_print_sl tx_print_stub
     #define cm_print_lim tx_print_stub
@@ -807,6 +824,9 @@ stat_t cm_set_gdi(nvObj_t *nv);         // set gcode default distance mode
     #define cm_print_lv tx_print_stub
     #define cm_print_lb tx_print_stub
     #define cm_print_zb tx_print_stub
+    #define cm_print_st tx_print_stub
+    #define cm_print_sf tx_print_stub
+    #define cm_print_sd tx_print_stub
     #define cm_print_cofs tx_print_stub
     #define cm_print_cpos tx_print_stub
 
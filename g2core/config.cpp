@@ -113,8 +113,11 @@ void config_init()
 {
     nvObj_t *nv = nv_reset_nv_list();
     config_init_assertions();
+    nv_index_init();                             // build token lookup index
     js.json_mode = JSON_MODE;                    // initial value until persistence is read
-    _set_defa(nv, false);
+    persistence_suspend();                       // don't write the defaults back to NVM...
+    _set_defa(nv, false);                        // ...while loading them
+    persistence_restore(nv);                     // then apply persisted values in a single pass
     rpt_print_loading_configs_message();
 }
 
@@ -153,7 +156,9 @@ stat_t set_defaults(nvObj_t *nv)
     if (!nv->value_int) {
         return(help_defa(nv));
     }
+    persistence_suspend();                      // the defaults aren't logged...
     _set_defa(nv, true);
+    persistence_clear();                        // ...the log is emptied instead
 
     // The nvlist was used for the initialize message so the values are all garbage
     // Mark the nv as $defa so it displays nicely in the response
@@ -386,33 +391,62 @@ stat_t set_grp(nvObj_t *nv)
  * nvObj helper functions and other low-level nv helpers
  */
 
-/* nv_get_index() - get index from mnenonic token + group
+/* nv_index_init() - build the sorted lookup index for nv_get_index()
+ * nv_get_index()  - get index from mnenonic token + group
  *
- * nv_get_index() is the most expensive routine in the whole config. It does a
- * linear table scan of the strings, which of course could be further
- * optimized with indexes or hashing.
+ * nv_get_index() is called for every JSON and text token and every status report
+ * element, so it uses a binary search of cfgIndex[] rather than a linear scan of
+ * cfgArray. cfgIndex holds cfgArray indexes sorted by token. It's built at runtime
+ * from whatever cfgArray was compiled for this board, so board-conditional entries
+ * need no special handling. The cost is 2 bytes of RAM per cfgArray entry.
+ *
+ * Matching only looks at the first INDEX_MATCH_LEN characters of the group + token,
+ * same as the original linear scan. If two entries match, the one earliest in
+ * cfgArray wins, which is why the index is sorted by table position within equal tokens.
  */
+
+#define INDEX_MATCH_LEN (TOKEN_LEN-1)   // number of token characters that are significant
+
+static bool _index_ready = false;
+
+static bool _index_less(const index_t a, const index_t b)
+{
+    int c = strncmp(cfgArray[a].token, cfgArray[b].token, INDEX_MATCH_LEN);
+    return ((c < 0) || ((c == 0) && (a < b)));
+}
+
+void nv_index_init()
+{
+    index_t index_max = nv_index_max();
+    for (index_t i=0; i < index_max; i++) {
+        cfgIndex[i] = i;
+    }
+    std::sort(cfgIndex, cfgIndex + index_max, _index_less);
+    _index_ready = true;
+}
+
 index_t nv_get_index(const char *group, const char *token)
 {
-    char c;
     char str[TOKEN_LEN + GROUP_LEN+1];    // should actually never be more than TOKEN_LEN+1
     strncpy(str, group, GROUP_LEN+1);
     strncat(str, token, TOKEN_LEN+1);
 
-    index_t i;
-    index_t index_max = nv_index_max();
+    if (!_index_ready) {                  // lookups can happen before config_init()
+        nv_index_init();
+    }
 
-    for (i=0; i < index_max; i++) {
-        if ((c = GET_TOKEN_BYTE(token[0])) != str[0]) {    continue; }              // 1st character mismatch
-        if ((c = GET_TOKEN_BYTE(token[1])) == NUL) { if (str[1] == NUL) return(i);} // one character match
-        if (c != str[1]) continue;                                                  // 2nd character mismatch
-        if ((c = GET_TOKEN_BYTE(token[2])) == NUL) { if (str[2] == NUL) return(i);} // two character match
-        if (c != str[2]) continue;                                                  // 3rd character mismatch
-        if ((c = GET_TOKEN_BYTE(token[3])) == NUL) { if (str[3] == NUL) return(i);} // three character match
-        if (c != str[3]) continue;                                                  // 4th character mismatch
-        if ((c = GET_TOKEN_BYTE(token[4])) == NUL) { if (str[4] == NUL) return(i);} // four character match
-        if (c != str[4]) continue;                                                  // 5th character mismatch
-        return (i);                                                                 // five character match
+    index_t lo = 0;                       // find the first entry not less than str
+    index_t hi = nv_index_max();
+    while (lo < hi) {
+        index_t mid = lo + (hi - lo) / 2;
+        if (strncmp(cfgArray[cfgIndex[mid]].token, str, INDEX_MATCH_LEN) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if ((lo < nv_index_max()) && (strncmp(cfgArray[cfgIndex[lo]].token, str, INDEX_MATCH_LEN) == 0)) {
+        return (cfgIndex[lo]);
     }
     return (NO_MATCH);
 }
@@ -334,6 +334,9 @@ typedef struct cfgItem {
 extern nvStr_t nvStr;
 extern nvList_t nvl;
 extern const cfgItem_t cfgArray[];
+extern index_t cfgIndex[];              // cfgArray indexes sorted by token (see config_app.c)
+extern uint8_t cfgMark[];               // one bit per cfgArray index, scratch for persistence moves
+extern uint16_t cfgSlot[];              // persistence log slot of the latest record for each index
 
 //#define nv_header nv.list
 #define nv_header (&nvl.list[0])
@@ -356,6 +359,7 @@ stat_t nv_persist(nvObj_t *nv);         // main entry point for persistence
 // helpers
 uint8_t nv_get_type(nvObj_t *nv);
 void nv_coerce_types(nvObj_t *nv);
+void nv_index_init(void);
 index_t nv_get_index(const char *group, const char *token);
 index_t nv_index_max(void);             // (see config_app.c)
 bool nv_index_is_single(index_t index); // (see config_app.c)
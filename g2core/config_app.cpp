@@ -37,6 +37,7 @@
 #include "planner.h"
 #include "plan_arc.h"
 #include "stepper.h"
+#include "encoder.h"
 #include "gpio.h"
 #include "spindle.h"
 #include "temperature.h"
@@ -48,6 +49,7 @@
 #include "help.h"
 #include "xio.h"
 #include "pwm_motor.h"
+#include "special_functions.h"
 
 /*** structures ***/
 
@@ -135,6 +137,7 @@ const cfgItem_t cfgArray[] = {
     { "", "frmo",_i0, 0, cm_print_frmo, cm_get_frmo, set_ro, nullptr, 0 },    // feed rate mode
     { "", "tool",_i0, 0, cm_print_tool, cm_get_toolv,set_ro, nullptr, 0 },    // active tool
     { "", "g92e",_i0, 0, cm_print_g92e, cm_get_g92e, set_ro, nullptr, 0 },    // G92 enable state
+    { "", "udr", _i0, 0, tx_print_int,  st_get_udr,  set_ro, nullptr, 0 },    // stepper prep queue underruns
 #ifdef TEMPORARY_HAS_LEDS
     { "", "_leds",_i0, 0, tx_print_nul, _get_leds,_set_leds, nullptr, 0 },    // TEMPORARY - change LEDs
 #endif
@@ -315,6 +318,9 @@ const cfgItem_t cfgArray[] = {
     { "x","xlv",_fipc, 2, cm_print_lv, cm_get_lv, cm_set_lv, nullptr, X_LATCH_VELOCITY },
     { "x","xlb",_fipc, 5, cm_print_lb, cm_get_lb, cm_set_lb, nullptr, X_LATCH_BACKOFF },
     { "x","xzb",_fipc, 5, cm_print_zb, cm_get_zb, cm_set_zb, nullptr, X_ZERO_BACKOFF },
+    { "x","xst",_iip,  0, cm_print_st, cm_get_st, cm_set_st, nullptr, X_SHAPER_TYPE },
+    { "x","xsf",_fip,  2, cm_print_sf, cm_get_sf, cm_set_sf, nullptr, X_SHAPER_FREQUENCY },
+    { "x","xsd",_fip,  3, cm_print_sd, cm_get_sd, cm_set_sd, nullptr, X_SHAPER_DAMPING },
 
     { "y","yam",_iip,  0, cm_print_am, cm_get_am, cm_set_am, nullptr, Y_AXIS_MODE },
     { "y","yvm",_fipc, 0, cm_print_vm, cm_get_vm, cm_set_vm, nullptr, Y_VELOCITY_MAX },
@@ -329,6 +335,9 @@ const cfgItem_t cfgArray[] = {
     { "y","ylv",_fipc, 2, cm_print_lv, cm_get_lv, cm_set_lv, nullptr, Y_LATCH_VELOCITY },
     { "y","ylb",_fipc, 5, cm_print_lb, cm_get_lb, cm_set_lb, nullptr, Y_LATCH_BACKOFF },
     { "y","yzb",_fipc, 5, cm_print_zb, cm_get_zb, cm_set_zb, nullptr, Y_ZERO_BACKOFF },
+    { "y","yst",_iip,  0, cm_print_st, cm_get_st, cm_set_st, nullptr, Y_SHAPER_TYPE },
+    { "y","ysf",_fip,  2, cm_print_sf, cm_get_sf, cm_set_sf, nullptr, Y_SHAPER_FREQUENCY },
+    { "y","ysd",_fip,  3, cm_print_sd, cm_get_sd, cm_set_sd, nullptr, Y_SHAPER_DAMPING },
 
     { "z","zam",_iip,  0, cm_print_am, cm_get_am, cm_set_am, nullptr, Z_AXIS_MODE },
     { "z","zvm",_fipc, 0, cm_print_vm, cm_get_vm, cm_set_vm, nullptr, Z_VELOCITY_MAX },
@@ -343,6 +352,9 @@ const cfgItem_t cfgArray[] = {
     { "z","zlv",_fipc, 2, cm_print_lv, cm_get_lv, cm_set_lv, nullptr, Z_LATCH_VELOCITY },
     { "z","zlb",_fipc, 5, cm_print_lb, cm_get_lb, cm_set_lb, nullptr, Z_LATCH_BACKOFF },
     { "z","zzb",_fipc, 5, cm_print_zb, cm_get_zb, cm_set_zb, nullptr, Z_ZERO_BACKOFF },
+    { "z","zst",_iip,  0, cm_print_st, cm_get_st, cm_set_st, nullptr, Z_SHAPER_TYPE },
+    { "z","zsf",_fip,  2, cm_print_sf, cm_get_sf, cm_set_sf, nullptr, Z_SHAPER_FREQUENCY },
+    { "z","zsd",_fip,  3, cm_print_sd, cm_get_sd, cm_set_sd, nullptr, Z_SHAPER_DAMPING },
 
     { "u","uam",_iip,  0, cm_print_am, cm_get_am, cm_set_am, nullptr, U_AXIS_MODE },
     { "u","uvm",_fipc, 0, cm_print_vm, cm_get_vm, cm_set_vm, nullptr, U_VELOCITY_MAX },
@@ -547,7 +559,7 @@ const cfgItem_t cfgArray[] = {
 #endif
 
 #if PWM_MOTORS_AVAILABLE
-  // Digital output state readers (default to non-active)
+  // PWM motors - set frequency in Hz (m11, m12 set M1, M2 duty in %), get returns blocked state
   { "m","m1",  _i0, 2, pwm_motor_print_out, pwm_motor_get_value, pwm_motor_set_value, nullptr, 0 },
   { "m","m2",  _i0, 2, pwm_motor_print_out, pwm_motor_get_value, pwm_motor_set_value, nullptr, 0 },
   { "m","m3",  _i0, 2, pwm_motor_print_out, pwm_motor_get_value, pwm_motor_set_value, nullptr, 0 },
@@ -562,8 +574,18 @@ const cfgItem_t cfgArray[] = {
 #endif
 
 #ifdef CHECK_ENCODERS
-  { "eac","eac1",  _i0, 2, encoder_check_print_out, encoder_check_get_value, encoder_check_set_value, nullptr, 0 },
-  { "eac","eac2",  _i0, 2, encoder_check_print_out, encoder_check_get_value, encoder_check_set_value, nullptr, 0 },
+  // Encoder checks - see encoder.h. Set at runtime, board defaults in encoder.cpp
+  { "eac","eac1",  _i0, 0, tx_print_int, get_int32, encoder_check_set_value, &encoder_check_configs[0].threshold, 0 },
+  { "eac","eac2",  _i0, 0, tx_print_int, get_int32, encoder_check_set_value, &encoder_check_configs[1].threshold, 0 },
+  { "eac","eacm1", _i0, 0, tx_print_int, get_int32, set_int32, &encoder_check_configs[0].motor_factor, 0 },
+  { "eac","eacm2", _i0, 0, tx_print_int, get_int32, set_int32, &encoder_check_configs[1].motor_factor, 0 },
+  { "eac","eace1", _i0, 0, tx_print_int, get_int32, set_int32, &encoder_check_configs[0].encoder_factor, 0 },
+  { "eac","eace2", _i0, 0, tx_print_int, get_int32, set_int32, &encoder_check_configs[1].encoder_factor, 0 },
+  { "eac","eacx1", _i0, 0, tx_print_int, get_int32, encoder_check_set_max, &encoder_check_configs[0].max_error, 0 },
+  { "eac","eacx2", _i0, 0, tx_print_int, get_int32, encoder_check_set_max, &encoder_check_configs[1].max_error, 0 },
+  { "eac","each1", _s0, 0, tx_print_str, encoder_check_get_histogram, set_ro, nullptr, 0 },
+  { "eac","each2", _s0, 0, tx_print_str, encoder_check_get_histogram, set_ro, nullptr, 0 },
+  { "eac","eacr",  _i0, 0, tx_print_int, get_int32, encoder_check_set_rate, &encoder_check_rate, 0 },
 #endif // check encoders
 
     // PWM settings
@@ -760,6 +782,7 @@ const cfgItem_t cfgArray[] = {
     // General system parameters
     { "sys","jt",  _fipn, 2, cm_print_jt,  cm_get_jt,  cm_set_jt,  nullptr, JUNCTION_INTEGRATION_TIME },
     { "sys","ct",  _fipnc,4, cm_print_ct,  cm_get_ct,  cm_set_ct,  nullptr, CHORDAL_TOLERANCE },
+    { "sys","mlt", _fipnc,4, cm_print_mlt, cm_get_mlt, cm_set_mlt, nullptr, MERGE_TOLERANCE },
     { "sys","zl",  _fipnc,3, cm_print_zl,  cm_get_zl,  cm_set_zl,  nullptr, FEEDHOLD_Z_LIFT },
     { "sys","sl",  _bipn, 0, cm_print_sl,  cm_get_sl,  cm_set_sl,  nullptr, SOFT_LIMIT_ENABLE },
     { "sys","lim", _bipn, 0, cm_print_lim, cm_get_lim, cm_set_lim, nullptr, HARD_LIMIT_ENABLE },
@@ -779,9 +802,13 @@ const cfgItem_t cfgArray[] = {
 #endif
     { "sys","ej", _iipn, 0, js_print_ej,  js_get_ej, js_set_ej, nullptr, COMM_MODE },
     { "sys","jv", _iipn, 0, js_print_jv,  js_get_jv, js_set_jv, nullptr, JSON_VERBOSITY },
+    { "sys","jcl",_iipn, 0, js_print_jcl, js_get_jcl, js_set_jcl, nullptr, JSON_COALESCE_LINES },
+    { "sys","jct",_iipn, 0, js_print_jct, js_get_jct, js_set_jct, nullptr, JSON_COALESCE_MS },
     { "sys","qv", _iipn, 0, qr_print_qv,  qr_get_qv, qr_set_qv, nullptr, QUEUE_REPORT_VERBOSITY },
     { "sys","sv", _iipn, 0, sr_print_sv,  sr_get_sv, sr_set_sv, nullptr, STATUS_REPORT_VERBOSITY },
     { "sys","si", _iipn, 0, sr_print_si,  sr_get_si, sr_set_si, nullptr, STATUS_REPORT_INTERVAL_MS },
+    { "sys","btv",_iipn, 0, bt_print_btv, bt_get_btv, bt_set_btv, nullptr, BINARY_TELEMETRY_VERBOSITY },
+    { "sys","bti",_iipn, 0, bt_print_bti, bt_get_bti, bt_set_bti, nullptr, BINARY_TELEMETRY_INTERVAL_MS },
 
     // Gcode defaults
     // NOTE: The ordering within the gcode defaults is important for token resolution. gc must follow gco
@@ -817,6 +844,129 @@ const cfgItem_t cfgArray[] = {
     { "", "h",   _b0, 0, tx_print_nul, help_config, set_nul, nullptr, 0 },  // alias for "help"
 #endif
 
+#ifdef SPECIAL_FUNCTIONS
+    // Special function rules - see special_functions.h
+    // r1: gate 1: microswitch hit while the gate is open -> open the microswitch lock
+    { "r1","r1in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].input, SF_PIN_GATE1_SWITCH },
+    { "r1","r1tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].trigger, SF_TRIGGER_LOW },
+    { "r1","r1gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].guard, SF_PIN_GATE1 },
+    { "r1","r1db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].debounce_ms, 0 },
+    { "r1","r1ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].action, SF_ACTION_SET },
+    { "r1","r1ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].output, SF_PIN_GATE1_LOCK },
+    { "r1","r1dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].delay_ms, 0 },
+    { "r1","r1du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[0].duration_ms, 0 },
+
+    // r2: ...and close the gate after dl ms
+    { "r2","r2in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].input, SF_PIN_GATE1_SWITCH },
+    { "r2","r2tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].trigger, SF_TRIGGER_LOW },
+    { "r2","r2gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].guard, SF_PIN_GATE1 },
+    { "r2","r2db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].debounce_ms, 0 },
+    { "r2","r2ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].action, SF_ACTION_CLEAR },
+    { "r2","r2ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].output, SF_PIN_GATE1 },
+    { "r2","r2dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].delay_ms, 0 },
+    { "r2","r2du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[1].duration_ms, 0 },
+
+    // r3: gate 2: microswitch hit while the gate is open -> close the gate
+    { "r3","r3in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].input, SF_PIN_GATE2_SWITCH },
+    { "r3","r3tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].trigger, SF_TRIGGER_LOW },
+    { "r3","r3gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].guard, SF_PIN_GATE2 },
+    { "r3","r3db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].debounce_ms, 0 },
+    { "r3","r3ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].action, SF_ACTION_CLEAR },
+    { "r3","r3ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].output, SF_PIN_GATE2 },
+    { "r3","r3dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].delay_ms, 0 },
+    { "r3","r3du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[2].duration_ms, 0 },
+
+    // r4: ...and open the microswitch lock
+    { "r4","r4in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].input, SF_PIN_GATE2_SWITCH },
+    { "r4","r4tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].trigger, SF_TRIGGER_LOW },
+    { "r4","r4gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].guard, SF_PIN_GATE2 },
+    { "r4","r4db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].debounce_ms, 0 },
+    { "r4","r4ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].action, SF_ACTION_SET },
+    { "r4","r4ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].output, SF_PIN_GATE2_LOCK },
+    { "r4","r4dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].delay_ms, 0 },
+    { "r4","r4du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[3].duration_ms, 0 },
+
+    // r5: conveyor 1: no holder at the high level sensor -> run in reverse briefly, repeatedly
+    { "r5","r5in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].input, SF_PIN_HOLDER_HIGH1 },
+    { "r5","r5tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].trigger, SF_TRIGGER_HIGH_REPEAT },
+    { "r5","r5gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].guard, 0 },
+    { "r5","r5db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].debounce_ms, 2500 },
+    { "r5","r5ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].action, SF_ACTION_SET },
+    { "r5","r5ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].output, SF_PIN_CONVEYOR1_DIR },
+    { "r5","r5dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].delay_ms, 0 },
+    { "r5","r5du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[4].duration_ms, 250 },
+
+    // r6: conveyor 2: same for sensor 2
+    { "r6","r6in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].input, SF_PIN_HOLDER_HIGH2 },
+    { "r6","r6tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].trigger, SF_TRIGGER_HIGH_REPEAT },
+    { "r6","r6gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].guard, 0 },
+    { "r6","r6db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].debounce_ms, 2500 },
+    { "r6","r6ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].action, SF_ACTION_SET },
+    { "r6","r6ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].output, SF_PIN_CONVEYOR2_DIR },
+    { "r6","r6dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].delay_ms, 0 },
+    { "r6","r6du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[5].duration_ms, 250 },
+
+    // r7: holder line 1 full -> block M1
+    { "r7","r7in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].input, SF_PIN_HOLDER_HIGH1 },
+    { "r7","r7tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].trigger, SF_TRIGGER_LOW },
+    { "r7","r7gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].guard, 0 },
+    { "r7","r7db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].debounce_ms, 500 },
+    { "r7","r7ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].action, SF_ACTION_BLOCK },
+    { "r7","r7ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].output, 1 },
+    { "r7","r7dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].delay_ms, 0 },
+    { "r7","r7du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[6].duration_ms, 0 },
+
+    // r8: ...and run conveyor 1 in reverse briefly
+    { "r8","r8in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].input, SF_PIN_HOLDER_HIGH1 },
+    { "r8","r8tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].trigger, SF_TRIGGER_LOW },
+    { "r8","r8gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].guard, 0 },
+    { "r8","r8db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].debounce_ms, 500 },
+    { "r8","r8ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].action, SF_ACTION_SET },
+    { "r8","r8ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].output, SF_PIN_CONVEYOR1_DIR },
+    { "r8","r8dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].delay_ms, 0 },
+    { "r8","r8du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[7].duration_ms, 250 },
+
+    // r9: holder line 1 clear -> unblock M1
+    { "r9","r9in",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].input, SF_PIN_HOLDER_HIGH1 },
+    { "r9","r9tr",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].trigger, SF_TRIGGER_HIGH },
+    { "r9","r9gd",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].guard, 0 },
+    { "r9","r9db",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].debounce_ms, 500 },
+    { "r9","r9ac",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].action, SF_ACTION_UNBLOCK },
+    { "r9","r9ot",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].output, 1 },
+    { "r9","r9dl",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].delay_ms, 0 },
+    { "r9","r9du",   _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[8].duration_ms, 0 },
+
+    // r10: holder line 2 full -> block M2
+    { "r10","r10in",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].input, SF_PIN_HOLDER_HIGH2 },
+    { "r10","r10tr",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].trigger, SF_TRIGGER_LOW },
+    { "r10","r10gd",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].guard, 0 },
+    { "r10","r10db",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].debounce_ms, 500 },
+    { "r10","r10ac",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].action, SF_ACTION_BLOCK },
+    { "r10","r10ot",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].output, 2 },
+    { "r10","r10dl",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].delay_ms, 0 },
+    { "r10","r10du",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[9].duration_ms, 0 },
+
+    // r11: ...and run conveyor 2 in reverse briefly
+    { "r11","r11in",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].input, SF_PIN_HOLDER_HIGH2 },
+    { "r11","r11tr",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].trigger, SF_TRIGGER_LOW },
+    { "r11","r11gd",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].guard, 0 },
+    { "r11","r11db",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].debounce_ms, 500 },
+    { "r11","r11ac",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].action, SF_ACTION_SET },
+    { "r11","r11ot",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].output, SF_PIN_CONVEYOR2_DIR },
+    { "r11","r11dl",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].delay_ms, 0 },
+    { "r11","r11du",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[10].duration_ms, 250 },
+
+    // r12: holder line 2 clear -> unblock M2
+    { "r12","r12in",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].input, SF_PIN_HOLDER_HIGH2 },
+    { "r12","r12tr",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].trigger, SF_TRIGGER_HIGH },
+    { "r12","r12gd",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].guard, 0 },
+    { "r12","r12db",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].debounce_ms, 500 },
+    { "r12","r12ac",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].action, SF_ACTION_UNBLOCK },
+    { "r12","r12ot",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].output, 2 },
+    { "r12","r12dl",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].delay_ms, 0 },
+    { "r12","r12du",  _iip, 0, tx_print_int, get_int32, sf_set_rule, &sf.rule[11].duration_ms, 0 },
+#endif
+
 #ifdef __USER_DATA
     // User defined data groups
     { "uda","uda0", _fip, 0, tx_print_int, get_data, set_data, &cfg.user_data_a[0], USER_DATA_A0 },
@@ -1245,6 +1395,38 @@ const cfgItem_t cfgArray[] = {
     { "_fe","_fe6",_f0, 2, tx_print_flt, get_flt, set_nul, &mr->following_error[MOTOR_6], 0 },
 #endif
 
+    // planner profiling - see planner.h
+#ifdef __PLANNER_PROFILING
+    { "_pf","_pfbr",_f0, 1, tx_print_flt, mp_get_pf, set_nul, nullptr, 0 },    // blocks per second
+    { "_pf","_pfsr",_f0, 1, tx_print_flt, mp_get_pf, set_nul, nullptr, 0 },    // segments per second
+    { "_pf","_pfal",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_aline() average cycles
+    { "_pf","_pfml",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_aline() max cycles
+    { "_pf","_pfap",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_plan_block_list() average cycles
+    { "_pf","_pfmp",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_plan_block_list() max cycles
+    { "_pf","_pfaf",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_forward_plan() average cycles
+    { "_pf","_pfmf",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_forward_plan() max cycles
+    { "_pf","_pfae",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_exec_move() average cycles
+    { "_pf","_pfme",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // mp_exec_move() max cycles
+    { "_pf","_pfas",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // st_prep_line() average cycles
+    { "_pf","_pfms",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // st_prep_line() max cycles
+    { "_pf","_pfad",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // DDA interrupt average cycles
+    { "_pf","_pfmd",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // DDA interrupt max cycles
+    { "_pf","_pfag",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // segment exec average cycles
+    { "_pf","_pfmg",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // segment exec max cycles
+    { "_pf","_pfak",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // inverse kinematics average cycles
+    { "_pf","_pfmk",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // inverse kinematics max cycles
+    { "_pf","_pfsl",_f0, 1, tx_print_flt, mp_get_pf, set_nul, nullptr, 0 },    // worst segment load, percent of segment time
+    { "_pf","_pfso",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // segments over the time budget
+    { "_pf","_pfn0",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // meet velocity solved without iterating
+    { "_pf","_pfn1",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // meet velocity in 1 iteration
+    { "_pf","_pfn2",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // meet velocity in 2 iterations
+    { "_pf","_pfn3",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // meet velocity in 3 iterations
+    { "_pf","_pfn4",_i0, 0, tx_print_int, mp_get_pf, set_nul, nullptr, 0 },    // meet velocity out of iterations
+#endif
+
+    // segment trace - see planner.h
+    { "","_sgt",_i0, 0, tx_print_int, mp_get_sgt, mp_set_sgt, nullptr, 0 },    // arm/disarm capture, get record count
+
 #endif  //  __DIAGNOSTIC_PARAMETERS
 
     // Persistence for status report - must be in sequence
@@ -1424,6 +1606,24 @@ const cfgItem_t cfgArray[] = {
     { "","pid2",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // PID 2 group
     { "","pid3",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // PID 3 group
 
+#ifdef SPECIAL_FUNCTIONS
+#define SPECIAL_FUNCTION_GROUPS 12
+    { "","r1", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r2", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r3", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r4", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r5", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r6", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r7", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r8", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r9", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r10",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r11",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+    { "","r12",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // special function rule group
+#else
+#define SPECIAL_FUNCTION_GROUPS 0
+#endif
+
 #ifdef __USER_DATA
 #define USER_DATA_GROUPS 4
     { "","uda", _f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },   // user data group
@@ -1433,7 +1633,11 @@ const cfgItem_t cfgArray[] = {
 #endif
 
 #ifdef __DIAGNOSTIC_PARAMETERS
+#ifdef __PLANNER_PROFILING
+#define DIAGNOSTIC_GROUPS 9
+#else
 #define DIAGNOSTIC_GROUPS 8
+#endif
     { "","_te",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // target axis endpoint group
     { "","_tr",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // target axis runtime group
     { "","_ts",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // target motor steps group
@@ -1442,6 +1646,9 @@ const cfgItem_t cfgArray[] = {
     { "","_es",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // encoder steps group
     { "","_xs",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // correction steps group
     { "","_fe",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // following error group
+#ifdef __PLANNER_PROFILING
+    { "","_pf",_f0, 0, tx_print_nul, get_grp, set_grp, nullptr, 0 },    // planner profiling group
+#endif
 #endif
 
 #define NV_COUNT_UBER_GROUPS 6
@@ -1466,6 +1673,7 @@ const cfgItem_t cfgArray[] = {
                         + TOOL_OFFSET_GROUPS \
                         + MACHINE_STATE_GROUPS \
                         + TEMPERATURE_GROUPS \
+                        + SPECIAL_FUNCTION_GROUPS \
                         + USER_DATA_GROUPS \
                         + DIAGNOSTIC_GROUPS)
 
@@ -1476,6 +1684,10 @@ const cfgItem_t cfgArray[] = {
 #define NV_INDEX_START_UBER_GROUPS (NV_INDEX_MAX - NV_COUNT_UBER_GROUPS)
 /* </DO NOT MESS WITH THESE DEFINES> */
 
+index_t cfgIndex[NV_INDEX_MAX];     // sorted lookup index into cfgArray - see nv_get_index()
+uint8_t cfgMark[(NV_INDEX_MAX + 7) / 8];    // one bit per cfgArray index - see persistence.cpp
+uint16_t cfgSlot[NV_INDEX_MAX];             // persistence log slot of each index, 0 if none - see persistence.cpp
+
 index_t nv_index_max() { return ( NV_INDEX_MAX );}
 bool nv_index_is_single(index_t index) { return ((index <= NV_INDEX_END_SINGLES) ? true : false);}
 bool nv_index_is_group(index_t index) { return (((index >= NV_INDEX_START_GROUPS) && (index < NV_INDEX_START_UBER_GROUPS)) ? true : false);}
@@ -1557,16 +1769,19 @@ stat_t set_float(nvObj_t *nv, float &value) {
 stat_t set_float_range(nvObj_t *nv, float &value, float low, float high) {
 
     char msg[64];
+    char *str = msg;
 
     convert_incoming_float(nv);      // conditional unit conversion
     if (nv->value_flt < low) {
-        sprintf(msg, "Input is less than minimum value %0.4f", low);
+        str_concat(str, "Input is less than minimum value ");
+        floattoa(str, low, 4);
         nv_add_conditional_message(msg);
         nv->valuetype = TYPE_NULL;
         return (STAT_INPUT_LESS_THAN_MIN_VALUE);
     }
     if (nv->value_flt > high) {
-        sprintf(msg, "Input is more than maximum value %0.4f", high);
+        str_concat(str, "Input is more than maximum value ");
+        floattoa(str, high, 4);
         nv_add_conditional_message(msg);
         nv->valuetype = TYPE_NULL;
         return (STAT_INPUT_EXCEEDS_MAX_VALUE);
@@ -76,7 +76,9 @@ static stat_t _sync_to_planner(void);
 static stat_t _sync_to_tx_buffer(void);
 static stat_t _dispatch_command(void);
 static stat_t _dispatch_control(void);
-static void _dispatch_kernel(const devflags_t flags);
+static bool _dispatch_kernel(const devflags_t flags);
+static bool _dispatch_batch_ready(void);
+static char *_save_line(const char *line);
 static stat_t _controller_state(void);          // manage controller state transitions
 
 static Motate::OutputPin<Motate::kOutputSAFE_PinNumber> safe_pin;
@@ -94,6 +96,7 @@ void controller_init()
     commMode comm_mode = cs.comm_mode;
 
     memset(&cs, 0, sizeof(controller_t));           // clear all values, job_id's, pointers and status
+    cs.saved_buf = cs.saved_line;
     _init_assertions();
 
     cs.comm_mode = comm_mode;                       // restore parameters
@@ -151,6 +154,7 @@ static void _controller_HSM()
 
     DISPATCH(hardware_periodic());              // give the hardware a chance to do stuff
     DISPATCH(_led_indicator());                 // blink LEDs at the current rate
+    DISPATCH(xio_coalesce_callback());          // send held responses that have waited long enough
     DISPATCH(_shutdown_handler());              // invoke shutdown
     DISPATCH(_interlock_handler());             // invoke / remove safety interlock
     DISPATCH(temperature_callback());           // makes sure temperatures are under control
@@ -164,20 +168,12 @@ static void _controller_HSM()
     DISPATCH(st_motor_power_callback());        // stepper motor power sequencing
     DISPATCH(sr_status_report_callback());      // conditionally send status report
     DISPATCH(qr_queue_report_callback());       // conditionally send queue report
+    DISPATCH(bt_telemetry_callback());          // conditionally send binary telemetry
 
     // these 3 must be in this exact order:
     DISPATCH(mp_planner_callback());            // motion planner
     DISPATCH(cm_operation_runner_callback());   // operation action runner
     DISPATCH(cm_arc_callback(cm));              // arc generation runs as a cycle above lines
-#ifdef SPECIAL_FUNCTIONS
-    // SPECIAL FUNCTIONS by Hamed
-    DISPATCH(cm_special_function());            // SPECIAL FUNCTIONS by Hamed
-#endif
-
-#ifdef CHECK_ENCODERS
-    DISPATCH(cm_check_encoder());               // Check encoders by Hamed
-#endif // check encoders
-
 
     DISPATCH(cm_homing_cycle_callback());       // homing cycle operation (G28.2)
     DISPATCH(cm_probing_cycle_callback());      // probing cycle operation (G38.2)
@@ -204,8 +200,15 @@ static void _controller_HSM()
  *
  *  Reads next command line and dispatches to relevant parser or action
  *
- *  Note: The dispatchers must only read and process a single line from the
+ *  Note: _dispatch_control must only read and process a single line from the
  *        RX queue before returning control to the main loop.
+ *
+ *  _dispatch_command reads a batch of up to DISPATCH_BATCH_LINES Gcode lines, or as many
+ *  as fit in DISPATCH_BATCH_TIME_MS, so short segments don't each pay for a full pass of
+ *  the controller loop. The batch ends as soon as any line is not a successfully parsed
+ *  Gcode block, or the machine needs the rest of the loop to run (see _dispatch_batch_ready).
+ *  readline() always returns pending control lines first, so '!', '~', '%' and ^D still
+ *  end the batch on the very next line.
  */
 
 static stat_t _dispatch_control()
@@ -223,14 +226,44 @@ static stat_t _dispatch_command()
 {
     if (cs.controller_state != CONTROLLER_PAUSED) {
         devflags_t flags = DEV_IS_BOTH | DEV_IS_MUTED; // expressly state we'll handle muted devices
-        if ((!mp_planner_is_full(mp)) && (cs.bufp = xio_readline(flags, cs.linelen)) != NULL) {
-            _dispatch_kernel(flags);
+        uint32_t batch_start = SysTickTimer_getValue();
+        for (uint8_t lines = 0; lines < DISPATCH_BATCH_LINES; lines++) {
+            if ((mp_planner_is_full(mp)) || (cs.bufp = xio_readline(flags, cs.linelen)) == NULL) {
+                break;
+            }
+            if (!_dispatch_kernel(flags) || !_dispatch_batch_ready()) {
+                break;
+            }
+            if ((SysTickTimer_getValue() - batch_start) >= DISPATCH_BATCH_TIME_MS) {
+                break;
+            }
+            flags = DEV_IS_BOTH | DEV_IS_MUTED;
         }
     }
     return (STAT_OK);
 }
 
-static void _dispatch_kernel(const devflags_t flags)
+/*
+ * _dispatch_batch_ready() - return true if another Gcode line can be parsed in this pass
+ *
+ *  Anything the controller loop would block new Gcode on (see _controller_HSM) ends the batch.
+ */
+static bool _dispatch_batch_ready()
+{
+    return ((cs.controller_state != CONTROLLER_PAUSED) &&
+            (cm->cycle_type <= CYCLE_MACHINING) &&          // not homing, probing or jogging
+            (cm->arc.run_state == BLOCK_INACTIVE) &&        // arc generation must run first
+            (cm1.hold_state == FEEDHOLD_OFF) &&
+            (cm1.cycle_start_state != CYCLE_START_REQUESTED) &&
+            (cm1.queue_flush_state != QUEUE_FLUSH_REQUESTED) &&
+            (cm1.job_kill_state != JOB_KILL_REQUESTED) &&
+            (js.json_mode != MARLIN_COMM_MODE));
+}
+
+/*
+ * _dispatch_kernel() - dispatch one line. Returns true if it was a Gcode block that parsed OK
+ */
+static bool _dispatch_kernel(const devflags_t flags)
 {
     stat_t status;
 
@@ -241,7 +274,7 @@ static void _dispatch_kernel(const devflags_t flags)
         nv_print_list(status, TEXT_NO_PRINT, JSON_RESPONSE_TO_MUTED_FORMAT);
 
         // It's possible to let some stuff through, but that's not happening yet.
-        return;
+        return (false);
     }
 
 #if MARLIN_COMPAT_ENABLED == true
@@ -250,27 +283,31 @@ static void _dispatch_kernel(const devflags_t flags)
         js.json_mode = MARLIN_COMM_MODE;
         sr.status_report_verbosity = SR_OFF;
         qr.queue_report_verbosity = QR_OFF;
-        return;
+        return (false);
     }
 #endif
 
+    sr_flag_change(SR_SOURCE_MODEL);                        // any command can change the model...
+    sr_flag_change(SR_SOURCE_IO);                           // ...or set outputs, spindle or coolant
+
     while ((*cs.bufp == SPC) || (*cs.bufp == TAB)) {        // position past any leading whitespace
         cs.bufp++;
     }
-    strncpy(cs.saved_buf, cs.bufp, SAVED_BUFFER_LEN-1);     // save input buffer for reporting
+    cs.saved_buf = cs.bufp;                                 // Gcode is not modified by the parser, so report it in place
 
     if (*cs.bufp == NUL) {                                  // blank line - just a CR or the 2nd termination in a CRLF
         if (js.json_mode == TEXT_MODE) {
             text_response(STAT_OK, cs.saved_buf);
-            return;
+            return (true);                                  // keep the batch going across CRLFs
         }
     }
 
-    // trap single character commands
-    if      (*cs.bufp == '!') { cm_request_feedhold(FEEDHOLD_TYPE_ACTIONS, FEEDHOLD_EXIT_CYCLE); }
-    else if (*cs.bufp == '~') { cm_request_cycle_start(); }
-    else if (*cs.bufp == '%') { cm_request_queue_flush(); xio_flush_to_command(); }
-    else if (*cs.bufp == EOT) { cm_request_job_kill(); xio_flush_to_command(); }
+    // trap single character commands. Held responses go out first so the host has every ack
+    // sent before the hold, cycle start, flush or kill
+    if      (*cs.bufp == '!') { xio_flush_coalesced(); cm_request_feedhold(FEEDHOLD_TYPE_ACTIONS, FEEDHOLD_EXIT_CYCLE); }
+    else if (*cs.bufp == '~') { xio_flush_coalesced(); cm_request_cycle_start(); }
+    else if (*cs.bufp == '%') { xio_flush_coalesced(); cm_request_queue_flush(); xio_flush_to_command(); }
+    else if (*cs.bufp == EOT) { xio_flush_coalesced(); cm_request_job_kill(); xio_flush_to_command(); }
     else if (*cs.bufp == ENQ) { controller_request_enquiry(); }
     else if (*cs.bufp == CAN) { hw_hard_reset(); }          // reset immediately
 
@@ -279,12 +316,14 @@ static void _dispatch_kernel(const devflags_t flags)
             js.json_mode = JSON_MODE;                       // switch to JSON mode
         }
         cs.comm_request_mode = JSON_MODE;                   // mode of this command
+        cs.saved_buf = _save_line(cs.bufp);                 // the JSON parser modifies the line
         json_parser(cs.bufp);
     }
 #ifdef __TEXT_MODE
     else if (strchr("$?Hh", *cs.bufp) != NULL) {            // process as text mode
         if (cs.comm_mode == AUTO_MODE) { js.json_mode = TEXT_MODE; } // switch to text mode
         cs.comm_request_mode = TEXT_MODE;                   // mode of this command
+        cs.saved_buf = _save_line(cs.bufp);                 // the text parser modifies the line
         status = text_parser(cs.bufp);
         if (js.json_mode == TEXT_MODE) {                    // needed in case mode was changed by $EJ=1
             text_response(status, cs.saved_buf);
@@ -292,7 +331,9 @@ static void _dispatch_kernel(const devflags_t flags)
     }
     else if (js.json_mode == TEXT_MODE) {                   // anything else is interpreted as Gcode
         cs.comm_request_mode = TEXT_MODE;                   // mode of this command
-        text_response(gcode_parser(cs.bufp), cs.saved_buf);
+        status = gcode_parser(cs.bufp);
+        text_response(status, cs.saved_buf);
+        return (status == STAT_OK);
     }
 #endif
 
@@ -308,7 +349,7 @@ static void _dispatch_kernel(const devflags_t flags)
         // this optimization bypasses the standard JSON parser and does what it needs directly
         nvObj_t *nv = nv_reset_nv_list();                   // get a fresh nvObj list
         strcpy(nv->token, "gc");                            // label is as a Gcode block (do not get an index - not necessary)
-        nv_copy_string(nv, cs.bufp);                        // copy the Gcode line
+        nv->stringp = (char (*)[])cs.bufp;                  // reference the Gcode line - the Gcode parser does not modify it
         nv->valuetype = TYPE_STRING;
         status = gcode_parser(cs.bufp);
 
@@ -319,17 +360,28 @@ static void _dispatch_kernel(const devflags_t flags)
             sr.status_report_verbosity = SR_OFF;
             qr.queue_report_verbosity = QR_OFF;
             marlin_response(status, cs.saved_buf);
-            return;
+            return (false);
         }
 #endif
 
         nv_print_list(status, TEXT_NO_PRINT, JSON_RESPONSE_FORMAT);
         sr_request_status_report(SR_REQUEST_TIMED);         // generate incremental status report to show any changes
+        return (status == STAT_OK);
     }
+    return (false);
 }
 
 /**** Local Functions ******************************************************************/
 
+/*
+ * _save_line() - copy a line the parsers will modify so it can still be reported as received
+ */
+static char *_save_line(const char *line)
+{
+    strncpy(cs.saved_line, line, SAVED_BUFFER_LEN-1);
+    return (cs.saved_line);
+}
+
 /*
  * _reset_comms_mode() - reset the communications mode (and other effected settings) after connection or disconnection
  */
@@ -34,6 +34,13 @@
 #define SAVED_BUFFER_LEN RX_BUFFER_SIZE // saved buffer size (for reporting only)
 #define OUTPUT_BUFFER_LEN 512           // text buffer size
 
+#ifndef DISPATCH_BATCH_LINES
+#define DISPATCH_BATCH_LINES 8          // max Gcode lines parsed per controller pass
+#endif
+#ifndef DISPATCH_BATCH_TIME_MS
+#define DISPATCH_BATCH_TIME_MS 2        // max time spent parsing Gcode lines per controller pass (in ms)
+#endif
+
 #define LED_NORMAL_BLINK_RATE 3000      // blink rate for normal operation (in ms)
 #define LED_ALARM_BLINK_RATE 750        // blink rate for alarm state (in ms)
 #define LED_SHUTDOWN_BLINK_RATE 300     // blink rate for shutdown state (in ms)
@@ -73,7 +80,8 @@ typedef struct controllerSingleton {    // main TG controller struct
     char *bufp;                         // pointer to primary or secondary in buffer
     uint16_t linelen;                   // length of currently processing line
     char out_buf[OUTPUT_BUFFER_LEN];    // output buffer
-    char saved_buf[SAVED_BUFFER_LEN];   // save the input buffer
+    char *saved_buf;                    // the input line as received (for reporting)
+    char saved_line[SAVED_BUFFER_LEN];  // copy of lines the parsers modify in place
 
     // Exceptions - some exceptions cannot be notified by an ER because they are in interrupts 
     bool exec_aline_assertion_failure;  // record an exception deep inside mp_exec_aline()
@@ -346,26 +346,22 @@ static void _send_probe_report() {
 
     if (cm->probe_report_enable) {
         // If probe was successful the 'e' word == 1, otherwise e == 0 to signal an error
-        char  buf[32];
+        // Each probed axis overwrites the one before it, so only the last is reported
+        static const uint8_t axes[] = { AXIS_X, AXIS_Y, AXIS_Z, AXIS_A, AXIS_B, AXIS_C };
+        static const char axis_names[] = "xyzabc";
+        char  buf[40];
         char* bufp = buf;
-        bufp += sprintf(bufp, "{\"prb\":{\"e\":%i, \"", (int)cm->probe_state[0]);
-        if (pb.flags[AXIS_X]) {
-            sprintf(bufp, "x\":%0.3f}}\n", cm->probe_results[0][AXIS_X]);
-        }
-        if (pb.flags[AXIS_Y]) {
-            sprintf(bufp, "y\":%0.3f}}\n", cm->probe_results[0][AXIS_Y]);
-        }
-        if (pb.flags[AXIS_Z]) {
-            sprintf(bufp, "z\":%0.3f}}\n", cm->probe_results[0][AXIS_Z]);
-        }
-        if (pb.flags[AXIS_A]) {
-            sprintf(bufp, "a\":%0.3f}}\n", cm->probe_results[0][AXIS_A]);
-        }
-        if (pb.flags[AXIS_B]) {
-            sprintf(bufp, "b\":%0.3f}}\n", cm->probe_results[0][AXIS_B]);
-        }
-        if (pb.flags[AXIS_C]) {
-            sprintf(bufp, "c\":%0.3f}}\n", cm->probe_results[0][AXIS_C]);
+        str_concat(bufp, "{\"prb\":{\"e\":");
+        bufp += inttoa(bufp, (int)cm->probe_state[0]);
+        str_concat(bufp, ", \"");
+        for (uint8_t i = 0; i < sizeof(axes); i++) {
+            if (pb.flags[axes[i]]) {
+                char* str = bufp;
+                *str++ = axis_names[i];
+                str_concat(str, "\":");
+                str += floattoa(str, cm->probe_results[0][axes[i]], 3);
+                str_concat(str, "}}\n");
+            }
         }
         xio_writeline(buf);
     }
@@ -30,11 +30,23 @@
 #include "encoder.h"
 #include "canonical_machine.h"  // needed for cm_panic() in assertions
 #include "controller.h"
+#include "util.h"
+
+#include "MotateTimers.h"
+using namespace Motate;
 
 /**** Allocate Structures ****/
 
 enEncoders_t en;
 
+#ifdef CHECK_ENCODERS
+static void _encoder_check(void);
+
+SysTickEvent encoder_check_tick_event {[&] {
+  _encoder_check();
+}, nullptr};
+#endif
+
 /************************************************************************************
  **** CODE **************************************************************************
  ************************************************************************************/
@@ -73,6 +85,9 @@ void encoder_init() {
     REG_TC2_CCR0  = TC_CCR_CLKEN | TC_CCR_SWTRG;
     #endif
 
+    #ifdef CHECK_ENCODERS
+    SysTickTimer.registerEvent(&encoder_check_tick_event);
+    #endif
 }
 
 void encoder_reset() { encoder_init(); }
@@ -155,16 +170,7 @@ float* en_get_encoder_snapshot_vector() { return (en.snapshot); }
  * Functions to print variables from the cfgArray table
  ***********************************************************************************/
 
- #ifdef CHECK_ENCODERS
-
-typedef struct encoder_check_config {
-  uint8_t motor_index;
-  uint8_t motor_factor;
-  uint8_t encoder_index;
-  uint8_t encoder_factor;
-  uint32_t threshold;
-} encoder_check_config_t;
-
+#ifdef CHECK_ENCODERS
 
 #ifdef CHECK_ENCODER_CONFIG_STATION
 /* station:
@@ -177,8 +183,7 @@ typedef struct encoder_check_config {
  1 step = 6 enc
  x 6 = x 2 + x 4
 */
-#define ENCODER_COUNT 1
-encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
+encoder_check_config_t encoder_check_configs[ENCODER_CHECKS] = {
   { 2, 6, 0, 1, 0},
 };
 #endif
@@ -214,8 +219,7 @@ encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
 
 
 */
-#define ENCODER_COUNT 2
-encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
+encoder_check_config_t encoder_check_configs[ENCODER_CHECKS] = {
   { 0, 6, 1, 1, 0}, // X
   { 1, 3, 0, 1, 0}, // Y
 };
@@ -233,8 +237,7 @@ encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
  400 step = 1600 enc
  1 step = 4 enc
 */
-#define ENCODER_COUNT 1
-encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
+encoder_check_config_t encoder_check_configs[ENCODER_CHECKS] = {
   // motor_index / factor; encoder_index / factor; threshold;
   { 0, 4, 0, 1, 0},
 };
@@ -252,61 +255,109 @@ encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
  400 step = 2400 enc
  1 step = 6 enc
 */
-#define ENCODER_COUNT 1
-encoder_check_config_t encoder_check_configs[ENCODER_COUNT] = {
+encoder_check_config_t encoder_check_configs[ENCODER_CHECKS] = {
   // motor_index / factor; encoder_index / factor; threshold;
   { 2, 6, 0, 1, 0},
 };
 #endif
 
-stat_t cm_check_encoder(void) {
-  for (uint8_t i = 0; i < ENCODER_COUNT; i++) {
-    encoder_check_config_t *c = &encoder_check_configs[i];
+int32_t encoder_check_rate = ENCODER_CHECK_RATE;
+static uint32_t encoder_check_period = 1000 / ENCODER_CHECK_RATE; // ms
+static uint32_t encoder_check_downcount = 1000 / ENCODER_CHECK_RATE;
+
+/*
+ * _encoder_check() - compare motor and encoder positions. SysTick context
+ *
+ * Uses encoder_steps + steps_run so steps from the running segment count too. Interrupts
+ * are masked while reading the pair because the DDA folds one into the other on load.
+ */
+static void _encoder_check(void) {
+  if (--encoder_check_downcount != 0) {
+    return;
+  }
+  encoder_check_downcount = encoder_check_period;
+
+  int32_t encoder_values[2] = {(int32_t) REG_TC0_CV0, (int32_t) REG_TC2_CV0};
 
-    if (c->threshold == 0) continue; // disable enable
+  for (uint8_t i = 0; i < ENCODER_CHECKS; i++) {
+    encoder_check_config_t *c = &encoder_check_configs[i];
 
-    int32_t encoder_values[2] = {(int32_t) REG_TC0_CV0, (int32_t) REG_TC2_CV0};
-    int32_t encoder_value = encoder_values[c->encoder_index];
-    int32_t motor_value = en.en[c->motor_index].encoder_steps;
+    if (c->threshold <= 0) continue; // disabled
 
+    __disable_irq();
+    int32_t motor_value = en.en[c->motor_index].encoder_steps + en.en[c->motor_index].steps_run;
+    __enable_irq();
 
+    int32_t encoder_value = encoder_values[c->encoder_index] * c->encoder_factor;
     motor_value = motor_value * c->motor_factor;
-    encoder_value = encoder_value * c->encoder_factor;
-    uint32_t error = abs(motor_value - encoder_value);
+    int32_t error = abs(motor_value - encoder_value);
+
+    if (error > c->max_error) {
+      c->max_error = error;
+    }
+    uint32_t bin = ENCODER_CHECK_BINS-1;     // at or over the threshold goes in the last bin
+    if (error < c->threshold) {               // 64 bits as error * bins can wrap for large thresholds
+      bin = (uint32_t)(((uint64_t)error * (ENCODER_CHECK_BINS-1)) / (uint32_t)c->threshold);
+    }
+    c->histogram[bin]++;
+    if (++c->samples >= ENCODER_CHECK_WINDOW) {
+      c->samples = 0;
+      for (uint8_t b = 0; b < ENCODER_CHECK_BINS; b++) {
+        c->histogram[b] >>= 1;
+      }
+    }
 
     if (error > c->threshold) {
         cm_request_feedhold(FEEDHOLD_TYPE_ACTIONS, FEEDHOLD_EXIT_CYCLE);
     }
   }
-  return STAT_OK;
 }
 
-void encoder_check_print_out(nvObj_t *nv) {
-  // sprintf(cs.out_buf, "ena%s: %5d\n", nv->token, (int)nv->value_int);
-  // xio_writeline(cs.out_buf);
-};
+// {eac1:n} threshold - 0 disables the check
+stat_t encoder_check_set_value(nvObj_t *nv) {
+  if (nv->value_int < 0) {
+    return (STAT_INPUT_LESS_THAN_MIN_VALUE);
+  }
+  return (set_int32(nv));
+}
 
-stat_t  encoder_check_get_value(nvObj_t *nv) {
-  // // uint8_t output_num = _io(nv->index);
-  //   nv->valuetype = TYPE_FLOAT;
-  //   nv->precision = 2;
-  //   nv->value_flt = 50;
-    return STAT_OK;
-};
-stat_t  encoder_check_set_value(nvObj_t *nv) {
+// {eacx1:0} clears the max error and the histogram
+stat_t encoder_check_set_max(nvObj_t *nv) {
+  uint8_t index = cfgArray[nv->index].token[4] - '1';
+  encoder_check_config_t *c = &encoder_check_configs[index];
+
+  __disable_irq();
+  c->max_error = nv->value_int;
+  c->samples = 0;
+  memset(c->histogram, 0, sizeof(c->histogram));
+  __enable_irq();
+  return (STAT_OK);
+}
 
-  // get encoder index
-  const char *ptr = cfgArray[nv->index].token;
-  ptr = ptr + 3;
-  uint8_t index = atoi(ptr) - 1;
+// {eacr:n} sample rate in Hz, rounded to a whole number of SysTick ms
+stat_t encoder_check_set_rate(nvObj_t *nv) {
+  if ((nv->value_int < 1) || (nv->value_int > 1000)) {
+    return (STAT_INPUT_VALUE_RANGE_ERROR);
+  }
+  encoder_check_rate = nv->value_int;
+  encoder_check_period = 1000 / encoder_check_rate;
+  encoder_check_downcount = encoder_check_period;
+  return (STAT_OK);
+}
 
-  if (index >= ENCODER_COUNT) return STAT_OK;
-  encoder_check_configs[index].threshold = (uint32_t)nv->value_int;
+// {each1:n} returns the histogram as a comma separated string of bin counts
+stat_t encoder_check_get_histogram(nvObj_t *nv) {
+  uint8_t index = cfgArray[nv->index].token[4] - '1';
+  encoder_check_config_t *c = &encoder_check_configs[index];
+  char buf[ENCODER_CHECK_BINS * 11];
+  char *ptr = buf;
 
-  return STAT_OK;
+  for (uint8_t b = 0; b < ENCODER_CHECK_BINS; b++) {
+    ptr += sprintf(ptr, (b == 0) ? "%lu" : ",%lu", (unsigned long)c->histogram[b]);
+  }
+  return (get_string(nv, buf));
 }
 
-
 #endif // check encoders
 
 #ifdef __TEXT_MODE
@@ -135,9 +135,41 @@ float en_get_encoder_snapshot_steps(uint8_t motor);
 float* en_get_encoder_snapshot_vector();
 
 #ifdef CHECK_ENCODERS
-void    encoder_check_print_out(nvObj_t *nv);
-stat_t  encoder_check_get_value(nvObj_t *nv);
+/*
+ * Encoder checks compare a motor's step count with a hardware quadrature encoder (TC0 or TC2)
+ * from the SysTick, every 1000/eacr ms. Both sides are scaled to a common unit:
+ *
+ *    error = | motor_steps * motor_factor - encoder_counts * encoder_factor |
+ *
+ * and an error above threshold requests a feedhold. A stall is therefore caught within one
+ * sample period, regardless of main loop load. The histogram counts errors in eighths of
+ * the threshold (the last bin is over threshold) and is halved every ENCODER_CHECK_WINDOW
+ * samples so it shows recent behavior.
+ */
+#define ENCODER_CHECKS 2                // eac1, eac2
+#define ENCODER_CHECK_BINS 9
+#define ENCODER_CHECK_WINDOW 1000       // samples between halving the histogram
+#define ENCODER_CHECK_RATE 1000         // default sample rate in Hz - 1000 max (SysTick)
+
+typedef struct encoder_check_config {
+  uint8_t  motor_index;                 // fixed by board wiring
+  int32_t  motor_factor;                // {eacm1:n}
+  uint8_t  encoder_index;               // 0 = TC0 (enc1), 1 = TC2 (enc2)
+  int32_t  encoder_factor;              // {eace1:n}
+  int32_t  threshold;                   // {eac1:n} 0 = check disabled
+
+  int32_t  max_error;                   // {eacx1:n} largest error seen - set to 0 to reset
+  uint32_t samples;                     // samples since the histogram was last halved
+  uint32_t histogram[ENCODER_CHECK_BINS];
+} encoder_check_config_t;
+
+extern encoder_check_config_t encoder_check_configs[ENCODER_CHECKS];
+extern int32_t encoder_check_rate;
+
 stat_t  encoder_check_set_value(nvObj_t *nv);
+stat_t  encoder_check_set_max(nvObj_t *nv);
+stat_t  encoder_check_set_rate(nvObj_t *nv);
+stat_t  encoder_check_get_histogram(nvObj_t *nv);
 #endif // check encoders
 
 
@@ -49,6 +49,7 @@
 
 #define __DIAGNOSTICS               // enables various debug functions
 #define __DIAGNOSTIC_PARAMETERS     // enables system diagnostic parameters (_xx) in config_app
+//#define __PLANNER_PROFILING       // enables planner cycle profiling (_pf) - see planner.h. Costs ISR time
 
 /******************************************************************************
  ***** APPLICATION DEFINITIONS ************************************************
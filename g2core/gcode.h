@@ -174,6 +174,7 @@ typedef struct GCodeState {             // Gcode model state - used by model, pl
     cmCanonicalPlane select_plane;      // G17,G18,G19 - values to set plane to
     cmUnitsMode units_mode;             // G20,G21 - 0=inches (G20), 1 = mm (G21)
     cmPathControl path_control;         // G61... EXACT_PATH, EXACT_STOP, CONTINUOUS
+    float path_tolerance;               // G64 P - corner blending tolerance in mm, 0 = no blending
     cmDistanceMode distance_mode;       // G90=use absolute coords, G91=incremental movement
     cmDistanceMode arc_distance_mode;   // G90.1=use absolute IJK offsets, G91.1=incremental IJK offsets
     cmAbsoluteOverride absolute_override;// G53 TRUE = move using machine coordinates - this block only
@@ -197,6 +198,7 @@ typedef struct GCodeState {             // Gcode model state - used by model, pl
         select_plane = CANON_PLANE_XY;
         units_mode = INCHES;
         path_control = PATH_EXACT_PATH;
+        path_tolerance = 0.0;
         distance_mode = ABSOLUTE_DISTANCE_MODE;
         arc_distance_mode = ABSOLUTE_DISTANCE_MODE;
         absolute_override = ABSOLUTE_OVERRIDE_OFF;
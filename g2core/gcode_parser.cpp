@@ -218,10 +218,10 @@ GCodeValue_t gv;    // gcode input values
 GCodeFlag_t gf;     // gcode input flags
 
 // local helper functions and macros
-static void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_delete_flag);
+static char *_normalize_gcode_block(const char *str, const char *end, char **active_comment, uint8_t *block_delete_flag);
 static stat_t _get_next_gcode_word(char **pstr, char *letter, float *value, int32_t *value_int);
 static stat_t _point(float value);
-static stat_t _verify_checksum(char *str);
+static stat_t _verify_checksum(const char *str, const char **end);
 static stat_t _validate_gcode_block(char *active_comment);
 static stat_t _parse_gcode_block(char *line, char *active_comment); // Parse the block into the GN/GF structs
 static stat_t _execute_gcode_block(char *active_comment);           // Execute the gcode block
@@ -248,17 +248,18 @@ void gcode_parser_init()
 
 stat_t gcode_parser(char *block)
 {
-    char *str = block;                      // gcode command or NUL string
+    char *str;                              // normalized gcode command or NUL string
+    const char *end;                        // end of the block - the NUL or the checksum '*'
     char none = NUL;
     char *active_comment = &none;           // gcode comment or NUL string
     uint8_t block_delete_flag;
 
-    stat_t check_ret = _verify_checksum(str);
+    stat_t check_ret = _verify_checksum(block, &end);
     if (check_ret != STAT_OK) {
         return check_ret;
     }
 
-    _normalize_gcode_block(str, &active_comment, &block_delete_flag);
+    str = _normalize_gcode_block(block, end, &active_comment, &block_delete_flag);
 
     // TODO, now MSG is put in the active comment, handle that.
 
@@ -276,7 +277,7 @@ stat_t gcode_parser(char *block)
     if (block_delete_flag == true) {
         return (STAT_NOOP);
     }
-    return(_parse_gcode_block(block, active_comment));
+    return(_parse_gcode_block(str, active_comment));
 }
 
 /*
@@ -284,8 +285,10 @@ stat_t gcode_parser(char *block)
  *
  * Returns STAT_OK is it's valid.
  * Returns STAT_CHECKSUM_MATCH_FAILED if the checksum doesn't match.
+ * Sets end to the '*' of the checksum, or the terminating NUL if there is none.
+ * The block is not modified.
  */
-static stat_t _verify_checksum(char *str)
+static stat_t _verify_checksum(const char *str, const char **end)
 {
     bool has_line_number = false; // -1 means we don't have one
     if (*str == 'N') {
@@ -300,9 +303,9 @@ static stat_t _verify_checksum(char *str)
     }
 
     // c might be 0 here, in which case we didn't get a checksum and we return STAT_OK
+    *end = str-1;               // the normalizer stops here - the parser won't like the * or the CR
 
     if (c == '*') {
-        *(str-1) = 0; // null terminate, the parser won't like this * here!
         gf.checksum = true;
         if (strtol(str, NULL, 10) != checksum) {
             debug_trap("checksum failure");
@@ -317,7 +320,7 @@ static stat_t _verify_checksum(char *str)
 }
 
 /****************************************************************************************
- * _normalize_gcode_block() - normalize a block (line) of gcode in place
+ * _normalize_gcode_block() - normalize a block (line) of gcode into _normalize_scratch
  *
  *  Baseline normalization functions:
  *   - Isolate comments. See below.
@@ -342,7 +345,11 @@ static stat_t _verify_checksum(char *str)
  *     - Only ONE MSG comment will be accepted
  *   - Other "plain" comments are discarded
  *
+ *  The block itself is left untouched, so the caller can echo it back as received, and the
+ *  parser works directly on the normalized copy in the scratch buffer.
+ *
  *  Returns:
+ *   - pointer to the normalized block (in _normalize_scratch)
  *   - com points to comment string or to NUL if no comment
  *   - msg points to message string or to NUL if no comment
  *   - block_delete_flag is set true if block delete encountered, false otherwise
@@ -361,13 +368,13 @@ static stat_t _verify_checksum(char *str)
 
 char _normalize_scratch[RX_BUFFER_SIZE];
 
-void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_delete_flag)
+static char *_normalize_gcode_block(const char *str, const char *end, char **active_comment, uint8_t *block_delete_flag)
 {
     _normalize_scratch[0] = 0;
 
-    char *gc_rd = str;                  // read pointer
+    const char *gc_rd = str;            // read pointer
     char *gc_wr = _normalize_scratch;   // write pointer
-    char *ac_rd = str;                  // Active Comment read pointer
+    const char *ac_rd = str;            // Active Comment read pointer
     char *ac_wr = _normalize_scratch;   // Active Comment write pointer
     bool last_char_was_digit = false;   // used for octal stripping
 
@@ -382,9 +389,9 @@ void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_del
         *block_delete_flag = false;
     }
 
-    while (*gc_rd != 0) {
+    while (gc_rd < end) {
         if ((*gc_rd == ';') || (*gc_rd == '%')) {   // check for ';' or '%' comments that end the line
-            *gc_rd = 0;                             // go ahead and snap the string off cleanly here
+            end = gc_rd;                            // the active comment pass stops here too
             break;
         }
 
@@ -402,23 +409,22 @@ void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_del
 
                 // skip the comment, handling strings carefully
                 bool in_string = false;
-                while (*(++gc_rd) != 0) {
+                while (++gc_rd < end) {
                     if (*gc_rd=='"') {
                         in_string = true;
                     } else if (in_string) {
-                        if ((*gc_rd == '\\') && (*(gc_rd+1) != 0)) {
+                        if ((*gc_rd == '\\') && (gc_rd+1 < end)) {
                             gc_rd++; // Skip it, it's escaped.
                         }
                     } else if ((*gc_rd == ')')) {
                         break;
                     }
                 }
-                if (*gc_rd == 0) {      // We don't want the rd++ later to skip the NULL if we're at one
+                if (gc_rd >= end) {     // We don't want the rd++ later to skip the end if we're at it
                     break;
                 }
             } else {
-                *(gc_rd-1) = ' ';       // Change the '(' to a space to simplify the comment copy later
-                while ((*gc_rd != 0) && (*gc_rd != ')')) {  // skip ahead until we find a ')' (or NULL)
+                while ((gc_rd < end) && (*gc_rd != ')')) {  // skip ahead until we find a ')' (or the end)
                     gc_rd++;
                 }
             }
@@ -452,7 +458,7 @@ void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_del
     if (ac_rd != nullptr) {
 
         // Now we'll copy the comments to the scratch
-        while (*ac_rd != 0) {
+        while (ac_rd < end) {
             // check for comment '('
             // Remember: we're only "counting characters" at this point, no more.
             if (*ac_rd == '(') {
@@ -502,11 +508,15 @@ void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_del
                     do_copy = true;
                 }
 
+                else {
+                    continue;           // plain comment - treat the '(' like any other skipped character
+                }
+
                 if (do_copy) {
                     // skip the comment, handling strings carefully
                     bool in_string = false;
                     bool escaped = false;
-                    while (*ac_rd != 0) {
+                    while (ac_rd < end) {
                         if (in_string && (*ac_rd == '\\')) {
                             escaped = true;
                         } else if (!escaped && (*ac_rd == '"')) {
@@ -537,8 +547,8 @@ void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_del
                     }
                 }
 
-                // We don't want the rd++ later to skip the NULL if we're at one
-                if (*ac_rd == 0) {
+                // We don't want the rd++ later to skip the end if we're at it
+                if (ac_rd >= end) {
                     break;
                 }
             }
@@ -549,10 +559,8 @@ void _normalize_gcode_block(char *str, char **active_comment, uint8_t *block_del
     // Enforce null termination
     *ac_wr = 0;
 
-    // Now copy it all back
-    memcpy(str, _normalize_scratch, (ac_wr-_normalize_scratch)+1);
-
-    *active_comment = str + (comment_start - _normalize_scratch);
+    *active_comment = comment_start;
+    return (_normalize_scratch);
 }
 
 /****************************************************************************************
@@ -994,7 +1002,7 @@ stat_t _execute_gcode_block(char *active_comment)
     EXEC_FUNC(cm_set_coord_system, coord_system);           // G54, G55, G56, G57, G58, G59
 
     if (gf.path_control) {                                  // G61, G61.1, G64
-        status = cm_set_path_control(MODEL, gv.path_control);
+        ritorno(cm_set_path_control(MODEL, gv.path_control, gv.P_word, gf.P_word));
     }
 
     EXEC_FUNC(cm_set_distance_mode, distance_mode);         // G90, G91
@@ -1254,7 +1262,13 @@ stat_t gc_get_gc(nvObj_t *nv)
 
 stat_t gc_run_gc(nvObj_t *nv)
 {
-    return(gcode_parser(*nv->stringp));
+    stat_t status = gcode_parser(*nv->stringp);
+
+    // the parser leaves the block as received - echo it normalized, the way the parser saw it
+    if ((status != STAT_CHECKSUM_MATCH_FAILED) && (status != STAT_MISSING_LINE_NUMBER_WITH_CHECKSUM)) {
+        strcpy(*nv->stringp, _normalize_scratch);
+    }
+    return (status);
 }
 
 /***********************************************************************************
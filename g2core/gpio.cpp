@@ -237,6 +237,7 @@ struct ioDigitalInputExt {
                         }
                 }
 
+                sr_flag_change(SR_SOURCE_IO);
                 sr_request_status_report(SR_REQUEST_TIMED);
         };
 };
@@ -534,6 +535,7 @@ bool gpio_read_input(const uint8_t input_num_ext)
  */
 stat_t gpio_set_output(uint8_t output_num, float value) {
         ioMode outMode = d_out[output_num].mode;
+        sr_flag_change(SR_SOURCE_IO);
         if (outMode == IO_MODE_DISABLED) {
                 value = 0; // Inactive?
         } else {
@@ -44,14 +44,14 @@ jsSingleton_t js;
 
 static stat_t _json_parser_kernal(nvObj_t *nv, char *str);
 static stat_t _json_parser_execute(nvObj_t *nv);
-static stat_t _normalize_json_string(char *str, uint16_t size);
 static stat_t _get_nv_pair(nvObj_t *nv, char **pstr, int8_t *depth);
+static char *_get_number(nvObj_t *nv, char *str);
 
 /****************************************************************************
  * json_parser() - exposed part of JSON parser
  * _json_parser_kernal()
- * _normalize_json_string()
- * _get_nv_pair_strict()
+ * _get_nv_pair()
+ * _get_number()
  *
  *  This is a dumbed down JSON parser to fit in limited memory with no malloc
  *  or practical way to do recursion ("depth" tracks parent/child levels).
@@ -150,12 +150,7 @@ static stat_t _json_parser_kernal(nvObj_t *nv, char *str)
     int8_t depth;
     char group[GROUP_LEN+1] = {""};                 // group identifier - starts as NUL
     int8_t i = NV_BODY_LEN;
-
-    status = _normalize_json_string(str, JSON_INPUT_STRING_MAX);
-    if (status != STAT_OK) {
-        nv->valuetype = TYPE_NULL;
-        return (status);
-    }
+    char *start = str;
 
     // parse the JSON command into the nv body
     do {
@@ -168,6 +163,10 @@ static stat_t _json_parser_kernal(nvObj_t *nv, char *str)
             nv->valuetype = TYPE_NULL;
             return (status);
         }
+        if ((str - start) > JSON_INPUT_STRING_MAX) {
+            nv->valuetype = TYPE_NULL;
+            return (STAT_INPUT_EXCEEDS_MAX_LENGTH);
+        }
         // propagate the group from previous NV pair (if relevant)
         if (group[0] != NUL) {
             strncpy(nv->group, group, GROUP_LEN);   // copy the parent's group to this child
@@ -189,35 +188,6 @@ static stat_t _json_parser_kernal(nvObj_t *nv, char *str)
     return (STAT_OK);                               // only successful commands exit through this point
 }
 
-/*
- * _normalize_json_string - normalize a JSON string in place
- *
- *  Validate string size limits, remove all whitespace and convert
- *  to lower case, with the exception of gcode comments
- */
-
-static stat_t _normalize_json_string(char *str, uint16_t size)
-{
-    char *wr;                                       // write pointer
-    uint8_t in_comment = false;
-
-    if (strlen(str) > size) {
-        return (STAT_INPUT_EXCEEDS_MAX_LENGTH);
-    }
-    for (wr = str; *str != NUL; str++) {
-        if (!in_comment) {                          // normal processing
-            if (*str == '(') in_comment = true;
-            if ((*str <= ' ') || (*str == DEL)) continue; // toss ctrls, WS & DEL
-            *wr++ = tolower(*str);
-        } else {                                    // Gcode comment processing
-            if (*str == ')') in_comment = false;
-            *wr++ = *str;
-        }
-    }
-    *wr = NUL;
-    return (STAT_OK);
-}
-
 /*
  * _get_nv_pair() - get the next name-value pair w/relaxed JSON rules. Also parses strict JSON.
  *
@@ -231,7 +201,13 @@ static stat_t _normalize_json_string(char *str, uint16_t size)
  *  If this were to be extended to track multiple parents or more than two
  *  levels deep it would have to track closing curlies - which it does not.
  *
- *  ASSUMES INPUT STRING HAS FIRST BEEN NORMALIZED BY _normalize_json_string()
+ *  The line is parsed in a single pass, straight from the input buffer:
+ *    - whitespace, control characters and DEL are skipped wherever they occur
+ *    - the name is lower cased into nv->token as it's read, and the input is not changed
+ *    - numbers are read by _get_number()
+ *    - string values are normalized in place - whitespace removed and lower cased, except
+ *      in Gcode comments - and NUL terminated over the closing quote. nv->stringp points
+ *      into the input buffer, so the buffer must stay put until the list is done with
  *
  *  If a group prefix is passed in it will be pre-pended to any name parsed
  *  to form a token string. For example, if "x" is provided as a group and
@@ -246,10 +222,15 @@ static stat_t _normalize_json_string(char *str, uint16_t size)
  *  See build 406.xx or earlier for strict JSON parser - deleted in 407.03
  */
 
+static inline bool _is_json_space(const char c)
+{
+    return ((c != NUL) && ((c <= ' ') || (c == DEL)));
+}
+
 static stat_t _get_nv_pair(nvObj_t *nv, char **pstr, int8_t *depth)
 {
     uint8_t i;
-    char *tmp;
+    char *str = *pstr;
     char leaders[] = {"{,\""};      // open curly, quote and leading comma
     char separators[] = {":\""};    // colon and quote
     char terminators[] = {"},\""};  // close curly, comma and quote
@@ -258,97 +239,114 @@ static stat_t _get_nv_pair(nvObj_t *nv, char **pstr, int8_t *depth)
     nv_reset_nv(nv);                // wipes the object and sets the depth
 
     // --- Process name part ---
-    // Find, terminate and set pointers for the name. Allow for leading and trailing name quotes.
-    char * name = *pstr;
-    for (i=0; true; i++, (*pstr)++) {
-        if (strchr(leaders, (int)**pstr) == NULL) {     // find leading character of name
-            name = (*pstr)++;
-            break;
-        }
-        if (i == MAX_PAD_CHARS) {
+    // Skip the leading curly, comma and quote, then copy the name to the token up to the separator
+    for (i=0; true; str++) {
+        if (_is_json_space(*str)) continue;
+        if ((*str == NUL) || (strchr(leaders, (int)*str) == NULL)) break;
+        if (++i > MAX_PAD_CHARS) {
             return (STAT_JSON_SYNTAX_ERROR);
         }
     }
-
-    // Find the end of name, NUL terminate and copy token
-    for (i=0; true; i++, (*pstr)++) {
-        if (strchr(separators, (int)**pstr) != NULL) {
-            *(*pstr)++ = NUL;
-            strncpy(nv->token, name, TOKEN_LEN+1);      // copy the string to the token
+    for (i=0; true; str++) {
+        if (*str == NUL) {
+            return (STAT_JSON_SYNTAX_ERROR);
+        }
+        if (_is_json_space(*str)) continue;
+        if (strchr(separators, (int)*str) != NULL) {
+            nv->token[i] = NUL;
+            str++;
             break;
         }
         if (i == TOKEN_LEN) {
             return (STAT_INPUT_EXCEEDS_MAX_LENGTH);
         }
+        nv->token[i++] = tolower(*str);
     }
 
     // --- Process value part ---  (organized from most to least frequently encountered)
 
     // Find the start of the value part
-    for (i=0; true; i++, (*pstr)++) {
-        if (isalnum((int)**pstr)) break;
-        if (strchr(value, (int)**pstr) != NULL) break;
-        if (i == MAX_PAD_CHARS) {
+    for (i=0; true; str++) {
+        if (_is_json_space(*str)) continue;
+        if (isalnum((int)*str)) break;
+        if ((*str == NUL) || (strchr(value, (int)*str) != NULL)) break;
+        if (++i > MAX_PAD_CHARS) {
             return (STAT_JSON_SYNTAX_ERROR);
         }
     }
 
     // nulls (gets)
-    if ((**pstr == 'n') || ((**pstr == '\"') && (*(*pstr+1) == '\"'))) { // process null value
+    if ((tolower(*str) == 'n') || ((*str == '\"') && (*(str+1) == '\"'))) { // process null value
         nv->valuetype = TYPE_NULL;
         nv->value_int = TYPE_NULL;
+        str += (*str == 'n' || *str == 'N') ? 1 : 2;    // past the 'n' or both quotes
 
     // numbers
-    } else if (isdigit(**pstr) || (**pstr == '-')) {    // value is a number
-        nv->value_int = atol(*pstr);                    // get the number as an integer
-        nv->value_flt = (float)strtod(*pstr, &tmp);     // get the number as a float - tmp is the end pointer
-
-        if ((tmp == *pstr) ||                           // if start pointer equals end the conversion failed
-            (strchr(terminators, *tmp) == NULL)) {      // terminators are the only legal chars at the end of a number
+    } else if (isdigit(*str) || (*str == '-')) {        // value is a number
+        char *end = _get_number(nv, str);
+        while (_is_json_space(*end)) {
+            end++;
+        }
+        if ((end == str) ||                             // nothing was read
+            (*end == NUL) || (strchr(terminators, *end) == NULL)) { // terminators are the only legal chars at the end of a number
             nv->valuetype = TYPE_NULL;                  // report back an error
             return (STAT_BAD_NUMBER_FORMAT);
         }
         nv->valuetype = TYPE_FLOAT;
+        str = end;
 
     // object parent
-    } else if (**pstr == '{') {
+    } else if (*str == '{') {
         nv->valuetype = TYPE_PARENT;
 //        *depth += 1;                                  // nv_reset_nv() sets the next object's level so this is redundant
-        (*pstr)++;
+        *pstr = str+1;
         return(STAT_EAGAIN);                            // signal that there is more to parse
 
     // strings
-    } else if (**pstr == '\"') {                        // value is a string
-        (*pstr)++;
-        nv->valuetype = TYPE_STRING;
-        if ((tmp = strchr(*pstr, '\"')) == NULL) {
-            return (STAT_JSON_SYNTAX_ERROR);            // find the end of the string
+    } else if (*str == '\"') {                          // value is a string
+        char *rd = ++str;
+        char *wr = str;
+        bool in_comment = false;
+        for ( ; *rd != '\"'; rd++) {                    // normalize in place up to the closing quote
+            if (*rd == NUL) {
+                return (STAT_JSON_SYNTAX_ERROR);        // no closing quote
+            }
+            if (!in_comment) {                          // normal processing
+                if (*rd == '(') in_comment = true;
+                if ((*rd <= ' ') || (*rd == DEL)) continue; // toss ctrls, WS & DEL
+                *wr++ = tolower(*rd);
+            } else {                                    // Gcode comment processing
+                if (*rd == ')') in_comment = false;
+                *wr++ = *rd;
+            }
         }
-        *tmp = NUL;
+        *wr = NUL;                                      // wr is at or behind the closing quote
+        nv->valuetype = TYPE_STRING;
 
         // if string begins with 0x it might be data, needs to be at least 3 chars long
-        if( strlen(*pstr)>=3 && (*pstr)[0]=='0' && (*pstr)[1]=='x')
-        {
+        if (((wr - str) >= 3) && (str[0] == '0') && (str[1] == 'x')) {
             uint32_t *v = (uint32_t*)&nv->value_flt;
-            *v = strtoul((const char *)*pstr, 0L, 0);
+            *v = strtoul((const char *)str, 0L, 0);
             nv->valuetype = TYPE_DATA;
         } else {
-            ritorno(nv_copy_string(nv, *pstr));
+            nv->stringp = (char (*)[])str;              // the string stays in the input buffer
         }
-        *pstr = ++tmp;
+        str = rd+1;
 
     // boolean true/false
-    } else if (**pstr == 't') {
+    } else if (tolower(*str) == 't') {
         nv->valuetype = TYPE_BOOLEAN;
         nv->value_int = true;
-    } else if (**pstr == 'f') {
+        str++;
+    } else if (tolower(*str) == 'f') {
         nv->valuetype = TYPE_BOOLEAN;
         nv->value_int = false;
+        str++;
 
     // arrays
-    } else if (**pstr == '[') {
+    } else if (*str == '[') {
         nv->valuetype = TYPE_ARRAY;
-        ritorno(nv_copy_string(nv, *pstr));     // copy array into string for error displays
+        ritorno(nv_copy_string(nv, str));       // copy array into string for error displays
         return (STAT_VALUE_TYPE_ERROR);         // return error as the parser doesn't do input arrays yet
 
     // general error condition
@@ -357,20 +355,86 @@ static stat_t _get_nv_pair(nvObj_t *nv, char **pstr, int8_t *depth)
     }
 
     // process comma separators and end curlies
-    if ((*pstr = strpbrk(*pstr, terminators)) == NULL) { // advance to terminator or err out
+    if ((str = strpbrk(str, terminators)) == NULL) { // advance to terminator or err out
         return (STAT_JSON_SYNTAX_ERROR);
     }
-    if (**pstr == '}') {
+    if (*str == '}') {
         *depth -= 1;                            // pop up a nesting level
-        (*pstr)++;                              // advance to comma or whatever follows
+        str++;                                  // advance to comma or whatever follows
+        while (_is_json_space(*str)) {
+            str++;
+        }
     }
-    if (**pstr == ',') {
+    *pstr = str;
+    if (*str == ',') {
         return (STAT_EAGAIN);                   // signal that there is more to parse
     }
     (*pstr)++;
     return (STAT_OK);                           // signal that parsing is complete
 }
 
+/*
+ * _get_number() - read a number into value_flt, and its integer part into value_int
+ *
+ *  Plain decimals of up to 7 significant digits - which is all config and HMI traffic -
+ *  are read as one integer and a divide by a power of 10. Both are exact as floats so
+ *  the result is correctly rounded. Anything longer, or with an exponent or a base,
+ *  falls back to strtod(). Returns a pointer to the character after the number, or
+ *  str if there wasn't one.
+ */
+
+#define NUMBER_MANTISSA_MAX 1677720     // another digit still fits the 24 bit float mantissa
+
+static const float _pow10f[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+static char *_get_number(nvObj_t *nv, char *str)
+{
+    char *p = str;
+    bool negative = (*p == '-');
+    if (negative) {
+        p++;
+    }
+    char *digits = p;
+    uint32_t integer_part = 0;
+    uint32_t mantissa = 0;              // all the digits, with the decimal point removed
+    uint8_t decimals = 0;               // digits after the decimal point
+    bool exact = true;                  // mantissa and 10^decimals are both exact as floats
+
+    for ( ; isdigit(*p); p++) {
+        integer_part = (integer_part * 10) + (*p - '0');
+        if (mantissa <= NUMBER_MANTISSA_MAX) {
+            mantissa = (mantissa * 10) + (*p - '0');
+        } else {
+            exact = false;
+        }
+    }
+    if (*p == '.') {
+        for (p++; isdigit(*p); p++) {
+            if ((mantissa <= NUMBER_MANTISSA_MAX) && (decimals < 9)) {
+                mantissa = (mantissa * 10) + (*p - '0');
+                decimals++;
+            } else {
+                exact = false;
+            }
+        }
+    }
+    if ((p == digits) || ((p == digits+1) && (*digits == '.'))) {
+        return (str);                   // no digits
+    }
+    if (isalpha(*p)) {                  // exponent, or hex - leave it to strtod()
+        exact = false;
+    }
+
+    if (exact) {
+        float value = (float)mantissa / _pow10f[decimals];
+        nv->value_flt = negative ? -value : value;
+    } else {
+        nv->value_flt = (float)strtod(str, &p);
+    }
+    nv->value_int = negative ? -(int32_t)integer_part : (int32_t)integer_part;
+    return (p);
+}
+
 /****************************************************************************
  * json_serialize() - make a JSON object string from JSON object array
  *
@@ -439,7 +503,7 @@ uint16_t json_serialize(nvObj_t *nv, char *out_buf, uint16_t size)
 //                                        str += sprintf(str, "%d", (int)nv->value);
 //                                        break;
 //                                    }
-                case (TYPE_INTEGER):{   str += sprintf(str, "%d", (int)nv->value_int);
+                case (TYPE_INTEGER):{   str += inttoa(str, (int)nv->value_int);
                                         break;
                                     }
                 case (TYPE_STRING): {   *str++ = '"';
@@ -458,7 +522,10 @@ uint16_t json_serialize(nvObj_t *nv, char *out_buf, uint16_t size)
                                         break;
                                     }
                 case (TYPE_DATA):   {   uint32_t *v = (uint32_t*)&nv->value_flt;
-                                        str += sprintf(str, "\"0x%lx\"", *v);
+                                        strcpy(str, "\"0x");
+                                        str += 3;
+                                        str += hextoa(str, *v);
+                                        *str++ = '"';
                                         break;
                                     }
                 case (TYPE_ARRAY):  {   strcpy(str++, "[");
@@ -484,11 +551,18 @@ uint16_t json_serialize(nvObj_t *nv, char *out_buf, uint16_t size)
     while (prev_depth-- > initial_depth) {
         *str++ = '}';
     }
-    #if ENC2_AVAILABLE
-    str += sprintf((char *)str, ", \"enc1\":%ld, \"enc2\": %ld}\n", (int32_t)REG_TC0_CV0, (int32_t)REG_TC2_CV0);         // using sprintf for this last one ensures a NUL termination
-    #else
-    str += sprintf((char *)str, ", \"enc1\":%ld}\n", (int32_t)REG_TC0_CV0);         // using sprintf for this last one ensures a NUL termination
-    #endif
+    if (!bt_has_encoders()) {           // otherwise the counters are assigned to binary telemetry (btv)
+        strcpy(str, ", \"enc1\":");
+        str += 9;
+        str += inttoa(str, (int32_t)REG_TC0_CV0);
+        #if ENC2_AVAILABLE
+        strcpy(str, ", \"enc2\": ");
+        str += 10;
+        str += inttoa(str, (int32_t)REG_TC2_CV0);
+        #endif
+    }
+    strcpy(str, "}\n");                // strcpy for this last one ensures a NUL termination
+    str += 2;
 
     if (str > out_buf + size) {
         return (-1);
@@ -622,8 +696,13 @@ void json_print_response(uint8_t status, const bool only_to_muted /*= false*/)
     nv->nx = NULL;                                          // terminate the list
 
     // serialize the JSON response and print it if there were no errors
+    // OK responses may be held and sent with the ones after them. Anything else goes out now
     if (json_serialize(nv_header, cs.out_buf, sizeof(cs.out_buf)) >= 0) {
-        xio_writeline(cs.out_buf, only_to_muted);
+        if ((status == STAT_OK) && (js.ack_coalesce_lines > 1) && (!only_to_muted)) {
+            xio_writeline_coalesced(cs.out_buf, js.ack_coalesce_lines, js.ack_coalesce_ms);
+        } else {
+            xio_writeline(cs.out_buf, only_to_muted);
+        }
     }
 }
 
@@ -684,6 +763,29 @@ stat_t js_set_jv(nvObj_t *nv)
     return(STAT_OK);
 }
 
+/*
+ * js_get_jcl() - get response coalescing lines
+ * js_set_jcl() - set response coalescing lines. 1 sends each response as it's made
+ * js_get_jct() - get response coalescing time
+ * js_set_jct() - set response coalescing time
+ *
+ *  See xio_writeline_coalesced(). Keep jcl below the number of lines the host sends
+ *  ahead of the acks it has received, or it will wait on jct for every batch.
+ */
+
+stat_t js_get_jcl(nvObj_t *nv) { return(get_integer(nv, js.ack_coalesce_lines)); }
+stat_t js_set_jcl(nvObj_t *nv)
+{
+    ritorno (set_integer(nv, js.ack_coalesce_lines, 1, XIO_COALESCE_LINES_MAX));
+    if (js.ack_coalesce_lines == 1) {
+        xio_flush_coalesced();
+    }
+    return (STAT_OK);
+}
+
+stat_t js_get_jct(nvObj_t *nv) { return(get_integer(nv, js.ack_coalesce_ms)); }
+stat_t js_set_jct(nvObj_t *nv) { return(set_integer(nv, js.ack_coalesce_ms, 1, XIO_COALESCE_MS_MAX)); }
+
 /*
  * json_set_ej() - set JSON communications mode
  */
@@ -719,16 +821,22 @@ stat_t json_set_ej(nvObj_t *nv)
  * js_print_jv()
  * js_print_js()
  * js_print_jf()
+ * js_print_jcl()
+ * js_print_jct()
  */
 
 static const char fmt_ej[] = "[ej]  enable json mode%13d [0=text,1=JSON,2=auto]\n";
 static const char fmt_jv[] = "[jv]  json verbosity%15d [0=silent,1=footer,2=messages,3=configs,4=linenum,5=verbose]\n";
 static const char fmt_js[] = "[js]  json serialize style%9d [0=relaxed,1=strict]\n";
 static const char fmt_jf[] = "[jf]  json footer style%12d [1=checksum,2=window report]\n";
+static const char fmt_jcl[] = "[jcl] json coalesce lines%10d [1=off]\n";
+static const char fmt_jct[] = "[jct] json coalesce time%11d ms\n";
 
 void js_print_ej(nvObj_t *nv) { text_print(nv, fmt_ej);}    // TYPE_INT
 void js_print_jv(nvObj_t *nv) { text_print(nv, fmt_jv);}    // TYPE_INT
 void js_print_js(nvObj_t *nv) { text_print(nv, fmt_js);}    // TYPE_INT
 void js_print_jf(nvObj_t *nv) { text_print(nv, fmt_jf);}    // TYPE_INT
+void js_print_jcl(nvObj_t *nv) { text_print(nv, fmt_jcl);}  // TYPE_INT
+void js_print_jct(nvObj_t *nv) { text_print(nv, fmt_jct);}  // TYPE_INT
 
 #endif // __TEXT_MODE
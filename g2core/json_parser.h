@@ -71,6 +71,8 @@ typedef struct jsSingleton {
     bool echo_json_configs;
     bool echo_json_linenum;
     bool echo_json_gcode_block;
+    uint8_t ack_coalesce_lines;     // responses held to go out in one write (1 = off)
+    uint8_t ack_coalesce_ms;        // longest a response is held (in ms)
 
     /*** runtime values (PRIVATE) ***/
 
@@ -93,6 +95,10 @@ stat_t js_get_ej(nvObj_t *nv);
 stat_t js_set_ej(nvObj_t *nv);
 stat_t js_get_jv(nvObj_t *nv);
 stat_t js_set_jv(nvObj_t *nv);
+stat_t js_get_jcl(nvObj_t *nv);
+stat_t js_set_jcl(nvObj_t *nv);
+stat_t js_get_jct(nvObj_t *nv);
+stat_t js_set_jct(nvObj_t *nv);
 
 #ifdef __TEXT_MODE
 
@@ -100,6 +106,8 @@ stat_t js_set_jv(nvObj_t *nv);
     void js_print_jv(nvObj_t *nv);
     void js_print_js(nvObj_t *nv);
     void js_print_jf(nvObj_t *nv);
+    void js_print_jcl(nvObj_t *nv);
+    void js_print_jct(nvObj_t *nv);
 
 #else
 
@@ -107,6 +115,8 @@ stat_t js_set_jv(nvObj_t *nv);
     #define js_print_jv tx_print_stub
     #define js_print_js tx_print_stub
     #define js_print_jf tx_print_stub
+    #define js_print_jcl tx_print_stub
+    #define js_print_jct tx_print_stub
 
 #endif // __TEXT_MODE
 
@@ -30,10 +30,27 @@
 #include "config.h"
 #include "canonical_machine.h"
 #include "stepper.h"
+#include "settings.h"
 #include "kinematics.h"
 #include "util.h"
 
+// Motor mapping table - see kinematics.h
+
+typedef struct knMotorMap {
+    uint8_t motors;                     // number of motors mapped to an axis that is not inhibited
+    uint8_t motor[MOTORS];              // the motor...
+    uint8_t axis[MOTORS];               // ...the axis (joint) it's mapped to
+    float steps_per_unit[MOTORS];       // ...its steps per unit
+    float forward_scale[MOTORS];        // ...and its share of the joint position from its steps -
+                                        //    units per step over the number of best resolution
+                                        //    motors on the axis, 0 if it's not one of them
+} knMotorMap_t;
+
+static knMotorMap_t kn_map[2];                  // tables, one in use and one to build into
+static knMotorMap_t *kn_active = &kn_map[0];    // table in use
+
 static void _inverse_kinematics(const float travel[], float joint[]);
+static void _forward_kinematics(const float joint[], float travel[]);
 
 /*
  * kn_kinematics() - wrapper routine for inverse kinematics
@@ -49,113 +66,257 @@ static void _inverse_kinematics(const float travel[], float joint[]);
 
 void kn_inverse_kinematics(const float travel[], float steps[]) {
     float joint[AXES];
+    const knMotorMap_t *m = kn_active;                    // the table can be swapped while this runs
 
-    _inverse_kinematics(travel, joint);  // insert inverse kinematics transformations here
-
-// We'll time-test each and see if unrolling is worth it.
-#if 0
-    // Map motors to axes and convert length units to steps
-    // Most of the conversion math has already been done in during config in steps_per_unit()
-    // which takes axis travel, step angle and microsteps into account.
-    for (uint8_t axis=0; axis<AXES; axis++) {
-        if (cm->a[axis].axis_mode == AXIS_INHIBITED) { joint[axis] = 0;}
-        if (st_cfg.mot[MOTOR_1].motor_map == axis) {
-            steps[MOTOR_1] = joint[axis] * st_cfg.mot[MOTOR_1].steps_per_unit;
-        }
-        if (st_cfg.mot[MOTOR_2].motor_map == axis) {
-            steps[MOTOR_2] = joint[axis] * st_cfg.mot[MOTOR_2].steps_per_unit;
-        }
-        if (st_cfg.mot[MOTOR_3].motor_map == axis) {
-            steps[MOTOR_3] = joint[axis] * st_cfg.mot[MOTOR_3].steps_per_unit;
-        }
-        if (st_cfg.mot[MOTOR_4].motor_map == axis) {
-            steps[MOTOR_4] = joint[axis] * st_cfg.mot[MOTOR_4].steps_per_unit;
-        }
-#if (MOTORS >= 5)
-        if (st_cfg.mot[MOTOR_5].motor_map == axis) {
-            steps[MOTOR_5] = joint[axis] * st_cfg.mot[MOTOR_5].steps_per_unit;
-        }
-#endif
-#if (MOTORS >= 6)
-        if (st_cfg.mot[MOTOR_6].motor_map == axis) {
-            steps[MOTOR_6] = joint[axis] * st_cfg.mot[MOTOR_6].steps_per_unit;
-        }
-#endif
+    _inverse_kinematics(travel, joint);
+
+    // Map motors to axes and convert length units to steps. Motors on inhibited axes are left where they are.
+    for (uint8_t i = 0; i < m->motors; i++) {
+        steps[m->motor[i]] = joint[m->axis[i]] * m->steps_per_unit[i];
     }
+}
 
-#else
+/*
+ * kn_config_changed() - rebuild the motor mapping table from the motor and axis settings
+ *
+ *	Each axis is read back (forward kinematics) from the average of its best resolution motors.
+ */
+
+void kn_config_changed() {
+    knMotorMap_t *m = (kn_active == &kn_map[0]) ? &kn_map[1] : &kn_map[0];
+    float best_steps_per_unit[AXES];
+    uint8_t best_motors[AXES];
 
     for (uint8_t axis = 0; axis < AXES; axis++) {
-        if (cm->a[axis].axis_mode == AXIS_INHIBITED) {
-            joint[axis] = 0;
+        best_steps_per_unit[axis] = -1.0;
+        best_motors[axis] = 0;
+    }
+    for (uint8_t motor = 0; motor < MOTORS; motor++) {
+        uint8_t axis = st_cfg.mot[motor].motor_map;
+        if (axis >= AXES) {                         // motor is not mapped
             continue;
         }
-        for (uint8_t motor = 0; motor < MOTORS; motor++) {
-            if (st_cfg.mot[motor].motor_map == axis) {
-                steps[motor] = joint[axis] * st_cfg.mot[motor].steps_per_unit;
-            }
+        // If this motor has a better (or the only) resolution it's the one to use, if it's the same use both
+        if (best_steps_per_unit[axis] < st_cfg.mot[motor].steps_per_unit) {
+            best_steps_per_unit[axis] = st_cfg.mot[motor].steps_per_unit;
+            best_motors[axis] = 1;
+        } else if (fp_EQ(best_steps_per_unit[axis], st_cfg.mot[motor].steps_per_unit)) {
+            best_motors[axis]++;
         }
     }
-#endif
+
+    m->motors = 0;
+    for (uint8_t motor = 0; motor < MOTORS; motor++) {
+        uint8_t axis = st_cfg.mot[motor].motor_map;
+        if ((axis >= AXES) || (cm->a[axis].axis_mode == AXIS_INHIBITED)) {
+            continue;
+        }
+        uint8_t i = m->motors++;
+        m->motor[i] = motor;
+        m->axis[i] = axis;
+        m->steps_per_unit[i] = st_cfg.mot[motor].steps_per_unit;
+        m->forward_scale[i] = fp_EQ(best_steps_per_unit[axis], st_cfg.mot[motor].steps_per_unit) ?
+                              st_cfg.mot[motor].units_per_step / best_motors[axis] : 0;
+    }
+    kn_active = m;                                  // swap it in
 }
 
 /*
- * _inverse_kinematics() - inverse kinematics - example is for a cartesian machine
+ * _inverse_kinematics() - transform a Cartesian position into joint positions
+ * _forward_kinematics() - transform joint positions into a Cartesian position
  *
- *	You can glue in inverse kinematics here, but be aware of time budget constraints.
- *	This function is run during the _exec() portion of the cycle and will therefore
+ *	Inverse kinematics is run during the _exec() portion of the cycle and will therefore
  *	be run once per interpolation segment. The total time for the segment load,
  *	including the inverse kinematics transformation cannot exceed the segment time,
- *	and ideally should be no more than 25-50% of the segment time. Currently segments
- *	run every 1.5 ms, but this might be lowered. To profile this time look at the
- *	time it takes to complete the mp_exec_move() function.
+ *	and ideally should be no more than 25-50% of the segment time. The worst case is
+ *	measured by the segment profiling slot - read {"_pfmg":n} and {"_pfsl":n}.
  *
- *	Note: the compiler will  inline trivial functions (like memcpy) so there is no
- *	size or performance penalty for breaking this out
+ *	Forward kinematics is only used to set the position from the motors (homing, probing)
+ *	so it is written for clarity, not speed.
  */
+
+#if (KINEMATICS == KINE_CARTESIAN)
+
 static void _inverse_kinematics(const float travel[], float joint[]) {
     memcpy(joint, travel, sizeof(float) * AXES);  // just do a memcpy for Cartesian machines
+}
+
+static void _forward_kinematics(const float joint[], float travel[]) {
+    memcpy(travel, joint, sizeof(float) * AXES);
+}
+
+#elif (KINEMATICS == KINE_COREXY) || (KINEMATICS == KINE_HBOT)
 
-    //	for (uint8_t i=0; i<AXES; i++) {
-    //		joint[i] = travel[i];
-    //	}
+static void _inverse_kinematics(const float travel[], float joint[]) {
+    memcpy(joint, travel, sizeof(float) * AXES);
+    joint[AXIS_X] = travel[AXIS_X] + travel[AXIS_Y];
+    joint[AXIS_Y] = travel[AXIS_X] - travel[AXIS_Y];
+}
+
+static void _forward_kinematics(const float joint[], float travel[]) {
+    memcpy(travel, joint, sizeof(float) * AXES);
+    travel[AXIS_X] = (joint[AXIS_X] + joint[AXIS_Y]) / 2;
+    travel[AXIS_Y] = (joint[AXIS_X] - joint[AXIS_Y]) / 2;
 }
 
+#elif (KINEMATICS == KINE_SCARA)
+
 /*
- * kn_forward_kinematics() - forward kinematics for a cartesian machine
+ *	The shoulder angle from atan2() jumps by 360 degrees on the -X side of the shoulder,
+ *	so it is unwrapped to the turn nearest the last angle returned. The elbow always
+ *	bends the same way (KINE_SCARA_ELBOW) and stays within +/-180 degrees. Targets out
+ *	of reach put the arm straight out (or folded) towards them.
+ */
+
+static struct knScara {
+    float inner_sq;                 // inner arm length squared
+    float outer_sq;                 // outer arm length squared
+    float inverse_2io;              // 1 / (2 * inner * outer)
+    float shoulder;                 // last shoulder angle, in degrees
+} kn;
+
+static void _kinematics_init() {
+    kn.inner_sq = square(KINE_SCARA_INNER_ARM);
+    kn.outer_sq = square(KINE_SCARA_OUTER_ARM);
+    kn.inverse_2io = 1 / (2 * KINE_SCARA_INNER_ARM * KINE_SCARA_OUTER_ARM);
+    kn.shoulder = 0;
+}
+
+static void _inverse_kinematics(const float travel[], float joint[]) {
+    memcpy(joint, travel, sizeof(float) * AXES);
+
+    float cos_elbow = (square(travel[AXIS_X]) + square(travel[AXIS_Y]) - kn.inner_sq - kn.outer_sq) * kn.inverse_2io;
+    cos_elbow = min(max(cos_elbow, (float)-1.0), (float)1.0);
+    float sin_elbow = KINE_SCARA_ELBOW * sqrtf(1 - square(cos_elbow));
+
+    float shoulder = atan2f(travel[AXIS_Y], travel[AXIS_X]) -
+                     atan2f(KINE_SCARA_OUTER_ARM * sin_elbow, KINE_SCARA_INNER_ARM + KINE_SCARA_OUTER_ARM * cos_elbow);
+    shoulder *= (float)(180 / M_PI);
+    shoulder += 360 * floorf((kn.shoulder - shoulder) / 360 + (float)0.5);   // nearest turn to the last angle
+
+    kn.shoulder = shoulder;
+    joint[AXIS_X] = shoulder;
+    joint[AXIS_Y] = atan2f(sin_elbow, cos_elbow) * (float)(180 / M_PI);
+}
+
+static void _forward_kinematics(const float joint[], float travel[]) {
+    memcpy(travel, joint, sizeof(float) * AXES);
+
+    float shoulder = joint[AXIS_X] * (float)(M_PI / 180);
+    float wrist = shoulder + joint[AXIS_Y] * (float)(M_PI / 180);
+    travel[AXIS_X] = KINE_SCARA_INNER_ARM * cosf(shoulder) + KINE_SCARA_OUTER_ARM * cosf(wrist);
+    travel[AXIS_Y] = KINE_SCARA_INNER_ARM * sinf(shoulder) + KINE_SCARA_OUTER_ARM * sinf(wrist);
+    kn.shoulder = joint[AXIS_X];    // inverse kinematics continues from where the arm really is
+}
+
+#elif (KINEMATICS == KINE_LINEAR_DELTA)
+
+/*
+ *	Each carriage sits a rod's height above the effector, less the horizontal distance
+ *	from its tower: h = z + sqrt(L^2 - dx^2 - dy^2). The tower positions are cached.
+ *	Forward kinematics finds the point a rod length below all three carriages by
+ *	trilateration. Targets out of reach of a tower put its rod flat.
+ */
+
+#define DELTA_TOWERS 3
+
+static struct knDelta {
+    float tower_x[DELTA_TOWERS];    // tower XY positions, relative to the effector joints
+    float tower_y[DELTA_TOWERS];
+    float rod_sq;                   // rod length squared
+} kn;
+
+static void _kinematics_init() {
+    static const float angle[DELTA_TOWERS] = { 210, 330, 90 };
+    for (uint8_t i = 0; i < DELTA_TOWERS; i++) {
+        kn.tower_x[i] = KINE_DELTA_RADIUS * cosf(angle[i] * (float)(M_PI / 180));
+        kn.tower_y[i] = KINE_DELTA_RADIUS * sinf(angle[i] * (float)(M_PI / 180));
+    }
+    kn.rod_sq = square(KINE_DELTA_ROD_LENGTH);
+}
+
+static void _inverse_kinematics(const float travel[], float joint[]) {
+    memcpy(joint, travel, sizeof(float) * AXES);
+    for (uint8_t i = 0; i < DELTA_TOWERS; i++) {
+        float height_sq = kn.rod_sq - square(travel[AXIS_X] - kn.tower_x[i]) - square(travel[AXIS_Y] - kn.tower_y[i]);
+        joint[AXIS_X + i] = travel[AXIS_Z] + sqrtf(max(height_sq, (float)0.0));
+    }
+}
+
+static void _forward_kinematics(const float joint[], float travel[]) {
+    memcpy(travel, joint, sizeof(float) * AXES);
+
+    float p1[3] = { kn.tower_x[0], kn.tower_y[0], joint[AXIS_X] };     // carriage joint positions
+    float p2[3] = { kn.tower_x[1], kn.tower_y[1], joint[AXIS_Y] };
+    float p3[3] = { kn.tower_x[2], kn.tower_y[2], joint[AXIS_Z] };
+    float ex[3], ey[3], ez[3], p13[3];
+    for (uint8_t k = 0; k < 3; k++) {
+        ex[k] = p2[k] - p1[k];
+        p13[k] = p3[k] - p1[k];
+    }
+    float d = sqrtf(square(ex[0]) + square(ex[1]) + square(ex[2]));
+    for (uint8_t k = 0; k < 3; k++) { ex[k] /= d; }
+    float i = ex[0]*p13[0] + ex[1]*p13[1] + ex[2]*p13[2];
+    for (uint8_t k = 0; k < 3; k++) { ey[k] = p13[k] - i * ex[k]; }
+    float j = sqrtf(square(ey[0]) + square(ey[1]) + square(ey[2]));
+    for (uint8_t k = 0; k < 3; k++) { ey[k] /= j; }
+    ez[0] = ex[1]*ey[2] - ex[2]*ey[1];
+    ez[1] = ex[2]*ey[0] - ex[0]*ey[2];
+    ez[2] = ex[0]*ey[1] - ex[1]*ey[0];
+
+    // all three distances are the rod length, which simplifies the usual trilateration
+    float x = d / 2;
+    float y = (square(i) + square(j) - 2 * i * x) / (2 * j);
+    float z = sqrtf(max(kn.rod_sq - square(x) - square(y), (float)0.0));
+    if (ez[2] > 0) {                // the effector is below the carriages
+        z = -z;
+    }
+    travel[AXIS_X] = p1[0] + x * ex[0] + y * ey[0] + z * ez[0];
+    travel[AXIS_Y] = p1[1] + x * ex[1] + y * ey[1] + z * ez[1];
+    travel[AXIS_Z] = p1[2] + x * ex[2] + y * ey[2] + z * ez[2];
+}
+
+#else
+#error "KINEMATICS must be one of the KINE_ models in kinematics.h"
+#endif
+
+/*
+ * kinematics_init() - compute the cached geometry of the kinematics model
+ *
+ *  The motor map is not built here. It reads the axis settings in the canonical machine,
+ *  which is not initialized yet - config_init() builds it as it applies the settings.
+ */
+
+void kinematics_init() {
+#if (KINEMATICS == KINE_SCARA) || (KINEMATICS == KINE_LINEAR_DELTA)
+    _kinematics_init();
+#endif
+}
+
+/*
+ * kn_forward_kinematics() - wrapper routine for forward kinematics
  *
  * This is designed for PRECISION, not PERFORMANCE!
  *
- * This function is NOT to be used where high-speed is important. If that becomes the case,
- * there are many opportunities for caching and optimization for performance here.
+ * Each joint is taken from the best resolution motor(s) mapped to it, then transformed
+ * into axis positions. This function is NOT to be used where high-speed is important.
  */
 
 void kn_forward_kinematics(const float steps[], float travel[]) {
-    float best_steps_per_unit[AXES];
+    float joint[AXES];
+    const knMotorMap_t *m = kn_active;
 
-    // Setup
     for (uint8_t axis = 0; axis < AXES; axis++) {
-        travel[axis]              = 0.0;
-        best_steps_per_unit[axis] = -1.0;
+        joint[axis] = 0.0;
+    }
+    for (uint8_t i = 0; i < m->motors; i++) {
+        joint[m->axis[i]] += steps[m->motor[i]] * m->forward_scale[i];
     }
+    _forward_kinematics(joint, travel);
 
-    // Scan through each axis then through each motor
     for (uint8_t axis = 0; axis < AXES; axis++) {
         if (cm->a[axis].axis_mode == AXIS_INHIBITED) {
             travel[axis] = 0.0;
-            continue;
-        }
-        for (uint8_t motor = 0; motor < MOTORS; motor++) {
-            if (st_cfg.mot[motor].motor_map == axis) {
-                // If this motor has a better (or the only) resolution, then use this motor's value
-                if (best_steps_per_unit[axis] < st_cfg.mot[motor].steps_per_unit) {
-                    best_steps_per_unit[axis] = st_cfg.mot[motor].steps_per_unit;
-                    travel[axis]              = steps[motor] * st_cfg.mot[motor].units_per_step;
-                } // If a second motor has the same resolution for the same axis average their values
-                else if (fp_EQ(best_steps_per_unit[axis], st_cfg.mot[motor].steps_per_unit)) {
-                    travel[axis] = (travel[axis] + (steps[motor] * st_cfg.mot[motor].units_per_step)) / 2.0;
-                }
-            }
         }
     }
 }
@@ -28,10 +28,58 @@
 #ifndef KINEMATICS_H_ONCE
 #define KINEMATICS_H_ONCE
 
+/*
+ * Kinematics models
+ *
+ *  The model is selected at compile time by defining KINEMATICS in the settings file
+ *  (settings_default.h makes it KINE_CARTESIAN). Inverse kinematics runs once per
+ *  segment in the exec interrupt, transforming the Cartesian target into joint positions
+ *  that are then mapped to motors as usual - a motor mapped to X drives joint X, etc.
+ *  Joints move linearly within a segment, which is what makes the short segments a good
+ *  enough approximation of the true path on the non-linear models.
+ *
+ *    KINE_CARTESIAN    joints are the axes
+ *    KINE_COREXY       joint X = X + Y, joint Y = X - Y
+ *    KINE_HBOT         same transform as CoreXY. The machines differ in belt routing, not math
+ *    KINE_SCARA        joint X = shoulder angle, joint Y = elbow angle, both in degrees.
+ *                      Shoulder is at the XY origin, 0 degrees points along +X, CCW is positive.
+ *                      Set travel per rev of the X and Y motors in degrees (360 / gear ratio)
+ *    KINE_LINEAR_DELTA joints X, Y and Z are the carriage heights of towers A, B and C, at 210,
+ *                      330 and 90 degrees around the Z axis. Z is the effector height
+ *
+ *  Axes beyond the ones a model uses (Z for the XY models, A, B, C...) pass through.
+ *  Homing and probing run in Cartesian space on every model, so they only make sense on
+ *  the models where each axis has its own limit switch travel (Cartesian, CoreXY, H-bot).
+ *
+ *  Trig and geometry that do not change are computed once by kinematics_init(). The
+ *  worst-case cost of a segment, including kinematics, is reported in the _pf group
+ *  (see planner.h, Planner Profiling).
+ */
+
+#define KINE_CARTESIAN      0
+#define KINE_COREXY         1
+#define KINE_HBOT           2
+#define KINE_SCARA          3
+#define KINE_LINEAR_DELTA   4
+
+/*
+ * Motor mapping
+ *
+ *  Joints are converted to motor steps (and back) through a table of the motors that
+ *  are mapped to an axis, so the per-segment work is a single pass over those motors.
+ *  The table is rebuilt by kn_config_changed(), which must be called whenever motor
+ *  mapping (ma), steps per unit (su, sa, tr, mi) or an axis mode (am) changes.
+ *
+ *  Rebuilds run in the main loop while segments may be running, so the new table is
+ *  built in the idle half of a pair and swapped in with a single pointer write.
+ */
+
 /*
  * Global Scope Functions
  */
 
+void kinematics_init(void);
+void kn_config_changed(void);
 void kn_inverse_kinematics(const float travel[], float steps[]);
 void kn_forward_kinematics(const float steps[], float travel[]);
 
@@ -30,12 +30,14 @@
 #include "report.h"
 #include "planner.h"
 #include "stepper.h"
+#include "kinematics.h"
 #include "coolant.h"
 #include "encoder.h"
 #include "spindle.h"
 #include "temperature.h"
 #include "gpio.h"
 #include "pwm.h"
+#include "special_functions.h"
 #include "xio.h"
 
 #include "util.h"
@@ -110,6 +112,7 @@ void application_init_machine(void)
     encoder_init();                     // virtual encoders
     gpio_init();                        // inputs and outputs
     pwm_init();                         // pulse width modulation drivers
+    kinematics_init();                  // kinematics model geometry. The motor map is built by config_init()
     canonical_machine_inits();          // combined inits for CMs and planner
 }
 
@@ -126,6 +129,9 @@ void application_init_startup(void)
     coolant_reset();
     temperature_init();
     gpio_reset();
+#ifdef SPECIAL_FUNCTIONS
+    sf_init();                          // start the rules engine - after config_init()
+#endif
 }
 
 /*
@@ -530,7 +530,9 @@ void marlin_response(const stat_t status, char *buf)
         request_resend = true;
     }
     else {
-        str += sprintf(str, "Error:%s", get_status_message(status));
+        str_concat(str, "Error:");
+        strcpy(str, get_status_message(status));
+        str += strlen(str);
     }
 
     *str++ = '\n';
@@ -28,7 +28,7 @@
 #include "persistence.h"
 #include "canonical_machine.h"
 #include "report.h"
-//#include "util.h"
+#include "util.h"
 
 /***********************************************************************************
  **** STRUCTURE ALLOCATIONS ********************************************************
@@ -36,29 +36,469 @@
 
 nvmSingleton_t nvm;
 
+/***********************************************************************************
+ **** FLASH BACKEND ****************************************************************
+ ***********************************************************************************/
+/*
+ *  The flash backend is the only hardware-specific part of persistence. It provides
+ *  a read pointer to the log area and a page write. Pages are written through the
+ *  EEFC latch buffer. Appends use Write Page (no erase). Unused words are written
+ *  as 0xFF so they stay erased. Moving to the other half uses Erase and Write Page.
+ *
+ *  The command and the wait for completion run from RAM with interrupts disabled.
+ *  Code can't be fetched from a flash bank while it's being programmed, and we
+ *  don't know which bank the ISRs live in, so there is nothing narrower to mask.
+ *  To keep that stall off the machine each command is a single page (a few ms),
+ *  persistence_commit() does at most one page per controller pass, and it won't
+ *  write at all while the machine is in a cycle.
+ */
+
+#if defined(__SAM3X8E__) || defined(__SAM3X8C__)
+#define NVM_AVAILABLE
+
+#define NVM_FIRST_PAGE ((IFLASH1_SIZE / IFLASH1_PAGE_SIZE) - (NVM_HALF_PAGES * 2)) // page number in bank 1
+#define NVM_BASE ((const uint8_t *)(IFLASH1_ADDR + (NVM_FIRST_PAGE * IFLASH1_PAGE_SIZE)))
+
+#define NVM_FCMD_WP  0x01           // write page
+#define NVM_FCMD_EWP 0x03           // erase page and write page
+#define NVM_FCMD_CLB 0x09           // clear lock bit
+
+static_assert(NVM_PAGE_SIZE == IFLASH1_PAGE_SIZE, "NVM_PAGE_SIZE must match the flash page size");
+
+__attribute__ ((long_call, section (".ramfunc")))
+static uint32_t _flash_command(const uint32_t command, const uint32_t page)
+{
+    uint32_t status;
+
+    __disable_irq();
+    EFC1->EEFC_FCR = EEFC_FCR_FKEY(0x5A) | EEFC_FCR_FARG(page) | EEFC_FCR_FCMD(command);
+    while (((status = EFC1->EEFC_FSR) & EEFC_FSR_FRDY) == 0);
+    __enable_irq();
+    return (status);
+}
+
+static void _flash_unlock()
+{
+    for (uint32_t page = 0; page < (NVM_HALF_PAGES * 2); page += (IFLASH1_LOCK_REGION_SIZE / IFLASH1_PAGE_SIZE)) {
+        _flash_command(NVM_FCMD_CLB, NVM_FIRST_PAGE + page);
+    }
+}
+
+static stat_t _flash_write_page(const uint16_t page, const uint32_t *data, const bool erase)
+{
+    volatile uint32_t *latch = (volatile uint32_t *)(NVM_BASE + (page * NVM_PAGE_SIZE));
+    for (uint16_t i=0; i < NVM_PAGE_SIZE/sizeof(uint32_t); i++) {
+        latch[i] = data[i];
+    }
+    uint32_t status = _flash_command((erase ? NVM_FCMD_EWP : NVM_FCMD_WP), NVM_FIRST_PAGE + page);
+    if (status & (EEFC_FSR_FCMDE | EEFC_FSR_FLOCKE)) {
+        return (STAT_PERSISTENCE_ERROR);
+    }
+    return (STAT_OK);
+}
+#endif // __SAM3X8E__ || __SAM3X8C__
+
 /***********************************************************************************
  **** GENERIC STATIC FUNCTIONS AND VARIABLES ***************************************
  ***********************************************************************************/
 
+#ifdef NVM_AVAILABLE
+
+static uint32_t _page_buf[NVM_PAGE_SIZE/sizeof(uint32_t)];  // page image being built for a write
+static uint32_t _head_buf[NVM_PAGE_SIZE/sizeof(uint32_t)];  // first page of a half - written last
+
+static_assert(sizeof(nvmRecord_t) == NVM_RECORD_SIZE, "nvmRecord_t must be NVM_RECORD_SIZE bytes");
+static_assert(sizeof(nvmHeader_t) == NVM_RECORD_SIZE, "nvmHeader_t must be NVM_RECORD_SIZE bytes");
+
+static const nvmRecord_t *_slot(const uint8_t half, const uint16_t slot)
+{
+    return ((const nvmRecord_t *)(NVM_BASE + (half * NVM_HALF_PAGES * NVM_PAGE_SIZE)) + slot);
+}
+
+static uint32_t _record_check(const nvmRecord_t *r)
+{
+    const uint32_t *w = (const uint32_t *)r;
+    return (~(w[0] + w[1] + w[2]));
+}
+
+static uint32_t _header_check(const nvmHeader_t *h)
+{
+    return (~(h->magic + h->sequence + h->layout));
+}
+
+static bool _header_is_valid(const nvmHeader_t *h)
+{
+    return ((h->magic == NVM_MAGIC) && (h->check == _header_check(h)));
+}
+
+static bool _record_is_erased(const nvmRecord_t *r)
+{
+    return ((uint8_t)r->token[0] == 0xFF);
+}
+
+static bool _record_is_valid(const nvmRecord_t *r)
+{
+    return (!_record_is_erased(r) && (r->check == _record_check(r)));
+}
+
+// FNV-1a hash of the cfgArray tokens in table order - changes if anything is added, removed or moved
+static uint32_t _layout_hash()
+{
+    uint32_t hash = 2166136261UL;
+    for (index_t i=0; i < nv_index_max(); i++) {
+        for (const char *c = cfgArray[i].token; *c != NUL; c++) {
+            hash = (hash ^ (uint8_t)*c) * 16777619UL;
+        }
+        hash = (hash ^ ',') * 16777619UL;
+    }
+    return (hash);
+}
+
+// build a record in place (dst must be a RAM page image)
+static void _make_record(nvmRecord_t *dst, const char *token, const uint32_t value)
+{
+    memset(dst->token, 0, sizeof(dst->token));
+    strncpy(dst->token, token, TOKEN_LEN);
+    dst->value = value;
+    dst->check = _record_check(dst);
+}
+
+// latest record for an index in the active half, or NULL
+static const nvmRecord_t *_find_record(const index_t index)
+{
+    if (cfgSlot[index] == 0) {
+        return (NULL);
+    }
+    return (_slot(nvm.active, cfgSlot[index]));
+}
+
+// rebuild cfgSlot[] from the active half. Later records overwrite earlier ones
+static void _index_log()
+{
+    memset(cfgSlot, 0, nv_index_max() * sizeof(uint16_t));
+    if (nvm.active == NVM_NO_HALF) {
+        return;
+    }
+    for (uint16_t slot = 1; slot < nvm.next; slot++) {
+        const nvmRecord_t *r = _slot(nvm.active, slot);
+        if (!_record_is_valid(r)) {
+            continue;
+        }
+        index_t index = nv_get_index((const char *)"", r->token);
+        if ((index != NO_MATCH) && (cfgArray[index].flags & F_PERSIST)) {
+            cfgSlot[index] = slot;                  // tokens no longer in cfgArray are left out
+        }
+    }
+}
+
+// latest pending write for an index, or NULL
+static nvmCacheEntry_t *_find_cached(const index_t index)
+{
+    for (uint8_t i = nvm.cache_len; i > 0; i--) {
+        if (nvm.cache[i-1].index == index) {
+            return (&nvm.cache[i-1]);
+        }
+    }
+    return (NULL);
+}
+
+// drop the first count pending writes - they are in flash now
+static void _drop_cached(const uint8_t count)
+{
+    nvm.cache_len -= count;
+    memmove(&nvm.cache[0], &nvm.cache[count], nvm.cache_len * sizeof(nvmCacheEntry_t));
+}
+
+/*
+ * _move_start() - start copying the live records and pending writes into the other half
+ * _move_step()  - build and write the next page of the other half
+ *
+ *  The source is the pending writes that were in the cache when the move started, then
+ *  the latest record of each index in cfgSlot[]. cfgMark[] has a bit for each index
+ *  already copied so a pending write hides the record it replaces.
+ *
+ *  Each step erases and writes one page. The header page is held in _head_buf and goes
+ *  last - it commits the move. Until then the current half stays active, reads are
+ *  served from it and the cache, and new writes go to the cache behind the ones being
+ *  moved. Those are appended once the move is done.
+ */
+static void _move_start()
+{
+    nvm.moving = (nvm.active == NVM_NO_HALF) ? 0 : (nvm.active ^ 1);
+    nvm.move_cache = nvm.cache_len;
+    nvm.move_next = 0;
+    nvm.move_slot = 1;
+    nvm.move_page = 0;
+    memset(cfgMark, 0, (nv_index_max() + 7) / 8);
+    memset(_head_buf, 0xFF, sizeof(_head_buf));
+    memset(_page_buf, 0xFF, sizeof(_page_buf));
+}
+
+// next live record for the half being built. Returns false when the source is used up
+static bool _move_next_record(index_t *index, uint32_t *value)
+{
+    uint16_t end = nvm.move_cache + nv_index_max();
+
+    while (nvm.move_next < end) {
+        uint16_t n = nvm.move_next++;
+        if (n < nvm.move_cache) {
+            *index = nvm.cache[n].index;
+            *value = nvm.cache[n].value;
+        } else {
+            *index = n - nvm.move_cache;
+            if (cfgSlot[*index] == 0) {
+                continue;
+            }
+            *value = _slot(nvm.active, cfgSlot[*index])->value;
+        }
+        if (cfgMark[*index / 8] & (1 << (*index % 8))) {
+            continue;                               // superseded by a pending write
+        }
+        cfgMark[*index / 8] |= (1 << (*index % 8));
+        return (true);
+    }
+    return (false);
+}
+
+static stat_t _move_step()
+{
+    index_t index;
+    uint32_t value;
+
+    if (nvm.move_page < NVM_HALF_PAGES) {
+        uint32_t *buf = (nvm.move_page == 0) ? _head_buf : _page_buf;
+        uint16_t page_end = (nvm.move_page + 1) * NVM_RECORDS_PER_PAGE;
+        while ((nvm.move_slot < page_end) && _move_next_record(&index, &value)) {
+            _make_record((nvmRecord_t *)buf + (nvm.move_slot % NVM_RECORDS_PER_PAGE), cfgArray[index].token, value);
+            nvm.move_slot++;
+        }
+        if (nvm.move_page > 0) {                    // also erases the pages past the last record
+            ritorno(_flash_write_page((nvm.moving * NVM_HALF_PAGES) + nvm.move_page, _page_buf, true));
+            memset(_page_buf, 0xFF, sizeof(_page_buf));
+        }
+        nvm.move_page++;
+        return (STAT_EAGAIN);
+    }
+    if (_move_next_record(&index, &value)) {
+        return (STAT_PERSISTENCE_ERROR);            // live records don't fit in a half
+    }
+
+    nvmHeader_t *h = (nvmHeader_t *)_head_buf;
+    h->magic = NVM_MAGIC;
+    h->sequence = (nvm.active == NVM_NO_HALF) ? 1 : nvm.sequence + 1;
+    h->layout = _layout_hash();
+    h->check = _header_check(h);
+    ritorno(_flash_write_page(nvm.moving * NVM_HALF_PAGES, _head_buf, true));
+
+    nvm.active = nvm.moving;
+    nvm.sequence = h->sequence;
+    nvm.layout = h->layout;
+    nvm.next = nvm.move_slot;
+    nvm.moving = NVM_NO_HALF;
+    _drop_cached(nvm.move_cache);
+    nvm.move_cache = 0;
+    _index_log();
+    return ((nvm.cache_len > 0) ? STAT_EAGAIN : STAT_OK);
+}
+
+// append pending writes to the end of the active half - one page per call
+static stat_t _append_step()
+{
+    uint16_t page = nvm.next / NVM_RECORDS_PER_PAGE;
+    uint16_t slot = nvm.next;
+    uint8_t count = 0;
+
+    memset(_page_buf, 0xFF, sizeof(_page_buf));
+    while ((count < nvm.cache_len) && (slot / NVM_RECORDS_PER_PAGE == page)) {
+        _make_record((nvmRecord_t *)_page_buf + (slot % NVM_RECORDS_PER_PAGE),
+                     cfgArray[nvm.cache[count].index].token, nvm.cache[count].value);
+        slot++;
+        count++;
+    }
+    ritorno(_flash_write_page((nvm.active * NVM_HALF_PAGES) + page, _page_buf, false));
+    for (uint16_t s = nvm.next; s < slot; s++) {    // records on this page are now in flash
+        cfgSlot[nvm.cache[s - nvm.next].index] = s;
+    }
+    nvm.next = slot;
+    _drop_cached(count);
+    return ((nvm.cache_len > 0) ? STAT_EAGAIN : STAT_OK);
+}
+
+static uint32_t _get_raw_value(nvObj_t *nv)
+{
+    uint8_t type = cfgArray[nv->index].flags & F_TYPE_MASK;
+    if ((type == TYPE_INTEGER) || (type == TYPE_BOOLEAN)) {
+        return ((uint32_t)nv->value_int);
+    }
+    uint32_t value;                                 // floats and blind data
+    memcpy(&value, &nv->value_flt, sizeof(value));
+    return (value);
+}
+
+static void _set_raw_value(nvObj_t *nv, const uint32_t value)
+{
+    uint8_t type = cfgArray[nv->index].flags & F_TYPE_MASK;
+    if ((type == TYPE_INTEGER) || (type == TYPE_BOOLEAN)) {
+        nv->value_int = (int32_t)value;
+    } else {
+        memcpy(&nv->value_flt, &value, sizeof(value));
+    }
+}
 
 /***********************************************************************************
  **** CODE *************************************************************************
  ***********************************************************************************/
 
+/*
+ * persistence_init() - find the active half and the end of its log
+ *
+ *  cfgSlot[] needs the token index, so it's built later by persistence_restore().
+ */
+
 void persistence_init()
 {
-    return;
+    _flash_unlock();
+    nvm.active = NVM_NO_HALF;
+    nvm.moving = NVM_NO_HALF;
+    nvm.move_cache = 0;
+    nvm.cache_len = 0;
+    nvm.suspended = false;
+
+    for (uint8_t half=0; half < 2; half++) {
+        const nvmHeader_t *h = (const nvmHeader_t *)_slot(half, 0);
+        if (_header_is_valid(h) && ((nvm.active == NVM_NO_HALF) || ((int32_t)(h->sequence - nvm.sequence) > 0))) {
+            nvm.active = half;
+            nvm.sequence = h->sequence;
+            nvm.layout = h->layout;
+        }
+    }
+    if (nvm.active == NVM_NO_HALF) {
+        return;
+    }
+    for (nvm.next = 1; nvm.next < NVM_HALF_SLOTS; nvm.next++) {  // torn records are skipped but still use a slot
+        if (_record_is_erased(_slot(nvm.active, nvm.next))) {
+            break;
+        }
+    }
 }
 
 /*
- * read_persistent_value()	- return value (as float) by index
+ * persistence_suspend() - ignore writes until persistence_restore() or persistence_clear()
+ * persistence_restore() - apply persisted values on top of the defaults in a single pass
+ * persistence_clear()   - drop all persisted values, leaving the defaults that were just loaded
+ *
+ *  Restore indexes the log into cfgSlot[], then sets each index that has a record once,
+ *  with its latest value, in cfgArray order. Records for tokens that are no longer in
+ *  cfgArray are skipped.
+ *
+ *  The status report list (se00 - se39) holds cfgArray indexes. If the cfgArray layout
+ *  changed since the log was written these are meaningless, so the report is reset
+ *  to its defaults instead.
+ *
+ *  Clear is for $defa. Rather than logging every default it forgets every record, and
+ *  the next commit moves to the other half with only the writes made after it.
+ */
+
+void persistence_suspend()
+{
+    nvm.suspended = true;
+}
+
+void persistence_restore(nvObj_t *nv)
+{
+    nvm.suspended = true;
+    _index_log();
+    for (nv->index = 0; nv->index < nv_index_max(); nv->index++) {
+        const nvmRecord_t *r = _find_record(nv->index);
+        if (r == NULL) {
+            continue;
+        }
+        strncpy(nv->token, cfgArray[nv->index].token, TOKEN_LEN);
+        _set_raw_value(nv, r->value);
+        cfgArray[nv->index].set(nv);
+    }
+    nvm.suspended = false;
+    if ((nvm.active != NVM_NO_HALF) && (nvm.layout != _layout_hash())) {
+        sr_init_status_report();                    // indexes in the persisted SR list are stale
+    }
+}
+
+void persistence_clear()
+{
+    memset(cfgSlot, 0, nv_index_max() * sizeof(uint16_t));
+    nvm.cache_len = 0;
+    _move_start();                                  // (re)starts an empty move - restarts one under way
+    nvm.last_write = SysTickTimer_getValue();
+    nvm.suspended = false;
+}
+
+/*
+ * persistence_commit() - write pending values to flash, one page per call
+ *
+ *  Returns STAT_EAGAIN until everything pending is in flash, so call it once per
+ *  controller pass. Does nothing while the machine is in a cycle - a move to the
+ *  other half that is under way picks up where it left off once the cycle ends.
+ *
+ *  Pending writes wait until no value has been written for NVM_COMMIT_DELAY_MS, so a
+ *  value that is set over and over (HMI data in uda0 - udd3, say) stays in the cache
+ *  and reaches flash once it settles instead of on every set.
+ *
+ *  Moves to the other half if the pending records don't fit in the active one.
+ *  On a write failure the pending values are dropped so the failure isn't retried forever.
+ */
+
+static stat_t _commit(const bool now)
+{
+    if (cm->cycle_type != CYCLE_NONE) {             // never stall the ISRs while the machine is moving
+        return (STAT_OK);
+    }
+    if (nvm.moving == NVM_NO_HALF) {
+        if (nvm.cache_len == 0) {
+            return (STAT_OK);
+        }
+        if (!now && ((SysTickTimer_getValue() - nvm.last_write) < NVM_COMMIT_DELAY_MS)) {
+            return (STAT_OK);
+        }
+        if ((nvm.active == NVM_NO_HALF) || ((nvm.next + nvm.cache_len) > NVM_HALF_SLOTS)) {
+            _move_start();
+        }
+    }
+    stat_t status = (nvm.moving != NVM_NO_HALF) ? _move_step() : _append_step();
+    if ((status == STAT_OK) || (status == STAT_EAGAIN)) {
+        return (status);
+    }
+    nvm.moving = NVM_NO_HALF;
+    nvm.move_cache = 0;
+    nvm.cache_len = 0;
+    _index_log();
+    return (rpt_exception(status, "persistence_commit() flash write failed"));
+}
+
+stat_t persistence_commit()
+{
+    return (_commit(false));
+}
+
+/*
+ * read_persistent_value()	- return the persisted value by index
  *
  *	It's the responsibility of the caller to make sure the index does not exceed range
  */
 
 stat_t read_persistent_value(nvObj_t *nv)
 {
-    nv->value_flt = 0;
+    nvmCacheEntry_t *c = _find_cached(nv->index);
+    if (c != NULL) {
+        _set_raw_value(nv, c->value);
+        return (STAT_OK);
+    }
+    const nvmRecord_t *r = _find_record(nv->index);
+    if (r == NULL) {
+        nv->value_flt = 0;
+        nv->value_int = 0;
+        return (STAT_PERSISTENCE_ERROR);
+    }
+    _set_raw_value(nv, r->value);
     return (STAT_OK);
 }
 
@@ -67,12 +507,67 @@ stat_t read_persistent_value(nvObj_t *nv)
  *
  *	It's the responsibility of the caller to make sure the index does not exceed range
  *	Note: Removed NAN and INF checks on floats - not needed
+ *
+ *  The value goes into the RAM cache and is committed later by persistence_commit().
+ *  If the cache is full it's committed now, unless the machine is in cycle. Pending
+ *  writes that are being copied by a move to the other half are not updated in place.
  */
 
 stat_t write_persistent_value(nvObj_t *nv)
 {
-//    if (cm->cycle_state != CYCLE_OFF) { // can't write when machine is moving
-//        return(rpt_exception(STAT_FILE_NOT_OPEN, "write_persistent_value() can't write when machine is in cycle"));
-//    }
+    if (nvm.suspended) {
+        return (STAT_OK);
+    }
+    uint32_t value = _get_raw_value(nv);
+
+    nvmCacheEntry_t *c = _find_cached(nv->index);
+    if (c != NULL) {
+        if (c->value == value) {
+            return (STAT_OK);                       // unchanged
+        }
+        if ((c - nvm.cache) >= nvm.move_cache) {    // coalesce with a pending write
+            c->value = value;
+            nvm.last_write = SysTickTimer_getValue();
+            return (STAT_OK);
+        }
+    } else {
+        const nvmRecord_t *r = _find_record(nv->index);
+        if ((r != NULL) && (r->value == value)) {
+            return (STAT_OK);                       // unchanged
+        }
+    }
+    if (nvm.cache_len >= NVM_CACHE_LEN) {
+        if (cm->cycle_type != CYCLE_NONE) {         // can't write when machine is moving
+            return(rpt_exception(STAT_PERSISTENCE_ERROR, "write_persistent_value() cache full while in cycle"));
+        }
+        stat_t status;
+        while ((status = _commit(true)) == STAT_EAGAIN);
+        ritorno(status);
+    }
+    nvm.cache[nvm.cache_len].index = nv->index;
+    nvm.cache[nvm.cache_len].value = value;
+    nvm.cache_len++;
+    nvm.last_write = SysTickTimer_getValue();
+    return (STAT_OK);
+}
+
+#else // NVM_AVAILABLE
+
+void persistence_init() {}
+void persistence_suspend() {}
+void persistence_restore(nvObj_t *nv) {}
+void persistence_clear() {}
+stat_t persistence_commit() { return (STAT_OK); }
+
+stat_t read_persistent_value(nvObj_t *nv)
+{
+    nv->value_flt = 0;
+    return (STAT_OK);
+}
+
+stat_t write_persistent_value(nvObj_t *nv)
+{
     return (STAT_OK);
 }
+
+#endif // NVM_AVAILABLE
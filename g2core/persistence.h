@@ -30,22 +30,81 @@
 
 #include "config.h"  // needed for nvObj_t definition
 
-#define NVM_VALUE_LEN 4       // NVM value length (float, fixed length)
-#define NVM_BASE_ADDR 0x0000  // base address of usable NVM
+/*
+ *  Persistence is a log-structured key/value store in on-chip flash. Each record holds
+ *  a config token (the key) and its 32 bit value. Records are appended to the end of
+ *  the log, so the latest record for a token wins. The flash area is split into two
+ *  halves. When the active half is full, the live records are copied into the other
+ *  half, which then becomes active. This spreads erases across the whole area
+ *  (wear leveling). Each half starts with a header whose sequence number says which
+ *  half is newer. The header is written last, so a half that was interrupted
+ *  mid-copy is never used.
+ *
+ *  Writes go to a small RAM write-back cache and are committed to flash from
+ *  cm_deferred_write_callback() when no machining cycle is running and nothing has
+ *  been written for NVM_COMMIT_DELAY_MS. Flash writes stall the bus, so they must
+ *  never happen while the steppers are moving. cfgSlot[] holds the log slot of the
+ *  latest record for each cfgArray index, so lookups never scan flash.
+ *  On startup config_init() loads the defaults, then applies the log once on top.
+ *
+ *  Only SAM3X parts have the flash backend (upper end of flash bank 1). On other
+ *  parts persistence is a no-op, as before.
+ */
+
+#define NVM_HALF_PAGES 64           // flash pages in each half of the log (2 halves, 32K total)
+#define NVM_PAGE_SIZE 256           // flash page size in bytes
+#define NVM_CACHE_LEN 32            // pending writes held in RAM until committed
+#define NVM_COMMIT_DELAY_MS 5000    // pending writes wait until nothing has been written for this long
+#define NVM_MAGIC 0x314D564E        // "NVM1" - change this if the record layout changes
+
+#define NVM_RECORD_SIZE 16
+#define NVM_RECORDS_PER_PAGE (NVM_PAGE_SIZE / NVM_RECORD_SIZE)
+#define NVM_HALF_SLOTS (NVM_HALF_PAGES * NVM_RECORDS_PER_PAGE)  // slot 0 is the header
+#define NVM_NO_HALF 0xFF            // no valid half - the log is empty
+
+typedef struct nvmRecord {          // one key/value record - NVM_RECORD_SIZE bytes
+    char token[TOKEN_LEN+2];        // NUL padded token. Erased flash (0xFF) marks the end of the log
+    uint32_t value;                 // raw value - float or int32 depending on the cfgArray type
+    uint32_t check;                 // detects records torn by a reset during a write
+} nvmRecord_t;
+
+typedef struct nvmHeader {          // occupies slot 0 of each half - NVM_RECORD_SIZE bytes
+    uint32_t magic;                 // NVM_MAGIC
+    uint32_t sequence;              // incremented each time the log moves to the other half
+    uint32_t layout;                // hash of the cfgArray tokens when written - detects table layout changes
+    uint32_t check;
+} nvmHeader_t;
+
+typedef struct nvmCacheEntry {
+    index_t index;                  // cfgArray index of the pending value
+    uint32_t value;
+} nvmCacheEntry_t;
 
 //**** persistence singleton ****
 
 typedef struct nvmSingleton {
-    uint16_t base_addr;     // NVM base address
-    uint16_t profile_base;  // NVM base address of current profile]
-    uint16_t address;
-    float    tmp_value;
-    int8_t   byte_array[NVM_VALUE_LEN];
+    uint8_t active;                 // active half, or NVM_NO_HALF if the log is empty
+    uint32_t sequence;              // sequence number of the active half
+    uint32_t layout;                // cfgArray layout hash recorded in the active half
+    uint16_t next;                  // next free slot in the active half
+    uint8_t moving;                 // half being built by a move, or NVM_NO_HALF
+    uint8_t move_cache;             // pending writes (from the front of the cache) being moved
+    uint16_t move_next;             // position in the move's source - see _move_next_record()
+    uint16_t move_slot;             // next slot in the half being built
+    uint16_t move_page;             // next page of the half being built
+    uint32_t last_write;            // SysTick of the last write to the cache
+    bool suspended;                 // ignore writes while loading defaults and restoring
+    uint8_t cache_len;              // number of pending writes
+    nvmCacheEntry_t cache[NVM_CACHE_LEN];
 } nvmSingleton_t;
 
 //**** persistence function prototypes ****
 
 void persistence_init(void);
+void persistence_suspend(void);
+void persistence_restore(nvObj_t* nv);
+void persistence_clear(void);
+stat_t persistence_commit(void);
 stat_t read_persistent_value(nvObj_t* nv);
 stat_t write_persistent_value(nvObj_t* nv);
 
@@ -27,6 +27,8 @@
 // Local functions
 
 static stat_t _compute_arc(const bool radius_f);
+static void _compute_arc_segments(void);
+static bool _arc_is_single_block(void);
 static void _compute_arc_offsets_from_radius(void);
 static float _estimate_arc_time (float arc_time);
 static stat_t _test_arc_soft_limits(void);
@@ -38,6 +40,9 @@ static stat_t _test_arc_soft_limits(void);
  * cm_arc_feed()     - canonical machine entry point for arc
  * cm_arc_callback() - main-loop callback for arc generation
  * cm_abort_arc()    - stop an arc in process
+ *
+ *  Arcs are normally queued to the planner as a single arc block by mp_arc(). Arcs that
+ *  can't be (see _arc_is_single_block()) are generated as line segments by cm_arc_callback().
  */
 
 /*
@@ -93,8 +98,8 @@ stat_t cm_arc_callback(cmMachine_t *_cm)
 /*
  * cm_arc_feed() - canonical machine entry point for arcs
  *
- * Generates an arc by queuing line segments to the move buffer. The arc is
- * approximated by generating a large number of tiny, linear segments.
+ * Queues the arc to the planner as a single arc block, or if that's not possible
+ * sets up the arc to be approximated by a large number of tiny, linear segments.
  */
 
 stat_t cm_arc_feed(const float target[], const bool target_f[],     // target endpoint
@@ -251,9 +256,14 @@ stat_t cm_arc_feed(const float target[], const bool target_f[],     // target en
     }
 
     cm_cycle_start();                                       // if not already started
-    cm->arc.run_state = BLOCK_ACTIVE;                       // enable arc to be run from the callback
+    if (_arc_is_single_block()) {
+        status = mp_arc(&cm->gm, &cm->arc);                 // queue the whole arc as one block
+    } else {
+        _compute_arc_segments();
+        cm->arc.run_state = BLOCK_ACTIVE;                   // enable arc to be run from the callback
+    }
     cm_update_model_position();
-    return (STAT_OK);
+    return (status);
 }
 
 /*
@@ -339,7 +349,48 @@ static stat_t _compute_arc(const bool radius_f)
     cm->arc.linear_travel = cm->arc.gm.target[cm->arc.linear_axis] - cm->arc.position[cm->arc.linear_axis];
     cm->arc.planar_travel = cm->arc.angular_travel * cm->arc.radius;
     cm->arc.length = hypotf(cm->arc.planar_travel, fabs(cm->arc.linear_travel));
+    cm->arc.center_0 = cm->arc.position[cm->arc.plane_axis_0] - sin(cm->arc.theta) * cm->arc.radius;
+    cm->arc.center_1 = cm->arc.position[cm->arc.plane_axis_1] - cos(cm->arc.theta) * cm->arc.radius;
+    return (STAT_OK);
+}
 
+/*
+ * _arc_is_single_block() - true if the arc can be queued to the planner as one arc block
+ *
+ *  Arc blocks are interpolated in the planner's coordinate space, so the arc can't be
+ *  rotated on the way in (see mp_aline()), and only the arc axes may move.
+ */
+
+static bool _arc_is_single_block()
+{
+    for (uint8_t i=0; i<3; i++) {
+        for (uint8_t j=0; j<3; j++) {
+            float identity = (i == j) ? 1.0 : 0.0;
+            if (fp_NE(cm->rotation_matrix[i][j], identity)) {
+                return (false);
+            }
+        }
+    }
+    if (fp_NOT_ZERO(cm->rotation_z_offset)) {
+        return (false);
+    }
+    for (uint8_t axis=0; axis<AXES; axis++) {
+        if ((axis == cm->arc.plane_axis_0) || (axis == cm->arc.plane_axis_1) || (axis == cm->arc.linear_axis)) {
+            continue;
+        }
+        if (fp_NE(cm->arc.gm.target[axis], cm->arc.position[axis])) {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+/*
+ * _compute_arc_segments() - set up an arc to be run as line segments from cm_arc_callback()
+ */
+
+static void _compute_arc_segments()
+{
     // Find the minimum number of segments that meet accuracy and time constraints...
     // Note: removed segment_length test as segment_time accounts for this (build 083.37)
     float arc_time;
@@ -355,10 +406,7 @@ static stat_t _compute_arc(const bool radius_f)
     cm->arc.segment_count = (int32_t)cm->arc.segments;
     cm->arc.segment_theta = cm->arc.angular_travel / cm->arc.segments;
     cm->arc.segment_linear_travel = cm->arc.linear_travel / cm->arc.segments;
-    cm->arc.center_0 = cm->arc.position[cm->arc.plane_axis_0] - sin(cm->arc.theta) * cm->arc.radius;
-    cm->arc.center_1 = cm->arc.position[cm->arc.plane_axis_1] - cos(cm->arc.theta) * cm->arc.radius;
     cm->arc.gm.target[cm->arc.linear_axis] = cm->arc.position[cm->arc.linear_axis];    // initialize the linear target
-    return (STAT_OK);
 }
 
 /*
@@ -30,6 +30,7 @@
 #include "config.h"
 #include "controller.h"
 #include "planner.h"
+#include "plan_shaper.h"
 #include "kinematics.h"
 #include "stepper.h"
 #include "encoder.h"
@@ -43,8 +44,11 @@ static stat_t _exec_aline_head(mpBuf_t *bf); // passing bf because body might ne
 static stat_t _exec_aline_body(mpBuf_t *bf); // passing bf so that body can extend itself if the exit velocity rises.
 static stat_t _exec_aline_tail(mpBuf_t *bf);
 static stat_t _exec_aline_segment(void);
+static stat_t _exec_segment_steps(const float target[], const float segment_time, const bool settle);
 static void   _exec_aline_normalize_block(mpBlockRuntimeBuf_t *b);
 static stat_t _exec_aline_feedhold(mpBuf_t *bf);
+static void   _exec_arc_position(const float distance, float target[]);
+static float  _exec_remaining_length(void);
 
 static void _init_forward_diffs(float v_0, float v_1);
 
@@ -186,13 +190,14 @@ static stat_t _plan_aline(mpBuf_t *bf, float entry_velocity)
 
 stat_t mp_forward_plan()
 {
+    PROFILE_SCOPE(PROFILE_FWD_PLAN);
+
     mpBuf_t *bf = mp_get_run_buffer();
     float entry_velocity;
         
     // Case 0: Examine current running buffer for early exit conditions
     if (bf == NULL) {                               // case 0a: NULL means nothing is running - this is OK
-        st_prep_null();
-        return (STAT_NOOP);
+        return (STAT_NOOP);                         // nb: never write the prep queue from here - exec owns it
     }
     if (bf->buffer_state < MP_BUFFER_BACK_PLANNED) { // case 0b: nothing to do. get outta here.
         return (STAT_NOOP);
@@ -209,7 +214,7 @@ stat_t mp_forward_plan()
     // bf points to a command block; start cases 1f, 1g, 1h, 1i, 1j, 1k, 2c, 2d, 2e, 2h, 2i, 2j
     bool planned_something = false;
 
-    if (bf->block_type != BLOCK_TYPE_ALINE) {       // meaning it's a COMMAND
+    if (!mp_is_move_block(bf->block_type)) {        // meaning it's a COMMAND
         while (bf->block_type >= BLOCK_TYPE_COMMAND) {
             if (bf->buffer_state == MP_BUFFER_BACK_PLANNED) {
                 bf->buffer_state = MP_BUFFER_FULLY_PLANNED; // "planning" is just setting the state (for now)
@@ -218,14 +223,14 @@ stat_t mp_forward_plan()
             bf = bf->nx;
         }
         // Note: bf now points to the first non-command buffer past the command(s)
-        if ((bf->block_type == BLOCK_TYPE_ALINE) && (bf->buffer_state > MP_BUFFER_BACK_PLANNED )) { // case 1i
+        if (mp_is_move_block(bf->block_type) && (bf->buffer_state > MP_BUFFER_BACK_PLANNED )) { // case 1i
             entry_velocity = mr->r->exit_velocity;   // set entry_velocity for Note 1a
         }        
     } 
     // bf will always be on a non-command at this point - either a move or empty buffer
 
     // process move                           
-    if (bf->block_type == BLOCK_TYPE_ALINE) {           // do cases 1a - 1e; finish cases 1f - 1k
+    if (mp_is_move_block(bf->block_type)) {             // do cases 1a - 1e; finish cases 1f - 1k
         if (bf->buffer_state == MP_BUFFER_BACK_PLANNED) {// do 1a; finish 1f, 1j, 2d, 2i
             _plan_aline(bf, entry_velocity);
             planned_something = true;
@@ -243,7 +248,17 @@ stat_t mp_forward_plan()
 
 stat_t mp_exec_move()
 {
-    mpBuf_t *bf;
+    PROFILE_SCOPE(PROFILE_EXEC);
+
+    mpBuf_t *bf = mp_get_run_buffer();
+
+    // Let the input shaper catch up before running anything that expects motion to have stopped:
+    // the end of the queue, commands and dwells, and the end of a feedhold
+    if (mp_shaper_busy() && ((bf == NULL) || !mp_is_move_block(bf->block_type) ||
+                             (cm->hold_state == FEEDHOLD_MOTION_STOPPING))) {
+        PROFILE_SEGMENT_TIME(NOM_SEGMENT_TIME);
+        return (_exec_segment_steps(mr->position, NOM_SEGMENT_TIME, true));
+    }
 
     // It is possible to try to try to exec from a priming planner if coming off a hold
     // This occurs if new p1 commands (and were held back) arrived while in a hold
@@ -260,12 +275,12 @@ stat_t mp_exec_move()
     }
 
     // Getting a NULL buffer means nothing's running in the queue - this is OK
-    if ((bf = mp_get_run_buffer()) == NULL) {
+    if (bf == NULL) {
         st_prep_null();
         return (STAT_NOOP);
     }
 
-    if (bf->block_type == BLOCK_TYPE_ALINE) {           // cycle auto-start for lines only
+    if (mp_is_move_block(bf->block_type)) {             // cycle auto-start for lines and arcs only
         // first-time operations
 
         if (bf->buffer_state != MP_BUFFER_RUNNING) {
@@ -437,7 +452,8 @@ stat_t mp_exec_aline(mpBuf_t *bf)
             "mp_exec_aline() mr->exit_velocity > mr->r->cruise_velocity");
 
         // Start a new move by setting up the runtime singleton (mr)
-        memcpy(&mr->gm, &(bf->gm), sizeof(GCodeState_t));   // copy in the gcode model state
+        memcpy(&mr->gm, bf->gm, sizeof(GCodeState_t));     // copy in the gcode model state
+        sr_flag_change(SR_SOURCE_MODEL);                    // runtime model is the active model
         bf->block_state = BLOCK_ACTIVE;                     // note that this buffer is running
         mr->block_state = BLOCK_INITIAL_ACTION;             // note the planner doesn't look at block_state
 
@@ -453,8 +469,15 @@ stat_t mp_exec_aline(mpBuf_t *bf)
 
         // transfer move parameters from planner buffer to the runtime
         copy_vector(mr->unit, bf->unit);
-        copy_vector(mr->target, bf->gm.target);
+        copy_vector(mr->target, bf->gm->target);
         copy_vector(mr->axis_flags, bf->axis_flags);
+        mr->block_type = bf->block_type;
+        if (mr->block_type == BLOCK_TYPE_ARC) {
+            mr->arc = *bf->arc;
+            mr->arc_length = bf->length;
+            mr->arc_distance = 0;
+            mr->arc_linear_start = mr->position[mr->arc.linear_axis];
+        }
 
         mr->run_bf = bf;                                // DIAGNOSTIC: points to running bf
         mr->plan_bf = bf->nx;                           // DIAGNOSTIC: points to next bf to forward plan
@@ -470,10 +493,16 @@ stat_t mp_exec_aline(mpBuf_t *bf)
         }
 
         // generate the way points for position correction at section ends
-        for (uint8_t axis=0; axis<AXES; axis++) {
-            mr->waypoint[SECTION_HEAD][axis] = mr->position[axis] + mr->unit[axis] * mr->r->head_length;
-            mr->waypoint[SECTION_BODY][axis] = mr->position[axis] + mr->unit[axis] * (mr->r->head_length + mr->r->body_length);
-            mr->waypoint[SECTION_TAIL][axis] = mr->position[axis] + mr->unit[axis] * (mr->r->head_length + mr->r->body_length + mr->r->tail_length);
+        if (mr->block_type == BLOCK_TYPE_ARC) {
+            _exec_arc_position(mr->r->head_length, mr->waypoint[SECTION_HEAD]);
+            _exec_arc_position(mr->r->head_length + mr->r->body_length, mr->waypoint[SECTION_BODY]);
+            copy_vector(mr->waypoint[SECTION_TAIL], mr->target);   // land exactly on the end of the arc
+        } else {
+            for (uint8_t axis=0; axis<AXES; axis++) {
+                mr->waypoint[SECTION_HEAD][axis] = mr->position[axis] + mr->unit[axis] * mr->r->head_length;
+                mr->waypoint[SECTION_BODY][axis] = mr->position[axis] + mr->unit[axis] * (mr->r->head_length + mr->r->body_length);
+                mr->waypoint[SECTION_TAIL][axis] = mr->position[axis] + mr->unit[axis] * (mr->r->head_length + mr->r->body_length + mr->r->tail_length);
+            }
         }
     }
 
@@ -753,6 +782,7 @@ static stat_t _exec_aline_head(mpBuf_t *bf)
         mr->segments = ceil(uSec(mr->r->head_time) / NOM_SEGMENT_USEC);// # of segments for the section
         mr->segment_count = (uint32_t)mr->segments;
         mr->segment_time = mr->r->head_time / mr->segments; // time to advance for each segment
+        PROFILE_SEGMENT_TIME(mr->segment_time);
 
         if (mr->segment_count == 1) {
             // We will only have one segment, simply average the velocities
@@ -804,6 +834,7 @@ static stat_t _exec_aline_body(mpBuf_t *bf)
         float body_time = mr->r->body_time;
         mr->segments = ceil(uSec(body_time) / NOM_SEGMENT_USEC);
         mr->segment_time = body_time / mr->segments;
+        PROFILE_SEGMENT_TIME(mr->segment_time);
         mr->segment_velocity = mr->r->cruise_velocity;
         mr->segment_count = (uint32_t)mr->segments;
         if (mr->segment_time < MIN_SEGMENT_TIME) {
@@ -842,6 +873,7 @@ static stat_t _exec_aline_tail(mpBuf_t *bf)
         mr->segments = ceil(uSec(mr->r->tail_time) / NOM_SEGMENT_USEC);// # of segments for the section
         mr->segment_count = (uint32_t)mr->segments;
         mr->segment_time = mr->r->tail_time / mr->segments; // time to advance for each segment
+        PROFILE_SEGMENT_TIME(mr->segment_time);
 
         if (mr->segment_count == 1) {
             mr->segment_velocity = mr->r->tail_length / mr->segment_time;
@@ -877,8 +909,9 @@ static stat_t _exec_aline_tail(mpBuf_t *bf)
  *
  * NOTES ON STEP ERROR CORRECTION:
  *
- *  The commanded_steps are the target_steps delayed by one more segment.
- *  This lines them up in time with the encoder readings so a following error can be generated
+ *  The following error is computed by the loader as each segment starts, from the encoder and the
+ *  target_steps of the segment that just finished (see stepper.h, Prep queue). The copies in mr
+ *  are for display - commanded_steps is backed out of the encoder reading and the error.
  *
  *  The following_error term is positive if the encoder reading is greater than (ahead of)
  *  the commanded steps, and negative (behind) if the encoder reading is less than the
@@ -894,8 +927,6 @@ static stat_t _exec_aline_tail(mpBuf_t *bf)
 
 static stat_t _exec_aline_segment()
 {
-    float travel_steps[MOTORS];
-
     // Set target position for the segment
     // If the segment ends on a section waypoint synchronize to the head, body or tail end
     // Otherwise if not at a section waypoint compute target from segment time and velocity
@@ -903,6 +934,14 @@ static stat_t _exec_aline_segment()
 
     if ((--mr->segment_count == 0) && (cm->hold_state == FEEDHOLD_OFF)) {
         copy_vector(mr->gm.target, mr->waypoint[mr->section]);
+        if (mr->block_type == BLOCK_TYPE_ARC) {             // the section ends at a known distance along the arc
+            mr->arc_distance = mr->r->head_length;
+            if (mr->section != SECTION_HEAD) { mr->arc_distance += mr->r->body_length; }
+            if (mr->section == SECTION_TAIL) { mr->arc_distance += mr->r->tail_length; }
+        }
+    } else if (mr->block_type == BLOCK_TYPE_ARC) {         // arcs are interpolated along the curve
+        mr->arc_distance += mr->segment_velocity * mr->segment_time;
+        _exec_arc_position(mr->arc_distance, mr->gm.target);
     } else {
         float segment_length = mr->segment_velocity * mr->segment_time;
         // See https://en.wikipedia.org/wiki/Kahan_summation_algorithm
@@ -917,6 +956,37 @@ static stat_t _exec_aline_segment()
         }
     }
 
+    // Update the mb->run_time_remaining -- we know it's missing the current segment's time before it's loaded, that's ok.
+    mp->run_time_remaining -= mr->segment_time;
+    if (mp->run_time_remaining < 0) {
+        mp->run_time_remaining = 0.0;
+    }
+
+    ritorno(_exec_segment_steps(mr->gm.target, mr->segment_time, false));
+    copy_vector(mr->position, mr->gm.target);               // update position from target
+    if (mr->segment_count == 0) {
+        return (STAT_OK);                                   // this section has run all its segments
+    }
+    return (STAT_EAGAIN);                                   // this section still has more segments to run
+}
+
+/*********************************************************************************************
+ * _exec_segment_steps() - convert a segment target to steps and prep it for the steppers
+ *
+ *  Used by _exec_aline_segment() and for the settle segments mp_exec_move() runs while the
+ *  input shaper catches up to a stopped target (see plan_shaper.h). Settle segments don't
+ *  belong to a block - mr->run_bf may already have been freed and reused - so they are
+ *  flagged for the segment trace.
+ */
+
+static stat_t _exec_segment_steps(const float target[], const float segment_time, const bool settle)
+{
+    PROFILE_SEGMENT_SCOPE;
+    float travel_steps[MOTORS];
+    float shaped[AXES];
+
+    sr_flag_change(SR_SOURCE_RUNTIME);                  // mr->position moves on below
+
     // Convert target position to steps
     // Bucket-brigade the old target down the chain before getting the new target from kinematics
     //
@@ -925,16 +995,21 @@ static stat_t _exec_aline_segment()
     // Truncating the move contributes to positional error, but this is corrected by encoder feedback should
     // it ever accumulate to more than one step.
     //
-    // NB: The direct manipulation of steps to compute travel_steps only works for Cartesian kinematics.
-    //     Other kinematics may require transforming travel distance as opposed to simply subtracting steps.
+    // NB: Subtracting steps to compute travel_steps moves the joints in a straight line over the segment.
+    //     This is exact for linear kinematics (Cartesian, CoreXY, H-bot) and close enough for the others
+    //     because segments are short. See kinematics.h.
 
     for (uint8_t m=0; m<MOTORS; m++) {
-        mr->commanded_steps[m] = mr->position_steps[m];     // previous segment's position, delayed by 1 segment
         mr->position_steps[m] = mr->target_steps[m];        // previous segment's target becomes position
-        mr->encoder_steps[m] = en_read_encoder(m);          // get current encoder position (time aligns to commanded_steps)
-        mr->following_error[m] = mr->encoder_steps[m] - mr->commanded_steps[m];
+        mr->encoder_steps[m] = en_read_encoder(m);          // get current encoder position
+        mr->following_error[m] = st_pre.following_error[m]; // as of the last segment loaded
+        mr->commanded_steps[m] = mr->encoder_steps[m] - mr->following_error[m];
+    }
+    mp_shaper_segment(target, shaped, segment_time);        // shape the target (does nothing if no axis is shaped)
+    {
+        PROFILE_SCOPE(PROFILE_KINE);
+        kn_inverse_kinematics(shaped, mr->target_steps);    // now determine the target steps...
     }
-    kn_inverse_kinematics(mr->gm.target, mr->target_steps); // now determine the target steps...
 
     for (uint8_t m=0; m<MOTORS; m++) {                      // and compute the distances to be traveled
         travel_steps[m] = mr->target_steps[m] - mr->position_steps[m];
@@ -943,19 +1018,37 @@ static stat_t _exec_aline_segment()
         }
     }
 
-    // Update the mb->run_time_remaining -- we know it's missing the current segment's time before it's loaded, that's ok.
-    mp->run_time_remaining -= mr->segment_time;
-    if (mp->run_time_remaining < 0) {
-        mp->run_time_remaining = 0.0;
-    }
-
     // Call the stepper prep function
-    ritorno(st_prep_line(travel_steps, mr->following_error, mr->segment_time));
-    copy_vector(mr->position, mr->gm.target);               // update position from target
-    if (mr->segment_count == 0) {
-        return (STAT_OK);                                   // this section has run all its segments
+#ifdef __SEGMENT_TRACE
+    mp_trace_segment(travel_steps, mr->following_error, segment_time, settle);
+#endif
+    return (st_prep_line(mr->target_steps, travel_steps, segment_time));
+}
+
+/*********************************************************************************************
+ * _exec_arc_position() - position at a distance along the running arc
+ * _exec_remaining_length() - length left to run in the running block
+ *
+ *  Axes that are not part of the arc don't move, so they are taken from the target.
+ */
+
+static void _exec_arc_position(const float distance, float target[])
+{
+    float fraction = min(distance / mr->arc_length, (float)1.0);
+    float theta = mr->arc.theta + mr->arc.angular_travel * fraction;
+
+    memcpy(target, mr->target, sizeof(float) * AXES);
+    target[mr->arc.plane_axis_0] = mr->arc.center_0 + sin(theta) * mr->arc.radius;
+    target[mr->arc.plane_axis_1] = mr->arc.center_1 + cos(theta) * mr->arc.radius;
+    target[mr->arc.linear_axis]  = mr->arc_linear_start + mr->arc.linear_travel * fraction;
+}
+
+static float _exec_remaining_length()
+{
+    if (mr->block_type == BLOCK_TYPE_ARC) {
+        return (max(mr->arc_length - mr->arc_distance, (float)0.0));
     }
-    return (STAT_EAGAIN);                                   // this section still has more segments to run
+    return (get_axis_vector_length(mr->target, mr->position));
 }
 
 /*********************************************************************************************
@@ -1051,7 +1144,13 @@ static stat_t _exec_aline_feedhold(mpBuf_t *bf)
             
             // Otherwise setup the block to complete motion (regardless of how hold will ultimately be exited)      
             else { 
-                bf->length = get_axis_vector_length(mr->position, mr->target);  // update bf w/remaining length in move
+                bf->length = _exec_remaining_length();      // update bf w/remaining length in move
+                if ((bf->block_type == BLOCK_TYPE_ARC) && (mr->arc_length > 0)) {
+                    float fraction = mr->arc_distance / mr->arc_length;  // restart the arc from where it stopped
+                    bf->arc->theta += bf->arc->angular_travel * fraction;
+                    bf->arc->angular_travel -= bf->arc->angular_travel * fraction;
+                    bf->arc->linear_travel -= bf->arc->linear_travel * fraction;
+                }
                 
                 // If length ~= 0 it's because the deceleration was exact. Handle this exception to avoid planning errors
                 if (bf->length < EPSILON4) {
@@ -1119,7 +1218,7 @@ static stat_t _exec_aline_feedhold(mpBuf_t *bf)
         // enough (to EPSILON2) (1e). Case 1e happens frequently when the tail in the move was 
         // already planned to zero. EPSILON2 deals with floating point rounding errors that can 
         // mis-classify this case. EPSILON2 is 0.0001, which is 0.1 microns in length.
-        float available_length = get_axis_vector_length(mr->target, mr->position);
+        float available_length = _exec_remaining_length();
 
         // Cases (1b1, 1c1) deceleration will fit in the block
         if ((available_length + EPSILON2 - mr->r->tail_length) > 0) {
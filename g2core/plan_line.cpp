@@ -31,6 +31,7 @@
 #include "controller.h"
 #include "canonical_machine.h"
 #include "planner.h"
+#include "plan_arc.h"
 #include "stepper.h"
 #include "report.h"
 #include "util.h"
@@ -50,7 +51,7 @@ extern OutputPin<kDebug3_PinNumber> debug_pin3;
 // planner helper functions
 static mpBuf_t* _plan_block(mpBuf_t* bf);
 static void _calculate_override(mpBuf_t* bf);
-static void _calculate_jerk(mpBuf_t* bf);
+static void _calculate_jerk(mpBuf_t* bf, const float unit[]);
 static void _calculate_vmaxes(mpBuf_t* bf, const float axis_length[], const float axis_square[]);
 static void _calculate_junction_vmax(mpBuf_t* bf);
 
@@ -103,6 +104,268 @@ float mp_get_runtime_display_position(uint8_t axis) {
     }
 }
 
+/****************************************************************************************
+ * Line merging - coalesce runs of short, nearly collinear G1 moves before mp_aline()
+ *
+ * mp_merge_line()     - hold a feed move so the next one can be merged into it
+ * mp_merge_flush()    - queue the held move, if any
+ * mp_merge_discard()  - drop the held move (queue flush)
+ * mp_merge_callback() - queue the held move once it has waited MERGE_HOLD_MS
+ *
+ *  CAM output often arrives as long runs of tiny G1 segments that are nearly in line.
+ *  Each would take a planner buffer and a junction. With a merge tolerance set ({mlt:n})
+ *  cm_straight_feed() hands G1s to mp_merge_line(), which holds the latest one back. If the
+ *  next G1 has the same modal state, and every point absorbed so far (including the held
+ *  endpoint) stays within the tolerance of the straight line from the held move's start to
+ *  the new target - and in order along it - the held move is just extended to the new target.
+ *  Otherwise the held move is queued and the new one is held in its place.
+ *
+ *  Corner blending (G64 P<tolerance>) works on the same held move. When the held move is
+ *  queued because a new G1 arrived, the corner between the two is replaced by a tangent arc
+ *  block whose midpoint is path_tolerance from the corner: the held move is cut short at the
+ *  start of the arc and the new move starts at its end. The planner runs the arc at the
+ *  speed its curvature allows rather than slowing for a sharp junction. The arc is kept to
+ *  half of either move, so blends never overlap. Corners are only blended when both moves
+ *  lie in the XY, XZ or YZ plane, the coordinate space is not rotated (arc blocks can't
+ *  be), and the arc radius is at least MIN_ARC_RADIUS - otherwise the corner is left sharp.
+ *
+ *  Anything else that enters the primary planner queues the held move first, so ordering is
+ *  kept: mp_aline(), mp_arc(), every other mp_get_write_buffer() and planner position changes.
+ *  mp_merge_callback() sends it when the input stops. Moves made in the secondary planner
+ *  (during feedholds) and homing, probing and jogging moves are never held.
+ *
+ *  Points are kept in the model (pre-rotation) coordinates cm_straight_feed() works in.
+ *  Lines are held if either line merging or corner blending is on.
+ */
+
+typedef struct mpMergeStage {
+    bool pending;                       // a move is being held
+    uint8_t points;                     // points absorbed into the held move
+    GCodeState_t gm;                    // the held move - its target is the end of the merged path
+    float start[AXES];                  // model position the held move starts from
+    float point[MERGE_POINTS_MAX][AXES];// absorbed endpoints, in path order
+    Timeout hold_timeout;               // when to stop waiting for the next move
+} mpMergeStage_t;
+
+static mpMergeStage_t mg;
+
+// same modal state, and one that can be merged at all
+static bool _merge_compatible(const GCodeState_t *a, const GCodeState_t *b)
+{
+    if ((a->motion_mode != b->motion_mode) || (a->feed_rate_mode != b->feed_rate_mode) ||
+        (a->feed_rate != b->feed_rate) || (a->path_control != b->path_control) ||
+        (a->coord_system != b->coord_system) || (a->tool != b->tool) ||
+        (a->absolute_override != b->absolute_override)) {
+        return (false);
+    }
+    for (uint8_t axis = 0; axis < AXES; axis++) {
+        if (a->display_offset[axis] != b->display_offset[axis]) {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+// true if p is within the tolerance of the line from mg.start along the chord, and past *t_last
+static bool _merge_on_chord(const float p[], const float chord[], const float chord_sq, float *t_last)
+{
+    float dot = 0;
+    for (uint8_t axis = 0; axis < AXES; axis++) {
+        dot += (p[axis] - mg.start[axis]) * chord[axis];
+    }
+    float t = dot / chord_sq;
+    if ((t < *t_last) || (t > 1.0)) {   // the path has to keep going forward
+        return (false);
+    }
+    *t_last = t;
+    float dist_sq = 0;
+    for (uint8_t axis = 0; axis < AXES; axis++) {
+        dist_sq += square(p[axis] - mg.start[axis] - t * chord[axis]);
+    }
+    return (dist_sq <= square(cm->merge_tolerance));
+}
+
+static bool _merge_fits(const GCodeState_t *_gm)
+{
+    if ((mg.points >= MERGE_POINTS_MAX) || !_merge_compatible(&mg.gm, _gm)) {
+        return (false);
+    }
+    float chord[AXES];
+    float chord_sq = 0;
+    for (uint8_t axis = 0; axis < AXES; axis++) {
+        chord[axis] = _gm->target[axis] - mg.start[axis];
+        chord_sq += square(chord[axis]);
+    }
+    if (chord_sq < EPSILON) {
+        return (false);
+    }
+    float t = 0;
+    for (uint8_t i = 0; i < mg.points; i++) {
+        if (!_merge_on_chord(mg.point[i], chord, chord_sq, &t)) {
+            return (false);
+        }
+    }
+    return (_merge_on_chord(mg.gm.target, chord, chord_sq, &t));
+}
+
+// true if the coordinate space is not rotated - the same test plan_arc.cpp uses for arc blocks
+static bool _blend_unrotated()
+{
+    for (uint8_t i = 0; i < 3; i++) {
+        for (uint8_t j = 0; j < 3; j++) {
+            float identity = (i == j) ? 1.0 : 0.0;
+            if (fp_NE(cm->rotation_matrix[i][j], identity)) {
+                return (false);
+            }
+        }
+    }
+    return (fp_ZERO(cm->rotation_z_offset));
+}
+
+/*
+ * _blend_corner() - queue the held move with its corner into _gm rounded off by an arc
+ *
+ *  On return start[] is where the next move begins. Returns STAT_NOOP if the corner
+ *  can't be blended, in which case nothing was queued.
+ */
+
+static stat_t _blend_corner(const GCodeState_t *_gm, float start[])
+{
+    GCodeState_t *held = &mg.gm;
+    if ((held->path_control != PATH_CONTINUOUS) || (held->path_tolerance < EPSILON) || !_blend_unrotated()) {
+        return (STAT_NOOP);
+    }
+
+    // find the plane of the corner - only two of X, Y and Z may move
+    uint8_t moving = 0;
+    for (uint8_t axis = 0; axis < AXES; axis++) {
+        if (fp_NE(held->target[axis], mg.start[axis]) || fp_NE(_gm->target[axis], held->target[axis])) {
+            if (axis > AXIS_Z) {
+                return (STAT_NOOP);
+            }
+            moving |= (1 << axis);
+        }
+    }
+    cmAxes axis_0, axis_1, linear_axis;
+    switch (moving) {
+        case 0x03: { axis_0 = AXIS_X; axis_1 = AXIS_Y; linear_axis = AXIS_Z; break; }
+        case 0x05: { axis_0 = AXIS_X; axis_1 = AXIS_Z; linear_axis = AXIS_Y; break; }
+        case 0x06: { axis_0 = AXIS_Y; axis_1 = AXIS_Z; linear_axis = AXIS_X; break; }
+        default: { return (STAT_NOOP); }
+    }
+
+    // unit vectors in and out of the corner
+    float u_0 = held->target[axis_0] - mg.start[axis_0];
+    float u_1 = held->target[axis_1] - mg.start[axis_1];
+    float w_0 = _gm->target[axis_0] - held->target[axis_0];
+    float w_1 = _gm->target[axis_1] - held->target[axis_1];
+    float u_length = hypotf(u_0, u_1);
+    float w_length = hypotf(w_0, w_1);
+    if ((u_length < EPSILON) || (w_length < EPSILON)) {
+        return (STAT_NOOP);
+    }
+    u_0 /= u_length;  u_1 /= u_length;
+    w_0 /= w_length;  w_1 /= w_length;
+
+    // the arc turns through the deflection angle phi. With h = cos(phi/2) and s = sin(phi/2)
+    // an arc of radius r is trimmed back r*s/h along each move and passes r*(1-h)/h from the corner
+    float cos_phi = u_0 * w_0 + u_1 * w_1;
+    float h = sqrt((1 + cos_phi) / 2);
+    float s = sqrt((1 - cos_phi) / 2);
+    if ((s < EPSILON) || (h < EPSILON)) {               // straight on, or straight back
+        return (STAT_NOOP);
+    }
+    float trim = min3(held->path_tolerance * s / (1 - h), u_length / 2, w_length / 2);
+    float radius = trim * h / s;
+    if (radius < MIN_ARC_RADIUS) {
+        return (STAT_NOOP);
+    }
+
+    // cut the held move short at the start of the arc and queue it
+    float corner_0 = held->target[axis_0];
+    float corner_1 = held->target[axis_1];
+    held->target[axis_0] = corner_0 - trim * u_0;
+    held->target[axis_1] = corner_1 - trim * u_1;
+    ritorno(mp_aline(held));
+
+    // the center is radius off the start of the arc, towards the inside of the corner
+    float sin_phi = 2 * s * h;
+    cmArc_t arc;
+    arc.plane_axis_0 = axis_0;
+    arc.plane_axis_1 = axis_1;
+    arc.linear_axis = linear_axis;
+    arc.radius = radius;
+    arc.center_0 = held->target[axis_0] + radius * (w_0 - cos_phi * u_0) / sin_phi;
+    arc.center_1 = held->target[axis_1] + radius * (w_1 - cos_phi * u_1) / sin_phi;
+    arc.theta = atan2(held->target[axis_0] - arc.center_0, held->target[axis_1] - arc.center_1);
+    arc.angular_travel = 2 * atan2(s, h);               // theta runs clockwise from axis 1 - a left turn is negative
+    if ((u_0 * w_1 - u_1 * w_0) > 0) {
+        arc.angular_travel = -arc.angular_travel;
+    }
+    arc.linear_travel = 0;
+
+    held->target[axis_0] = corner_0 + trim * w_0;
+    held->target[axis_1] = corner_1 + trim * w_1;
+    memcpy(start, held->target, sizeof(float) * AXES);
+    return (mp_arc(held, &arc));
+}
+
+stat_t mp_merge_line(GCodeState_t *_gm, const float start[])
+{
+    bool blending = (_gm->path_control == PATH_CONTINUOUS) && (_gm->path_tolerance >= EPSILON);
+    if ((mp != &mp1) || ((cm->merge_tolerance < EPSILON) && !blending) ||
+        (_gm->feed_rate_mode == INVERSE_TIME_MODE) || (_gm->path_control == PATH_EXACT_STOP)) {
+        return (mp_aline(_gm));                         // not holding - mp_aline() sends any held move first
+    }
+    if (mg.pending && (cm->merge_tolerance >= EPSILON) && _merge_fits(_gm)) {
+        copy_vector(mg.point[mg.points++], mg.gm.target);   // absorb the held endpoint...
+        memcpy(&mg.gm, _gm, sizeof(GCodeState_t));      // ...and extend the held move to the new one
+        mg.hold_timeout.set(MERGE_HOLD_MS);
+        return (STAT_OK);
+    }
+    stat_t status = STAT_OK;
+    float next_start[AXES];
+    copy_vector(next_start, start);
+    if (mg.pending) {
+        mg.pending = false;
+        if ((status = _blend_corner(_gm, next_start)) == STAT_NOOP) {
+            status = mp_aline(&mg.gm);
+        }
+    }
+    memcpy(&mg.gm, _gm, sizeof(GCodeState_t));
+    copy_vector(mg.start, next_start);
+    mg.points = 0;
+    mg.pending = true;
+    mg.hold_timeout.set(MERGE_HOLD_MS);
+    return (status == STAT_MINIMUM_LENGTH_MOVE ? STAT_OK : status);
+}
+
+void mp_merge_flush()
+{
+    if (mg.pending && (mp == &mp1)) {
+        mg.pending = false;                             // clear first - mp_aline() calls back in here
+        mg.hold_timeout.clear();
+        if (mp_aline(&mg.gm) == STAT_MINIMUM_LENGTH_MOVE) {
+            if (!mp_has_runnable_buffer(mp)) {          // same as cm_straight_feed() - let the cycle end
+                cm_cycle_end();
+            }
+        }
+    }
+}
+
+void mp_merge_discard()
+{
+    mg.pending = false;
+    mg.hold_timeout.clear();
+}
+
+void mp_merge_callback()
+{
+    if (mg.pending && mg.hold_timeout.isPast()) {
+        mp_merge_flush();
+    }
+}
+
 /****************************************************************************************
  * mp_get_runtime_busy() - returns TRUE if motion control busy (i.e. robot is moving)
  * mp_runtime_is_idle()  - returns TRUE if steppers are not actively moving
@@ -112,6 +375,9 @@ float mp_get_runtime_display_position(uint8_t axis) {
  */
 bool mp_get_runtime_busy() 
 {
+    if (mg.pending) {                                   // a held line hasn't been queued yet
+        return (true);
+    }
     if (cm->cycle_type == CYCLE_NONE) {
         return (false);
     }
@@ -143,6 +409,9 @@ bool mp_runtime_is_idle() { return (!st_runtime_isbusy()); }
 
 stat_t mp_aline(GCodeState_t* _gm)
 {
+    mp_merge_flush();                                   // a held line goes first
+    PROFILE_SCOPE(PROFILE_ALINE);
+
     float target_rotated[]  = INIT_AXES_ZEROES;
     float axis_square[]     = INIT_AXES_ZEROES;
     float axis_length[]     = INIT_AXES_ZEROES;
@@ -203,7 +472,7 @@ stat_t mp_aline(GCodeState_t* _gm)
             axis_square[axis] = 0;  // Fix bug that can kill feedholds by corrupting block_time in _calculate_times 
         }
     }
-    length = sqrt(length_square);
+    length = fast_sqrt(length_square);
 
     // exit if the move has zero movement. At all.
 //    if (length < 0.00002) {  // this value is 2x EPSILON and prevents trap failures in _plan_aline()
@@ -218,8 +487,8 @@ stat_t mp_aline(GCodeState_t* _gm)
     if (bf == NULL) {                                   // never supposed to fail
         return (cm_panic(STAT_FAILED_GET_PLANNER_BUFFER, "aline()"));
     }
-    memcpy(&bf->gm, _gm, sizeof(GCodeState_t));
-    copy_vector(bf->gm.target, target_rotated);         // copy the rotated target in place
+    memcpy(bf->gm, _gm, sizeof(GCodeState_t));
+    copy_vector(bf->gm->target, target_rotated);        // copy the rotated target in place
 
     // setup the buffer
     bf->bf_func = mp_exec_aline;                        // register the callback to the exec function
@@ -229,16 +498,118 @@ stat_t mp_aline(GCodeState_t* _gm)
             bf->unit[axis] = axis_length[axis] / length;// nb: bf-> unit was cleared by mp_get_write_buffer()
         }
     }
-    _calculate_jerk(bf);                                // compute bf->jerk values
+    _calculate_jerk(bf, bf->unit);                      // compute bf->jerk values
     _calculate_vmaxes(bf, axis_length, axis_square);    // compute cruise_vmax and absolute_vmax
     _set_bf_diagnostics(bf);                            // DIAGNOSTIC
 
     // Note: these next lines must remain in exact order. Position must update before committing the buffer.
-    copy_vector(mp->position, bf->gm.target);           // update the planner position for the next move
+    copy_vector(mp->position, bf->gm->target);          // update the planner position for the next move
     mp_commit_write_buffer(BLOCK_TYPE_ALINE);           // commit current block (must follow the position update)
     return (STAT_OK);
 }
 
+/****************************************************************************************
+ * mp_arc() - plan an arc or helix as a single block
+ *
+ *  The arc is queued as one BLOCK_TYPE_ARC buffer that is planned like a line of the same
+ *  length and interpolated along the curve at runtime by mp_exec_aline(). This keeps the
+ *  look-ahead deep through arcs instead of filling the queue with short chords.
+ *
+ *  The differences from a line are:
+ *    - unit is the tangent at the start of the arc, and arc.exit_unit is the tangent at the
+ *      end, so junctions to the neighboring blocks see the true entry and exit directions
+ *    - jerk and axis rate limits use the largest share of the move each axis can take
+ *      somewhere along the arc, as the tangent sweeps through the plane
+ *    - velocity is limited so that the jerk of moving around the circle (v^3 / r^2)
+ *      does not exceed the jerk of the block
+ *
+ *  The caller must have already checked that the arc is in an unrotated coordinate space
+ *  and that no axes other than the arc plane and linear axes move (see cm_arc_feed()).
+ */
+
+stat_t mp_arc(GCodeState_t* _gm, const cmArc_t* _arc)
+{
+    mp_merge_flush();                                   // a held line goes first
+    PROFILE_SCOPE(PROFILE_ALINE);
+
+    float envelope[]    = INIT_AXES_ZEROES;             // largest unit vector component of each axis
+    float axis_length[] = INIT_AXES_ZEROES;
+    float axis_square[] = INIT_AXES_ZEROES;
+
+    float planar_travel = fabs(_arc->angular_travel * _arc->radius);
+    float length = hypotf(planar_travel, _arc->linear_travel);
+
+    if (length < 0.0001) {                              // same minimum as mp_aline()
+        sr_request_status_report(SR_REQUEST_TIMED_FULL);
+        return (STAT_MINIMUM_LENGTH_MOVE);
+    }
+
+    mpBuf_t* bf = mp_get_write_buffer();
+    if (bf == NULL) {                                   // never supposed to fail
+        return (cm_panic(STAT_FAILED_GET_PLANNER_BUFFER, "arc()"));
+    }
+    memcpy(bf->gm, _gm, sizeof(GCodeState_t));
+
+    // setup the buffer
+    mpArc_t *arc = bf->arc;
+    arc->plane_axis_0   = _arc->plane_axis_0;
+    arc->plane_axis_1   = _arc->plane_axis_1;
+    arc->linear_axis    = _arc->linear_axis;
+    arc->center_0       = _arc->center_0;
+    arc->center_1       = _arc->center_1;
+    arc->radius         = _arc->radius;
+    arc->theta          = _arc->theta;
+    arc->angular_travel = _arc->angular_travel;
+    arc->linear_travel  = _arc->linear_travel;
+    for (uint8_t axis = 0; axis < AXES; axis++) {       // nb: unlike bf->unit, exit_unit is not cleared by mp_get_write_buffer()
+        arc->exit_unit[axis] = 0;
+    }
+
+    bf->bf_func = mp_exec_aline;                        // arcs run through the line executor
+    bf->length = length;
+
+    // tangents at the start and end of the arc: d/ds of (sin(theta) * r, cos(theta) * r, linear)
+    float scale = arc->angular_travel * arc->radius / length;
+    float theta_end = arc->theta + arc->angular_travel;
+    bf->unit[arc->plane_axis_0] = cos(arc->theta) * scale;
+    bf->unit[arc->plane_axis_1] = -sin(arc->theta) * scale;
+    bf->unit[arc->linear_axis]  = arc->linear_travel / length;
+    arc->exit_unit[arc->plane_axis_0] = cos(theta_end) * scale;
+    arc->exit_unit[arc->plane_axis_1] = -sin(theta_end) * scale;
+    arc->exit_unit[arc->linear_axis]  = bf->unit[arc->linear_axis];
+
+    // limits are taken as if each plane axis could carry all of the planar travel
+    bf->axis_flags[arc->plane_axis_0] = true;
+    bf->axis_flags[arc->plane_axis_1] = true;
+    envelope[arc->plane_axis_0] = planar_travel / length;
+    envelope[arc->plane_axis_1] = planar_travel / length;
+    axis_length[arc->plane_axis_0] = planar_travel;
+    axis_length[arc->plane_axis_1] = planar_travel;
+    axis_square[arc->plane_axis_0] = square(planar_travel);  // axis_square only feeds the path length of the move
+    if ((bf->axis_flags[arc->linear_axis] = fp_NOT_ZERO(arc->linear_travel))) {
+        envelope[arc->linear_axis] = fabs(bf->unit[arc->linear_axis]);
+        axis_length[arc->linear_axis] = fabs(arc->linear_travel);
+        axis_square[arc->linear_axis] = square(arc->linear_travel);
+    }
+    _calculate_jerk(bf, envelope);
+    _calculate_vmaxes(bf, axis_length, axis_square);
+
+    // limit velocity to what the jerk allows around the curve: J = v^3 / r^2
+    float curve_vmax = fast_cbrt(bf->jerk * square(max(arc->radius, MIN_ARC_RADIUS)));
+    if (bf->cruise_vset > curve_vmax) {
+        bf->cruise_vset = curve_vmax;
+        bf->cruise_vmax = curve_vmax;
+        bf->block_time  = length / curve_vmax;
+    }
+    bf->absolute_vmax = min(bf->absolute_vmax, curve_vmax);
+    _set_bf_diagnostics(bf);                            // DIAGNOSTIC
+
+    // Note: these next lines must remain in exact order. Position must update before committing the buffer.
+    copy_vector(mp->position, bf->gm->target);          // update the planner position for the next move
+    mp_commit_write_buffer(BLOCK_TYPE_ARC);             // commit current block (must follow the position update)
+    return (STAT_OK);
+}
+
 /****************************************************************************************
  * mp_plan_block_list() - plan all the blocks in the list
  *
@@ -254,6 +625,8 @@ stat_t mp_aline(GCodeState_t* _gm)
 
 void mp_plan_block_list() 
 {
+    PROFILE_SCOPE(PROFILE_PLAN);
+
     mpBuf_t* bf = mp->p;
     bool planned_something = false;
 
@@ -293,7 +666,7 @@ static mpBuf_t* _plan_block(mpBuf_t* bf)
 
         if (bf->pv->plannable) {
             _calculate_junction_vmax(bf->pv);  // compute maximum junction velocity constraint
-            if (bf->pv->gm.path_control == PATH_EXACT_STOP) {
+            if (bf->pv->gm->path_control == PATH_EXACT_STOP) {
                 bf->pv->exit_vmax = 0;
             } else {
                 bf->pv->exit_vmax = min3(bf->pv->junction_vmax, bf->pv->cruise_vmax, bf->cruise_vmax);
@@ -457,6 +830,9 @@ static void _calculate_override(mpBuf_t* bf)  // execute ramp to adjust cruise v
     // pull in override factor from previous block or seed initial value from the system setting
     bf->override_factor = fp_ZERO(bf->pv->override_factor) ? cm->gmx.mfo_factor : bf->pv->override_factor;
     bf->cruise_vmax     = bf->override_factor * bf->cruise_vset;
+    if (bf->block_type == BLOCK_TYPE_ARC) {             // overrides can't take an arc past its curvature limit
+        bf->cruise_vmax = min(bf->cruise_vmax, bf->absolute_vmax);
+    }
 
     // generate ramp term is a ramp is active
     if (mp->ramp_active) {
@@ -503,22 +879,23 @@ static void _calculate_override(mpBuf_t* bf)  // execute ramp to adjust cruise v
  *  Set the jerk scaling to the lowest axis with a non-zero unit vector.
  *  Go through the axes one by one and compute the scaled jerk, then pick
  *  the highest jerk that does not violate any of the axes in the move.
+ *  Lines pass their unit vector; arcs pass the largest component each axis reaches.
  *
  * Cost about ~65 uSec
  */
 
-static void _calculate_jerk(mpBuf_t* bf) 
+static void _calculate_jerk(mpBuf_t* bf, const float unit[]) 
 {
     // compute the jerk as the largest jerk that still meets axis constraints
     bf->jerk   = 8675309;  // a ridiculously large number
     float jerk = 0;
 
     for (uint8_t axis = 0; axis < AXES; axis++) {
-        if (fabs(bf->unit[axis]) > 0) {  // if this axis is participating in the move
+        if (fabs(unit[axis]) > 0) {      // if this axis is participating in the move
             float axis_jerk = 0;
 #ifdef TRAVERSE_AT_HIGH_JERK
 #warning using experimental feature TRAVERSE_AT_HIGH_JERK!
-            switch (bf->gm.motion_mode) {
+            switch (bf->gm->motion_mode) {
                 case MOTION_MODE_STRAIGHT_TRAVERSE:
                 //case MOTION_MODE_STRAIGHT_PROBE: // <-- not sure on this one
                     axis_jerk = cm->a[axis].jerk_high;
@@ -530,7 +907,7 @@ static void _calculate_jerk(mpBuf_t* bf)
             axis_jerk = cm->a[axis].jerk_max;
 #endif
 
-            jerk = axis_jerk / fabs(bf->unit[axis]);
+            jerk = axis_jerk / fabs(unit[axis]);
             if (jerk < bf->jerk) {
                 bf->jerk = jerk;
                 //              bf->jerk_axis = axis;           // +++ diagnostic
@@ -542,7 +919,7 @@ static void _calculate_jerk(mpBuf_t* bf)
     bf->recip_jerk = 1 / bf->jerk;
 
     const float q        = 2.40281141413;  // (sqrt(10)/(3^(1/4)))
-    const float sqrt_j   = sqrt(bf->jerk);
+    const float sqrt_j   = fast_sqrt(bf->jerk);
     bf->sqrt_j           = sqrt_j;
     bf->q_recip_2_sqrt_j = q / (2 * sqrt_j);
 }
@@ -633,24 +1010,24 @@ static void _calculate_vmaxes(mpBuf_t* bf, const float axis_length[], const floa
     float block_time;           // resulting move time
 
     // compute feed time for feeds and probe motion
-    if (bf->gm.motion_mode != MOTION_MODE_STRAIGHT_TRAVERSE) {
-        if (bf->gm.feed_rate_mode == INVERSE_TIME_MODE) {
-            feed_time = bf->gm.feed_rate;  // NB: feed rate was un-inverted to minutes by cm_set_feed_rate()
-            bf->gm.feed_rate_mode = UNITS_PER_MINUTE_MODE;
+    if (bf->gm->motion_mode != MOTION_MODE_STRAIGHT_TRAVERSE) {
+        if (bf->gm->feed_rate_mode == INVERSE_TIME_MODE) {
+            feed_time = bf->gm->feed_rate;  // NB: feed rate was un-inverted to minutes by cm_set_feed_rate()
+            bf->gm->feed_rate_mode = UNITS_PER_MINUTE_MODE;
         } else {
             // compute length of linear move in millimeters. Feed rate is provided as mm/min
-            feed_time = sqrt(axis_square[AXIS_X] + axis_square[AXIS_Y] + axis_square[AXIS_Z]) / bf->gm.feed_rate;
+            feed_time = fast_sqrt(axis_square[AXIS_X] + axis_square[AXIS_Y] + axis_square[AXIS_Z]) / bf->gm->feed_rate;
             // if no linear axes, compute length of multi-axis rotary move in degrees. 
             // Feed rate is provided as degrees/min
             if (fp_ZERO(feed_time)) {
-                feed_time = sqrt(axis_square[AXIS_A] + axis_square[AXIS_B] + axis_square[AXIS_C]) / bf->gm.feed_rate;
+                feed_time = fast_sqrt(axis_square[AXIS_A] + axis_square[AXIS_B] + axis_square[AXIS_C]) / bf->gm->feed_rate;
             }
         }
     }
     // compute rate limits and absolute maximum limit
     for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
         if (bf->axis_flags[axis]) {
-            if (bf->gm.motion_mode == MOTION_MODE_STRAIGHT_TRAVERSE) {
+            if (bf->gm->motion_mode == MOTION_MODE_STRAIGHT_TRAVERSE) {
                 tmp_time = fabs(axis_length[axis]) / cm->a[axis].velocity_max;
             } else {// gm.motion_mode == MOTION_MODE_STRAIGHT_FEED
                 tmp_time = fabs(axis_length[axis]) / cm->a[axis].feedrate_max;
@@ -724,12 +1101,13 @@ static void _calculate_junction_vmax(mpBuf_t* bf)
     // If we change cruise_vmax, we'll need to recompute junction_vmax, if we do this:
 //    float velocity = min(bf->cruise_vmax, bf->nx->cruise_vmax);  // start with our maximum possible velocity
     float velocity = 8675309;
+    const float *unit = (bf->block_type == BLOCK_TYPE_ARC) ? bf->arc->exit_unit : bf->unit;  // direction leaving this block
 
     // cmAxes jerk_axis = AXIS_X;   // a diagnostic in case you want to find the limiting axis
 
     for (uint8_t axis = 0; axis < AXES; axis++) {
         if (bf->axis_flags[axis] || bf->nx->axis_flags[axis]) {       // skip axes with no movement
-            float delta = fabs(bf->unit[axis] - bf->nx->unit[axis]);  // formula (1)
+            float delta = fabs(unit[axis] - bf->nx->unit[axis]);      // formula (1)
 
             // Corner case: If an axis has zero delta, we might have a straight line.
             // Corner case: An axis doesn't change (and it's not a straight line).
@@ -738,8 +1116,9 @@ static void _calculate_junction_vmax(mpBuf_t* bf)
                 // formula (4): (See Note 1, above)
 
                 // velocity = min(velocity, (cm->a[axis].max_junction_accel / delta));
-                if ((cm->a[axis].max_junction_accel / delta) < velocity) {
-                    velocity = (cm->a[axis].max_junction_accel / delta);
+                float axis_velocity = cm->a[axis].max_junction_accel / delta;  // one divide per axis
+                if (axis_velocity < velocity) {
+                    velocity = axis_velocity;
                     // bf->jerk_axis = axis;
                 }
             }
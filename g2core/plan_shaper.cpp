@@ -0,0 +1,224 @@
+/*
+ * plan_shaper.cpp - input shaping for the segment runtime
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * As a special exception, you may use this file as part of a software library without
+ * restriction. Specifically, if other files instantiate templates or use macros or
+ * inline functions from this file, or you compile this file and link it with  other
+ * files to produce an executable, this file does not by itself cause the resulting
+ * executable to be covered by the GNU General Public License. This exception does not
+ * however invalidate any other reasons why the executable file might be covered by the
+ * GNU General Public License.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "g2core.h"
+#include "config.h"
+#include "planner.h"
+#include "plan_shaper.h"
+#include "canonical_machine.h"
+#include "util.h"
+
+mpShaper_t sh;
+
+static_assert(SHAPER_HISTORY <= 256, "SHAPER_DELAY_MAX_MS needs more history than uint8_t indexes can reach");
+
+static inline uint8_t _shaper_next(const uint8_t i) { return ((i < SHAPER_HISTORY - 1) ? i + 1 : 0); }
+
+/*
+ * mp_shaper_set_axis() - set the shaper for one axis and restart shaping from the runtime position
+ *
+ *  A type of SHAPER_NONE or a frequency of 0 turns shaping off for the axis. Returns an
+ *  error if the frequency is too low for the delays to fit in the history.
+ *
+ *  The history restarts from mr->position, so this is only accepted with the machine idle:
+ *  no cycle running and the shaped position settled on it.
+ */
+
+stat_t mp_shaper_set_axis(const uint8_t axis, const uint8_t type, const float frequency, const float damping)
+{
+    if (axis >= SHAPER_AXES) {
+        return (STAT_INPUT_VALUE_RANGE_ERROR);
+    }
+    if ((cm->cycle_type != CYCLE_NONE) || mp_shaper_busy()) {
+        return (STAT_COMMAND_NOT_ACCEPTED);
+    }
+    mpShaperAxis_t *a = &sh.axis[axis];
+    a->taps = 0;
+
+    if ((type != SHAPER_NONE) && (frequency > EPSILON)) {
+        float root = sqrt(1 - square(damping));
+        float period = 1000000 / (frequency * root);            // damped period in microseconds
+        float k = exp(-damping * M_PI / root);                  // decay of the ringing over half a period
+
+        a->delay[0] = 0;
+        a->delay[1] = (uint32_t)(period / 2);
+        a->delay[2] = (uint32_t)period;
+        switch (type) {
+            case SHAPER_ZV: {
+                a->taps = 2;
+                a->amplitude[0] = 1;
+                a->amplitude[1] = k;
+                break;
+            }
+            case SHAPER_ZVD: {
+                a->taps = 3;
+                a->amplitude[0] = 1;
+                a->amplitude[1] = 2 * k;
+                a->amplitude[2] = k * k;
+                break;
+            }
+            case SHAPER_EI: {
+                a->taps = 3;
+                a->amplitude[0] = (1 + SHAPER_EI_VIBRATION) / 4;
+                a->amplitude[1] = (1 - SHAPER_EI_VIBRATION) / 2 * k;
+                a->amplitude[2] = a->amplitude[0] * k * k;
+                break;
+            }
+            default: {
+                return (STAT_INPUT_VALUE_RANGE_ERROR);
+            }
+        }
+        if (a->delay[a->taps - 1] > SHAPER_DELAY_MAX_MS * 1000) {  // the history can't reach back that far
+            a->taps = 0;
+            mp_shaper_reset(mr->position);
+            return (STAT_INPUT_LESS_THAN_MIN_VALUE);
+        }
+        float sum = 0;
+        for (uint8_t i = 0; i < a->taps; i++) {
+            sum += a->amplitude[i];
+        }
+        for (uint8_t i = 0; i < a->taps; i++) {
+            a->amplitude[i] /= sum;
+        }
+    }
+    mp_shaper_reset(mr->position);
+    return (STAT_OK);
+}
+
+/*
+ * mp_shaper_reset() - fill the history with a position the machine is standing still at
+ */
+
+void mp_shaper_reset(const float position[])
+{
+    sh.active = false;
+    sh.delay_max = 0;
+    for (uint8_t axis = 0; axis < SHAPER_AXES; axis++) {
+        mpShaperAxis_t *a = &sh.axis[axis];
+        if (a->taps) {
+            sh.active = true;
+            sh.delay_max = max(sh.delay_max, a->delay[a->taps - 1]);
+        }
+        for (uint8_t i = 0; i < SHAPER_TAPS_MAX; i++) {
+            a->cursor[i] = _shaper_next(sh.head);  // the oldest entry
+        }
+    }
+    for (uint16_t i = 0; i < SHAPER_HISTORY; i++) {
+        sh.time[i] = sh.clock;
+        for (uint8_t axis = 0; axis < SHAPER_AXES; axis++) {
+            sh.position[i][axis] = position[axis];
+        }
+    }
+    sh.settle_time = 0;
+}
+
+bool mp_shaper_busy() { return (sh.settle_time > 0); }
+
+/*
+ * _shaper_lookup() - commanded position of an axis at time t, interpolated from the history
+ *
+ *  Each tap's time only ever moves forward, so its cursor is walked forward from where the
+ *  last lookup left it. Times before the oldest entry get the oldest position.
+ */
+
+static float _shaper_lookup(const uint8_t axis, const uint8_t tap, const uint32_t t)
+{
+    uint8_t c = sh.axis[axis].cursor[tap];
+    uint8_t n = _shaper_next(c);
+    while ((c != sh.head) && ((int32_t)(sh.time[n] - t) <= 0)) {
+        c = n;
+        n = _shaper_next(c);
+    }
+    sh.axis[axis].cursor[tap] = c;
+
+    if ((c == sh.head) || ((int32_t)(t - sh.time[c]) <= 0)) {
+        return (sh.position[c][axis]);
+    }
+    float fraction = (float)(t - sh.time[c]) / (float)(sh.time[n] - sh.time[c]);
+    return (sh.position[c][axis] + fraction * (sh.position[n][axis] - sh.position[c][axis]));
+}
+
+/*
+ * mp_shaper_segment() - shape the target of a segment
+ *
+ *  target is the commanded (planner) position at the end of the segment, shaped is
+ *  returned with the position the motors should go to. Axes that are not shaped are
+ *  copied through. segment_time is in minutes, as in the rest of the runtime.
+ *
+ *  Runs in the exec interrupt.
+ */
+
+void mp_shaper_segment(const float target[], float shaped[], const float segment_time)
+{
+    memcpy(shaped, target, sizeof(float) * AXES);
+    if (!sh.active) {
+        return;
+    }
+    uint32_t usec = (uint32_t)(segment_time * MICROSECONDS_PER_MINUTE);
+
+    // the target moved - the shaped position needs the longest delay to catch up to it
+    bool moved = false;
+    for (uint8_t axis = 0; axis < SHAPER_AXES; axis++) {
+        if (target[axis] != sh.position[sh.head][axis]) {
+            moved = true;
+        }
+    }
+    if (moved) {
+        sh.settle_time = sh.delay_max;
+    } else {
+        sh.settle_time = (sh.settle_time > usec) ? (sh.settle_time - usec) : 0;
+    }
+
+    // push the target into the history, moving any cursor off the oldest entry it overwrites
+    sh.clock += usec;
+    uint8_t next = _shaper_next(sh.head);
+    for (uint8_t axis = 0; axis < SHAPER_AXES; axis++) {
+        for (uint8_t i = 0; i < SHAPER_TAPS_MAX; i++) {
+            if (sh.axis[axis].cursor[i] == next) {
+                sh.axis[axis].cursor[i] = _shaper_next(next);
+            }
+        }
+    }
+    sh.head = next;
+    sh.time[next] = sh.clock;
+    for (uint8_t axis = 0; axis < SHAPER_AXES; axis++) {
+        sh.position[next][axis] = target[axis];
+    }
+
+    if (sh.settle_time == 0) {                          // caught up - land exactly on the target
+        return;
+    }
+    for (uint8_t axis = 0; axis < SHAPER_AXES; axis++) {
+        mpShaperAxis_t *a = &sh.axis[axis];
+        if (a->taps == 0) {
+            continue;
+        }
+        float position = a->amplitude[0] * target[axis];
+        for (uint8_t i = 1; i < a->taps; i++) {
+            position += a->amplitude[i] * _shaper_lookup(axis, i, sh.clock - a->delay[i]);
+        }
+        shaped[axis] = position;
+    }
+}
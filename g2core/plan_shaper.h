@@ -0,0 +1,90 @@
+/*
+ * plan_shaper.h - input shaping for the segment runtime
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PLAN_SHAPER_H_ONCE
+#define PLAN_SHAPER_H_ONCE
+
+/*
+ * Input shaping
+ *
+ *  A shaper replaces each commanded position x(t) with a weighted sum of delayed copies
+ *  of it: sum(A[i] * x(t - t[i])). Sized for a resonance at frequency f with damping
+ *  ratio z, the vibration each copy excites is cancelled by the ones that follow it, so
+ *  the axis stops ringing after a move. The cost is a little smearing of corners and a
+ *  delay of up to one damped period (Td = 1 / (f * sqrt(1 - z^2))) at the end of motion.
+ *
+ *    ZV   2 impulses over Td/2   - shortest, only cancels near f
+ *    ZVD  3 impulses over Td     - less sensitive to f being off
+ *    EI   3 impulses over Td     - allows 5% residual vibration, widest range of f
+ *
+ *  Shaping runs on the X, Y and Z positions of each segment, before kinematics, so it
+ *  works in Cartesian space whatever the machine. Positions are kept for the last
+ *  SHAPER_HISTORY segments and interpolated at the delayed times. The longest delay - Td/2
+ *  for ZV, Td for ZVD and EI - can be up to SHAPER_DELAY_MAX_MS, which sets the lowest
+ *  frequency that can be shaped. The history is sized to cover that at MIN_SEGMENT_MS.
+ *
+ *  The planner still works in unshaped positions (mr->position). When motion stops the
+ *  runtime keeps running settle segments until the shaped position has caught up - before
+ *  commands and dwells run and before a feedhold reports motion stopped. Shapers should be
+ *  configured with the machine idle; changing one resets the history to the current position.
+ */
+
+#define SHAPER_AXES         3                   // X, Y and Z can be shaped
+#define SHAPER_TAPS_MAX     3                   // most impulses in any shaper
+
+#ifndef SHAPER_DELAY_MAX_MS                     // boards can override this value in hardware.h
+#define SHAPER_DELAY_MAX_MS 100.0               // longest impulse delay - ZV down to 5 Hz, ZVD and EI to 10 Hz
+#endif
+#define SHAPER_HISTORY      ((uint16_t)(SHAPER_DELAY_MAX_MS / MIN_SEGMENT_MS) + 2)  // segments of position history, 256 max
+
+#define SHAPER_FREQUENCY_MAX 500.0              // Hz. 0 turns the shaper off
+#define SHAPER_DAMPING_MAX  0.9                 // damping ratio is 0 to this value
+#define SHAPER_EI_VIBRATION 0.05                // residual vibration the EI shaper allows
+
+typedef enum {
+    SHAPER_NONE = 0,                            // axis is not shaped
+    SHAPER_ZV,                                  // zero vibration
+    SHAPER_ZVD,                                 // zero vibration and derivative
+    SHAPER_EI                                   // extra insensitive
+} mpShaperType;
+
+typedef struct mpShaperAxis {
+    uint8_t taps;                               // number of impulses, 0 if the axis is not shaped
+    float amplitude[SHAPER_TAPS_MAX];           // impulse amplitudes - they sum to 1
+    uint32_t delay[SHAPER_TAPS_MAX];            // impulse delays in microseconds. The first is always 0
+    uint8_t cursor[SHAPER_TAPS_MAX];            // history entry at or just before the delayed time
+} mpShaperAxis_t;
+
+typedef struct mpShaper {
+    bool active;                                // any axis is shaped
+    uint8_t head;                               // newest history entry
+    uint32_t clock;                             // microseconds of segments run (wraps)
+    uint32_t delay_max;                         // longest delay of any axis
+    uint32_t settle_time;                       // microseconds until the shaped position catches up, 0 = settled
+    uint32_t time[SHAPER_HISTORY];              // clock at the end of each history segment
+    float position[SHAPER_HISTORY][SHAPER_AXES];// commanded position at the end of each history segment
+    mpShaperAxis_t axis[SHAPER_AXES];
+} mpShaper_t;
+
+extern mpShaper_t sh;
+
+stat_t mp_shaper_set_axis(const uint8_t axis, const uint8_t type, const float frequency, const float damping);
+void mp_shaper_reset(const float position[]);
+void mp_shaper_segment(const float target[], float shaped[], const float segment_time);
+bool mp_shaper_busy(void);
+
+#endif  // End of include guard: PLAN_SHAPER_H_ONCE
@@ -354,7 +354,7 @@ stat_t mp_calculate_ramps(mpBlockRuntimeBuf_t* block, mpBuf_t* bf, const float e
 float mp_get_target_length(const float v_0, const float v_1, const mpBuf_t* bf) 
 {
     const float q_recip_2_sqrt_j = bf->q_recip_2_sqrt_j;
-    return q_recip_2_sqrt_j * sqrt(fabs(v_1 - v_0)) * (v_1 + v_0);
+    return q_recip_2_sqrt_j * fast_sqrt(fabs(v_1 - v_0)) * (v_1 + v_0);
 }
 
 /*
@@ -386,8 +386,8 @@ float mp_get_target_velocity(const float v_0, const float L, const mpBuf_t* bf)
     const float b_part2 = a80 * v_0_3;      // 80 a v_0^3
 
     //              b^3 = a^2 (3 L sqrt(j (2 b_part2  +  b_part1))  +  b_part2  +  b_part1)
-    const float b_cubed = a_2 * (3 * L * sqrt(j * (2 * b_part2 + b_part1)) + b_part2 + b_part1);
-    const float b       = cbrtf(b_cubed);
+    const float b_cubed = a_2 * (3 * L * fast_sqrt(j * (2 * b_part2 + b_part1)) + b_part2 + b_part1);
+    const float b       = fast_cbrt(b_cubed);
 
     const float const1a = 0.8292422988276;    // 4 * 10^(1/3) * a
     const float const2a = 4.823680612597;     // 1/(10^(1/3) * a)
@@ -428,7 +428,7 @@ float mp_get_decel_velocity(const float v_0, const float L, const mpBuf_t* bf)
     while (i++ < 20) {          // If it fails after 20 iterations something's wrong
 
         // l_t is the difference in length between the L provided and the current guessed deceleration length
-        const float sqrt_delta_v_0 = sqrt(v_0 - v_1);
+        const float sqrt_delta_v_0 = fast_sqrt(v_0 - v_1);
         const float l_t = q_recip_2_sqrt_j * (sqrt_delta_v_0 * (v_1 + v_0)) - L;
 
         // The return condition allows a minor error in length (in mm). 
@@ -465,23 +465,44 @@ float mp_get_decel_velocity(const float v_0, const float L, const mpBuf_t* bf)
  * and jerk (J), will locate the velocity v_1 that will allow acceleration from v_0
  * at jerk J to v_1 and then deceleration at jerk J to v_2, all over total length L.
  *
+ *  The search is done in s = sqrt(v_1 - v_m), where v_m = max(v_0, v_2) and v_n = min(v_0, v_2).
+ *  With k = q_recip_2_sqrt_j the ramps on the v_m and v_n sides are
+ *
+ *      l_m(s) = k s (2 v_m + s^2)
+ *      l_n(s) = k sqrt(s^2 + v_m - v_n) (s^2 + v_m + v_n)
+ *
+ *  Both are increasing and convex in s, so l_m + l_n crosses L exactly once, a Newton step taken
+ *  from above the crossing stays above it, and a secant between points either side lands below it.
+ *  Each iteration takes one of each, and the last point below L is always a usable answer - the
+ *  gap just becomes body. The search starts between s = 0 and the crossing of l_n(0) + l_m(s),
+ *  which is above the solution. It finishes in MEET_ITERATIONS_MAX iterations of 2 sqrt each.
  */
 
+#define MEET_OVERLAP_MAX    0.00001     // head and tail may overlap by this much (mm)
+#define MEET_GAP_MAX        1.0         // accept up to this much body (mm)...
+#define MEET_GAP_FRACTION   0.01        // ...or this fraction of the block, whichever is smaller
+
+// ramp lengths at s, returns the slope of their sum
+static float _meet_lengths(const float s, const float v_m, const float v_n, const float k, float *l_m, float *l_n)
+{
+    const float s_2 = s * s;
+    const float r = fast_sqrt(s_2 + v_m - v_n);
+    *l_m = k * s * (2 * v_m + s_2);
+    *l_n = k * r * (s_2 + v_m + v_n);
+    return (k * (2 * v_m + 3 * s_2 + s * ((s_2 + v_m + v_n) / r + 2 * r)));
+}
+
 static float _get_meet_velocity(const float          v_0,
                                 const float          v_2,
                                 const float          L,
                                 mpBuf_t*             bf,
                                 mpBlockRuntimeBuf_t* block) 
 {
-    const float q_recip_2_sqrt_j = bf->q_recip_2_sqrt_j;
+    const float k = bf->q_recip_2_sqrt_j;
 
     // v_1 can never be smaller than v_0 or v_2, so we keep track of this value
     const float min_v_1 = max(v_0, v_2);
-
-    // v_1 is our estimated return value.
-    // We estimate with the speed obtained by L/2 traveled from the highest speed of v_0 or v_2.
-    float v_1 = mp_get_target_velocity(min_v_1, L / 2.0, bf);
-    // var v_1 = min_v_1 + 100;
+    const float v_n = min(v_0, v_2);
 
     if (fp_EQ(v_0, v_2)) {
         // Case (1)
@@ -492,89 +513,91 @@ static float _get_meet_velocity(const float          v_0,
         block->body_length = 0;
         block->tail_length = L - block->head_length;
         SET_PLANNER_ITERATIONS(-1);     // DIAGNOSTIC
-        return v_1;
+        COUNT_MEET_ITERATIONS(0);
+        return (mp_get_target_velocity(min_v_1, L / 2.0, bf));
     }
 
-    // Per iteration: 2 sqrt, 2 abs, 6 -, 4 +, 12 *, 3 /
-    int i = 0;          // limit the iterations // 466us - 644us
-    while (i++ < 30) {  // If it fails after 30, something's wrong
-        if (v_1 < min_v_1) {
-            // Case (2)
-            // We have caught a rather nasty problem. There is no meet velocity.
-            // This is due to an inversion in the velocities of very short moves.
-            // We need to compute the head OR tail length, and the body will be the rest.
-            // Yes, that means we're computing a cruise in here.
-
-            v_1 = min_v_1;
-
-            if (v_0 < v_2) {
-                // acceleration - it'll be a head/body
-                block->head_length = mp_get_target_length(v_0, v_2, bf);
-                if (block->head_length > L) {
-                    block->head_length = L;
-                    block->body_length = 0;
-                    v_1 = mp_get_target_velocity(v_0, L, bf);
-                } else {
-                    block->body_length = L - block->head_length;
-                }
-                block->tail_length = 0;
+    float l_m, l_n;
+    float s_lo = 0;                     // the best point below L so far, and its ramp lengths
+    float l_m_lo = 0;
+    float l_n_lo = k * fast_sqrt(min_v_1 - v_n) * (min_v_1 + v_n);
 
-            } else {
-                // deceleration - it'll be tail/body
-                block->tail_length = mp_get_target_length(v_2, v_0, bf);
-                if (block->tail_length > L) {
-                    block->tail_length = L;
-                    block->body_length = 0;
-                    v_1 = mp_get_target_velocity(v_2, L, bf);
-                } else {
-                    block->body_length = L - block->tail_length;
-                }
-                block->head_length = 0;
-            }
+    if (l_n_lo >= L) {
+        // Case (2)
+        // There is no meet velocity - the ramp between v_0 and v_2 alone doesn't fit.
+        // This is due to an inversion in the velocities of very short moves.
+        // The block is all head (or all tail), ending short of the other velocity.
+        block->body_length = 0;
+        if (v_0 < v_2) {
+            block->head_length = L;
+            block->tail_length = 0;
+            COUNT_MEET_ITERATIONS(0);
+            return (mp_get_target_velocity(v_0, L, bf));
+        }
+        block->head_length = 0;
+        block->tail_length = L;
+        COUNT_MEET_ITERATIONS(0);
+        return (mp_get_target_velocity(v_2, L, bf));
+    }
 
+    // l_m(s) >= 2 k v_m s and >= k s^3, so either crossing is an upper bound on s
+    const float gap = min((float)MEET_GAP_MAX, (float)(L * MEET_GAP_FRACTION));
+    float s_hi = (L - l_n_lo) / (2 * k * min_v_1);
+    if (k * s_hi * s_hi * s_hi > (L - l_n_lo)) {
+        s_hi = fast_cbrt((L - l_n_lo) / k);
+    }
+    float s = s_hi;
+    float l_c = 0;
+
+    uint8_t i = 0;
+    while (++i <= MEET_ITERATIONS_MAX) {
+        // Case (3) - Newton step down from above
+        float slope = _meet_lengths(s_hi, min_v_1, v_n, k, &l_m, &l_n);
+        l_c = (l_m + l_n) - L;
+        s = s_hi;
+        if ((l_c < MEET_OVERLAP_MAX) && (l_c > -gap)) {
             break;
         }
+        if (l_c < 0) {                  // only from rounding - it's a point below, so step up from it
+            s_lo = s_hi;
+            l_m_lo = l_m;
+            l_n_lo = l_n;
+            s_hi -= l_c / slope;
+            continue;
+        }
+        s = s_lo + (s_hi - s_lo) * (L - (l_m_lo + l_n_lo)) / ((l_m + l_n) - (l_m_lo + l_n_lo));
+        s_hi -= l_c / slope;
 
-        // Precompute some common chunks -- note that some attempts may have v_1 < v_0 or v_1 < v_2
-        const float sqrt_delta_v_0 = sqrt(fabs(v_1 - v_0));
-        const float sqrt_delta_v_2 = sqrt(fabs(v_1 - v_2));  // 849us
-
-        // l_c is our total-length calculation with the current v_1 estimate, minus the expected length.
-        // This makes l_c == 0 when v_1 is the correct value.
-
-        // GAMBLE: At the cost of one more multiply per iteration, we will keep the two length calculations seperate.
-        // This allows us to store the resulting head/tail lengths.
-        const float l_h = q_recip_2_sqrt_j * (sqrt_delta_v_0 * (v_1 + v_0));
-        const float l_t = q_recip_2_sqrt_j * (sqrt_delta_v_2 * (v_1 + v_2));
-        const float l_c = (l_h + l_t) - L;
-
-        block->head_length = l_h;
-        block->tail_length = l_t;
-        block->body_length = 0;
-
-        // We need this level of precision, or our length computations fail to match the block length.
-        // What we really want to ensure is that the two lengths down add up to be too much.
-        // We can be a little under (and have a small body).
-
-        // TODO: make these tunable
-        if ((l_c < 0.00001) && (l_c > -1.0)) {  // allow 0.00001 overlap, OR up to a 1mm gap
-            if (l_c < 0.0) {
-                // Case (3a)
-                block->body_length = -l_c;
-            } else {
-                // Case (3b)
-                // fix the overlap
-                block->tail_length = L - block->head_length;
-            }
+        // ...and secant step up from below
+        _meet_lengths(s, min_v_1, v_n, k, &l_m, &l_n);
+        l_c = (l_m + l_n) - L;
+        if ((l_c < MEET_OVERLAP_MAX) && (l_c > -gap)) {
             break;
         }
+        if (l_c < 0) {
+            s_lo = s;
+            l_m_lo = l_m;
+            l_n_lo = l_n;
+        }
+    }
+    if (i > MEET_ITERATIONS_MAX) {      // out of iterations - settle for the best point below L
+        s = s_lo;
+        l_m = l_m_lo;
+        l_n = l_n_lo;
+        l_c = (l_m + l_n) - L;
+    }
+    SET_MEET_ITERATIONS(i);             // DIAGNOSTIC
+    COUNT_MEET_ITERATIONS(i);
 
-        const float v_1x3     = 3 * v_1;
-        const float recip_l_d = (2 * sqrt_delta_v_0 * sqrt_delta_v_2) /
-                                ((sqrt_delta_v_0 * (v_1x3 - v_2) - (v_0 - v_1x3) * sqrt_delta_v_2) * q_recip_2_sqrt_j);
-
-        v_1 = v_1 - (l_c * recip_l_d);
+    block->head_length = (v_0 > v_2) ? l_m : l_n;
+    block->tail_length = (v_0 > v_2) ? l_n : l_m;
+    block->body_length = 0;
+    if (l_c < 0.0) {
+        // Case (3a) - the gap becomes body
+        block->body_length = -l_c;
+    } else {
+        // Case (3b) - fix the overlap
+        block->tail_length = L - block->head_length;
     }
-    SET_MEET_ITERATIONS(i);     // DIAGNOSTIC
-    return v_1;
+    return (min_v_1 + s * s);
 }
@@ -56,6 +56,7 @@
 #include "canonical_machine.h"
 #include "plan_arc.h"
 #include "planner.h"
+#include "plan_shaper.h"
 #include "kinematics.h"
 #include "stepper.h"
 #include "encoder.h"
@@ -76,6 +77,12 @@ mpPlannerRuntime_t mr2;                     // secondary planner runtime context
 
 mpBuf_t mp1_queue[PLANNER_QUEUE_SIZE];      // storage allocation for primary planner queue buffers
 mpBuf_t mp2_queue[SECONDARY_QUEUE_SIZE];    // storage allocation for secondary planner queue buffers
+mpBufState_t mp1_state[PLANNER_QUEUE_SIZE];     // side table for primary planner queue buffers
+mpBufState_t mp2_state[SECONDARY_QUEUE_SIZE];   // side table for secondary planner queue buffers
+
+// RAM budget for the planner queues - the Makefile prints actual sizes after each link (ram-report)
+#define PLANNER_QUEUE_RAM ((sizeof(mpBuf_t) + sizeof(mpBufState_t)) * (PLANNER_QUEUE_SIZE + SECONDARY_QUEUE_SIZE))
+static_assert(PLANNER_QUEUE_RAM <= PLANNER_RAM_BUDGET, "Planner queues exceed PLANNER_RAM_BUDGET - reduce PLANNER_QUEUE_SIZE");
 
 // Execution routines (NB: These are called from the LO interrupt)
 static stat_t _exec_dwell(mpBuf_t *bf);
@@ -149,7 +156,7 @@ _json_commands_t jc;
  */
 
 // initialize a planner queue
-void _init_planner_queue(mpPlanner_t *_mp, mpBuf_t *queue, uint8_t size)
+void _init_planner_queue(mpPlanner_t *_mp, mpBuf_t *queue, mpBufState_t *state, uint8_t size)
 {
     mpBuf_t *pv, *nx;
     uint8_t i, nx_i;
@@ -160,7 +167,9 @@ void _init_planner_queue(mpPlanner_t *_mp, mpBuf_t *queue, uint8_t size)
     q->magic_end = MAGICNUM;
 
     memset(queue, 0, sizeof(mpBuf_t)*size); // clear all buffers in queue
+    memset(state, 0, sizeof(mpBufState_t)*size); // ...and their side table entries
     q->bf = queue;                          // link the buffer pool first
+    q->bs = state;
     q->w = queue;                           // init all buffer pointers
     q->r = queue;
     q->queue_size = size;
@@ -173,12 +182,14 @@ void _init_planner_queue(mpPlanner_t *_mp, mpBuf_t *queue, uint8_t size)
         nx = &q->bf[nx_i];
         q->bf[i].nx = nx;                   // setup circular list pointers
         q->bf[i].pv = pv;
+        q->bf[i].gm = &q->bs[i].gm;         // point into the side table
+        q->bf[i].arc = &q->bs[i].arc;
         pv = &q->bf[i];
     }
     q->bf[size-1].nx = queue;
 }
 
-void planner_init(mpPlanner_t *_mp, mpPlannerRuntime_t *_mr, mpBuf_t *queue, uint8_t queue_size)
+void planner_init(mpPlanner_t *_mp, mpPlannerRuntime_t *_mr, mpBuf_t *queue, mpBufState_t *state, uint8_t queue_size)
 {
     // init planner master structure
     memset(_mp, 0, sizeof(mpPlanner_t));    // clear all values, pointers and status
@@ -188,7 +199,7 @@ void planner_init(mpPlanner_t *_mp, mpPlannerRuntime_t *_mr, mpBuf_t *queue, uin
 
     // init planner queues
     _mp->q.bf = queue;                      // assign puffer pool to queue manager structure
-    _init_planner_queue(_mp, queue, queue_size);
+    _init_planner_queue(_mp, queue, state, queue_size);
 
     // init runtime structs
     _mp->mr = _mr;
@@ -200,6 +211,8 @@ void planner_init(mpPlanner_t *_mp, mpPlannerRuntime_t *_mr, mpBuf_t *queue, uin
     _mr->block[1].nx = &_mr->block[0];
     _mr->r = &_mr->block[0];
     _mr->p = &_mr->block[1];
+
+    mp_profile_reset();                     // start profiling from a clean slate
 }
 
 void planner_reset(mpPlanner_t *_mp)        // reset planner queue, cease MR activity, but leave positions alone
@@ -208,7 +221,10 @@ void planner_reset(mpPlanner_t *_mp)        // reset planner queue, cease MR act
     _mp->reset();
     _mp->mr->reset();
     // jc.reset();
-    _init_planner_queue(_mp, _mp->q.bf, _mp->q.queue_size); // reset planner buffers
+    if (_mp == &mp1) {
+        mp_merge_discard();                 // a held line goes with the queue
+    }
+    _init_planner_queue(_mp, _mp->q.bf, _mp->q.bs, _mp->q.queue_size); // reset planner buffers
 }
 
 stat_t planner_assert(const mpPlanner_t *_mp)
@@ -259,8 +275,16 @@ void mp_halt_runtime()
  *  and the real tool position is still close to the starting point.
  */
 
-void mp_set_planner_position(uint8_t axis, const float position) { mp->position[axis] = position; }
-void mp_set_runtime_position(uint8_t axis, const float position) { mr->position[axis] = position; }
+void mp_set_planner_position(uint8_t axis, const float position)
+{
+    mp_merge_flush();                       // a held line ends at the old position
+    mp->position[axis] = position;
+}
+void mp_set_runtime_position(uint8_t axis, const float position)
+{
+    mr->position[axis] = position;
+    sr_flag_change(SR_SOURCE_RUNTIME);
+}
 
 void mp_set_steps_to_runtime_position()
 {
@@ -272,11 +296,12 @@ void mp_set_steps_to_runtime_position()
         mr->commanded_steps[motor] = step_position[motor];
         en_set_encoder_steps(motor, step_position[motor]);  // write steps to encoder register
         mr->encoder_steps[motor] = en_read_encoder(motor);
+        st_set_commanded_steps(motor, step_position[motor]); // ...and measure following error from here
 
         // These must be zero:
         mr->following_error[motor] = 0;
-        st_pre.mot[motor].corrected_steps = 0;
     }
+    mp_shaper_reset(mr->position);                          // the shaper starts over from here too
 }
 
 /****************************************************************************************
@@ -313,9 +338,9 @@ void mp_queue_command(void(*cm_exec)(float *, bool *), float *value, bool *flag)
     bf->bf_func = _exec_command;      // callback to planner queue exec function
     bf->cm_func = cm_exec;            // callback to canonical machine exec function
 
-    for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
-        bf->unit[axis] = value[axis];               // use the unit vector to store command values
-        bf->axis_flags[axis] = flag[axis];
+    for (uint8_t axis = AXIS_X; axis < AXES; axis++) { // either vector is NULL if the command doesn't use it
+        bf->unit[axis] = (value != nullptr) ? value[axis] : 0;  // use the unit vector to store command values
+        bf->axis_flags[axis] = (flag != nullptr) && flag[axis];
     }
     mp_commit_write_buffer(BLOCK_TYPE_COMMAND);     // must be final operation before exit
 }
@@ -329,6 +354,8 @@ static stat_t _exec_command(mpBuf_t *bf)
 stat_t mp_runtime_command(mpBuf_t *bf)
 {
     bf->cm_func(bf->unit, bf->axis_flags);          // 2 vectors used by callbacks
+    sr_flag_change(SR_SOURCE_MODEL);                // commands update the runtime model...
+    sr_flag_change(SR_SOURCE_IO);                   // ...and run M-codes for spindle, coolant and outputs
     if (mp_free_run_buffer()) {
         cm_cycle_end();                             // free buffer & perform cycle_end if planner is empty
     }
@@ -535,6 +562,8 @@ bool mp_is_phat_city_time()
 
 stat_t mp_planner_callback()
 {
+    mp_merge_callback();                    // queue a held line once the input has gone quiet
+
     // Test if the planner has transitioned to an IDLE state
     if ((mp_get_planner_buffers(mp) == mp->q.queue_size) &&     // detect and set IDLE state
         (cm->motion_state == MOTION_STOP) && (cm->hold_state == FEEDHOLD_OFF)) {
@@ -664,6 +693,188 @@ void mp_planner_time_accounting()
     UPDATE_MP_DIAGNOSTICS                           // DIAGNOSTIC
 }
 
+/****************************************************************************************
+ * PLANNER PROFILING - see planner.h for an overview
+ *
+ * mp_profile_reset() - start the cycle counter and clear all profiling counters
+ * mp_get_pf()        - get a profiling value for the _pf group
+ *
+ *  The _pf tokens are "_pf" + 'a'(verage) or 'm'(ax) cycles + a slot letter, or a rate:
+ *    _pfbr / _pfsr      blocks per second / segments per second since last clear
+ *    _pfal / _pfml      mp_aline()            average / max cycles
+ *    _pfap / _pfmp      mp_plan_block_list()  average / max cycles
+ *    _pfaf / _pfmf      mp_forward_plan()     average / max cycles
+ *    _pfae / _pfme      mp_exec_move()        average / max cycles
+ *    _pfas / _pfms      st_prep_line()        average / max cycles
+ *    _pfad / _pfmd      DDA timer interrupt   average / max cycles
+ *    _pfag / _pfmg      _exec_segment_steps() average / max cycles
+ *    _pfak / _pfmk      kn_inverse_kinematics() average / max cycles
+ *    _pfsl / _pfso      worst segment load in percent of segment time / segments over SEGMENT_BUDGET
+ *    _pfn0 ... _pfn4    _get_meet_velocity() calls that took 0..4 iterations (4 = ran out)
+ */
+
+#ifdef __PLANNER_PROFILING
+mpProfile_t mpf;
+
+void mp_profile_reset()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // enable the DWT unit...
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;            // ...and its cycle counter
+    memset(&mpf.slot, 0, sizeof(mpf.slot));
+    memset(&mpf.meet, 0, sizeof(mpf.meet));
+    mpf.load_cycles = 0;
+    mpf.load_segment_cycles = 1;                    // so the first segment becomes the worst
+    mpf.segment_overruns = 0;
+    mpf.start_ms = SysTickTimer.getValue();
+}
+
+static float _profile_rate(const mpProfileSlot slot)
+{
+    uint32_t elapsed_ms = SysTickTimer.getValue() - mpf.start_ms;
+    if (elapsed_ms == 0) {
+        return (0);
+    }
+    return ((float)mpf.slot[slot].count * 1000 / elapsed_ms);
+}
+
+/*
+ * mp_profile_segment_time() - set the segment time being run. Runs in the exec interrupt.
+ * mp_profile_segment() - record a segment's cycles against its time. Runs in the exec interrupt.
+ *
+ *  segment_time is in minutes, as in the rest of the runtime. The load comparison is
+ *  cycles / segment_cycles against the worst so far, cross multiplied to stay in integers.
+ */
+
+void mp_profile_segment_time(const float segment_time)
+{
+    mpf.segment_cycles = (uint32_t)(segment_time * 60 * SystemCoreClock);
+    mpf.budget_cycles = (uint32_t)(mpf.segment_cycles * SEGMENT_BUDGET);
+}
+
+void mp_profile_segment(const uint32_t cycles)
+{
+    mpProfileCounter_t *c = &mpf.slot[PROFILE_SEGMENT];
+    c->count++;
+    c->cycles += cycles;
+    if (cycles > c->max_cycles) {
+        c->max_cycles = cycles;
+    }
+    if (((uint64_t)cycles * mpf.load_segment_cycles) > ((uint64_t)mpf.load_cycles * mpf.segment_cycles)) {
+        mpf.load_cycles = cycles;
+        mpf.load_segment_cycles = mpf.segment_cycles;
+    }
+    if (cycles > mpf.budget_cycles) {
+        mpf.segment_overruns++;
+    }
+}
+
+stat_t mp_get_pf(nvObj_t *nv)
+{
+    static const char slot_letters[] = "lpfesdgk";   // in mpProfileSlot order
+    const char *token = cfgArray[nv->index].token;
+
+    if (strcmp(token, "_pfbr") == 0) { return (get_float(nv, _profile_rate(PROFILE_ALINE))); }
+    if (strcmp(token, "_pfsr") == 0) { return (get_float(nv, _profile_rate(PROFILE_PREP))); }
+    if (strcmp(token, "_pfsl") == 0) { return (get_float(nv, (float)mpf.load_cycles * 100 / mpf.load_segment_cycles)); }
+    if (strcmp(token, "_pfso") == 0) { return (get_integer(nv, mpf.segment_overruns)); }
+    if (token[3] == 'n') {
+        uint8_t bin = token[4] - '0';
+        if (bin >= MEET_HISTOGRAM_BINS) {
+            nv->valuetype = TYPE_NULL;
+            return (STAT_INPUT_VALUE_RANGE_ERROR);
+        }
+        return (get_integer(nv, mpf.meet[bin]));
+    }
+
+    const char *s = strchr(slot_letters, token[4]);
+    if ((s == NULL) || (token[4] == NUL)) {
+        nv->valuetype = TYPE_NULL;
+        return (STAT_INPUT_VALUE_RANGE_ERROR);
+    }
+    mpProfileCounter_t *c = &mpf.slot[s - slot_letters];
+    if (token[3] == 'm') {
+        return (get_integer(nv, c->max_cycles));
+    }
+    return (get_integer(nv, (c->count == 0) ? 0 : (int32_t)(c->cycles / c->count)));
+}
+#else
+void mp_profile_reset() {}
+stat_t mp_get_pf(nvObj_t *nv) { return (get_nul(nv)); }
+#endif // __PLANNER_PROFILING
+
+/****************************************************************************************
+ * SEGMENT TRACE - see planner.h for an overview
+ *
+ * mp_trace_segment() - record one st_prep_line() call. Runs in the exec interrupt.
+ *                      Shaper settle segments are recorded as a block of their own with
+ *                      linenum and jerk 0 - there's no running block to read them from.
+ * mp_get_sgt()       - get the number of records captured
+ * mp_set_sgt()       - arm (non-zero) or disarm (0) the capture. Arming clears the buffer.
+ *
+ *  The header is filled in when the capture is armed, so changing motor mapping or
+ *  steps per unit during a capture will not be reflected in the trace.
+ */
+
+#ifdef __SEGMENT_TRACE
+mpSegmentTrace_t mst;
+
+void mp_trace_segment(const float travel_steps[], const float following_error[], const float segment_time, const bool settle)
+{
+    static const mpBuf_t *last_bf = NULL;
+    static uint32_t block = 0;
+
+    if (!mst.armed) {
+        return;
+    }
+    if (mst.count >= SEGMENT_TRACE_RECORDS) {
+        mst.armed = false;                          // one-shot: stop when full
+        return;
+    }
+    const mpBuf_t *bf = settle ? NULL : mr->run_bf;
+    if (bf != last_bf) {                            // new block
+        last_bf = bf;
+        block++;
+    }
+    mpSegmentRecord_t *r = &mst.rec[mst.count];
+    r->block = block;
+    r->linenum = (bf == NULL) ? 0 : bf->gm->linenum;
+    r->jerk = (bf == NULL) ? 0 : bf->jerk;
+    r->segment_time = segment_time;
+    for (uint8_t m=0; m<MOTORS; m++) {
+        r->travel_steps[m] = travel_steps[m];
+        r->following_error[m] = following_error[m];
+    }
+    mst.count++;
+}
+
+stat_t mp_get_sgt(nvObj_t *nv)
+{
+    return (get_integer(nv, mst.count));
+}
+
+stat_t mp_set_sgt(nvObj_t *nv)
+{
+    mst.armed = false;                              // keep the exec interrupt out while we set up
+    if (nv->value_int == 0) {
+        return (STAT_OK);
+    }
+    mst.magic = SEGMENT_TRACE_MAGIC;
+    mst.version = SEGMENT_TRACE_VERSION;
+    mst.motors = MOTORS;
+    mst.capacity = SEGMENT_TRACE_RECORDS;
+    for (uint8_t m=0; m<MOTORS; m++) {
+        mst.motor_map[m] = st_cfg.mot[m].motor_map;
+        mst.steps_per_unit[m] = st_cfg.mot[m].steps_per_unit;
+    }
+    mst.count = 0;
+    mst.armed = true;
+    return (STAT_OK);
+}
+#else
+stat_t mp_get_sgt(nvObj_t *nv) { return (get_nul(nv)); }
+stat_t mp_set_sgt(nvObj_t *nv) { return (set_nul(nv)); }
+#endif // __SEGMENT_TRACE
+
 /**** PLANNER BUFFER PRIMITIVES ************************************************************
  *
  *  Planner buffers are used to queue and operate on Gcode blocks. Each buffer contains
@@ -757,6 +968,7 @@ mpBuf_t * mp_get_r() { return (mp->q.r); }
 
 mpBuf_t * mp_get_write_buffer()     // get & clear a buffer
 {
+    mp_merge_flush();               // anything else in the queue goes after a held line
 
     mpPlannerQueue_t *q = &(mp->q);
 
@@ -793,7 +1005,7 @@ void mp_commit_write_buffer(const blockType block_type)
     q->w->block_type = block_type;
     q->w->block_state = BLOCK_INITIAL_ACTION;
 
-    if (block_type != BLOCK_TYPE_ALINE) {
+    if (!mp_is_move_block(block_type)) {
         if ((mp->planner_state > PLANNER_STARTUP) && (cm->hold_state == FEEDHOLD_OFF)) {
             // NB: BEWARE! the requested exec may result in the planner buffer being
             // processed IMMEDIATELY and then freed - invalidating the contents
@@ -842,7 +1054,9 @@ bool mp_free_run_buffer()           // EMPTY current run buffer & advance to the
 void mp_copy_buffer(mpBuf_t *bf, const mpBuf_t *bp)
 {
     // copy contents of bp to bf while preserving pointers in bp
-    memcpy((void *)(&bf->bf_func), (&bp->bf_func), sizeof(mpBuf_t) - (sizeof(void *) * 2));
+    memcpy((void *)(&bf->bf_func), (&bp->bf_func), sizeof(mpBuf_t) - (sizeof(void *) * 4));
+    *bf->gm = *bp->gm;
+    *bf->arc = *bp->arc;
 }
 */
 
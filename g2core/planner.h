@@ -48,7 +48,7 @@
  * motion segments - is interpreted, queued to the planner, and joined together to produce 
  * continuous, synchronized motion. Non-motion commands such as pauses (dwells) and 
  * peripheral controls such as spindles can also be synchronized in the queue. Arcs are 
- * just a special case consisting of many linear moves. Arcs are not interpreted directly.
+ * queued as single arc blocks that are planned like lines and interpolated at runtime.
  *
  * The planner sits in the middle of three system layers: 
  *  - The Gcode interpreter and canonical machine (the 'model'), which feeds...
@@ -82,8 +82,11 @@
  *  - mp_json_command()  - queue a JSON command for run-time interpretation and execution (M100)  
  *  - mp_json_wait()     - queue a JSON wait for run-time interpretation and execution (M101)
  *  - 
- * In addition, cm_arc_feed() valaidates and sets up a arc paramewters and calls mp_aline() 
- * repeatedly to spool out the arc segments into the planner queue.
+ *  - mp_arc()           - plan and queue an arc or helix as a single block
+ *
+ * cm_arc_feed() valaidates and sets up a arc paramewters and calls mp_arc(). If the arc can't
+ * be run as a single block (a rotated coordinate space, or other axes moving with the arc)
+ * it falls back to calling mp_aline() repeatedly to spool out arc segments into the queue.
  *
  * All the above queueing commands other than mp_aline() are relatively trivial; they just
  * post callbacks into the next available planner buffer. Command functions are in 2 parts: 
@@ -179,7 +182,8 @@ typedef enum {                      // bf->buffer_state values in incresing orde
 typedef enum {                      // bf->block_type values
     BLOCK_TYPE_NULL = 0,            // MUST=0  null move - does a no-op
     BLOCK_TYPE_ALINE = 1,           // MUST=1  acceleration planned line
-    BLOCK_TYPE_COMMAND = 2,         // MUST=2  general command
+    BLOCK_TYPE_ARC = 2,             // MUST=2  acceleration planned arc or helix
+    BLOCK_TYPE_COMMAND = 3,         // MUST=3  general command
                                     // All other non-move commands are > BLOCK_TYPE_COMMAND
     BLOCK_TYPE_DWELL,               // Gcode dwell
     BLOCK_TYPE_JSON_WAIT,           // JSON wait command
@@ -189,6 +193,8 @@ typedef enum {                      // bf->block_type values
     BLOCK_TYPE_END                  // program end
 } blockType;
 
+#define mp_is_move_block(t) (((t) == BLOCK_TYPE_ALINE) || ((t) == BLOCK_TYPE_ARC))
+
 typedef enum {
     BLOCK_INACTIVE = 0,             // block is inactive (MUST BE ZERO)
     BLOCK_INITIAL_ACTION,           // initial value if you need an initialization
@@ -226,11 +232,19 @@ typedef enum {                      // code blocks for planning and trapezoid ge
 
 /*** Most of these factors are the result of a lot of tweaking. Change with caution.***/
 
+#ifndef PLANNER_QUEUE_SIZE                              // boards with the RAM can opt in to more in hardware.h
 #define PLANNER_QUEUE_SIZE          ((uint8_t)48)       // Suggest 12 min. Limit is 255
+#endif
 #define SECONDARY_QUEUE_SIZE        ((uint8_t)12)       // Secondary planner queue for feedhold operations
 #define PLANNER_BUFFER_HEADROOM     ((uint8_t)4)        // Buffers to reserve in planner before processing new input line
+#ifndef PLANNER_RAM_BUDGET                              // boards can override this value in hardware.h
+#define PLANNER_RAM_BUDGET          (56 * 1024)         // bytes allowed for both planner queues and side tables
+#endif
 #define JERK_MULTIPLIER             ((float)1000000)    // DO NOT CHANGE - must always be 1 million
 
+#define MERGE_POINTS_MAX            8                   // points one merged line may absorb
+#define MERGE_HOLD_MS               10                  // time a held line waits for the next one
+
 #define JUNCTION_INTEGRATION_MIN    (0.05)              // JT minimum allowable setting
 #define JUNCTION_INTEGRATION_MAX    (5.00)              // JT maximum allowable setting
 
@@ -280,7 +294,7 @@ typedef enum {                      // code blocks for planning and trapezoid ge
 #ifdef __PLANNER_DIAGNOSTICS
 #define ASCII_ART(s) xio_writeline(s)
 
-#define UPDATE_BF_DIAGNOSTICS(bf)   { bf->linenum = bf->gm.linenum; \
+#define UPDATE_BF_DIAGNOSTICS(bf)   { bf->linenum = bf->gm->linenum; \
                                       bf->block_time_ms = bf->block_time*60000; \
                                       bf->plannable_time_ms = bf->plannable_time*60000; }
                                     
@@ -300,6 +314,155 @@ typedef enum {                      // code blocks for planning and trapezoid ge
 #define INC_MEET_ITERATIONS
 #endif
 
+/* Planner Profiling
+ *
+ *  Measures the cost of the planning and runtime pipeline on the target using the
+ *  Cortex-M DWT cycle counter. Each profiled function is bracketed by PROFILE_SCOPE(),
+ *  which reads CYCCNT on entry and on exit (including early returns) and accumulates
+ *  call count, total and worst-case cycles for that slot. The overhead is a couple of
+ *  register reads and a 64 bit add per call - including every DDA tick - so profiling is
+ *  off by default. Define __PLANNER_PROFILING in g2core.h, the board's hardware.h or on
+ *  the make line to build it in. Without it the _pf group is not in the config table.
+ *
+ *  Block and segment rates are computed from the ALINE and PREP call counts over the
+ *  SysTick time elapsed since the last clear. Read the results with {"_pf":n} and
+ *  clear them with {"clc":n} before running the program you want to measure.
+ *
+ *  Each slot is only written from a single execution level (main loop, fwd_plan, exec
+ *  or DDA interrupt), so no locking is needed. A clear that races a measurement can
+ *  corrupt at most that one sample.
+ *
+ *  The meet velocity histogram counts _get_meet_velocity() calls by the iterations they
+ *  took: bin 0 is solved without iterating, 1..MEET_ITERATIONS_MAX converged in that many,
+ *  and the last bin ran out of iterations and settled for a slower velocity. Read with
+ *  {"_pfn0":n} through {"_pfn4":n}.
+ *
+ *  The segment time budget monitor wraps the work done for every segment - shaping,
+ *  kinematics and prep - and compares its cycles to the segment's own duration. {"_pfsl":n}
+ *  is the worst share of a segment's time used (in percent), {"_pfso":n} counts segments
+ *  over SEGMENT_BUDGET. Kinematics models should be checked against these on the target.
+ *  PROFILE_SEGMENT_TIME() must follow every change to the segment time being run, so the
+ *  budget in cycles is worked out once per section rather than once per segment.
+ */
+
+typedef enum {
+    PROFILE_ALINE = 0,          // mp_aline()               - main loop
+    PROFILE_PLAN,               // mp_plan_block_list()     - main loop
+    PROFILE_FWD_PLAN,           // mp_forward_plan()        - fwd_plan interrupt
+    PROFILE_EXEC,               // mp_exec_move()           - exec interrupt (includes prep)
+    PROFILE_PREP,               // st_prep_line()           - exec interrupt
+    PROFILE_DDA,                // DDA timer interrupt      - stepper interrupt
+    PROFILE_SEGMENT,            // _exec_segment_steps()    - exec interrupt (includes kinematics and prep)
+    PROFILE_KINE,               // kn_inverse_kinematics()  - exec interrupt
+    PROFILE_SLOTS               // count of profiling slots
+} mpProfileSlot;
+
+typedef struct mpProfileCounter {
+    uint32_t count;             // number of measured calls
+    uint32_t max_cycles;        // worst-case cycles for a single call
+    uint64_t cycles;            // total cycles spent (64 bits - 32 would wrap in ~50 seconds)
+} mpProfileCounter_t;
+
+#define MEET_ITERATIONS_MAX 3   // _get_meet_velocity() iteration limit (2 sqrt per iteration)
+#define MEET_HISTOGRAM_BINS (MEET_ITERATIONS_MAX + 2)
+#define SEGMENT_BUDGET      0.5 // share of a segment's time its exec may use before it counts as an overrun
+
+typedef struct mpProfile {
+    uint32_t start_ms;          // SysTick time of the last clear
+    mpProfileCounter_t slot[PROFILE_SLOTS];
+    uint32_t meet[MEET_HISTOGRAM_BINS]; // _get_meet_velocity() calls by iterations taken
+    uint32_t segment_cycles;    // cycles in the segment time being run - set with the segment time...
+    uint32_t budget_cycles;     // ...and SEGMENT_BUDGET of them, so segments compare with no float math
+    uint32_t load_cycles;       // cycles used by the most heavily loaded segment...
+    uint32_t load_segment_cycles; // ...and the cycles in its segment time
+    uint32_t segment_overruns;  // segments that used more than SEGMENT_BUDGET of their time
+} mpProfile_t;
+
+#ifdef __PLANNER_PROFILING
+
+extern mpProfile_t mpf;
+
+struct mpProfileScope {         // records cycles spent in the enclosing scope
+    mpProfileCounter_t *c;
+    uint32_t start;
+
+    mpProfileScope(const mpProfileSlot slot) : c(&mpf.slot[slot]), start(DWT->CYCCNT) {};
+    ~mpProfileScope() {
+        uint32_t cycles = DWT->CYCCNT - start;  // unsigned math handles counter wrap
+        c->count++;
+        c->cycles += cycles;
+        if (cycles > c->max_cycles) {
+            c->max_cycles = cycles;
+        }
+    };
+};
+void mp_profile_segment_time(const float segment_time);
+void mp_profile_segment(const uint32_t cycles);
+
+struct mpSegmentScope {         // records cycles and the share of the time budget used by a segment
+    uint32_t start;
+
+    mpSegmentScope() : start(DWT->CYCCNT) {};
+    ~mpSegmentScope() { mp_profile_segment(DWT->CYCCNT - start); };
+};
+#define PROFILE_SCOPE(s)    mpProfileScope _profile_scope(s)
+#define PROFILE_SEGMENT_SCOPE       mpSegmentScope _segment_scope
+#define PROFILE_SEGMENT_TIME(t)     mp_profile_segment_time(t)
+#define COUNT_MEET_ITERATIONS(i)    { mpf.meet[i]++; }
+
+#else
+#define PROFILE_SCOPE(s)
+#define PROFILE_SEGMENT_SCOPE
+#define PROFILE_SEGMENT_TIME(t)
+#define COUNT_MEET_ITERATIONS(i)
+#endif
+
+/* Segment Trace
+ *
+ *  Captures the input to every st_prep_line() call into a RAM buffer so the motion actually
+ *  sent to the steppers can be analyzed offline. Each record holds the segment's travel steps,
+ *  segment time and following error, plus the jerk and line number of the block it came from.
+ *
+ *  Arm the capture with {"_sgt":1}, run the moves, then dump the mst structure with
+ *  Resources/debug/segment_trace.gdb and run Resources/debug/segment_analyze.py on the result.
+ *  Capture is one-shot: it stops when the buffer is full so the start of a program is kept.
+ *  {"_sgt":n} returns the number of records captured; {"_sgt":0} disarms the capture.
+ *
+ *  The buffer costs sizeof(mpSegmentRecord_t) * SEGMENT_TRACE_RECORDS of RAM (~11K for
+ *  4 motors), so it's compiled out unless you uncomment __SEGMENT_TRACE.
+ *  The layout is read by the analyzer - bump SEGMENT_TRACE_VERSION if you change it.
+ */
+
+//#define __SEGMENT_TRACE               // uncomment to enable segment trace capture
+#define SEGMENT_TRACE_RECORDS 256
+#define SEGMENT_TRACE_MAGIC 0x31544753  // "SGT1" as little-endian uint32
+#define SEGMENT_TRACE_VERSION 1
+
+typedef struct mpSegmentRecord {        // all 32 bit fields so the layout has no padding
+    uint32_t block;                     // block sequence number - changes at every block boundary
+    uint32_t linenum;                   // gcode line number of the block, 0 for shaper settle
+    float jerk;                         // bf->jerk of the block (mm/min^3), 0 for shaper settle
+    float segment_time;                 // segment time in minutes
+    float travel_steps[MOTORS];         // travel steps passed to st_prep_line()
+    float following_error[MOTORS];      // following error used by st_prep_line()
+} mpSegmentRecord_t;
+
+typedef struct mpSegmentTrace {
+    uint32_t magic;                     // SEGMENT_TRACE_MAGIC
+    uint32_t version;                   // SEGMENT_TRACE_VERSION
+    uint32_t motors;                    // MOTORS
+    uint32_t capacity;                  // SEGMENT_TRACE_RECORDS
+    uint32_t count;                     // records captured since armed
+    volatile uint32_t armed;            // true while capturing - cleared from main loop
+    uint32_t motor_map[MOTORS];         // motor to axis mapping at time of arming
+    float steps_per_unit[MOTORS];       // steps per unit at time of arming
+    mpSegmentRecord_t rec[SEGMENT_TRACE_RECORDS];
+} mpSegmentTrace_t;
+
+#ifdef __SEGMENT_TRACE
+extern mpSegmentTrace_t mst;
+#endif
+
 /*
  *  Planner structures
  *
@@ -311,18 +474,46 @@ typedef enum {                      // code blocks for planning and trapezoid ge
 
 //**** Planner Queue Structures ****
 
+typedef struct mpArc {                  // arc geometry carried by BLOCK_TYPE_ARC buffers
+    uint8_t plane_axis_0;               // arc plane axis 0 - e.g. X for G17
+    uint8_t plane_axis_1;               // arc plane axis 1 - e.g. Y for G17
+    uint8_t linear_axis;                // linear axis (normal to plane)
+    float center_0;                     // center of circle at plane axis 0
+    float center_1;                     // center of circle at plane axis 1
+    float radius;
+    float theta;                        // starting angle of arc (see plan_arc.cpp / _compute_arc())
+    float angular_travel;               // travel along the arc in radians
+    float linear_travel;                // travel along linear axis of arc in mm
+    float exit_unit[AXES];              // unit vector at the end of the arc - used for the next junction
+} mpArc_t;
+
+/*
+ *  Planner buffers are split in two. mpBuf_t holds the fields back-planning walks through
+ *  (lengths, velocities, jerk terms, hint and state) and is kept small so more of them fit
+ *  in RAM. The Gcode model state and arc geometry are only written when the block is queued
+ *  and read again when it runs, so they live in a parallel side table of mpBufState_t that
+ *  each buffer points into.
+ */
+
+typedef struct mpBufState {             // cold side of a planner buffer - queueing and runtime only
+    mpArc_t arc;                        // arc geometry - only valid for BLOCK_TYPE_ARC
+    GCodeState_t gm;                    // Gcode model state - passed from model, used by planner and runtime
+} mpBufState_t;
+
 typedef struct mpBuffer {
 
-    // *** CAUTION *** These two pointers are not reset by _clear_buffer()
+    // *** CAUTION *** These four pointers are not reset by _clear_buffer()
     struct mpBuffer *pv;                // static pointer to previous buffer
     struct mpBuffer *nx;                // static pointer to next buffer
+    GCodeState_t *gm;                   // static pointer to this buffer's Gcode model state in the side table
+    mpArc_t *arc;                       // static pointer to this buffer's arc geometry in the side table
     uint8_t buffer_number;              // DIAGNOSTIC for easier debugging
 
     stat_t (*bf_func)(struct mpBuffer *bf); // callback to buffer exec function
     cm_exec_t cm_func;                  // callback to canonical machine execution function
 
 #ifdef __PLANNER_DIAGNOSTICS
-    uint32_t linenum;                   // mirror of bf->gm.linenum
+    uint32_t linenum;                   // mirror of bf->gm->linenum
     int iterations;
     float block_time_ms;
     float plannable_time_ms;            // time in planner
@@ -367,8 +558,6 @@ typedef struct mpBuffer {
     float sqrt_j;                       // sqrt(jM) used for planning (computed and cached)
     float q_recip_2_sqrt_j;             // (q/(2 sqrt(jM))) where q = (sqrt(10)/(3^(1/4))), used in length computations (computed and cached)
 
-    GCodeState_t gm;                    // Gcode model state - passed from model, used by planner and runtime
-
     // clears the above structure
     void reset() {
         bf_func = nullptr;
@@ -407,7 +596,7 @@ typedef struct mpBuffer {
         recip_jerk = 0.0;
         sqrt_j = 0.0;
         q_recip_2_sqrt_j = 0.0;
-        gm.reset();
+        gm->reset();
     }
 } mpBuf_t;
 
@@ -418,6 +607,7 @@ typedef struct mpPlannerQueue {         // control structure for queue
     uint8_t queue_size;                 // total number of buffers, one-based (e.g. 48 not 47)
     uint8_t buffers_available;          // running count of available buffers in queue
     mpBuf_t *bf;                        // pointer to buffer pool (storage array)
+    mpBufState_t *bs;                   // pointer to buffer state side table (storage array)
     magic_t magic_end;
 } mpPlannerQueue_t;
 
@@ -448,6 +638,12 @@ typedef struct mpPlannerRuntime {       // persistent runtime variables
     bool out_of_band_dwell_flag;        // set true to conditionally execute out-of-band dwell
     float out_of_band_dwell_seconds;    // time for out-of-band dwell
 
+    blockType block_type;               // BLOCK_TYPE_ALINE or BLOCK_TYPE_ARC
+    mpArc_t arc;                        // arc geometry for arc blocks
+    float arc_length;                   // length of the running arc
+    float arc_distance;                 // distance travelled along the running arc
+    float arc_linear_start;             // linear axis position at the start of the arc
+
     float unit[AXES];                   // unit vector for axis scaling & planning
     bool axis_flags[AXES];              // set true for axes participating in the move
     float target[AXES];                 // final target for bf (used to correct rounding errors)
@@ -456,7 +652,7 @@ typedef struct mpPlannerRuntime {       // persistent runtime variables
 
     float target_steps[MOTORS];         // current MR target (absolute target as steps)
     float position_steps[MOTORS];       // current MR position (target from previous segment)
-    float commanded_steps[MOTORS];      // will align with next encoder sample (target from 2nd previous segment)
+    float commanded_steps[MOTORS];      // target of the segment the encoder was last compared to
     float encoder_steps[MOTORS];        // encoder position in steps - ideally the same as commanded_steps
     float following_error[MOTORS];      // difference between encoder_steps and commanded steps
 
@@ -563,6 +759,8 @@ extern mpPlannerRuntime_t mr2;          // secondary planner runtime context
 
 extern mpBuf_t mp1_queue[PLANNER_QUEUE_SIZE];   // storage allocation for primary planner queue buffers
 extern mpBuf_t mp2_queue[SECONDARY_QUEUE_SIZE]; // storage allocation for secondary planner queue buffers
+extern mpBufState_t mp1_state[PLANNER_QUEUE_SIZE];   // side table for primary planner queue buffers
+extern mpBufState_t mp2_state[SECONDARY_QUEUE_SIZE]; // side table for secondary planner queue buffers
 
 /*
  * Global Scope Functions
@@ -570,7 +768,7 @@ extern mpBuf_t mp2_queue[SECONDARY_QUEUE_SIZE]; // storage allocation for second
 
 //**** planner.cpp functions
 
-void planner_init(mpPlanner_t *_mp, mpPlannerRuntime_t *_mr, mpBuf_t *queue, uint8_t queue_size);
+void planner_init(mpPlanner_t *_mp, mpPlannerRuntime_t *_mr, mpBuf_t *queue, mpBufState_t *state, uint8_t queue_size);
 void planner_reset(mpPlanner_t *_mp);
 stat_t planner_assert(const mpPlanner_t *_mp);
 
@@ -605,6 +803,12 @@ void mp_start_traverse_override(const float ramp_time, const float override);
 void mp_end_traverse_override(const float ramp_time);
 void mp_planner_time_accounting(void);
 
+void mp_profile_reset(void);
+stat_t mp_get_pf(nvObj_t *nv);
+void mp_trace_segment(const float travel_steps[], const float following_error[], const float segment_time, const bool settle);
+stat_t mp_get_sgt(nvObj_t *nv);
+stat_t mp_set_sgt(nvObj_t *nv);
+
 //**** planner buffer primitives
 //void mp_init_planner_buffers(void);
 //mpBuf_t * mp_get_w(int8_t q);
@@ -632,6 +836,11 @@ bool mp_get_runtime_busy(void);
 bool mp_runtime_is_idle(void);
 
 stat_t mp_aline(GCodeState_t *_gm);                   // line planning...
+stat_t mp_arc(GCodeState_t *_gm, const cmArc_t *_arc);
+stat_t mp_merge_line(GCodeState_t *_gm, const float start[]);
+void mp_merge_flush(void);
+void mp_merge_discard(void);
+void mp_merge_callback(void);
 void mp_plan_block_list(void);
 void mp_plan_block_forward(mpBuf_t *bf);
 
@@ -3,27 +3,33 @@
 
 #include "pwm_motor.h"
 #include "gpio.h"
+#include "report.h"
+
+// pwm_timer is TimerChannel<6,0> in hardware.h, which is TC2 channel 0
+#define PWM_TC      (&TC2->TC_CHANNEL[0])
 
 // Feeder
 #if PWM_MOTORS_ARRANGEMENT == 1
 pwm_motor_t pwm_motors[PWM_MOTOR_COUNT] = {
-  { 0, 10000, 0, PIOA, 1 << 6, true}, // M1 - V2 - D58 - PA6
-  { 0, 10000, 0, PIOA, 1 << 22, true}, // M2 - V3 - D57 - PA22
-  { 0, 0, 0, PIOC, 1 << 15, false}, // M3 - Step 3 - D48 - PC15
-  { 0, 0, 0, PIOC, 1 << 17, false}, // M4 - Step 4 - D46 - PC17
-  { 0, 0, 0, PIOC, 1 << 19, false}, // M5 - Step 5 - D44 - PC19
-  { 0, 0, 0, PIOA, 1 << 19, false}, // M6 - Step 6 - D42 - PA19
-  { 0, 0, 0, PIOC, 1 << 8, false}, // M7 - Step 7 - D40 - PC8
-  { 0, 0, 0, PIOC, 1 << 6, false}, // M8 - Step 8 - D38 - PC6
-  { 0, 0, 0, PIOC, 1 << 4, false}, // M9 - Step 9 - D36 - PC4
+  { 0, 0.5, 0, 0, 0, PIOA, 1 << 6, true}, // M1 - V2 - D58 - PA6
+  { 0, 0.5, 0, 0, 0, PIOA, 1 << 22, true}, // M2 - V3 - D57 - PA22
+  { 0, 0.5, 0, 0, 0, PIOC, 1 << 15, false}, // M3 - Step 3 - D48 - PC15
+  { 0, 0.5, 0, 0, 0, PIOC, 1 << 17, false}, // M4 - Step 4 - D46 - PC17
+  { 0, 0.5, 0, 0, 0, PIOC, 1 << 19, false}, // M5 - Step 5 - D44 - PC19
+  { 0, 0.5, 0, 0, 0, PIOA, 1 << 19, false}, // M6 - Step 6 - D42 - PA19
+  { 0, 0.5, 0, 0, 0, PIOC, 1 << 8, false}, // M7 - Step 7 - D40 - PC8
+  { 0, 0.5, 0, 0, 0, PIOC, 1 << 6, false}, // M8 - Step 8 - D38 - PC6
+  { 0, 0.5, 0, 0, 0, PIOC, 1 << 4, false}, // M9 - Step 9 - D36 - PC4
 };
 #else
 // Dosing Feeder
 pwm_motor_t pwm_motors[PWM_MOTOR_COUNT] = {
-  { 0, 0, 0, PIOB, 1 << 25, false} // Conveyor motor - D2 - B25
+  { 0, 0.5, 0, 0, 0, PIOB, 1 << 25, false} // Conveyor motor - D2 - B25
 };
 #endif
 
+static uint32_t pwm_active = 0; // bitmask of motors with a pending toggle event
+
 void setup_pwm_motors() {
   // setup motors
   for (int i = 0; i < PWM_MOTOR_COUNT; i++) {
@@ -33,6 +39,12 @@ void setup_pwm_motors() {
     m->reg->PIO_PUDR = m->reg_mask; // Disable the pull up resistor
   }
 
+  // take over pwm_timer as a free-running 32 bit counter with a compare A interrupt
+  PWM_TC->TC_CCR = TC_CCR_CLKDIS;
+  PWM_TC->TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP;
+  PWM_TC->TC_IDR = 0xFFFFFFFF;    // compare A is enabled only while events are pending
+  PWM_TC->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+
 #ifdef PM_FEEDER
   // setup holder conveyors motor direction controller
   // M3, M4, Dir3, Dir4 - D49, D47
@@ -50,27 +62,136 @@ void setup_pwm_motors() {
 #endif
 }
 
-void pwm_motors_step() {
-  for (int i = 0; i < PWM_MOTOR_COUNT; i++) {
-    pwm_motor *m = &pwm_motors[i];
-    if (!m->x_counter_on) continue;
-    if (m->blocked) {
-      m->reg->PIO_CODR = m->reg_mask; // clear
-      continue;
+/*
+ * _pwm_schedule() - run all due toggles and program compare A for the earliest pending one
+ *
+ * Events within PWM_MOTOR_SLACK_TICKS of now are run early rather than scheduled, and
+ * the loop repeats if the counter passed the new compare value while we were working -
+ * otherwise that match would not happen until the counter wraps. A motor that fell a
+ * whole phase behind is resynced to now rather than catching up in a burst.
+ * Called from the pwm_timer interrupt, or with interrupts disabled.
+ */
+static void _pwm_schedule() {
+  uint32_t next = 0;
+
+  do {
+    if (pwm_active == 0) {
+      PWM_TC->TC_IDR = TC_IDR_CPAS;
+      return;
     }
-
-    if (m->counter == 0) {
-      // step
-      if (m->reg->PIO_ODSR & m->reg_mask) {
-        m->reg->PIO_CODR = m->reg_mask; // clear
-        m->counter = m->x_counter_off;
+    uint32_t now = PWM_TC->TC_CV;
+    int32_t earliest = INT32_MAX;
+
+    for (uint32_t active = pwm_active; active; active &= active - 1) {
+      pwm_motor *m = &pwm_motors[__builtin_ctz(active)];
+      int32_t until = (int32_t)(m->next_event - now);
+
+      if (until <= (int32_t)PWM_MOTOR_SLACK_TICKS) {
+        uint32_t phase;
+        if (m->reg->PIO_ODSR & m->reg_mask) {
+          m->reg->PIO_CODR = m->reg_mask; // clear
+          phase = m->ticks_off;
+        } else {
+          m->reg->PIO_SODR = m->reg_mask; // set
+          phase = m->ticks_on;
+        }
+        m->next_event += phase;
+        until = (int32_t)(m->next_event - now);
+        if (until <= 0) {
+          m->next_event = now + phase;
+          until = (int32_t)phase;
+        }
       }
-      else {
-        m->reg->PIO_SODR = m->reg_mask; // set
-        m->counter = m->x_counter_on;
+      if (until < earliest) {
+        earliest = until;
+        next = m->next_event;
       }
     }
-    m->counter--;
+    PWM_TC->TC_RA = next;
+    PWM_TC->TC_IER = TC_IER_CPAS;
+  } while ((int32_t)(next - PWM_TC->TC_CV) <= (int32_t)PWM_MOTOR_SLACK_TICKS);
+}
+
+void pwm_motors_step() {      // called from the pwm_timer interrupt on compare A
+  _pwm_schedule();
+}
+
+/*
+ * _pwm_restart() - apply a new frequency, duty or blocked state to a motor
+ *
+ * Starts a new period with the high phase. Motors that are stopped, blocked or at 0% or
+ * 100% duty get a static pin level and drop out of the scheduler.
+ */
+static void _pwm_restart(const uint8_t motor_index) {
+  pwm_motor *m = &pwm_motors[motor_index];
+
+  __disable_irq();                // also called from the special functions SysTick
+  pwm_active &= ~(1 << motor_index);
+  if (m->blocked || (m->ticks_on == 0)) {
+    m->reg->PIO_CODR = m->reg_mask; // clear
+  } else if (m->ticks_off == 0) {
+    m->reg->PIO_SODR = m->reg_mask; // set - 100% duty
+  } else {
+    m->reg->PIO_SODR = m->reg_mask; // set
+    m->next_event = PWM_TC->TC_CV + m->ticks_on;
+    pwm_active |= (1 << motor_index);
+  }
+  _pwm_schedule();
+  __enable_irq();
+}
+
+// convert frequency and duty to phase lengths. Returns true if they changed
+static bool _pwm_update_ticks(pwm_motor *m) {
+  uint32_t ticks_on = 0;
+  uint32_t ticks_off = 0;
+
+  if (m->frequency > 0) {
+    uint32_t period = (uint32_t)(PWM_MOTOR_TICKS_PER_SEC / m->frequency);
+    ticks_on = (uint32_t)(period * m->duty);
+    ticks_off = period - ticks_on;
+    if ((ticks_on > 0) && (ticks_on < PWM_MOTOR_MIN_TICKS)) { ticks_on = PWM_MOTOR_MIN_TICKS; }
+    if ((ticks_off > 0) && (ticks_off < PWM_MOTOR_MIN_TICKS)) { ticks_off = PWM_MOTOR_MIN_TICKS; }
+  }
+  if ((ticks_on == m->ticks_on) && (ticks_off == m->ticks_off)) {
+    return false;
+  }
+  __disable_irq();                // the ISR reads these
+  m->ticks_on = ticks_on;
+  m->ticks_off = ticks_off;
+  __enable_irq();
+  return true;
+}
+
+stat_t pwm_motor_set_frequency(const uint8_t motor_index, const float frequency) {
+  if (motor_index >= PWM_MOTOR_COUNT) { return STAT_INPUT_VALUE_RANGE_ERROR; }
+  if ((frequency < 0) || (frequency > (PWM_MOTOR_TICKS_PER_SEC / (2 * PWM_MOTOR_MIN_TICKS)))) {
+    return STAT_INPUT_VALUE_RANGE_ERROR;
+  }
+  pwm_motor *m = &pwm_motors[motor_index];
+  m->frequency = frequency;
+  if (_pwm_update_ticks(m)) {
+    _pwm_restart(motor_index);
+  }
+  return STAT_OK;
+}
+
+stat_t pwm_motor_set_duty(const uint8_t motor_index, const float duty) {
+  if (motor_index >= PWM_MOTOR_COUNT) { return STAT_INPUT_VALUE_RANGE_ERROR; }
+  if ((duty < 0) || (duty > 1)) { return STAT_INPUT_VALUE_RANGE_ERROR; }
+  pwm_motor *m = &pwm_motors[motor_index];
+  m->duty = duty;
+  if (_pwm_update_ticks(m)) {
+    _pwm_restart(motor_index);
+  }
+  return STAT_OK;
+}
+
+void pwm_motor_set_blocked(const uint8_t motor_index, const bool blocked) {
+  pwm_motor *m = &pwm_motors[motor_index];
+  if (m->blocked != blocked) {
+    m->blocked = blocked;
+    sr_flag_change(SR_SOURCE_IO);
+    _pwm_restart(motor_index);
   }
 }
 
@@ -91,47 +212,23 @@ stat_t pwm_motor_get_value(nvObj_t *nv)
 {
   // always return if sensor is blocked, if asked about {m1:n}
   uint8_t motor_index = nv_index_2_motor_index(nv->index);
+  if (motor_index >= PWM_MOTOR_COUNT) {
+    nv->valuetype = TYPE_NULL;
+    return STAT_INPUT_VALUE_RANGE_ERROR;
+  }
   nv->valuetype = TYPE_INTEGER;
   nv->value_int = pwm_motors[motor_index].blocked;
   return STAT_OK;
 }
 
-stat_t pwm_motor_set_value_simple(uint8_t motor_index, uint32_t value) {
-  bool m11_m12 = false;
-
-  // if (motor_index > 11 || ) return STAT_OK; // bad motors
-  if (motor_index > 9) {motor_index -= 10; m11_m12 = true;} // translate M11, M12 to M1, M2
-
-  pwm_motor *m = &pwm_motors[motor_index];
-
-#if PWM_MOTORS_ARRANGEMENT == 1
-  if(motor_index < 2) { //  M1, M2
-    if (m11_m12)
-      m->x_counter_off = value;
-    else
-      m->x_counter_on = value;
-
-  } else {
-    m->x_counter_on = value;
-    m->x_counter_off = value;
-  }
-#else
-  m->x_counter_on = value;
-  m->x_counter_off = value;
-#endif
-
-
-  if (m->x_counter_on == 0) {
-    m->reg->PIO_CODR = m->reg_mask;  // clear
-  }
-
-  return STAT_OK;
-}
-
-
+// {m1:n} .. {m9:n} set the motor frequency in Hz (0 stops it)
+// {m11:n}, {m12:n} set the duty cycle of M1, M2 in percent. Other motors run at 50%
 stat_t pwm_motor_set_value(nvObj_t *nv) {
   uint8_t motor_index = nv_index_2_motor_index(nv->index);
-  return pwm_motor_set_value_simple(motor_index, (uint32_t)nv->value_flt);
+  if (motor_index > 9) {      // M11, M12 -> duty of M1, M2
+    return pwm_motor_set_duty(motor_index - 10, nv->value_flt / 100);
+  }
+  return pwm_motor_set_frequency(motor_index, nv->value_flt);
 }
 
 
@@ -15,13 +15,22 @@
 # define PWM_MOTOR_COUNT 1
 #endif
 
+// PWM motors are driven by an event scheduler on pwm_timer (see hardware.h). The timer
+// free-runs at PWM_MOTOR_TICKS_PER_SEC and a single compare match is programmed for the
+// earliest pending pin toggle. Stopped and blocked motors schedule no events.
+#define PWM_MOTOR_TICKS_PER_SEC (SystemCoreClock / 2)       // TIMER_CLOCK1 = MCK/2
+#define PWM_MOTOR_MIN_TICKS     (PWM_MOTOR_TICKS_PER_SEC / 200000) // 5 uS - shortest high or low phase
+#define PWM_MOTOR_SLACK_TICKS   (PWM_MOTOR_TICKS_PER_SEC / 1000000) // events this close are run early
+
 typedef struct pwm_motor {
-  uint32_t x_counter_on; // total counter on
-  uint32_t x_counter_off; // total counter off
-  uint32_t counter;   // current counter
-  Pio     *reg;       // PIO;
+  float    frequency;   // Hz, 0 = stopped
+  float    duty;        // fraction of the period the pin is high (0.0 - 1.0)
+  uint32_t ticks_on;    // high phase in timer ticks
+  uint32_t ticks_off;   // low phase in timer ticks
+  uint32_t next_event;  // timer value of the next toggle
+  Pio     *reg;         // PIO;
   uint32_t reg_mask;
-  bool blocked;
+  bool     blocked;     // blocked by sensor - pin held low
 } pwm_motor_t;
 
 
@@ -30,11 +39,14 @@ extern pwm_motor_t pwm_motors[PWM_MOTOR_COUNT];
 void    setup_pwm_motors();
 void    pwm_motors_step();
 
+stat_t  pwm_motor_set_frequency(const uint8_t motor_index, const float frequency);
+stat_t  pwm_motor_set_duty(const uint8_t motor_index, const float duty);
+void    pwm_motor_set_blocked(const uint8_t motor_index, const bool blocked);
+
 uint8_t nv_index_2_motor_index(const index_t index);
 void    pwm_motor_print_out(nvObj_t *nv);
 stat_t  pwm_motor_get_value(nvObj_t *nv);
 stat_t  pwm_motor_set_value(nvObj_t *nv);
-stat_t pwm_motor_set_value_simple(uint8_t, uint32_t);
 
 #endif // PWM_MOTORS_AVAILABLE
 #endif // PWM_MOTOR_H_ONCE
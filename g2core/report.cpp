@@ -32,6 +32,10 @@
 #include "json_parser.h"
 #include "text_parser.h"
 #include "planner.h"
+#include "gpio.h"
+#include "spindle.h"
+#include "coolant.h"
+#include "pwm_motor.h"
 #include "settings.h"
 #include "util.h"
 #include "xio.h"
@@ -41,6 +45,7 @@
 
 srSingleton_t sr;
 qrSingleton_t qr;
+btSingleton_t bt;
 
 /**** Exception Reports ************************************************************
  *
@@ -60,8 +65,18 @@ stat_t rpt_exception(stat_t status, const char *msg)
         // you cannot send an exception report if the USB has not been set up. Causes a processor exception.
         if (cs.controller_state >= CONTROLLER_READY) {
             char buffer[128];
-            sprintf(buffer, "{\"er\":{\"fb\":%0.2f,\"st\":%d,\"msg\":\"%s - %s\"}}\n",
-                             G2CORE_FIRMWARE_BUILD, status, get_status_message(status), msg);
+            char *str = buffer;
+            str_concat(str, "{\"er\":{\"fb\":");
+            str += floattoa(str, G2CORE_FIRMWARE_BUILD, 2);
+            str_concat(str, ",\"st\":");
+            str += inttoa(str, status);
+            str_concat(str, ",\"msg\":\"");
+            strcpy(str, get_status_message(status));
+            str += strlen(str);
+            str_concat(str, " - ");
+            strcpy(str, msg);
+            str += strlen(str);
+            str_concat(str, "\"}}\n");
             xio_writeline(buffer);
         }
     }
@@ -167,6 +182,8 @@ void rpt_print_system_ready_message(void)
  */
 static stat_t _populate_unfiltered_status_report(void);
 static uint8_t _populate_filtered_status_report(void);
+static uint8_t _sr_field_sources(const index_t index);
+static uint8_t _sr_take_changes(void);
 
 uint8_t _is_stat(nvObj_t *nv)
 {
@@ -188,6 +205,7 @@ void sr_init_status_report()
 {
     nvObj_t *nv = nv_reset_nv_list();    // used for status report persistence locations
     sr.status_report_request = SR_OFF;
+    memset(sr.source_index, 0, sizeof(sr.source_index));       // read every field in the next report
     char sr_defaults[NV_STATUS_REPORT_LEN][TOKEN_LEN+1] = { STATUS_REPORT_DEFAULTS };
     nv->index = nv_get_index((const char *)"", (char *)"se00");    // set first SR persistence index
 
@@ -365,12 +383,12 @@ static stat_t _populate_unfiltered_status_report()
  *  Designed to be displayed as a JSON object; i.e. no footer or header
  *  Returns 'true' if the report has new data, 'false' if there is nothing to report.
  *
+ *  Only fields whose source has changed since the last report are read (see report.h).
+ *  A report where nothing changed returns before the nvObj list is touched.
+ *
  *  NOTE: Unlike sr_populate_unfiltered_status_report(), this function does NOT set
  *  the SR index, which is a relatively expensive operation. In current use this
  *  doesn't matter, but if the caller assumes its set it may lead to a side-effect (bug)
- *
- *  NOTE: Room for improvement - look up the SR index initially and cache it, use the
- *        cached value for all remaining reports.
  */
 static uint8_t _populate_filtered_status_report()
 {
@@ -378,6 +396,32 @@ static uint8_t _populate_filtered_status_report()
     bool has_data = false;
     char tmp[TOKEN_LEN+1];
     float current_value;
+    uint8_t changes = _sr_take_changes();       // take the flags before reading any values
+    bool read[NV_STATUS_REPORT_LEN];
+    bool any_read = false;
+
+    // work out which fields to read. stat is always reported while it's a stop or end
+    for (uint8_t i=0; i<NV_STATUS_REPORT_LEN; i++) {
+        index_t index = sr.status_report_list[i];
+        if (index == 0) {                       // end of list
+            break;
+        }
+        if (sr.source_index[i] != index) {      // new list entry - always read it once
+            sr.source_index[i] = index;
+            sr.source_bits[i] = _sr_field_sources(index);
+            read[i] = true;
+        } else {
+            read[i] = ((sr.source_bits[i] & changes) ||
+                       ((index == sr.stat_index) &&
+                        ((sr.status_report_value[i] == COMBINED_PROGRAM_STOP) ||
+                         (sr.status_report_value[i] == COMBINED_PROGRAM_END))));
+        }
+        any_read |= read[i];
+    }
+    if (!any_read) {
+        return (false);
+    }
+
     nvObj_t *nv = nv_reset_nv_list();           // sets nv to the start of the body
     
     // Set thresholds to detect value changes based on precision for the value. 
@@ -390,9 +434,13 @@ static uint8_t _populate_filtered_status_report()
     nv = nv->nx;                                // no need to check for NULL as list has just been reset
 
     for (uint8_t i=0; i<NV_STATUS_REPORT_LEN; i++) {
-        if ((nv->index = sr.status_report_list[i]) == 0) {  // end of list
+        if (sr.status_report_list[i] == 0) {    // end of list
             break;
         }
+        if (!read[i]) {                         // nothing it depends on has changed
+            continue;
+        }
+        nv->index = sr.status_report_list[i];
         nv_get_nvObj(nv);
 
         // extract the value and cast into a float, regardless of value type 
@@ -424,6 +472,86 @@ static uint8_t _populate_filtered_status_report()
     return (has_data);
 }
 
+/*
+ * _sr_state_signature() - pack the states reported by the STATE fields into one word
+ * _sr_take_changes()    - collect and clear the change flags, returns the sources that changed
+ *
+ *  Flags are cleared before any value is read, so a change that lands while the report
+ *  is being built is picked up by the next one. SR_ALWAYS is always returned.
+ */
+static uint32_t _sr_state_signature(const cmMachine_t *_cm)
+{
+    return ((uint32_t)_cm->machine_state | ((uint32_t)_cm->cycle_type << 8) |
+            ((uint32_t)_cm->motion_state << 16) | ((uint32_t)_cm->hold_state << 24)) ^
+           (((uint32_t)_cm->homing_state << 4) | ((uint32_t)_cm->probe_state[0] << 12));
+}
+
+static uint8_t _sr_take_changes()
+{
+    uint8_t changes = SR_ALWAYS;
+
+    uint32_t signature[2] = { _sr_state_signature(&cm1), _sr_state_signature(&cm2) };
+    if ((signature[0] != sr.state_signature[0]) || (signature[1] != sr.state_signature[1])) {
+        sr.state_signature[0] = signature[0];
+        sr.state_signature[1] = signature[1];
+        changes |= (1 << SR_SOURCE_STATE);
+    }
+    for (uint8_t source = 0; source < SR_SOURCES; source++) {
+        if (sr.changed[source]) {
+            sr.changed[source] = false;
+            changes |= (1 << source);
+        }
+    }
+    return (changes);
+}
+
+/*
+ * _sr_field_sources() - return the source bits for a status report field, from its GET function
+ */
+static uint8_t _sr_field_sources(const index_t index)
+{
+    fptrCmd get = cfgArray[index].get;
+
+    if ((get == cm_get_pos) || (get == cm_get_mpo) || (get == cm_get_ofs)) {
+        return ((1 << SR_SOURCE_RUNTIME) | (1 << SR_SOURCE_MODEL));
+    }
+    if (get == cm_get_vel) {
+        return ((1 << SR_SOURCE_RUNTIME) | (1 << SR_SOURCE_STATE));
+    }
+    if ((get == cm_get_line) || (get == cm_get_mline) || (get == cm_get_feed) ||
+        (get == cm_get_unit) || (get == cm_get_coor) || (get == cm_get_momo) ||
+        (get == cm_get_plan) || (get == cm_get_path) || (get == cm_get_dist) ||
+        (get == cm_get_admo) || (get == cm_get_frmo) || (get == cm_get_toolv) ||
+        (get == cm_get_g92e)) {
+        return (1 << SR_SOURCE_MODEL);
+    }
+    if ((get == cm_get_stat) || (get == cm_get_stat2) || (get == cm_get_macs) ||
+        (get == cm_get_cycs) || (get == cm_get_mots) || (get == cm_get_hold) ||
+        (get == cm_get_home) || (get == cm_get_hom) || (get == cm_get_prob) ||
+        (get == cm_get_prb)) {
+        return (1 << SR_SOURCE_STATE);
+    }
+    if ((get == qr_get) || (get == qi_get) || (get == qo_get)) {
+        return (1 << SR_SOURCE_QUEUE);
+    }
+#ifndef READ_INS_DIRECTLY_FEEDER                // some inputs are read straight from the port
+    if (get == io_get_input) {
+        return (1 << SR_SOURCE_IO);
+    }
+#endif
+#if PWM_MOTORS_AVAILABLE
+    if (get == pwm_motor_get_value) {
+        return (1 << SR_SOURCE_IO);
+    }
+#endif
+    if ((get == io_get_output) ||
+        (get == sp_get_spc) || (get == sp_get_sps) || (get == sp_get_spo) ||
+        (get == co_get_com) || (get == co_get_cof)) {
+        return (1 << SR_SOURCE_IO);
+    }
+    return (SR_ALWAYS);
+}
+
 
 /****************************
  * END OF REPORT FUNCTIONS *
@@ -511,9 +639,12 @@ void qr_request_queue_report(int8_t buffers)
     qr.buffers_available = mp_get_planner_buffers(mp);
     if (buffers > 0) {
         qr.buffers_added += buffers;
+        bt.buffers_added += buffers;
     } else {
         qr.buffers_removed -= buffers;
+        bt.buffers_removed -= buffers;
     }
+    sr_flag_change(SR_SOURCE_QUEUE);
 
     // time-throttle requests while generating arcs
 //    qr.motion_mode = cm_get_motion_mode(ACTIVE_MODEL);
@@ -548,19 +679,28 @@ stat_t qr_queue_report_callback()         // called by controller dispatcher
     qr.queue_report_requested = false;
 
     char report[32];    // we know these reports can't be longer than 30 bytes
+    char *str = report;
 
     if (cs.comm_mode == TEXT_MODE) {
-        if (qr.queue_report_verbosity == QR_SINGLE) {
-            sprintf(report, "qr:%d\n", qr.buffers_available);
-        } else  {
-            sprintf(report, "qr:%d, qi:%d, qo:%d\n", qr.buffers_available,qr.buffers_added,qr.buffers_removed);
+        str_concat(str, "qr:");
+        str += inttoa(str, qr.buffers_available);
+        if (qr.queue_report_verbosity != QR_SINGLE) {
+            str_concat(str, ", qi:");
+            str += inttoa(str, qr.buffers_added);
+            str_concat(str, ", qo:");
+            str += inttoa(str, qr.buffers_removed);
         }
+        str_concat(str, "\n");
     } else {
-        if (qr.queue_report_verbosity == QR_SINGLE) {
-            sprintf(report, "{\"qr\":%d}\n", qr.buffers_available);
-        } else {
-            sprintf(report, "{\"qr\":%d,\"qi\":%d,\"qo\":%d}\n", qr.buffers_available, qr.buffers_added,qr.buffers_removed);
+        str_concat(str, "{\"qr\":");
+        str += inttoa(str, qr.buffers_available);
+        if (qr.queue_report_verbosity != QR_SINGLE) {
+            str_concat(str, ",\"qi\":");
+            str += inttoa(str, qr.buffers_added);
+            str_concat(str, ",\"qo\":");
+            str += inttoa(str, qr.buffers_removed);
         }
+        str_concat(str, "}\n");
     }
     xio_writeline(report);
     qr_init_queue_report();
@@ -616,6 +756,200 @@ stat_t qo_get(nvObj_t *nv)
 stat_t qr_get_qv(nvObj_t *nv) { return(get_integer(nv, (uint8_t &)qr.queue_report_verbosity)); }
 stat_t qr_set_qv(nvObj_t *nv) { return(set_integer(nv, (uint8_t &)qr.queue_report_verbosity, QR_OFF, QR_TRIPLE)); }
 
+/*****************************************************************************
+ * Binary Telemetry
+ *
+ *  See report.h for the record layouts. Records are built straight from the
+ *  canonical machine and planner - none of this goes through the nvObj list
+ *  or the JSON serializer - and are only sent when the telemetry channel is
+ *  connected (see xio_write_telemetry()).
+ */
+
+static_assert(sizeof(btStatusRecord_t) < BT_RECORD_MAX, "binary telemetry status record is too long");
+
+/*
+ * _bt_cobs_encode() - COBS encode a record, returns the encoded length (len + 1)
+ *
+ *  Records are shorter than 254 bytes, so there is never more than one block
+ *  and the encoded data never contains a zero.
+ */
+
+static uint8_t _bt_cobs_encode(const uint8_t *src, const uint8_t len, uint8_t *dst)
+{
+    uint8_t *start = dst;
+    uint8_t *code = dst++;                      // the code byte of the current run
+    uint8_t run = 1;
+
+    for (uint8_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            *code = run;
+            code = dst++;
+            run = 1;
+        } else {
+            *dst++ = src[i];
+            run++;
+        }
+    }
+    *code = run;
+    return (dst - start);
+}
+
+/*
+ * _bt_send() - fill in the header, frame the record and write it to the telemetry channel
+ */
+
+static void _bt_send(btHeader_t *hdr, const btRecordType type, const uint8_t size)
+{
+    uint8_t frame[BT_RECORD_MAX + 3];           // leading delimiter, COBS code, record, trailing delimiter
+
+    hdr->type = type;
+    hdr->version = BT_VERSION;
+    hdr->sequence = bt.sequence++;
+    hdr->timestamp = bt.systick;
+
+    frame[0] = 0;
+    uint8_t len = _bt_cobs_encode((uint8_t *)hdr, size, &frame[1]) + 1;
+    frame[len++] = 0;
+    xio_write_telemetry((char *)frame, len);    // a frame that doesn't fit is cut short - see report.h
+}
+
+static void _bt_send_layout()
+{
+    btLayoutRecord_t r;
+    r.verbosity = bt.verbosity;
+    r.axes = AXES;
+#if ENC2_AVAILABLE
+    r.encoders = 2;
+#else
+    r.encoders = 1;
+#endif
+    r.status_size = sizeof(btStatusRecord_t);
+    r.queue_size = sizeof(btQueueRecord_t);
+    r.encoder_size = sizeof(btEncoderRecord_t);
+    r.interval = bt.interval;
+    _bt_send(&r.hdr, BT_RECORD_LAYOUT, sizeof(r));
+}
+
+static void _bt_send_status()
+{
+    btStatusRecord_t r;
+    r.stat = cm_get_combined_state(&cm1);
+    r.momo = cm_get_motion_mode(ACTIVE_MODEL);
+    r.unit = cm_get_units_mode(ACTIVE_MODEL);
+    r.coor = cm_get_coord_system(ACTIVE_MODEL);
+    r.line = cm_get_linenum(ACTIVE_MODEL);
+    r.vel = 0;
+    if (cm_get_motion_state() != MOTION_STOP) {
+        r.vel = mp_get_runtime_velocity();
+        if (cm_get_units_mode(RUNTIME) == INCHES) {
+            r.vel *= INCHES_PER_MM;
+        }
+    }
+    for (uint8_t axis = 0; axis < AXES; axis++) {
+        r.pos[axis] = cm_get_display_position(ACTIVE_MODEL, axis);
+        r.mpo[axis] = cm_get_absolute_position(ACTIVE_MODEL, axis);
+    }
+    _bt_send(&r.hdr, BT_RECORD_STATUS, sizeof(r));
+}
+
+static void _bt_send_queue()
+{
+    btQueueRecord_t r;
+    r.available = mp_get_planner_buffers(mp);
+    r.reserved[0] = r.reserved[1] = r.reserved[2] = 0;
+    r.added = bt.buffers_added;
+    r.removed = bt.buffers_removed;
+    _bt_send(&r.hdr, BT_RECORD_QUEUE, sizeof(r));
+}
+
+static void _bt_send_encoder()
+{
+    btEncoderRecord_t r;
+    r.count[0] = (int32_t)REG_TC0_CV0;
+#if ENC2_AVAILABLE
+    r.count[1] = (int32_t)REG_TC2_CV0;
+#else
+    r.count[1] = 0;
+#endif
+    _bt_send(&r.hdr, BT_RECORD_ENCODER, sizeof(r));
+}
+
+/*
+ * bt_telemetry_callback() - main loop callback to send telemetry records when they are due
+ *
+ *  Records are not throttled in time-constrained intervals like status reports -
+ *  they cost a few microseconds to build and don't touch the control channel.
+ */
+
+stat_t bt_telemetry_callback()          // called by controller dispatcher
+{
+    if (bt.verbosity == 0) {
+        return (STAT_NOOP);
+    }
+    if (!xio_telemetry_connected()) {
+        bt.layout_pending = true;       // tell the host what it's getting when it connects
+        return (STAT_NOOP);
+    }
+    uint32_t now = SysTickTimer_getValue();
+    if ((int32_t)(now - bt.systick) < 0) {
+        return (STAT_NOOP);
+    }
+    bt.systick = now;                   // timestamp for all the records sent now
+
+    if (bt.layout_pending) {
+        bt.layout_pending = false;
+        _bt_send_layout();
+    }
+    if (bt.verbosity & BT_STATUS) {
+        _bt_send_status();
+    }
+    if (bt.verbosity & BT_QUEUE) {
+        _bt_send_queue();
+    }
+    if (bt.verbosity & BT_ENCODER) {
+        _bt_send_encoder();
+    }
+    bt.systick += bt.interval;          // next records are due
+    return (STAT_OK);
+}
+
+/*
+ * bt_has_encoders() - true if the encoder counters are assigned to telemetry
+ *
+ *  The JSON serializer leaves "enc1"/"enc2" off responses when this is true. This depends
+ *  on btv alone so what the control channel sends doesn't change with USB1 connecting.
+ */
+
+bool bt_has_encoders()
+{
+    return (bt.verbosity & BT_ENCODER);
+}
+
+/*
+ * Wrappers and Setters - for calling from cfgArray table
+ *
+ * bt_get_btv() - get binary telemetry records enabled
+ * bt_set_btv() - set binary telemetry records enabled - 0 turns telemetry off
+ * bt_get_bti() - get binary telemetry interval
+ * bt_set_bti() - set binary telemetry interval
+ */
+
+stat_t bt_get_btv(nvObj_t *nv) { return(get_integer(nv, bt.verbosity)); }
+stat_t bt_set_btv(nvObj_t *nv)
+{
+    ritorno(set_integer(nv, bt.verbosity, 0, BT_ALL));
+    bt.layout_pending = true;
+    bt.systick = SysTickTimer_getValue();
+    return (STAT_OK);
+}
+stat_t bt_get_bti(nvObj_t *nv) { return(get_integer(nv, bt.interval)); }
+stat_t bt_set_bti(nvObj_t *nv)
+{
+    ritorno(set_int32(nv, bt.interval, BT_INTERVAL_MIN_MS, BT_INTERVAL_MAX_MS));
+    bt.layout_pending = true;
+    return (STAT_OK);
+}
+
 /*****************************************************************************
  * JOB ID REPORTS
  *
@@ -678,7 +1012,15 @@ uint8_t job_report_callback()
         // no-op, job_ids are client app state
         return (STAT_OK);
     }
-    sprintf(cs.out_buf, "{\"job\":[%lu,%lu,%lu,%lu]}\n", cfg.job_id[0], cfg.job_id[1], cfg.job_id[2], cfg.job_id[3] );
+    char *str = cs.out_buf;
+    str_concat(str, "{\"job\":[");
+    for (uint8_t i=0; i<4; i++) {
+        if (i > 0) {
+            *str++ = ',';
+        }
+        str += uinttoa(str, cfg.job_id[i]);
+    }
+    str_concat(str, "]}\n");
     xio_writeline(cs.out_buf);
     return (STAT_OK);
 }
@@ -696,10 +1038,14 @@ static const char fmt_qr[] = "qr:%d\n";
 static const char fmt_qi[] = "qi:%d\n";
 static const char fmt_qo[] = "qo:%d\n";
 static const char fmt_qv[] = "[qv]  queue report verbosity%7d [0=off,1=single,2=triple]\n";
+static const char fmt_btv[] = "[btv] binary telemetry records%6d [0=off,1=status,2=queue,4=encoders - add to combine]\n";
+static const char fmt_bti[] = "[bti] binary telemetry interval%5d ms\n";
 
 void qr_print_qr(nvObj_t *nv) { text_print(nv, fmt_qr);}    // TYPE_INT
 void qr_print_qi(nvObj_t *nv) { text_print(nv, fmt_qi);}    // TYPE_INT
 void qr_print_qo(nvObj_t *nv) { text_print(nv, fmt_qo);}    // TYPE_INT
 void qr_print_qv(nvObj_t *nv) { text_print(nv, fmt_qv);}    // TYPE_INT
+void bt_print_btv(nvObj_t *nv) { text_print(nv, fmt_btv);}  // TYPE_INT
+void bt_print_bti(nvObj_t *nv) { text_print(nv, fmt_bti);}  // TYPE_INT
 
 #endif // __TEXT_MODE
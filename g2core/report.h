@@ -57,6 +57,26 @@ typedef enum {                      // planner queue enable and verbosity
     QR_TRIPLE                       // queue depth reported for buffers, buffers added, buffered removed
 } qrVerbosity;
 
+/*
+ * Status report sources
+ *
+ *  Filtered status reports only read the fields whose source has flagged a change since
+ *  the last report (sr_flag_change()). Each field's source is worked out from its cfgArray
+ *  GET function the first time it is seen in the list. Fields with no known source are read
+ *  for every report, as before. Machine states are cheap to compare directly, so STATE is
+ *  flagged by the report itself rather than by the many places that set states.
+ */
+typedef enum {
+    SR_SOURCE_RUNTIME = 0,          // runtime position - flagged by the exec for every segment
+    SR_SOURCE_MODEL,                // gcode model or active model - flagged by commands and by blocks starting to run
+    SR_SOURCE_STATE,                // machine, cycle, motion, hold, homing and probe states
+    SR_SOURCE_QUEUE,                // planner queue - flagged by qr_request_queue_report()
+    SR_SOURCE_IO,                   // inputs, outputs, spindle, coolant and PWM motors
+    SR_SOURCES                      // count of sources
+} srSource;
+
+#define SR_ALWAYS           0x80    // field has no source - read for every report
+
 typedef struct srSingleton {
 
     /*** config values (PUBLIC) ***/
@@ -70,6 +90,10 @@ typedef struct srSingleton {
     uint8_t throttle_counter;                           // slow down SRs when in a constrained time (not phat_city)
     index_t status_report_list[NV_STATUS_REPORT_LEN];   // status report elements to report
     float status_report_value[NV_STATUS_REPORT_LEN];    // previous values for filtered reporting
+    index_t source_index[NV_STATUS_REPORT_LEN];         // list entry the source bits were worked out for
+    uint8_t source_bits[NV_STATUS_REPORT_LEN];          // (1 << srSource) bits, or SR_ALWAYS
+    volatile bool changed[SR_SOURCES];                  // set by sr_flag_change(), cleared by the report
+    uint32_t state_signature[2];                        // states of cm1 and cm2 at the last filtered report
 
 } srSingleton_t;
 
@@ -89,10 +113,107 @@ typedef struct qrSingleton {        // data for queue reports
 
 } qrSingleton_t;
 
+/*
+ * Binary telemetry
+ *
+ *  Fixed-layout records sent on the telemetry channel (the second USB port, when it is the data
+ *  port) every bti milliseconds. btv is a bitmask of the records to send; 0 turns telemetry off.
+ *  Each record is COBS encoded and sent between 0x00 delimiters, so a host can resync on any
+ *  zero byte. A frame that didn't fit in the TX buffer goes out cut short; the host drops it
+ *  because its length doesn't match its type, and the next frame's delimiter resyncs.
+ *
+ *  Setting the encoder bit in btv takes "enc1"/"enc2" off JSON responses, whether or not the
+ *  telemetry channel is connected. The control protocol depends only on btv, never on the
+ *  state of another port.
+ *
+ *  Records are little-endian and start with a btHeader. The sequence number counts every frame
+ *  built, including ones that were dropped, so gaps show lost frames. A layout record is sent
+ *  when telemetry is enabled and when the channel connects so the host can check the version
+ *  and record sizes before decoding.
+ */
+#define BT_VERSION          1               // bump if any record layout changes
+#define BT_INTERVAL_MIN_MS  10
+#define BT_INTERVAL_MAX_MS  10000
+#define BT_RECORD_MAX       254             // records must fit in one COBS block
+
+#define BT_STATUS           0x01            // btv bits - status record
+#define BT_QUEUE            0x02            // queue record
+#define BT_ENCODER          0x04            // raw encoder counters
+#define BT_ALL              (BT_STATUS | BT_QUEUE | BT_ENCODER)
+
+typedef enum {
+    BT_RECORD_LAYOUT = 0,
+    BT_RECORD_STATUS,
+    BT_RECORD_QUEUE,
+    BT_RECORD_ENCODER
+} btRecordType;
+
+typedef struct btHeader {
+    uint8_t type;                           // btRecordType
+    uint8_t version;                        // BT_VERSION
+    uint16_t sequence;                      // frame count, wraps
+    uint32_t timestamp;                     // SysTick milliseconds the record was taken
+} btHeader_t;
+
+typedef struct btLayoutRecord {
+    btHeader_t hdr;
+    uint8_t verbosity;                      // records enabled (btv)
+    uint8_t axes;                           // entries in the status position arrays
+    uint8_t encoders;                       // encoder counters in use
+    uint8_t status_size;                    // record sizes, in bytes
+    uint8_t queue_size;
+    uint8_t encoder_size;
+    uint16_t interval;                      // ms between records (bti)
+} btLayoutRecord_t;
+
+typedef struct btStatusRecord {             // same values as the status report fields of the same name
+    btHeader_t hdr;
+    uint8_t stat;
+    uint8_t momo;
+    uint8_t unit;                           // units of pos[] and vel: 0=inches, 1=mm
+    uint8_t coor;
+    uint32_t line;
+    float vel;
+    float pos[AXES];                        // work position
+    float mpo[AXES];                        // machine position, always mm
+} btStatusRecord_t;
+
+typedef struct btQueueRecord {
+    btHeader_t hdr;
+    uint8_t available;                      // planner buffers available (qr)
+    uint8_t reserved[3];
+    uint32_t added;                         // buffers added since startup, wraps
+    uint32_t removed;                       // buffers removed since startup, wraps
+} btQueueRecord_t;
+
+typedef struct btEncoderRecord {
+    btHeader_t hdr;
+    int32_t count[2];                       // raw counters enc1 and enc2 - see layout for how many are used
+} btEncoderRecord_t;
+
+typedef struct btSingleton {
+
+    /*** config values (PUBLIC) ***/
+    uint8_t verbosity;                      // BT_xxx bits of the records to send
+    int32_t interval;                       // in milliseconds
+
+    /*** runtime values (PRIVATE) ***/
+    bool layout_pending;                    // send a layout record before the next records
+    uint16_t sequence;
+    uint32_t systick;                       // SysTick value for the next records
+    volatile uint32_t buffers_added;        // counted by qr_request_queue_report()
+    volatile uint32_t buffers_removed;
+
+} btSingleton_t;
+
 /**** Externs - See report.c for allocation ****/
 
 extern srSingleton_t sr;
 extern qrSingleton_t qr;
+extern btSingleton_t bt;
+
+// flag that the values from a source may have changed - safe to call from interrupts
+inline void sr_flag_change(const srSource source) { sr.changed[source] = true; }
 
 /**** Function Prototypes ****/
 
@@ -132,6 +253,14 @@ stat_t qo_get(nvObj_t *nv);
 stat_t qr_get_qv(nvObj_t *nv);
 stat_t qr_set_qv(nvObj_t *nv);
 
+stat_t bt_telemetry_callback(void);
+bool bt_has_encoders(void);
+
+stat_t bt_get_btv(nvObj_t *nv);
+stat_t bt_set_btv(nvObj_t *nv);
+stat_t bt_get_bti(nvObj_t *nv);
+stat_t bt_set_bti(nvObj_t *nv);
+
 #ifdef __TEXT_MODE
 
     void sr_print_sr(nvObj_t *nv);
@@ -141,6 +270,8 @@ stat_t qr_set_qv(nvObj_t *nv);
     void qr_print_qr(nvObj_t *nv);
     void qr_print_qi(nvObj_t *nv);
     void qr_print_qo(nvObj_t *nv);
+    void bt_print_btv(nvObj_t *nv);
+    void bt_print_bti(nvObj_t *nv);
 
 #else
 
@@ -151,6 +282,8 @@ stat_t qr_set_qv(nvObj_t *nv);
     #define qr_print_qr tx_print_stub
     #define qr_print_qi tx_print_stub
     #define qr_print_qo tx_print_stub
+    #define bt_print_btv tx_print_stub
+    #define bt_print_bti tx_print_stub
 
 #endif // __TEXT_MODE
 
@@ -66,6 +66,31 @@
 #define CHORDAL_TOLERANCE           0.01    // {ct: chordal tolerance for arcs (in mm)
 #endif
 
+#ifndef MERGE_TOLERANCE
+#define MERGE_TOLERANCE             0.0     // {mlt: line merge tolerance (in mm), 0 turns merging off
+#endif
+
+#ifndef KINEMATICS
+#define KINEMATICS                  KINE_CARTESIAN  // see kinematics.h for the models
+#endif
+
+#ifndef KINE_SCARA_INNER_ARM
+#define KINE_SCARA_INNER_ARM        150.0   // SCARA shoulder to elbow (in mm)
+#endif
+#ifndef KINE_SCARA_OUTER_ARM
+#define KINE_SCARA_OUTER_ARM        150.0   // SCARA elbow to tool (in mm)
+#endif
+#ifndef KINE_SCARA_ELBOW
+#define KINE_SCARA_ELBOW            1       // SCARA elbow angle sign: 1=positive (CCW), -1=negative
+#endif
+
+#ifndef KINE_DELTA_ROD_LENGTH
+#define KINE_DELTA_ROD_LENGTH       250.0   // delta diagonal rod length, joint to joint (in mm)
+#endif
+#ifndef KINE_DELTA_RADIUS
+#define KINE_DELTA_RADIUS           120.0   // delta horizontal distance from the center of the effector joints to the carriage joints (in mm)
+#endif
+
 #ifndef MOTOR_POWER_TIMEOUT
 #define MOTOR_POWER_TIMEOUT         2.00    // {mt:  motor power timeout in seconds
 #endif
@@ -167,6 +192,14 @@
 #define JSON_VERBOSITY              JV_MESSAGES             // {jv: JV_SILENT, JV_FOOTER, JV_CONFIGS, JV_MESSAGES, JV_LINENUM, JV_VERBOSE
 #endif
 
+#ifndef JSON_COALESCE_LINES
+#define JSON_COALESCE_LINES         1                       // {jcl: OK responses sent in one write. 1 = off
+#endif
+
+#ifndef JSON_COALESCE_MS
+#define JSON_COALESCE_MS            2                       // {jct: milliseconds a response can be held
+#endif
+
 #ifndef QUEUE_REPORT_VERBOSITY
 #define QUEUE_REPORT_VERBOSITY      QR_OFF                  // {qv: QR_OFF, QR_SINGLE, QR_TRIPLE
 #endif
@@ -176,13 +209,21 @@
 #endif
 
 #ifndef STATUS_REPORT_MIN_MS
-#define STATUS_REPORT_MIN_MS        100                     // (no JSON) milliseconds - enforces a viable minimum
+#define STATUS_REPORT_MIN_MS        10                      // (no JSON) milliseconds - enforces a viable minimum
 #endif
 
 #ifndef STATUS_REPORT_INTERVAL_MS
 #define STATUS_REPORT_INTERVAL_MS   250                     // {si: milliseconds - set $SV=0 to disable
 #endif
 
+#ifndef BINARY_TELEMETRY_VERBOSITY
+#define BINARY_TELEMETRY_VERBOSITY  0                       // {btv: 0=off, or add BT_STATUS, BT_QUEUE, BT_ENCODER (1,2,4)
+#endif
+
+#ifndef BINARY_TELEMETRY_INTERVAL_MS
+#define BINARY_TELEMETRY_INTERVAL_MS 50                     // {bti: milliseconds between telemetry records
+#endif
+
 #ifndef STATUS_REPORT_DEFAULTS                              // {sr: See Status Reports wiki page
 #define STATUS_REPORT_DEFAULTS "line","posx","posy","posz","posa","feed","vel","unit","coor","dist","admo","frmo","momo","stat"
 // Alternate SRs that report in drawable units
@@ -456,6 +497,15 @@
 #ifndef X_ZERO_BACKOFF
 #define X_ZERO_BACKOFF              2.0                     // {xzb:  mm
 #endif
+#ifndef X_SHAPER_TYPE
+#define X_SHAPER_TYPE               0                       // {xst:  input shaper 0=off, 1=ZV, 2=ZVD, 3=EI
+#endif
+#ifndef X_SHAPER_FREQUENCY
+#define X_SHAPER_FREQUENCY          40.0                    // {xsf:  resonant frequency in Hz
+#endif
+#ifndef X_SHAPER_DAMPING
+#define X_SHAPER_DAMPING            0.1                     // {xsd:  damping ratio, 0 to 0.9
+#endif
 
 // Y AXIS
 #ifndef Y_AXIS_MODE
@@ -497,6 +547,15 @@
 #ifndef Y_ZERO_BACKOFF
 #define Y_ZERO_BACKOFF              2.0
 #endif
+#ifndef Y_SHAPER_TYPE
+#define Y_SHAPER_TYPE               0
+#endif
+#ifndef Y_SHAPER_FREQUENCY
+#define Y_SHAPER_FREQUENCY          40.0
+#endif
+#ifndef Y_SHAPER_DAMPING
+#define Y_SHAPER_DAMPING            0.1
+#endif
 
 // Z AXIS
 #ifndef Z_AXIS_MODE
@@ -538,6 +597,15 @@
 #ifndef Z_ZERO_BACKOFF
 #define Z_ZERO_BACKOFF              2.0
 #endif
+#ifndef Z_SHAPER_TYPE
+#define Z_SHAPER_TYPE               0
+#endif
+#ifndef Z_SHAPER_FREQUENCY
+#define Z_SHAPER_FREQUENCY          40.0
+#endif
+#ifndef Z_SHAPER_DAMPING
+#define Z_SHAPER_DAMPING            0.1
+#endif
 
 // U AXIS
 #ifndef U_AXIS_MODE
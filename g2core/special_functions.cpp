@@ -2,247 +2,313 @@
 #include "config.h"
 #include "encoder.h"
 #include "canonical_machine.h"  // needed for cm_panic() in assertions
+#include "special_functions.h"
 #include "pwm_motor.h"
 
+#include "MotateTimers.h"
+using namespace Motate;
+
 #ifdef SPECIAL_FUNCTIONS
-int32_t holder_gate_timer = -1; // disabled
-void holder_gate_contorl(void)  {
-  /*
-  Gate 1
-  gate: out4 -> D56 = PA23
-  microswitch: in5 -> 24 = PA15
-  holder microswitch lock: out6 -> D54 = PA16
-  */
 
-  // if "gate open" and "microswitch hit"
-  if ((REG_PIOA_PDSR & (1 << 23)) &&
-      ((REG_PIOA_PDSR & (1 << 15)) == 0) &&
-      (holder_gate_timer == -1))
-  {
-    // set timer to close gate
-    holder_gate_timer = cfg.user_data_b[0];
-    // open microswitch lock
-    REG_PIOA_SODR = 1 << 16;
-  }
-  if (holder_gate_timer > 0) {
-    holder_gate_timer --;
-  }
-  if (holder_gate_timer == 0) {
-    // close gate to normal condition value = 0
+sfSingleton_t sf;
 
-    REG_PIOA_CODR = 1 << 23;
+static Pio * const sf_ports[] = { PIOA, PIOB, PIOC, PIOD };
 
-    holder_gate_timer = -1; // disable timer
+// split a pin in rule notation (port * 100 + bit). Returns false if it is not a pin
+static bool _sf_pin(int32_t pin, uint8_t &port, uint32_t &mask) {
+  if (pin < 0) { pin = -pin; }
+  if ((pin < 100) || (pin > 431) || ((pin % 100) > 31)) {
+    return false;
   }
+  port = pin / 100 - 1;
+  mask = 1UL << (pin % 100);
+  return true;
+}
 
-
-  /*
-  Gate 2
-  gate: out5 -> D55 = PA24
-  microswitch: in9 -> D08 = PC22
-  holder microswitch lock: out7 -> D60 = PA3
-  */
-
-  // if "gate open" and "microswitch hit"
-  if ((REG_PIOA_PDSR & (1 << 24)) &&
-      ((REG_PIOC_PDSR & (1 << 22)) == 0))
-  {
-    // close gate to normal condition value = 0
-    // open microswitch lock
-    REG_PIOA_CODR = 1 << 24;
-    REG_PIOA_SODR = 1 << 3;
+static bool _sf_read(const int32_t pin, const uint32_t *pdsr) {
+  uint8_t port;
+  uint32_t mask;
+  if (!_sf_pin(pin, port, mask)) {
+    return false;
   }
+  return (pdsr[port] & mask) != 0;
+}
 
+static bool _sf_condition(const sfRule_t *r, const uint32_t *pdsr) {
+  bool active;
+  switch (r->trigger) {
+    case SF_TRIGGER_HIGH:
+    case SF_TRIGGER_HIGH_REPEAT: { active = _sf_read(r->input, pdsr); break; }
+    case SF_TRIGGER_LOW:
+    case SF_TRIGGER_LOW_REPEAT: { active = !_sf_read(r->input, pdsr); break; }
+    default: { return false; }
+  }
+  if (active && (r->guard != 0)) {
+    active = (_sf_read(r->guard, pdsr) == (r->guard > 0));
+  }
+  return active;
+}
 
+/**** Timer wheel ****
+ *
+ * Each rule has at most one pending timer. A timer due at tick t sits in slot t & SF_WHEEL_MASK
+ * and is only expired on the tick that matches exactly - timers longer than the wheel just
+ * stay in their slot for the extra turns.
+ */
+
+static void _sf_schedule(sfRule_t *r, int32_t ms) {
+  if (ms < 1) { ms = 1; }
+  int8_t i = r - sf.rule;
+  r->due = sf.tick + ms;
+  r->next = sf.wheel[r->due & SF_WHEEL_MASK];
+  sf.wheel[r->due & SF_WHEEL_MASK] = i;
 }
-#define NO_HOLDER_COUNTER 100000
-#define HOLDER_REVERSE_RUN 10000
 
-uint32_t no_holder_counter1 = 0;
-uint32_t holder_motor_in_reverse_counter1 = 0;
-uint32_t no_holder_counter2 = 0;
-uint32_t holder_motor_in_reverse_counter2 = 0;
-void holder_motor_direction() {
-  bool sensor_blocked;
-  bool motor_in_reverse;
+static void _sf_unschedule(sfRule_t *r) {
+  int8_t i = r - sf.rule;
+  int8_t *link = &sf.wheel[r->due & SF_WHEEL_MASK];
+  while (*link != -1) {
+    if (*link == i) {
+      *link = r->next;
+      return;
+    }
+    link = &sf.rule[*link].next;
+  }
+}
 
-  // D05	PC25	S3	holder air high level optical sensor 1
-  // motor direction = Conveyor1 Motor M3 -> DIR 3 -> D49 -> PC14
+/**** Actions ****/
 
-  sensor_blocked = (REG_PIOC_PDSR & (1 << 25)) == 0;
+static void _sf_action(const sfRule_t *r, const bool undo) {
+  uint8_t port;
+  uint32_t mask;
+  int32_t action = r->action;
 
-  if (sensor_blocked) {
-    no_holder_counter1 = 0;
-  }
-  else {
-    no_holder_counter1++;
+  if (undo) {
+    switch (action) {
+      case SF_ACTION_SET:     { action = SF_ACTION_CLEAR; break; }
+      case SF_ACTION_CLEAR:   { action = SF_ACTION_SET; break; }
+      case SF_ACTION_BLOCK:   { action = SF_ACTION_UNBLOCK; break; }
+      case SF_ACTION_UNBLOCK: { action = SF_ACTION_BLOCK; break; }
+    }
   }
-  // run motor in reverse. it will resume in special functions
-  if (no_holder_counter1 > NO_HOLDER_COUNTER) {
-    no_holder_counter1 = 0;
-    // motor run in rev
-    REG_PIOC_SODR = 1 << 14;
+  switch (action) {
+    case SF_ACTION_SET: {
+      if (_sf_pin(r->output, port, mask)) { sf_ports[port]->PIO_SODR = mask; }
+      break;
+    }
+    case SF_ACTION_CLEAR: {
+      if (_sf_pin(r->output, port, mask)) { sf_ports[port]->PIO_CODR = mask; }
+      break;
+    }
+#if PWM_MOTORS_AVAILABLE
+    case SF_ACTION_BLOCK:
+    case SF_ACTION_UNBLOCK: {
+      if ((r->output >= 1) && (r->output <= PWM_MOTOR_COUNT)) {
+        pwm_motor_set_blocked(r->output - 1, action == SF_ACTION_BLOCK);
+      }
+      break;
+    }
+#endif
   }
+}
 
-  motor_in_reverse = (REG_PIOC_PDSR & (1 << 14));
-  if (!motor_in_reverse) {
-    holder_motor_in_reverse_counter1 = 0;
+// action done (and undone) - wait for the condition to go false, or go again if repeating
+static void _sf_rearm(sfRule_t *r) {
+  if (!r->condition) {
+    r->state = SF_STATE_IDLE;
+  } else if ((r->trigger == SF_TRIGGER_HIGH_REPEAT) || (r->trigger == SF_TRIGGER_LOW_REPEAT)) {
+    r->state = SF_STATE_DEBOUNCE;
+    _sf_schedule(r, r->debounce_ms);
   } else {
-    holder_motor_in_reverse_counter1++;
-    if (holder_motor_in_reverse_counter1 > HOLDER_REVERSE_RUN){
-      // clear reverse
-      REG_PIOC_CODR = 1 << 14;
-    }
+    r->state = SF_STATE_LATCHED;
   }
+}
 
-  // D10	PA28 + PC29	S8	holder air high level optical sensor 2
-  // motor direction = Conveyor2 Motor M4 -> DIR 4 -> D47 -> PC16
-
-  sensor_blocked = (REG_PIOC_PDSR & (1 << 29)) == 0;
-
-  if (sensor_blocked) {
-    no_holder_counter2 = 0;
-  }
-  else {
-    no_holder_counter2++;
-  }
-  // run motor in reverse. it will resume in special functions
-  if (no_holder_counter2 > NO_HOLDER_COUNTER) {
-    no_holder_counter2 = 0;
-    // motor run in rev
-    REG_PIOC_SODR = 1 << 16;
+static void _sf_run_action(sfRule_t *r) {
+  _sf_action(r, false);
+  if (r->duration_ms > 0) {
+    r->state = SF_STATE_HOLD;
+    _sf_schedule(r, r->duration_ms);
+  } else {
+    _sf_rearm(r);
   }
+}
 
-  motor_in_reverse = (REG_PIOC_PDSR & (1 << 16));
-  if (!motor_in_reverse) {
-    holder_motor_in_reverse_counter2 = 0;
+static void _sf_fire(sfRule_t *r) {
+  if (r->delay_ms > 0) {
+    r->state = SF_STATE_DELAY;
+    _sf_schedule(r, r->delay_ms);
   } else {
-    holder_motor_in_reverse_counter2++;
-    if (holder_motor_in_reverse_counter2 > HOLDER_REVERSE_RUN){
-      // clear reverse
-      REG_PIOC_CODR = 1 << 16;
-    }
+    _sf_run_action(r);
   }
 }
 
+static void _sf_expire(sfRule_t *r) {
+  switch (r->state) {
+    case SF_STATE_DEBOUNCE: { _sf_fire(r); break; }
+    case SF_STATE_DELAY:    { _sf_run_action(r); break; }
+    case SF_STATE_HOLD:     { _sf_action(r, true); _sf_rearm(r); break; }
+  }
+}
 
-typedef struct sensor_blocking_data {
-  Pio     *sensor_reg;
-  uint32_t sensor_reg_mask;
-  Pio     *conveyor_reg;
-  uint32_t conveyor_reg_mask;
-  int32_t  blocked_counter;
-  bool*    blocked_out;
-} sensor_blocking_data_t;
-
-sensor_blocking_data_t sensor_blocking_data_array[] = {
-  {
-    // sensor PC25
-    PIOC,
-    1<<25,
-    // conveyor direction M3 -> DIR 3 -> D49 -> PC14
-    PIOC,
-    1<<14,
-    0,
-    &pwm_motors[0].blocked
-  },
-  {
-    // sensor PC29
-    PIOC,
-    1<<29,
-    // conveyor direction M4 -> DIR 4 -> D47 -> PC16
-    PIOC,
-    1<<16,
-    0,
-    &pwm_motors[1].blocked
-  }
-};
-
-#define BLOCKED_COUNTER_SMALL 20000
-#define BLOCKED_COUNTER_BIG   20000
-
-void holder_high_q_detection(sensor_blocking_data_t* d) {
-
-  bool motor_blocked_by_sensor = *(d->blocked_out);
-  // Sensor = in8 - S3 = D5 = C25 - active low
-  // holder exists -> sensor_blocked = true -> eventually motor_blocked_by_sensor = true
-  // lack of holder -> sensor_blocked = false ....
-  bool sensor_blocked = (d->sensor_reg->PIO_PDSR & d->sensor_reg_mask) == 0;
-
-  // 1- hysthersis calcs
-  if (motor_blocked_by_sensor) {
-    if (sensor_blocked) {
-      d->blocked_counter = BLOCKED_COUNTER_BIG;
-    }
-    else {
-      d->blocked_counter--;
-      if (d->blocked_counter <= 1) {
-        motor_blocked_by_sensor = false;
-        d->blocked_counter = 1;
-      }
-    }
+// condition edges start or cancel the debounce. Delays and holds run to completion
+static void _sf_evaluate(sfRule_t *r, const uint32_t *pdsr) {
+  bool condition = _sf_condition(r, pdsr);
+  if (condition == r->condition) {
+    return;
   }
-  else {
-    if (sensor_blocked) {
-      d->blocked_counter++;
-      if (d->blocked_counter >= BLOCKED_COUNTER_SMALL) {
-        // REG_PIOC_SODR = 1 << 9; // Zand feature request
-        d->conveyor_reg->PIO_SODR = d->conveyor_reg_mask;
-        motor_blocked_by_sensor = true;
-        d->blocked_counter = BLOCKED_COUNTER_BIG;
+  r->condition = condition;
+  if (condition) {
+    if (r->state == SF_STATE_IDLE) {
+      if (r->debounce_ms > 0) {
+        r->state = SF_STATE_DEBOUNCE;
+        _sf_schedule(r, r->debounce_ms);
+      } else {
+        _sf_fire(r);
       }
-
     }
-    else {
-      d->blocked_counter = 1;
+  } else {
+    if (r->state == SF_STATE_DEBOUNCE) {
+      _sf_unschedule(r);
+      r->state = SF_STATE_IDLE;
+    } else if (r->state == SF_STATE_LATCHED) {
+      r->state = SF_STATE_IDLE;
     }
   }
-  *d->blocked_out = motor_blocked_by_sensor;
 }
 
-
+#ifdef PM_FEEDER
 #define HOLDER_LOW_Q_MAX 40000
 #define HOLDER_LOW_Q_MIN 1
-void holder_low_q_detection () {
-  bool no_holder;
-
-  // holder line 1 = in4 = D27 = PD2
-  no_holder = (REG_PIOD_PDSR & (1 << 2));
-  if (no_holder) {
-    if (cfg.user_data_a[2] < HOLDER_LOW_Q_MAX)
-      cfg.user_data_a[2]++;}
-  else{
-    if (cfg.user_data_a[2] > HOLDER_LOW_Q_MIN)
-      cfg.user_data_a[2]--;}
-
-  // holder line 2 = in7(s4) = D6 = PC24
-  no_holder = (REG_PIOC_PDSR & (1 << 24));
-  if (no_holder){
-    if (cfg.user_data_a[3] < HOLDER_LOW_Q_MAX)
-      cfg.user_data_a[3]++;}
-  else{
-    if (cfg.user_data_a[3] > HOLDER_LOW_Q_MIN)
-      cfg.user_data_a[3]--;
-    }
+
+// holder line levels: UDA2, UDA3 integrate up 1/ms while the line is empty, down while not
+static void _sf_holder_level(const uint32_t *pdsr) {
+  if (_sf_read(SF_PIN_HOLDER_LINE1, pdsr)) {
+    if (cfg.user_data_a[2] < HOLDER_LOW_Q_MAX) { cfg.user_data_a[2]++; }
+  } else {
+    if (cfg.user_data_a[2] > HOLDER_LOW_Q_MIN) { cfg.user_data_a[2]--; }
+  }
+  if (_sf_read(SF_PIN_HOLDER_LINE2, pdsr)) {
+    if (cfg.user_data_a[3] < HOLDER_LOW_Q_MAX) { cfg.user_data_a[3]++; }
+  } else {
+    if (cfg.user_data_a[3] > HOLDER_LOW_Q_MIN) { cfg.user_data_a[3]--; }
+  }
 }
+#endif // PM_FEEDER
+
+/*
+ * _sf_tick() - 1 ms SysTick event
+ */
+static void _sf_tick() {
+  uint32_t pdsr[4];
+  bool changed = false;
+
+  sf.tick++;
+  for (uint8_t p = 0; p < 4; p++) {
+    pdsr[p] = sf_ports[p]->PIO_PDSR;
+    if ((pdsr[p] & sf.watch[p]) != sf.last[p]) {
+      sf.last[p] = pdsr[p] & sf.watch[p];
+      changed = true;
+    }
+  }
+  if (changed) {
+    for (uint8_t i = 0; i < SF_RULES; i++) {
+      _sf_evaluate(&sf.rule[i], pdsr);
+    }
+  }
+
+  // detach the timers due now before running them - they may reschedule into this slot
+  int8_t *link = &sf.wheel[sf.tick & SF_WHEEL_MASK];
+  int8_t due = -1;
+  while (*link != -1) {
+    sfRule_t *r = &sf.rule[*link];
+    if (r->due == sf.tick) {
+      int8_t i = *link;
+      *link = r->next;
+      r->next = due;
+      due = i;
+    } else {
+      link = &r->next;
+    }
+  }
+  while (due != -1) {
+    sfRule_t *r = &sf.rule[due];
+    due = r->next;
+    _sf_expire(r);
+  }
 
-stat_t cm_special_function(void) {
 #ifdef PM_FEEDER
-  holder_gate_contorl();
-  holder_motor_direction();
-  holder_high_q_detection(&sensor_blocking_data_array[0]);
-  holder_high_q_detection(&sensor_blocking_data_array[1]);
-  holder_low_q_detection();
-#endif // PM_FEEDER
+  _sf_holder_level(pdsr);
+#endif
+}
 
-  return STAT_OK;
+SysTickEvent sf_tick_event {[&] {
+  _sf_tick();
+}, nullptr};
+
+/*
+ * _sf_stop() - undo the actions of rules in their hold and park every rule idle
+ *
+ * Runs before a configuration change, so holds are undone with the output they were
+ * started on. With nothing watched and no timers the tick leaves the rules alone until
+ * _sf_start().
+ */
+static void _sf_stop() {
+  __disable_irq();
+  for (uint8_t i = 0; i < SF_RULES; i++) {
+    sfRule_t *r = &sf.rule[i];
+    if (r->state == SF_STATE_HOLD) {
+      _sf_action(r, true);
+    }
+    r->state = SF_STATE_IDLE;
+    r->condition = false;
+    r->next = -1;
+  }
+  for (uint8_t s = 0; s < SF_WHEEL_SLOTS; s++) {
+    sf.wheel[s] = -1;
+  }
+  for (uint8_t p = 0; p < 4; p++) {
+    sf.watch[p] = 0;
+    sf.last[p] = 0;
+  }
+  __enable_irq();
+}
 
+/*
+ * _sf_start() - watch the configured pins and start all rules from idle
+ *
+ * Rules whose condition is already true start their debounce on the next tick.
+ */
+static void _sf_start() {
+  __disable_irq();
+  for (uint8_t i = 0; i < SF_RULES; i++) {
+    sfRule_t *r = &sf.rule[i];
+    uint8_t port;
+    uint32_t mask;
+    if (r->trigger == SF_TRIGGER_DISABLED) {
+      continue;
+    }
+    if (_sf_pin(r->input, port, mask)) { sf.watch[port] |= mask; }
+    if (_sf_pin(r->guard, port, mask)) { sf.watch[port] |= mask; }
+  }
+  for (uint8_t p = 0; p < 4; p++) {
+    sf.last[p] = ~sf_ports[p]->PIO_PDSR & sf.watch[p];  // force an evaluation on the next tick
+  }
+  __enable_irq();
 }
 
+void sf_init() {
+  _sf_stop();
+  _sf_start();
+  SysTickTimer.registerEvent(&sf_tick_event);
+}
 
-// // blink
-// REG_PIOC_SODR = 1 << 28;
-// for (uint32_t i =0; i<1000000; i++) {z = z+i;}
-// REG_PIOC_CODR = 1 << 28;
+// set a rule parameter and restart the rules
+stat_t sf_set_rule(nvObj_t *nv) {
+  _sf_stop();
+  stat_t status = set_int32(nv);
+  _sf_start();
+  return (status);
+}
 
 #endif // SPECIAL_FUNCTIONS
@@ -0,0 +1,103 @@
+#ifndef SPECIAL_FUNCTIONS_H_ONCE
+#define SPECIAL_FUNCTIONS_H_ONCE
+
+#include "g2core.h"
+#include "config.h"
+
+#ifdef SPECIAL_FUNCTIONS
+
+/*
+ * Rules engine
+ *
+ * Each rule watches an input pin and runs an action on an output once the input has held
+ * its trigger level for debounce_ms:
+ *
+ *   input at trigger level [and guard] --debounce_ms--> wait delay_ms --> action
+ *                                                       --duration_ms--> undo action
+ *
+ * Pins are given as port * 100 + bit, with ports A..D as 1..4 - so 315 is PC15 and 402 is
+ * PD2. A negative guard means the guard pin must be low. 0 disables an input or guard.
+ *
+ * Rules run from the 1 ms SysTick: the watched ports are sampled once per tick and rules
+ * are only evaluated when a watched pin changes. Debounce, delay and duration are timed
+ * on a timer wheel, so rules that are not changing cost nothing. Actions run in the
+ * SysTick interrupt.
+ *
+ * Rules are configured as r1..r12 groups, e.g. {r1:{in:315,tr:2,db:500,ac:3,ot:1}}
+ */
+
+#define SF_RULES 12
+#define SF_WHEEL_SLOTS 64                   // must be a power of 2
+#define SF_WHEEL_MASK (SF_WHEEL_SLOTS-1)
+
+typedef enum {
+  SF_TRIGGER_DISABLED = 0,
+  SF_TRIGGER_HIGH,                        // fire once each time the condition becomes true
+  SF_TRIGGER_LOW,
+  SF_TRIGGER_HIGH_REPEAT,                 // ...and again every debounce_ms while it stays true
+  SF_TRIGGER_LOW_REPEAT
+} sfTrigger;
+
+typedef enum {
+  SF_ACTION_NONE = 0,
+  SF_ACTION_SET,                          // set output pin high
+  SF_ACTION_CLEAR,                        // set output pin low
+  SF_ACTION_BLOCK,                        // block PWM motor <output> (1 = M1)
+  SF_ACTION_UNBLOCK                       // unblock PWM motor <output>
+} sfAction;
+
+typedef enum {
+  SF_STATE_IDLE = 0,                      // condition false
+  SF_STATE_DEBOUNCE,                      // condition true, waiting debounce_ms
+  SF_STATE_DELAY,                         // fired, waiting delay_ms to run the action
+  SF_STATE_HOLD,                          // action run, waiting duration_ms to undo it
+  SF_STATE_LATCHED                        // done, waiting for the condition to go false
+} sfState;
+
+typedef struct sfRule {
+  // configuration - int32_t so the entries can use get_int32 / set_int32
+  int32_t input;                          // pin to watch
+  int32_t trigger;                        // sfTrigger
+  int32_t guard;                          // pin that must also be high (or low if negative)
+  int32_t debounce_ms;
+  int32_t action;                         // sfAction
+  int32_t output;                         // pin, or motor number for block/unblock
+  int32_t delay_ms;
+  int32_t duration_ms;                    // 0 = action is not undone
+
+  // runtime
+  uint8_t state;                          // sfState
+  bool condition;                         // last evaluated condition
+  int8_t next;                            // next rule in the same wheel slot, or -1
+  uint32_t due;                           // tick the pending timer expires
+} sfRule_t;
+
+typedef struct sfSingleton {
+  sfRule_t rule[SF_RULES];
+  uint32_t tick;                          // ms since sf_init()
+  uint32_t watch[4];                      // PIOA..PIOD bits used by any rule
+  uint32_t last[4];                       // last sampled value of the watched bits
+  int8_t wheel[SF_WHEEL_SLOTS];           // first rule timed in each slot, or -1
+} sfSingleton_t;
+
+extern sfSingleton_t sf;
+
+// Feeder pins in rule notation
+#define SF_PIN_HOLDER_LINE1     402         // in4 - D27 - PD2
+#define SF_PIN_GATE1_SWITCH     115         // in5 - D24 - PA15
+#define SF_PIN_HOLDER_LINE2     324         // in7 - D6  - PC24
+#define SF_PIN_GATE2_SWITCH     322         // in9 - D8  - PC22
+#define SF_PIN_HOLDER_HIGH1     325         // S3  - D5  - PC25 - holder air high level optical sensor 1
+#define SF_PIN_HOLDER_HIGH2     329         // S8  - D10 - PC29 - holder air high level optical sensor 2
+#define SF_PIN_GATE1            123         // out4 - D56 - PA23
+#define SF_PIN_GATE2            124         // out5 - D55 - PA24
+#define SF_PIN_GATE1_LOCK       116         // out6 - D54 - PA16 - holder microswitch lock
+#define SF_PIN_GATE2_LOCK       103         // out7 - D60 - PA3
+#define SF_PIN_CONVEYOR1_DIR    314         // M3 DIR 3 - D49 - PC14
+#define SF_PIN_CONVEYOR2_DIR    316         // M4 DIR 4 - D47 - PC16
+
+void sf_init(void);
+stat_t sf_set_rule(nvObj_t *nv);
+
+#endif // SPECIAL_FUNCTIONS
+#endif // SPECIAL_FUNCTIONS_H_ONCE
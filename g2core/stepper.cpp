@@ -34,6 +34,7 @@
 #include "stepper.h"
 #include "encoder.h"
 #include "planner.h"
+#include "kinematics.h"
 #include "hardware.h"
 #include "text_parser.h"
 #include "util.h"
@@ -58,6 +59,7 @@ static stRunSingleton_t st_run;
 /**** Static functions ****/
 
 static void _load_move(void);
+static bool _load_segment(stPrepSegment_t *s);
 
 /**** Setup motate ****/
 
@@ -142,7 +144,7 @@ void stepper_init()
 
     // setup software interrupt exec timer & initial condition
     exec_timer.setInterrupts(kInterruptOnSoftwareTrigger | kInterruptPriorityHigh);
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_EXEC;
+    st_pre.exec_idle = true;
 
     // setup software interrupt forward plan timer & initial condition
     fwd_plan_timer.setInterrupts(kInterruptOnSoftwareTrigger | kInterruptPriorityMedium);
@@ -157,8 +159,7 @@ void stepper_init()
 
     #if PWM_MOTORS_AVAILABLE
     pwm_timer.setInterrupts(kInterruptOnOverflow | kInterruptPriorityLowest);
-    setup_pwm_motors();
-    pwm_timer.start();
+    setup_pwm_motors();                         // programs and starts pwm_timer itself
     #endif
 }
 
@@ -173,11 +174,11 @@ void stepper_reset()
     dda_timer.stop();                                   // stop all movement
     st_run.dda_ticks_downcount = 0;                     // signal the runtime is not busy
     st_run.dwell_ticks_downcount = 0;
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_EXEC;    // set to EXEC or it won't restart
+    st_pre.tail = st_pre.head;                          // empty the prep queue or it won't restart
+    st_pre.exec_idle = true;
 
     for (uint8_t motor=0; motor<MOTORS; motor++) {
-        st_pre.mot[motor].prev_direction = STEP_INITIAL_DIRECTION;
-        st_pre.mot[motor].direction = STEP_INITIAL_DIRECTION;
+        st_run.mot[motor].prev_direction = STEP_INITIAL_DIRECTION;
         st_run.mot[motor].substep_accumulator = 0;      // will become max negative during per-motor setup;
         st_pre.mot[motor].corrected_steps = 0;          // diagnostic only - no action effect
     }
@@ -208,17 +209,24 @@ stat_t stepper_test_assertions()
 
 /*
  * st_runtime_isbusy() - return TRUE if runtime is busy:
+ * _runtime_running()  - return TRUE if the DDA or a dwell is running (the loader can't load)
  *
  *  Busy conditions:
  *  - motors are running
  *  - dwell is running
+ *  - segments are waiting in the prep queue
  */
 
-bool st_runtime_isbusy()
+static bool _runtime_running()
 {
     return (st_run.dda_ticks_downcount || st_run.dwell_ticks_downcount);    // returns false if down count is zero
 }
 
+bool st_runtime_isbusy()
+{
+    return (_runtime_running() || (st_pre.head != st_pre.tail));
+}
+
 /*
  * st_clc() - clear counters
  */
@@ -226,6 +234,8 @@ bool st_runtime_isbusy()
 stat_t st_clc(nvObj_t *nv)    // clear diagnostic counters, reset stepper prep
 {
     stepper_reset();
+    mp_profile_reset();
+    st_pre.underruns = 0;
     return(STAT_OK);
 }
 
@@ -242,8 +252,7 @@ stat_t st_motor_power_callback()     // called by controller
     }
 
     bool have_actually_stopped = false;
-    if ((!st_runtime_isbusy()) &&
-        (st_pre.buffer_state != PREP_BUFFER_OWNED_BY_LOADER) &&
+    if ((!st_runtime_isbusy()) &&                       // includes moves waiting to load
         (cm_get_machine_state() != MACHINE_CYCLE)) {    // if there are no moves to load...
         have_actually_stopped = true;
     }
@@ -267,36 +276,68 @@ stat_t st_motor_power_callback()     // called by controller
  *  The DDA timer interrupt does this:
  *    - fire on overflow
  *    - clear interrupt condition
- *    - clear all step pins - this clears those the were set during the previous interrupt
+ *    - clear the step pins that were set during the previous interrupt
  *    - if downcount == 0 and stop the timer and exit
- *    - run the DDA for each channel
+ *    - run the DDA for each motor that has steps in this segment
  *    - decrement the downcount - if it reaches zero load the next segment
  *
- *  Note that the motor_N.step.isNull() tests are compile-time tests, not run-time tests.
- *  If motor_N is not defined that if{} clause (i.e. that motor) drops out of the complied code.
+ *  The per-motor code is generated from the board's BOARD_STEPPERS list (board_stepper.h)
+ *  by the _dda_*() templates below. Each motor is expanded with its concrete (final) type,
+ *  so stepStart() and stepEnd() are resolved at compile time and inlined - the result is
+ *  the same straight-line code as the hand-unrolled version, for any number of motors.
+ *
+ *  Two bitmasks keep idle motors out of the tick:
+ *    - st_run.motor_active is set by _load_segment() for motors with steps in the segment.
+ *      Motors not in the mask skip the accumulator update entirely.
+ *    - st_run.motor_stepped records which motors were pulsed in this tick, so the next
+ *      tick only ends those pulses instead of writing every step pin.
  */
 
+template <typename... stepper_t>
+static constexpr uint8_t _stepper_count(stepper_t&...) { return (sizeof...(stepper_t)); }
+
+static_assert(_stepper_count(BOARD_STEPPERS) == MOTORS, "BOARD_STEPPERS must list exactly MOTORS motors");
+
+template <uint8_t motor>
+static inline void _dda_step_end(const uint32_t stepped) {}
+
+template <uint8_t motor, typename stepper_t, typename... rest_t>
+static inline void _dda_step_end(const uint32_t stepped, stepper_t &stepper, rest_t&... rest)
+{
+    if (stepped & (1 << motor)) {
+        stepper.stepEnd();
+    }
+    _dda_step_end<motor+1>(stepped, rest...);
+}
+
+template <uint8_t motor>
+static inline uint32_t _dda_step_start(const uint32_t active) { return (0); }
+
+template <uint8_t motor, typename stepper_t, typename... rest_t>
+static inline uint32_t _dda_step_start(const uint32_t active, stepper_t &stepper, rest_t&... rest)
+{
+    uint32_t stepped = 0;
+    if (active & (1 << motor)) {
+        if ((st_run.mot[motor].substep_accumulator += st_run.mot[motor].substep_increment) > 0) {
+            stepper.stepStart();        // turn step bit on
+            st_run.mot[motor].substep_accumulator -= st_run.dda_ticks_X_substeps;
+            INCREMENT_ENCODER(motor);
+            stepped = (1 << motor);
+        }
+    }
+    return (stepped | _dda_step_start<motor+1>(active, rest...));
+}
+
 namespace Motate {            // Must define timer interrupts inside the Motate namespace
 template<>
 void dda_timer_type::interrupt()
 {
+    PROFILE_SCOPE(PROFILE_DDA);
     dda_timer.getInterruptCause();  // clear interrupt condition
 
-    // clear all steps from the previous interrupt
-    motor_1.stepEnd();
-    motor_2.stepEnd();
-#if MOTORS > 2
-    motor_3.stepEnd();
-#endif
-#if MOTORS > 3
-    motor_4.stepEnd();
-#endif
-#if MOTORS > 4
-    motor_5.stepEnd();
-#endif
-#if MOTORS > 5
-    motor_6.stepEnd();
-#endif
+    // clear the steps set in the previous interrupt
+    _dda_step_end<MOTOR_1>(st_run.motor_stepped, BOARD_STEPPERS);
+    st_run.motor_stepped = 0;
 
     // process last DDA tick after end of segment
     if (st_run.dda_ticks_downcount == 0) {
@@ -304,58 +345,15 @@ void dda_timer_type::interrupt()
         return;
     }
 
-//  The following code would work, but it's faster on the M3 to loop unroll it. Perhaps not on the M7
-//    for (uint8_t motor=0; motor<MOTORS; motor++) {
-//        if  ((st_run.mot[motor].substep_accumulator += st_run.mot[motor].substep_increment) > 0) {
-//            Motors[motor]->stepStart();        // turn step bit on
-//            st_run.mot[motor].substep_accumulator -= st_run.dda_ticks_X_substeps;
-//            INCREMENT_ENCODER(motor);
-//        }
-//    }
-
     // process DDAs for each motor
-    if  ((st_run.mot[MOTOR_1].substep_accumulator += st_run.mot[MOTOR_1].substep_increment) > 0) {
-        motor_1.stepStart();        // turn step bit on
-        st_run.mot[MOTOR_1].substep_accumulator -= st_run.dda_ticks_X_substeps;
-        INCREMENT_ENCODER(MOTOR_1);
-    }
-    if ((st_run.mot[MOTOR_2].substep_accumulator += st_run.mot[MOTOR_2].substep_increment) > 0) {
-        motor_2.stepStart();        // turn step bit on
-        st_run.mot[MOTOR_2].substep_accumulator -= st_run.dda_ticks_X_substeps;
-        INCREMENT_ENCODER(MOTOR_2);
-    }
-#if MOTORS > 2
-    if ((st_run.mot[MOTOR_3].substep_accumulator += st_run.mot[MOTOR_3].substep_increment) > 0) {
-        motor_3.stepStart();        // turn step bit on
-        st_run.mot[MOTOR_3].substep_accumulator -= st_run.dda_ticks_X_substeps;
-        INCREMENT_ENCODER(MOTOR_3);
-    }
-#endif
-#if MOTORS > 3
-    if ((st_run.mot[MOTOR_4].substep_accumulator += st_run.mot[MOTOR_4].substep_increment) > 0) {
-        motor_4.stepStart();        // turn step bit on
-        st_run.mot[MOTOR_4].substep_accumulator -= st_run.dda_ticks_X_substeps;
-        INCREMENT_ENCODER(MOTOR_4);
-    }
-#endif
-#if MOTORS > 4
-    if ((st_run.mot[MOTOR_5].substep_accumulator += st_run.mot[MOTOR_5].substep_increment) > 0) {
-        motor_5.stepStart();        // turn step bit on
-        st_run.mot[MOTOR_5].substep_accumulator -= st_run.dda_ticks_X_substeps;
-        INCREMENT_ENCODER(MOTOR_5);
-    }
-#endif
-#if MOTORS > 5
-    if ((st_run.mot[MOTOR_6].substep_accumulator += st_run.mot[MOTOR_6].substep_increment) > 0) {
-        motor_6.stepStart();        // turn step bit on
-        st_run.mot[MOTOR_6].substep_accumulator -= st_run.dda_ticks_X_substeps;
-        INCREMENT_ENCODER(MOTOR_6);
-    }
-#endif
+    st_run.motor_stepped = _dda_step_start<MOTOR_1>(st_run.motor_active, BOARD_STEPPERS);
 
     // Process end of segment.
     // One more interrupt will occur to turn of any pulses set in this pass.
     if (--st_run.dda_ticks_downcount == 0) {
+        if ((st_pre.head == st_pre.tail) && !st_pre.exec_idle) {
+            st_pre.underruns++;     // exec didn't keep up
+        }
         _load_move();       // load the next move at the current interrupt level
     }
 } // MOTATE_TIMER_INTERRUPT
@@ -370,7 +368,7 @@ void pwm_timer_type::interrupt()
 {
     pwm_timer.getInterruptCause();  // clear interrupt condition
 
-    pwm_motors_step();
+    pwm_motors_step();              // compare A - next PWM motor edge is due
 }
 }
 #endif
@@ -380,11 +378,27 @@ void pwm_timer_type::interrupt()
  * Exec sequencing code   - computes and prepares next load segment
  * st_request_exec_move() - SW interrupt to request to execute a move
  * exec_timer interrupt   - interrupt handler for calling exec function
+ * _exec_can_prep()       - true if there is room in the prep queue and no command waiting to run
+ *
+ *  Exec fills the prep queue, one mp_exec_move() per segment. Any return other than NOOP
+ *  means the segment at the head was used (it may be a null) and is passed to the loader.
  */
 
+static bool _exec_can_prep()
+{
+    uint8_t queued = st_pre.head - st_pre.tail;
+    if (queued >= STEPPER_PREP_QUEUE_DEPTH) {
+        return (false);
+    }
+    if ((queued != 0) && (st_pre.seg[(st_pre.head - 1) & STEPPER_PREP_QUEUE_MASK].block_type == BLOCK_TYPE_COMMAND)) {
+        return (false);                                     // commands are a barrier - see stepper.h
+    }
+    return (true);
+}
+
 void st_request_exec_move()
 {
-    if (st_pre.buffer_state == PREP_BUFFER_OWNED_BY_EXEC) { // bother interrupting
+    if (_exec_can_prep()) {                                 // bother interrupting
         exec_timer.setInterruptPending();
         return;
     }
@@ -395,12 +409,16 @@ namespace Motate {    // Define timer inside Motate namespace
     void exec_timer_type::interrupt()
     {
         exec_timer.getInterruptCause();                    // clears the interrupt condition
-        if (st_pre.buffer_state == PREP_BUFFER_OWNED_BY_EXEC) {
-            if (mp_exec_move() != STAT_NOOP) {
-                st_pre.buffer_state = PREP_BUFFER_OWNED_BY_LOADER; // flip it back
-                st_request_load_move();
+        while (_exec_can_prep()) {
+            st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK].block_type = BLOCK_TYPE_NULL;
+            if (mp_exec_move() == STAT_NOOP) {
+                st_pre.exec_idle = true;
                 return;
             }
+            st_pre.exec_idle = false;
+            __DMB();                                        // finish the segment...
+            st_pre.head++;                                  // ...before handing it to the loader
+            st_request_load_move();
         }
     }
 } // namespace Motate
@@ -439,10 +457,10 @@ namespace Motate {    // Define timer inside Motate namespace
 
 void st_request_load_move()
 {
-    if (st_runtime_isbusy()) {                                      // don't request a load if the runtime is busy
+    if (_runtime_running()) {                                       // don't request a load if the runtime is busy
         return;
     }
-    if (st_pre.buffer_state == PREP_BUFFER_OWNED_BY_LOADER) {       // bother interrupting
+    if (st_pre.head != st_pre.tail) {                               // bother interrupting
        _load_move();
     }
 }
@@ -453,23 +471,18 @@ void st_request_load_move()
  *  This routine can only be called be called from an ISR at the same or
  *  higher level as the DDA or dwell ISR. A software interrupt has been
  *  provided to allow a non-ISR to request a load (st_request_load_move())
- *
- *  In aline() code:
- *   - All axes must set steps and compensate for out-of-range pulse phasing.
- *   - If axis has 0 steps the direction setting can be omitted
- *   - If axis has 0 steps the motor power must be set accord to the power mode
  */
 
 static void _load_move()
 {
     // Be aware that dda_ticks_downcount must equal zero for the loader to run.
     // So the initial load must also have this set to zero as part of initialization
-    if (st_runtime_isbusy()) {
+    if (_runtime_running()) {
         return;                     // exit if the runtime is busy
     }
 
     // If there are no moves to load start motor power timeouts
-    if (st_pre.buffer_state != PREP_BUFFER_OWNED_BY_LOADER) {
+    if (st_pre.head == st_pre.tail) {
         motor_1.motionStopped();    // ...start motor power timeouts
         motor_2.motionStopped();
 #if (MOTORS > 2)
@@ -485,16 +498,37 @@ static void _load_move()
         motor_6.motionStopped();
 #endif
         return;
-    } // if (st_pre.buffer_state != PREP_BUFFER_OWNED_BY_LOADER)
+    } // if (st_pre.head == st_pre.tail)
+
+    // Commands and nulls don't start the runtime, so keep going until a segment does or the queue is empty
+    while ((st_pre.head != st_pre.tail) && !_load_segment(&st_pre.seg[st_pre.tail & STEPPER_PREP_QUEUE_MASK])) {}
+    st_request_exec_move();                             // exec and prep next move
+}
+
+/*
+ * _load_segment() - load one segment from the prep queue and hand its slot back to exec
+ *
+ *  Returns true if the segment started the DDA or a dwell.
+ *
+ *  In aline() code:
+ *   - All axes must set steps and compensate for out-of-range pulse phasing.
+ *   - If axis has 0 steps the direction setting can be omitted
+ *   - If axis has 0 steps the motor power must be set accord to the power mode
+ */
+
+static bool _load_segment(stPrepSegment_t *s)
+{
+    bool started = true;
 
     // handle aline loads first (most common case)
-    if (st_pre.block_type == BLOCK_TYPE_ALINE) {
+    if (s->block_type == BLOCK_TYPE_ALINE) {
 
         //**** setup the new segment ****
 
         debug_trap_if_true((st_run.dda_ticks_downcount != 0), "_load_move() downcount is not zero");
-        st_run.dda_ticks_downcount = st_pre.dda_ticks;
-        st_run.dda_ticks_X_substeps = st_pre.dda_ticks_X_substeps;
+        st_run.dda_ticks_downcount = s->dda_ticks;
+        st_run.dda_ticks_X_substeps = s->dda_ticks_X_substeps;
+        st_run.motor_active = 0;
 
         // INLINED VERSION: 4.3us
         //**** MOTOR_1 LOAD ****
@@ -503,31 +537,31 @@ static void _load_move()
         // is supposed to take < 5 uSec (Arm M3 core). Be careful if you mess with this.
 
         // the following if() statement sets the runtime substep increment value or zeroes it
-        if ((st_run.mot[MOTOR_1].substep_increment = st_pre.mot[MOTOR_1].substep_increment) != 0) {
+        if ((st_run.mot[MOTOR_1].substep_increment = s->mot[MOTOR_1].substep_increment) != 0) {
+            st_run.motor_active |= (1 << MOTOR_1);
 
             // NB: If motor has 0 steps the following is all skipped. This ensures that state comparisons
             //     always operate on the last segment actually run by this motor, regardless of how many
             //     segments it may have been inactive in between.
 
             // Apply accumulator correction if the time base has changed since previous segment
-            if (st_pre.mot[MOTOR_1].accumulator_correction_flag == true) {
-                st_pre.mot[MOTOR_1].accumulator_correction_flag = false;
-                st_run.mot[MOTOR_1].substep_accumulator *= st_pre.mot[MOTOR_1].accumulator_correction;
+            if (s->mot[MOTOR_1].accumulator_correction_flag == true) {
+                st_run.mot[MOTOR_1].substep_accumulator *= s->mot[MOTOR_1].accumulator_correction;
             }
 
             // Detect direction change and if so:
             //    Set the direction bit in hardware.
             //    Compensate for direction change by flipping substep accumulator value about its midpoint.
 
-            if (st_pre.mot[MOTOR_1].direction != st_pre.mot[MOTOR_1].prev_direction) {
-                st_pre.mot[MOTOR_1].prev_direction = st_pre.mot[MOTOR_1].direction;
+            if (s->mot[MOTOR_1].direction != st_run.mot[MOTOR_1].prev_direction) {
+                st_run.mot[MOTOR_1].prev_direction = s->mot[MOTOR_1].direction;
                 st_run.mot[MOTOR_1].substep_accumulator = -(st_run.dda_ticks_X_substeps + st_run.mot[MOTOR_1].substep_accumulator);
-                motor_1.setDirection(st_pre.mot[MOTOR_1].direction);
+                motor_1.setDirection(s->mot[MOTOR_1].direction);
             }
 
             // Enable the stepper and start/update motor power management
             motor_1.enable();
-            SET_ENCODER_STEP_SIGN(MOTOR_1, st_pre.mot[MOTOR_1].step_sign);
+            SET_ENCODER_STEP_SIGN(MOTOR_1, s->mot[MOTOR_1].step_sign);
 
         } else {  // Motor has 0 steps; might need to energize motor for power mode processing
             motor_1.motionStopped();
@@ -536,115 +570,124 @@ static void _load_move()
         ACCUMULATE_ENCODER(MOTOR_1);
 
 #if (MOTORS >= 2)
-        if ((st_run.mot[MOTOR_2].substep_increment = st_pre.mot[MOTOR_2].substep_increment) != 0) {
-            if (st_pre.mot[MOTOR_2].accumulator_correction_flag == true) {
-                st_pre.mot[MOTOR_2].accumulator_correction_flag = false;
-                st_run.mot[MOTOR_2].substep_accumulator *= st_pre.mot[MOTOR_2].accumulator_correction;
+        if ((st_run.mot[MOTOR_2].substep_increment = s->mot[MOTOR_2].substep_increment) != 0) {
+            st_run.motor_active |= (1 << MOTOR_2);
+            if (s->mot[MOTOR_2].accumulator_correction_flag == true) {
+                st_run.mot[MOTOR_2].substep_accumulator *= s->mot[MOTOR_2].accumulator_correction;
             }
-            if (st_pre.mot[MOTOR_2].direction != st_pre.mot[MOTOR_2].prev_direction) {
-                st_pre.mot[MOTOR_2].prev_direction = st_pre.mot[MOTOR_2].direction;
+            if (s->mot[MOTOR_2].direction != st_run.mot[MOTOR_2].prev_direction) {
+                st_run.mot[MOTOR_2].prev_direction = s->mot[MOTOR_2].direction;
                 st_run.mot[MOTOR_2].substep_accumulator = -(st_run.dda_ticks_X_substeps + st_run.mot[MOTOR_2].substep_accumulator);
-                motor_2.setDirection(st_pre.mot[MOTOR_2].direction);
+                motor_2.setDirection(s->mot[MOTOR_2].direction);
             }
             motor_2.enable();
-            SET_ENCODER_STEP_SIGN(MOTOR_2, st_pre.mot[MOTOR_2].step_sign);
+            SET_ENCODER_STEP_SIGN(MOTOR_2, s->mot[MOTOR_2].step_sign);
         } else {
             motor_2.motionStopped();
         }
         ACCUMULATE_ENCODER(MOTOR_2);
 #endif
 #if (MOTORS >= 3)
-        if ((st_run.mot[MOTOR_3].substep_increment = st_pre.mot[MOTOR_3].substep_increment) != 0) {
-            if (st_pre.mot[MOTOR_3].accumulator_correction_flag == true) {
-                st_pre.mot[MOTOR_3].accumulator_correction_flag = false;
-                st_run.mot[MOTOR_3].substep_accumulator *= st_pre.mot[MOTOR_3].accumulator_correction;
+        if ((st_run.mot[MOTOR_3].substep_increment = s->mot[MOTOR_3].substep_increment) != 0) {
+            st_run.motor_active |= (1 << MOTOR_3);
+            if (s->mot[MOTOR_3].accumulator_correction_flag == true) {
+                st_run.mot[MOTOR_3].substep_accumulator *= s->mot[MOTOR_3].accumulator_correction;
             }
-            if (st_pre.mot[MOTOR_3].direction != st_pre.mot[MOTOR_3].prev_direction) {
-                st_pre.mot[MOTOR_3].prev_direction = st_pre.mot[MOTOR_3].direction;
+            if (s->mot[MOTOR_3].direction != st_run.mot[MOTOR_3].prev_direction) {
+                st_run.mot[MOTOR_3].prev_direction = s->mot[MOTOR_3].direction;
                 st_run.mot[MOTOR_3].substep_accumulator = -(st_run.dda_ticks_X_substeps + st_run.mot[MOTOR_3].substep_accumulator);
-                motor_3.setDirection(st_pre.mot[MOTOR_3].direction);
+                motor_3.setDirection(s->mot[MOTOR_3].direction);
             }
             motor_3.enable();
-            SET_ENCODER_STEP_SIGN(MOTOR_3, st_pre.mot[MOTOR_3].step_sign);
+            SET_ENCODER_STEP_SIGN(MOTOR_3, s->mot[MOTOR_3].step_sign);
         } else {
             motor_3.motionStopped();
         }
         ACCUMULATE_ENCODER(MOTOR_3);
 #endif
 #if (MOTORS >= 4)
-        if ((st_run.mot[MOTOR_4].substep_increment = st_pre.mot[MOTOR_4].substep_increment) != 0) {
-            if (st_pre.mot[MOTOR_4].accumulator_correction_flag == true) {
-                st_pre.mot[MOTOR_4].accumulator_correction_flag = false;
-                st_run.mot[MOTOR_4].substep_accumulator *= st_pre.mot[MOTOR_4].accumulator_correction;
+        if ((st_run.mot[MOTOR_4].substep_increment = s->mot[MOTOR_4].substep_increment) != 0) {
+            st_run.motor_active |= (1 << MOTOR_4);
+            if (s->mot[MOTOR_4].accumulator_correction_flag == true) {
+                st_run.mot[MOTOR_4].substep_accumulator *= s->mot[MOTOR_4].accumulator_correction;
             }
-            if (st_pre.mot[MOTOR_4].direction != st_pre.mot[MOTOR_4].prev_direction) {
-                st_pre.mot[MOTOR_4].prev_direction = st_pre.mot[MOTOR_4].direction;
+            if (s->mot[MOTOR_4].direction != st_run.mot[MOTOR_4].prev_direction) {
+                st_run.mot[MOTOR_4].prev_direction = s->mot[MOTOR_4].direction;
                 st_run.mot[MOTOR_4].substep_accumulator = -(st_run.dda_ticks_X_substeps + st_run.mot[MOTOR_4].substep_accumulator);
-                motor_4.setDirection(st_pre.mot[MOTOR_4].direction);
+                motor_4.setDirection(s->mot[MOTOR_4].direction);
             }
             motor_4.enable();
-            SET_ENCODER_STEP_SIGN(MOTOR_4, st_pre.mot[MOTOR_4].step_sign);
+            SET_ENCODER_STEP_SIGN(MOTOR_4, s->mot[MOTOR_4].step_sign);
         } else {
             motor_4.motionStopped();
         }
         ACCUMULATE_ENCODER(MOTOR_4);
 #endif
 #if (MOTORS >= 5)
-        if ((st_run.mot[MOTOR_5].substep_increment = st_pre.mot[MOTOR_5].substep_increment) != 0) {
-            if (st_pre.mot[MOTOR_5].accumulator_correction_flag == true) {
-                st_pre.mot[MOTOR_5].accumulator_correction_flag = false;
-                st_run.mot[MOTOR_5].substep_accumulator *= st_pre.mot[MOTOR_5].accumulator_correction;
+        if ((st_run.mot[MOTOR_5].substep_increment = s->mot[MOTOR_5].substep_increment) != 0) {
+            st_run.motor_active |= (1 << MOTOR_5);
+            if (s->mot[MOTOR_5].accumulator_correction_flag == true) {
+                st_run.mot[MOTOR_5].substep_accumulator *= s->mot[MOTOR_5].accumulator_correction;
             }
-            if (st_pre.mot[MOTOR_5].direction != st_pre.mot[MOTOR_5].prev_direction) {
-                st_pre.mot[MOTOR_5].prev_direction = st_pre.mot[MOTOR_5].direction;
+            if (s->mot[MOTOR_5].direction != st_run.mot[MOTOR_5].prev_direction) {
+                st_run.mot[MOTOR_5].prev_direction = s->mot[MOTOR_5].direction;
                 st_run.mot[MOTOR_5].substep_accumulator = -(st_run.dda_ticks_X_substeps + st_run.mot[MOTOR_5].substep_accumulator);
-                motor_5.setDirection(st_pre.mot[MOTOR_5].direction);
+                motor_5.setDirection(s->mot[MOTOR_5].direction);
             }
             motor_5.enable();
-            SET_ENCODER_STEP_SIGN(MOTOR_5, st_pre.mot[MOTOR_5].step_sign);
+            SET_ENCODER_STEP_SIGN(MOTOR_5, s->mot[MOTOR_5].step_sign);
         } else {
             motor_5.motionStopped();
         }
         ACCUMULATE_ENCODER(MOTOR_5);
 #endif
 #if (MOTORS >= 6)
-        if ((st_run.mot[MOTOR_6].substep_increment = st_pre.mot[MOTOR_6].substep_increment) != 0) {
-            if (st_pre.mot[MOTOR_6].accumulator_correction_flag == true) {
-                st_pre.mot[MOTOR_6].accumulator_correction_flag = false;
-                st_run.mot[MOTOR_6].substep_accumulator *= st_pre.mot[MOTOR_6].accumulator_correction;
+        if ((st_run.mot[MOTOR_6].substep_increment = s->mot[MOTOR_6].substep_increment) != 0) {
+            st_run.motor_active |= (1 << MOTOR_6);
+            if (s->mot[MOTOR_6].accumulator_correction_flag == true) {
+                st_run.mot[MOTOR_6].substep_accumulator *= s->mot[MOTOR_6].accumulator_correction;
             }
-            if (st_pre.mot[MOTOR_6].direction != st_pre.mot[MOTOR_6].prev_direction) {
-                st_pre.mot[MOTOR_6].prev_direction = st_pre.mot[MOTOR_6].direction;
+            if (s->mot[MOTOR_6].direction != st_run.mot[MOTOR_6].prev_direction) {
+                st_run.mot[MOTOR_6].prev_direction = s->mot[MOTOR_6].direction;
                 st_run.mot[MOTOR_6].substep_accumulator = -(st_run.dda_ticks_X_substeps + st_run.mot[MOTOR_6].substep_accumulator);
-                motor_6.setDirection(st_pre.mot[MOTOR_6].direction);
+                motor_6.setDirection(s->mot[MOTOR_6].direction);
             }
             motor_6.enable();
-            SET_ENCODER_STEP_SIGN(MOTOR_6, st_pre.mot[MOTOR_6].step_sign);
+            SET_ENCODER_STEP_SIGN(MOTOR_6, s->mot[MOTOR_6].step_sign);
         } else {
             motor_6.motionStopped();
         }
         ACCUMULATE_ENCODER(MOTOR_6);
 #endif
 
+        // The encoder now holds the steps of the segment that just finished - compare it to that segment's target
+        for (uint8_t motor = 0; motor < MOTORS; motor++) {
+            st_pre.following_error[motor] = en_read_encoder(motor) - st_run.mot[motor].commanded_steps;
+            st_run.mot[motor].commanded_steps = s->mot[motor].target_steps;
+        }
+
         //**** do this last ****
 
         dda_timer.start();                              // start the DDA timer if not already running
 
     // handle dwells and commands
-    } else if (st_pre.block_type == BLOCK_TYPE_DWELL) {
-        st_run.dwell_ticks_downcount = st_pre.dwell_ticks;
+    } else if (s->block_type == BLOCK_TYPE_DWELL) {
+        st_run.dwell_ticks_downcount = s->dwell_ticks;
         SysTickTimer.registerEvent(&dwell_systick_event); // We now use SysTick events to handle dwells
 
     // handle synchronous commands
-    } else if (st_pre.block_type == BLOCK_TYPE_COMMAND) {
-        mp_runtime_command(st_pre.bf);
+    } else if (s->block_type == BLOCK_TYPE_COMMAND) {
+        started = false;
+        mp_runtime_command(s->bf);
 
-    } // else null - which is okay in many cases
+    } else {                                            // null - which is okay in many cases
+        started = false;
+    }
 
-    // all other cases drop to here (e.g. Null moves after Mcodes skip to here)
-    st_pre.block_type = BLOCK_TYPE_NULL;
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_EXEC;    // we are done with the prep buffer - flip the flag back
-    st_request_exec_move();                             // exec and prep next move
+    // all cases drop to here (e.g. Null moves after Mcodes skip to here)
+    __DMB();                                            // finish with the segment...
+    st_pre.tail++;                                      // ...before handing it back to exec
+    return (started);
 }
 
 /***********************************************************************************
@@ -657,12 +700,13 @@ static void _load_move()
  *  floats and converted to their appropriate integer types for the loader.
  *
  * Args:
+ *    - target_steps[] is the position of each motor at the end of the segment, in steps.
+ *      The loader compares it to the encoder once the segment has run (following error).
+ *
  *    - travel_steps[] are signed relative motion in steps for each motor. Steps are
  *      floats that typically have fractional values (fractional steps). The sign
  *      indicates direction. Motors that are not in the move should be 0 steps on input.
  *
- *    - following_error[] is a vector of measured errors to the step count. Used for correction.
- *
  *    - segment_time - how many minutes the segment should run. If timing is not
  *      100% accurate this will affect the move velocity, but not the distance traveled.
  *
@@ -671,10 +715,13 @@ static void _load_move()
  *          dda_ticks_X_substeps = (int32_t)((microseconds/1000000) * f_dda * dda_substeps);
  */
 
-stat_t st_prep_line(float travel_steps[], float following_error[], float segment_time)
+stat_t st_prep_line(const float target_steps[], float travel_steps[], float segment_time)
 {
+    PROFILE_SCOPE(PROFILE_PREP);
+    stPrepSegment_t *s = &st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK];
+
     // trap assertion failures and other conditions that would prevent queuing the line
-    if (st_pre.buffer_state != PREP_BUFFER_OWNED_BY_EXEC) {     // never supposed to happen
+    if ((uint8_t)(st_pre.head - st_pre.tail) >= STEPPER_PREP_QUEUE_DEPTH) {    // never supposed to happen
         return (cm_panic(STAT_INTERNAL_ERROR, "st_prep_line() prep sync error"));
     } else if (isinf(segment_time)) {                           // never supposed to happen
         return (cm_panic(STAT_PREP_LINE_MOVE_TIME_IS_INFINITE, "st_prep_line()"));
@@ -685,17 +732,18 @@ stat_t st_prep_line(float travel_steps[], float following_error[], float segment
     // - dda_ticks is the integer number of DDA clock ticks needed to play out the segment
     // - ticks_X_substeps is the maximum depth of the DDA accumulator (as a negative number)
 
-    st_pre.dda_ticks = (int32_t)(segment_time * 60 * FREQUENCY_DDA);  // NB: converts minutes to seconds
-    st_pre.dda_ticks_X_substeps = st_pre.dda_ticks * DDA_SUBSTEPS;
+    s->dda_ticks = (int32_t)(segment_time * 60 * FREQUENCY_DDA);  // NB: converts minutes to seconds
+    s->dda_ticks_X_substeps = s->dda_ticks * DDA_SUBSTEPS;
 
     // setup motor parameters
 
     float correction_steps;
     for (uint8_t motor=0; motor<MOTORS; motor++) {          // remind us that this is motors, not axes
+        s->mot[motor].target_steps = target_steps[motor];
 
         // Skip this motor if there are no new steps. Leave all other values intact.
         if (fp_ZERO(travel_steps[motor])) {
-            st_pre.mot[motor].substep_increment = 0;        // substep increment also acts as a motor flag
+            s->mot[motor].substep_increment = 0;            // substep increment also acts as a motor flag
             continue;
         }
 
@@ -703,21 +751,22 @@ stat_t st_prep_line(float travel_steps[], float following_error[], float segment
         // Set the step_sign which is used by the stepper ISR to accumulate step position
 
         if (travel_steps[motor] >= 0) {                    // positive direction
-            st_pre.mot[motor].direction = DIRECTION_CW ^ st_cfg.mot[motor].polarity;
-            st_pre.mot[motor].step_sign = 1;
+            s->mot[motor].direction = DIRECTION_CW ^ st_cfg.mot[motor].polarity;
+            s->mot[motor].step_sign = 1;
         } else {
-            st_pre.mot[motor].direction = DIRECTION_CCW ^ st_cfg.mot[motor].polarity;
-            st_pre.mot[motor].step_sign = -1;
+            s->mot[motor].direction = DIRECTION_CCW ^ st_cfg.mot[motor].polarity;
+            s->mot[motor].step_sign = -1;
         }
 
         // Detect segment time changes and setup the accumulator correction factor and flag.
         // Putting this here computes the correct factor even if the motor was dormant for some number
         // of previous moves. Correction is computed based on the last segment time actually used.
 
+        s->mot[motor].accumulator_correction_flag = false;
         if (fabs(segment_time - st_pre.mot[motor].prev_segment_time) > 0.0000001) { // highly tuned FP != compare
             if (fp_NOT_ZERO(st_pre.mot[motor].prev_segment_time)) {                 // special case to skip first move
-                st_pre.mot[motor].accumulator_correction_flag = true;
-                st_pre.mot[motor].accumulator_correction = segment_time / st_pre.mot[motor].prev_segment_time;
+                s->mot[motor].accumulator_correction_flag = true;
+                s->mot[motor].accumulator_correction = segment_time / st_pre.mot[motor].prev_segment_time;
             }
             st_pre.mot[motor].prev_segment_time = segment_time;
         }
@@ -726,10 +775,10 @@ stat_t st_prep_line(float travel_steps[], float following_error[], float segment
         // NOTE: This clause can be commented out to test for numerical accuracy and accumulating errors
 
         if ((--st_pre.mot[motor].correction_holdoff < 0) &&
-            (fabs(following_error[motor]) > STEP_CORRECTION_THRESHOLD)) {
+            (fabs(st_pre.following_error[motor]) > STEP_CORRECTION_THRESHOLD)) {
 
             st_pre.mot[motor].correction_holdoff = STEP_CORRECTION_HOLDOFF;
-            correction_steps = following_error[motor] * STEP_CORRECTION_FACTOR;
+            correction_steps = st_pre.following_error[motor] * STEP_CORRECTION_FACTOR;
 
             if (correction_steps > 0) {
                 correction_steps = min3(correction_steps, fabs(travel_steps[motor]), STEP_CORRECTION_MAX);
@@ -745,21 +794,22 @@ stat_t st_prep_line(float travel_steps[], float following_error[], float segment
         // Rounding is performed to eliminate a negative bias in the uint32 conversion
         // that results in long-term negative drift. (fabs/round order doesn't matter)
 
-        st_pre.mot[motor].substep_increment = round(fabs(travel_steps[motor] * DDA_SUBSTEPS));
+        s->mot[motor].substep_increment = round(fabs(travel_steps[motor] * DDA_SUBSTEPS));
     }
-    st_pre.block_type = BLOCK_TYPE_ALINE;
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_LOADER;    // signal that prep buffer is ready
+    s->block_type = BLOCK_TYPE_ALINE;                   // the exec interrupt passes it to the loader
     return (STAT_OK);
 }
 
 /*
  * st_prep_null() - Keeps the loader happy. Otherwise performs no action
+ *
+ *  Only call this from the exec interrupt - it's the prep queue's only producer. A write
+ *  from any other level can land on a segment exec has queued since head was read.
  */
 
 void st_prep_null()
 {
-    st_pre.block_type = BLOCK_TYPE_NULL;
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_EXEC;    // signal that prep buffer is empty
+    st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK].block_type = BLOCK_TYPE_NULL;
 }
 
 /*
@@ -768,9 +818,9 @@ void st_prep_null()
 
 void st_prep_command(void *bf)
 {
-    st_pre.block_type = BLOCK_TYPE_COMMAND;
-    st_pre.bf = (mpBuf_t *)bf;
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_LOADER;    // signal that prep buffer is ready
+    stPrepSegment_t *s = &st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK];
+    s->block_type = BLOCK_TYPE_COMMAND;
+    s->bf = (mpBuf_t *)bf;
 }
 
 /*
@@ -779,29 +829,46 @@ void st_prep_command(void *bf)
 
 void st_prep_dwell(float microseconds)
 {
-    st_pre.block_type = BLOCK_TYPE_DWELL;
+    stPrepSegment_t *s = &st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK];
+    s->block_type = BLOCK_TYPE_DWELL;
     // we need dwell_ticks to be at least 1
-    st_pre.dwell_ticks = std::max((uint32_t)((microseconds/1000000) * FREQUENCY_DWELL), 1UL);
-    st_pre.buffer_state = PREP_BUFFER_OWNED_BY_LOADER;    // signal that prep buffer is ready
+    s->dwell_ticks = std::max((uint32_t)((microseconds/1000000) * FREQUENCY_DWELL), 1UL);
 }
 
 /*
  * st_prep_out_of_band_dwell()
  *
  * Add a dwell to the loader without going through the planner buffers.
- * Only usable while exec isn't running, e.g. in feedhold or stopped states.
- * Otherwise it is skipped.
+ * Only usable while the runtime is stopped, e.g. in feedhold or stopped states.
+ * Otherwise it is skipped. Called from exec, which queues the dwell on return.
  */
 
 void st_prep_out_of_band_dwell(float microseconds)
 {
     if (!st_runtime_isbusy()) {
         st_prep_dwell(microseconds);
-        st_pre.buffer_state = PREP_BUFFER_OWNED_BY_LOADER;    // signal that prep buffer is ready
-        st_request_load_move();
     }
 }
 
+/*
+ * st_set_commanded_steps() - set the position the following error is measured from
+ *
+ *  Use with the runtime stopped, when the encoder is set to the same position.
+ */
+
+void st_set_commanded_steps(const uint8_t motor, const float steps)
+{
+    st_run.mot[motor].commanded_steps = steps;
+    st_pre.following_error[motor] = 0;
+    st_pre.mot[motor].corrected_steps = 0;
+}
+
+/*
+ * st_get_udr() - get the prep queue underrun count
+ */
+
+stat_t st_get_udr(nvObj_t *nv) { return (get_integer(nv, st_pre.underruns)); }
+
 /*
  * _set_hw_microsteps() - set microsteps in hardware
  */
@@ -840,6 +907,7 @@ static float _set_motor_steps_per_unit(nvObj_t *nv)
                                    (360 * st_cfg.mot[m].microsteps);
 
     st_cfg.mot[m].steps_per_unit = 1/st_cfg.mot[m].units_per_step;
+    kn_config_changed();
     return (st_cfg.mot[m].steps_per_unit);
 }
 
@@ -900,6 +968,7 @@ stat_t st_set_ma(nvObj_t *nv)
     uint8_t remap_axis[9] = { 0,1,2,6,7,8,3,4,5 };
     nv->value_int = remap_axis[nv->value_int];
     ritorno(set_integer(nv, st_cfg.mot[_motor(nv->index)].motor_map, 0, AXES));
+    kn_config_changed();
     nv->value_int = external_axis;
     return(STAT_OK);
 }
@@ -971,6 +1040,7 @@ stat_t st_set_su(nvObj_t *nv)
     // You could scale any one of the other values, but TR makes the most sense
     st_cfg.mot[m].travel_rev = (360.0 * st_cfg.mot[m].microsteps) /
                                (st_cfg.mot[m].steps_per_unit * st_cfg.mot[m].step_angle);
+    kn_config_changed();
     return(STAT_OK);
 }
 
@@ -160,7 +160,7 @@
  *    the "segment", usually ~1ms worth of pulses
  *
  *  - When the current segment is finished the stepper interrupt LOADs the next segment
- *    from the prep buffer, reloads the timers, and starts the next segment. At the end
+ *    from the prep queue, reloads the timers, and starts the next segment. At the end
  *    of the load the stepper interrupt routine requests an "exec" of the next move in
  *    order to prepare for the next load operation. It does this by calling the exec
  *    using a software interrupt (actually a timer, since that's all we've got).
@@ -177,7 +177,8 @@
  *
  *  - Once the segment has been computed the exec handler finishes up by running the
  *    PREP routine in stepper.cpp. This computes the DDA values and gets the segment
- *    into the prep buffer - and ready for the next LOAD operation.
+ *    into the prep queue - and ready for the next LOAD operation. Exec keeps going
+ *    until the queue is full, so the loader normally has a few segments in hand.
  *
  *  - The main loop runs in background to receive gcode blocks, parse them, and send
  *    them to the planner in order to keep the planner queue full so that when the
@@ -217,7 +218,7 @@
  *      be needed to run the move - in this example st_prep_line().
  *
  *   7  st_prep_line() generates the timer and DDA values and stages these into
- *      the prep structure (sp) - ready for loading into the stepper runtime struct
+ *      the prep queue (st_pre) - ready for loading into the stepper runtime struct
  *
  *   8  stepper.st_prep_line() returns back to planner.mp_exec_move(), which
  *      frees the planning buffer (bf) back to the planner buffer pool if the
@@ -262,10 +263,26 @@
  *********************************/
 //See hardware.h for platform specific stepper definitions
 
-typedef enum {
-    PREP_BUFFER_OWNED_BY_LOADER = 0,    // staging buffer is ready for load
-    PREP_BUFFER_OWNED_BY_EXEC           // staging buffer is being loaded
-} prepBufferState;
+/* Prep queue
+ *
+ *  Prepared segments are passed from exec to the loader through a small ring (st_pre.seg).
+ *  Exec is the only writer of the head and the loader is the only writer of the tail, so no
+ *  locking is needed. Exec fills the queue ahead of the DDA, which lets a main loop or exec
+ *  hiccup of up to (depth - 1) segments go by without stalling motion. A synchronous command
+ *  is a barrier - exec stops at it until the loader has run it, since the command can change
+ *  what exec does next.
+ *
+ *  An underrun is the loader finding the queue empty at the end of a segment while exec still
+ *  had segments to produce. Read the count with {udr:n} (it can be put in status reports)
+ *  and clear it with {clc:n}.
+ *
+ *  Because segments wait in the queue, the following error is computed by the loader as each
+ *  segment starts, from the encoder and the target of the segment that just finished.
+ */
+#ifndef STEPPER_PREP_QUEUE_DEPTH            // boards can override this value in hardware.h
+#define STEPPER_PREP_QUEUE_DEPTH    4       // prepared segments. Must be a power of 2, 128 max
+#endif
+#define STEPPER_PREP_QUEUE_MASK     (STEPPER_PREP_QUEUE_DEPTH-1)
 
 typedef enum {                          // used w/start and stop flags to sequence motor power
     MOTOR_OFF = 0,                      // motor is stopped and deenergized
@@ -320,7 +337,8 @@ typedef enum {
 /* Step correction settings
  *
  *  Step correction settings determine how the encoder error is fed back to correct position errors.
- *  Since the following_error is running 2 segments behind the current segment you have to be careful
+ *  Since the following_error is running a queue's depth of segments behind the segment being prepped
+ *  you have to be careful
  *  not to overcompensate. The threshold determines if a correction should be applied, and the factor
  *  is how much. The holdoff is how many segments to wait before applying another correction. If threshold
  *  is too small and/or amount too large and/or holdoff is too small you may get a runaway correction
@@ -329,7 +347,7 @@ typedef enum {
 #define STEP_CORRECTION_THRESHOLD   (float)2.00     // magnitude of forwarding error to apply correction (in steps)
 #define STEP_CORRECTION_FACTOR      (float)0.25     // factor to apply to step correction for a single segment
 #define STEP_CORRECTION_MAX         (float)0.60     // max step correction allowed in a single segment
-#define STEP_CORRECTION_HOLDOFF            5        // minimum number of segments to wait between error correction
+#define STEP_CORRECTION_HOLDOFF     (4 + STEPPER_PREP_QUEUE_DEPTH) // minimum number of segments to wait between error correction
 
 /*
  * Stepper control structures
@@ -376,6 +394,8 @@ typedef struct stRunMotor {                 // one per controlled motor
     uint32_t substep_increment;             // total steps in axis times substeps factor
     int32_t substep_accumulator;            // DDA phase angle accumulator
     bool motor_flag;                        // true if motor is participating in this move
+    uint8_t prev_direction;                 // travel direction of the last segment loaded for this motor
+    float commanded_steps;                  // target of the last segment loaded - in step with the encoder once it's done
     uint32_t power_systick;                 // sys_tick for next motor power state transition
     float power_level_dynamic;              // power level for this segment of idle
 } stRunMotor_t;
@@ -385,42 +405,51 @@ typedef struct stRunSingleton {             // Stepper static values and axis pa
     uint32_t dda_ticks_downcount;           // dda tick down-counter (unscaled)
     uint32_t dwell_ticks_downcount;         // dwell tick down-counter (unscaled)
     uint32_t dda_ticks_X_substeps;          // ticks multiplied by scaling factor
+    uint32_t motor_active;                  // bitmask of motors with steps in this segment
+    uint32_t motor_stepped;                 // bitmask of motors pulsed in the last DDA tick
     stRunMotor_t mot[MOTORS];               // runtime motor structures
     magic_t magic_end;
 } stRunSingleton_t;
 
-// Motor prep structure. Used by exec/prep ISR (MED) and read-only during load
+// Motor prep structures. Written by exec/prep ISR (MED), segments are read-only during load
 // Must be careful about volatiles in this one
 
-typedef struct stPrepMotor {
-    uint32_t substep_increment;             // total steps in axis times substep factor
-    bool motor_flag;                        // true if motor is participating in this move
-
-    // direction and direction change
-    uint8_t direction;                      // travel direction corrected for polarity (CW==0. CCW==1)
-    uint8_t prev_direction;                 // travel direction from previous segment run for this motor
-    int8_t step_sign;                       // set to +1 or -1 for encoders
-
+typedef struct stPrepMotor {                // prep state carried from segment to segment
     // following error correction
     int32_t correction_holdoff;             // count down segments between corrections
     float corrected_steps;                  // accumulated correction steps for the cycle (for diagnostic display only)
 
     // accumulator phase correction
     float prev_segment_time;                // segment time from previous segment run for this motor
-    float accumulator_correction;           // factor for adjusting accumulator between segments
-    uint8_t accumulator_correction_flag;    // signals accumulator needs correction
 } stPrepMotor_t;
 
-typedef struct stPrepSingleton {
-    magic_t magic_start;                    // magic number to test memory integrity
-    volatile prepBufferState buffer_state;  // prep buffer state - owned by exec or loader
+typedef struct stSegmentMotor {             // one motor's part of a prepared segment
+    uint32_t substep_increment;             // total steps in axis times substep factor
+    uint8_t direction;                      // travel direction corrected for polarity (CW==0. CCW==1)
+    int8_t step_sign;                       // set to +1 or -1 for encoders
+    uint8_t accumulator_correction_flag;    // signals accumulator needs correction
+    float accumulator_correction;           // factor for adjusting accumulator between segments
+    float target_steps;                     // position at the end of the segment, for the following error
+} stSegmentMotor_t;
+
+typedef struct stPrepSegment {              // a prepared segment in the prep queue
     struct mpBuffer *bf;                    // static pointer to relevant buffer
     blockType block_type;                   // move type (requires planner.h)
-
     uint32_t dda_ticks;                     // DDA ticks for the move
     uint32_t dwell_ticks;                   // dwell ticks remaining
     uint32_t dda_ticks_X_substeps;          // DDA ticks scaled by substep factor
+    stSegmentMotor_t mot[MOTORS];
+} stPrepSegment_t;
+
+typedef struct stPrepSingleton {
+    magic_t magic_start;                    // magic number to test memory integrity
+    volatile uint8_t head;                  // count of segments queued - written by exec only
+    volatile uint8_t tail;                  // count of segments loaded - written by the loader only
+    volatile bool exec_idle;                // exec's last call had nothing to run
+    volatile uint32_t underruns;            // loader found the queue empty while exec had more to run
+    stPrepSegment_t seg[STEPPER_PREP_QUEUE_DEPTH];  // the queue. head & mask is the segment being prepped
     stPrepMotor_t mot[MOTORS];              // prep time motor structs
+    volatile float following_error[MOTORS]; // encoder minus commanded steps - written by the loader
     magic_t magic_end;
 } stPrepSingleton_t;
 
@@ -595,7 +624,9 @@ void st_prep_null(void);
 void st_prep_command(void *bf);        // use a void pointer since we don't know about mpBuf_t yet)
 void st_prep_dwell(float microseconds);
 void st_prep_out_of_band_dwell(float microseconds);
-stat_t st_prep_line(float travel_steps[], float following_error[], float segment_time);
+stat_t st_prep_line(const float target_steps[], float travel_steps[], float segment_time);
+void st_set_commanded_steps(const uint8_t motor, const float steps);
+stat_t st_get_udr(nvObj_t *nv);
 
 stat_t st_get_ma(nvObj_t *nv);
 stat_t st_set_ma(nvObj_t *nv);
@@ -371,7 +371,10 @@ struct PID {
                         // FAILURE!!
                         char buffer[128];
                         char *str = buffer;
-                        str += sprintf(str, "Heater temperature failed to rise fast enough. At: %f Set: %f", input, _set_point);
+                        str_concat(str, "Heater temperature failed to rise fast enough. At: ");
+                        str += floattoa(str, input, 6);
+                        str_concat(str, " Set: ");
+                        floattoa(str, _set_point, 6);
                         cm_alarm(STAT_TEMPERATURE_CONTROL_ERROR, buffer);
                         _set_point = 0;
                         _rise_time_timeout.clear();
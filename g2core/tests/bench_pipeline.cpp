@@ -0,0 +1,145 @@
+/*
+ * bench_pipeline.cpp - planner and runtime throughput on the host
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  Feeds the Resources/gcode programs through gcode_parser() -> mp_aline() -> mp_exec_move()
+ *  -> st_prep_line() and reports blocks and segments per second of host time, with the
+ *  _pf profile of each stage (planner.h). Fails if any program raises an alarm.
+ *
+ *    bench_pipeline [-q] [-t trace_file]
+ *
+ *  -q leaves out the per-stage table. -t writes every segment for the FAST_MATH step
+ *  comparison in test_fast_math.cpp (see trace.h for the format).
+ */
+
+#include "g2core.h"
+#include "config.h"
+#include "planner.h"
+#include "util.h"
+#include "host_machine.h"
+#include "trace.h"
+
+#include <chrono>
+
+#define PROGMEM
+namespace roadrunner_program {
+#include "../../Resources/gcode/gcode_roadrunner.h"
+}
+namespace hacdc_program {
+#include "../../Resources/gcode/gcode_hacdc.h"
+}
+namespace braid2d_program {
+#include "../../Resources/gcode/gcode_braid2d.h"
+}
+namespace contraptor_program {
+#include "../../Resources/gcode/gcode_contraptor_circle.h"
+}
+
+static const struct {
+    const char *name;
+    const char *gcode;
+} programs[] = {
+    { "roadrunner",        roadrunner_program::roadrunner },
+    { "hacdc",             hacdc_program::hacdc },
+    { "braid2d",           braid2d_program::gcode_file },
+    { "contraptor_circle", contraptor_program::contraptor_circle },
+};
+
+static const char *slot_names[PROFILE_SLOTS] = {
+    "mp_aline", "mp_plan_block_list", "mp_forward_plan", "mp_exec_move",
+    "st_prep_line", "(DDA)", "_exec_segment_steps", "kn_inverse_kinematics"
+};
+
+static FILE *trace_file;
+static traceRecord_t trace;
+
+static void _trace_segment(const hostSegment_t *s)
+{
+    if (s->block != trace.block_ptr) {                  // a new block starts its clock at 0
+        trace.block_ptr = s->block;
+        trace.block++;
+        trace.time = 0;
+    }
+    trace.time += s->time * MICROSECONDS_PER_MINUTE;
+    for (uint8_t motor = 0; motor < TRACE_MOTORS; motor++) {
+        trace.steps[motor] = s->target_steps[motor];
+    }
+    fwrite(&trace, sizeof(trace), 1, trace_file);
+}
+
+int main(int argc, char *argv[])
+{
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc)) {
+            if ((trace_file = fopen(argv[++i], "wb")) == NULL) {
+                perror(argv[i]);
+                return (2);
+            }
+            hm.segment_hook = _trace_segment;
+        } else {
+            fprintf(stderr, "usage: %s [-q] [-t trace_file]\n", argv[0]);
+            return (2);
+        }
+    }
+
+    uint32_t failures = 0;
+    printf("%-18s %7s %7s %8s %9s %9s %11s %11s\n",
+           "program", "lines", "blocks", "segments", "machine s", "host ms", "blocks/s", "segments/s");
+
+    for (auto &p : programs) {
+        hm_init();
+        trace.block_ptr = NULL;
+        uint64_t machine_us = host_time_us;
+        auto start = std::chrono::steady_clock::now();
+        hm_program(p.gcode);
+        hm_finish();
+        double host_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        machine_us = host_time_us - machine_us;
+
+        uint32_t blocks = mpf.slot[PROFILE_ALINE].count;
+        printf("%-18s %7u %7u %8u %9.1f %9.1f %11.0f %11.0f\n", p.name, hm.lines, blocks, hm.segments,
+               machine_us / 1000000.0, host_s * 1000, blocks / host_s, hm.segments / host_s);
+
+        if (hm.alarms != 0) {
+            printf("  FAILED: %u alarms, last status %d\n", hm.alarms, hm.last_alarm);
+            failures++;
+        }
+        if (quiet) {
+            continue;
+        }
+        printf("  %-22s %9s %9s %9s\n", "stage", "calls", "avg ns", "max ns");
+        for (uint8_t slot = 0; slot < PROFILE_SLOTS; slot++) {
+            mpProfileCounter_t *c = &mpf.slot[slot];
+            if (c->count == 0) {
+                continue;
+            }
+            printf("  %-22s %9u %9llu %9u\n", slot_names[slot], c->count,
+                   (unsigned long long)(c->cycles / c->count), c->max_cycles);
+        }
+        printf("  meet velocity iterations:");
+        for (uint8_t bin = 0; bin < MEET_HISTOGRAM_BINS; bin++) {
+            printf(" %u", mpf.meet[bin]);
+        }
+        printf("\n  worst segment load %.3f%% of its time\n\n", (float)mpf.load_cycles * 100 / mpf.load_segment_cycles);
+    }
+    if (trace_file != NULL) {
+        fclose(trace_file);
+    }
+    return (failures ? 1 : 0);
+}
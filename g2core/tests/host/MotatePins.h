@@ -0,0 +1,46 @@
+/*
+ * MotatePins.h - host stand-in for the Motate pin classes
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  Only what the planner and canonical machine sources touch. Every pin is unconnected.
+ */
+
+#ifndef MOTATEPINS_H_ONCE
+#define MOTATEPINS_H_ONCE
+
+#include <stdint.h>
+
+namespace Motate {
+    typedef int16_t pin_number;
+
+    enum {
+        kDebug1_PinNumber = -1,
+        kDebug2_PinNumber = -1,
+        kDebug3_PinNumber = -1,
+        kDebug4_PinNumber = -1
+    };
+
+    template <pin_number N>
+    struct OutputPin {
+        void set() {}
+        void clear() {}
+        void toggle() {}
+        void write(bool) {}
+        OutputPin &operator=(const bool) { return *this; }
+    };
+} // namespace Motate
+
+#endif // End of include guard: MOTATEPINS_H_ONCE
@@ -0,0 +1,45 @@
+/*
+ * MotateTimers.h - host stand-in for the Motate SysTick timer and timeouts
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  SysTick runs on simulated machine time, not the wall clock - see host_machine.cpp.
+ */
+
+#ifndef MOTATETIMERS_H_ONCE
+#define MOTATETIMERS_H_ONCE
+
+#include <stdint.h>
+
+namespace Motate {
+    struct SysTickTimer_t {
+        uint32_t getValue();
+    };
+    extern SysTickTimer_t SysTickTimer;
+
+    void delay(uint32_t ms);
+
+    struct Timeout {
+        uint32_t _end = 0;
+        bool _set = false;
+
+        void set(uint32_t ms) { _end = SysTickTimer.getValue() + ms; _set = true; }
+        void clear() { _set = false; }
+        bool isSet() { return _set; }
+        bool isPast() { return _set && ((int32_t)(SysTickTimer.getValue() - _end) >= 0); }
+    };
+} // namespace Motate
+
+#endif // End of include guard: MOTATETIMERS_H_ONCE
@@ -0,0 +1,97 @@
+/*
+ * hardware.h - host (x86 / POSIX) hardware for the planner tests and benchmarks
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  The host "board" has no pins, no timers and no motor drivers. The planner, canonical
+ *  machine and Gcode parser are built from the real sources against it - see tests/Makefile.
+ *
+ *  The DWT cycle counter used by __PLANNER_PROFILING (planner.h) reads a nanosecond
+ *  steady clock, so _pf cycle figures on the host are nanoseconds.
+ */
+
+#include "config.h"                 // needed for the stat_t typedef
+#include "error.h"
+
+#ifndef HARDWARE_H_ONCE
+#define HARDWARE_H_ONCE
+
+/*--- Hardware platform enumerations ---*/
+
+#define G2CORE_HARDWARE_PLATFORM    "host"
+#define G2CORE_HARDWARE_VERSION     "na"
+
+/*************************
+ * Global System Defines *
+ *************************/
+
+#define MILLISECONDS_PER_TICK 1     // MS for system tick (systick * N)
+#define SYS_ID_DIGITS 16            // actual digits in system ID (up to 16)
+#define SYS_ID_LEN 24               // total length including dashes and NUL
+
+/************************************************************************************
+ **** HOST SPECIFIC HARDWARE ********************************************************
+ ************************************************************************************/
+
+/**** Resource Assignment via Motate ****/
+
+#include "MotatePins.h"
+#include "MotateTimers.h"
+
+#define MOTORS 6                    // number of motors supported by the planner and kinematics
+#define PWMS 0                      // number of supported PWM channels
+
+// Same DDA and dwell rates as the Due boards so segment timing is comparable
+
+#define FREQUENCY_DDA       200000UL    // Hz step frequency. Interrupts actually fire at 2x (400 KHz)
+#define FREQUENCY_DWELL     1000UL
+#define FREQUENCY_SGI       200000UL    // 200,000 Hz means software interrupts will fire 5 uSec after being called
+
+/**** Cortex-M debug and trace stand-ins (__PLANNER_PROFILING) ****/
+
+struct hostCycleCounter {
+    operator uint32_t() const;      // nanoseconds from the host steady clock
+};
+
+struct hostDWT {
+    hostCycleCounter CYCCNT;
+    uint32_t CTRL;
+};
+
+struct hostCoreDebug {
+    uint32_t DEMCR;
+};
+
+extern hostDWT host_dwt;
+extern hostCoreDebug host_core_debug;
+extern uint32_t SystemCoreClock;    // "cycles" per second - 1 GHz on the host
+
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+#define CoreDebug_DEMCR_TRCENA_Msk 1UL
+
+extern uint64_t host_time_us;       // machine time SysTick runs on - see host_machine.h
+
+#define REG_TC0_CV0 0               // encoder timer counters (json_serialize(), report.cpp)
+#define REG_TC2_CV0 0
+
+/**** function prototypes ****/
+
+void hardware_init(void);           // master hardware init
+stat_t hardware_periodic();         // callback from the main loop (time sensitive)
+void hw_hard_reset(void);
+
+#endif  // end of include guard: HARDWARE_H_ONCE
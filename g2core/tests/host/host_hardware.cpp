@@ -0,0 +1,54 @@
+/*
+ * host_hardware.cpp - host clocks and console
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  Linked into every host program. SysTick counts host_time_us, which only moves when the
+ *  program moves it. The DWT cycle counter is the steady clock in nanoseconds. Lines
+ *  written to the console go to stdout.
+ */
+
+#include "g2core.h"
+#include "hardware.h"
+#include "xio.h"
+
+#include <chrono>
+
+uint64_t host_time_us;
+
+hostDWT host_dwt;
+hostCoreDebug host_core_debug;
+uint32_t SystemCoreClock = 1000000000;
+
+hostCycleCounter::operator uint32_t() const
+{
+    return ((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+namespace Motate {
+    SysTickTimer_t SysTickTimer;
+    uint32_t SysTickTimer_t::getValue() { return ((uint32_t)(host_time_us / 1000)); }
+    void delay(uint32_t ms) { host_time_us += (uint64_t)ms * 1000; }
+} // namespace Motate
+
+void hardware_init() {}
+stat_t hardware_periodic() { return (STAT_OK); }
+void hw_hard_reset() {}
+
+int16_t xio_writeline(const char *buffer, bool only_to_muted)
+{
+    return ((int16_t)fputs(buffer, stdout));
+}
@@ -0,0 +1,160 @@
+/*
+ * host_machine.cpp - runs the planner and runtime pipeline on the host
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "g2core.h"
+#include "config.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "plan_arc.h"
+#include "stepper.h"
+#include "kinematics.h"
+#include "util.h"
+#include "xio.h"
+#include "host_machine.h"
+
+hostMachine_t hm;
+
+/*
+ * hm_init() - initialize the machine, keeping the segment hook
+ *
+ *  Follows application_init_machine() and application_init_startup() in main.cpp, with
+ *  the settings config_init() would apply set directly.
+ */
+
+void hm_init()
+{
+    hostSegmentHook hook = hm.segment_hook;
+    memset(&hm, 0, sizeof(hm));
+    hm.segment_hook = hook;
+    memset(&st_pre, 0, sizeof(st_pre));
+
+    cm = &cm1;
+    kinematics_init();
+    canonical_machine_inits();
+
+    cm->junction_integration_time = 0.75;
+    cm->chordal_tolerance = 0.01;
+    cm->default_units_mode = MILLIMETERS;
+    cm->default_coord_system = G54;
+    cm->default_select_plane = CANON_PLANE_XY;
+    cm->default_path_control = PATH_CONTINUOUS;
+    cm->default_distance_mode = ABSOLUTE_DISTANCE_MODE;
+
+    for (uint8_t axis = AXIS_X; axis <= AXIS_Z; axis++) {
+        cfgAxis_t *a = &cm->a[axis];
+        a->axis_mode = AXIS_STANDARD;
+        a->velocity_max = (axis == AXIS_Z) ? 1200 : 12000;  // mm/min
+        a->feedrate_max = a->velocity_max;
+        a->recip_velocity_max = 1 / a->velocity_max;
+        a->recip_feedrate_max = 1 / a->feedrate_max;
+        a->travel_min = -1000;
+        a->travel_max = 1000;
+        cm_set_axis_max_jerk(axis, (axis == AXIS_Z) ? 500 : 5000);
+        cm_set_axis_high_jerk(axis, (axis == AXIS_Z) ? 1000 : 10000);
+    }
+    for (uint8_t motor = 0; motor < MOTORS; motor++) {
+        cfgMotor_t *m = &st_cfg.mot[motor];
+        m->motor_map = AXIS_X + motor;                    // motors 4-6 are on disabled axes
+        m->microsteps = 16;
+        m->step_angle = 1.8;
+        m->travel_rev = 40;
+        m->steps_per_unit = HOST_STEPS_PER_MM;
+        m->units_per_step = 1 / HOST_STEPS_PER_MM;
+    }
+    kn_config_changed();
+
+    canonical_machine_reset(&cm1);
+    gcode_parser_init();
+    mp_profile_reset();
+}
+
+/*
+ * _main_loop() - the part of the controller loop the pipeline needs, then the interrupts
+ *
+ *  Returns STAT_EAGAIN while the controller would hold off reading the next line.
+ */
+
+static stat_t _main_loop()
+{
+    bool worked = false;
+    while (hm_service()) {
+        worked = true;
+    }
+    mp_planner_callback();
+    stat_t status = cm_arc_callback(cm);
+    if (status != STAT_NOOP) {
+        worked = true;
+    }
+    if (!worked) {
+        host_time_us += 1000;                                 // idle - let the planner timeouts run out
+    }
+    if ((status == STAT_EAGAIN) || mp_planner_is_full(mp)) {
+        return (STAT_EAGAIN);
+    }
+    return (STAT_OK);
+}
+
+stat_t hm_line(const char *line)
+{
+    char block[HOST_LINE_LEN];
+    strncpy(block, line, sizeof(block) - 1);
+    block[sizeof(block) - 1] = NUL;
+
+    while (_main_loop() == STAT_EAGAIN) {}
+    hm.lines++;
+    stat_t status = gcode_parser(block);
+    if ((status != STAT_OK) && (status != STAT_NOOP) && (status != STAT_COMPLETE)) {
+        hm.errors++;
+        fprintf(stderr, "line %u: status %d: %s\n", hm.lines, status, line);
+    }
+    return (status);
+}
+
+uint32_t hm_program(const char *program)
+{
+    char line[HOST_LINE_LEN];
+    uint32_t lines = 0;
+    while (*program != NUL) {
+        uint16_t len = 0;
+        while ((*program != NUL) && (*program != '\n') && (*program != '\r')) {
+            if (len < sizeof(line) - 1) {
+                line[len++] = *program;
+            }
+            program++;
+        }
+        while ((*program == '\n') || (*program == '\r')) {
+            program++;
+        }
+        line[len] = NUL;
+        if (len != 0) {
+            hm_line(line);
+            lines++;
+        }
+    }
+    return (lines);
+}
+
+void hm_finish()
+{
+    for (;;) {
+        _main_loop();
+        if ((mp_get_planner_buffers(mp) == mp->q.queue_size) && (cm->arc.run_state == BLOCK_INACTIVE) &&
+            (cm->motion_state == MOTION_STOP) && !st_runtime_isbusy()) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * host_machine.h - runs the planner and runtime pipeline on the host
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HOST_MACHINE_H_ONCE
+#define HOST_MACHINE_H_ONCE
+
+#include "g2core.h"
+
+/*
+ * Host machine
+ *
+ *  Gcode lines go through the real gcode_parser() into the real canonical machine and
+ *  planner. The interrupt levels of stepper.cpp are run in priority order by host_service():
+ *  forward planning, then exec filling the prep queue, then the loader - which passes each
+ *  prepared segment straight to the segment hook instead of a DDA. SysTick runs on machine
+ *  time: it advances by the time of the segments loaded, or by 1 ms if a pass did nothing
+ *  so the planner's timeouts still expire.
+ *
+ *  The machine is a 3 axis mill (hm_init()). Motors 1-3 drive X, Y and Z at HOST_STEPS_PER_MM.
+ */
+
+#define HOST_STEPS_PER_MM   80.0                // 200 step motor, 16 microsteps, 40 mm per rev
+#define HOST_LINE_LEN       256                 // longest Gcode line fed
+
+typedef struct hostSegment {                    // a line segment as the loader gets it
+    const void *block;                          // run buffer when it was prepped - identifies the block, don't read it
+    float time;                                 // segment time in minutes
+    float target_steps[MOTORS];                 // motor positions at the end of the segment
+} hostSegment_t;
+
+typedef void (*hostSegmentHook)(const hostSegment_t *s);
+
+typedef struct hostMachine {
+    hostSegmentHook segment_hook;               // called for each segment loaded, or NULL
+    uint32_t lines;                             // Gcode lines fed
+    uint32_t segments;                          // line segments loaded
+    uint32_t commands;                          // commands run by the loader
+    uint32_t errors;                            // lines the parser rejected
+    uint32_t alarms;                            // alarms and panics raised
+    stat_t last_alarm;                          // status of the last one
+} hostMachine_t;
+
+extern hostMachine_t hm;
+
+void hm_init(void);                             // initialize the machine and planner
+stat_t hm_line(const char *line);               // feed one line - returns the parser status
+uint32_t hm_program(const char *program);       // feed NUL terminated text - returns lines fed
+void hm_finish(void);                           // run until the planner and runtime are idle
+bool hm_service(void);                          // one pass of the interrupt levels - true if it did work
+
+#endif // End of include guard: HOST_MACHINE_H_ONCE
@@ -0,0 +1,191 @@
+/*
+ * host_stepper.cpp - stepper prep queue and interrupt levels for the host build
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  The prep side of stepper.cpp - the prep queue, exec's loop and the st_prep_*() calls -
+ *  with the loader replaced by the segment hook (see host_machine.h). Keep the exec and
+ *  forward plan sequencing in step with the interrupt handlers in stepper.cpp.
+ */
+
+#include "g2core.h"
+#include "config.h"
+#include "planner.h"
+#include "stepper.h"
+#include "util.h"
+#include "host_machine.h"
+
+stConfig_t st_cfg;
+stPrepSingleton_t st_pre;
+Stepper* Motors[MOTORS];
+
+static hostSegment_t segment[STEPPER_PREP_QUEUE_DEPTH]; // what the hook gets - dda_ticks are truncated
+static bool fwd_plan_requested;                         // the "pending" bits of the software interrupts
+static bool exec_requested;
+
+static bool _exec_can_prep()
+{
+    uint8_t queued = st_pre.head - st_pre.tail;
+    if (queued >= STEPPER_PREP_QUEUE_DEPTH) {
+        return (false);
+    }
+    if ((queued != 0) && (st_pre.seg[(st_pre.head - 1) & STEPPER_PREP_QUEUE_MASK].block_type == BLOCK_TYPE_COMMAND)) {
+        return (false);                                     // commands are a barrier - see stepper.h
+    }
+    return (true);
+}
+
+void stepper_reset()
+{
+    st_pre.tail = st_pre.head;
+    st_pre.exec_idle = true;
+    mp_set_steps_to_runtime_position();
+}
+
+bool st_runtime_isbusy() { return (st_pre.head != st_pre.tail); }
+
+void st_request_exec_move()
+{
+    if (_exec_can_prep()) {
+        exec_requested = true;
+    }
+}
+
+void st_request_forward_plan() { fwd_plan_requested = true; }
+void st_request_load_move() {}                              // the loader runs at the end of each hm_service()
+
+/*
+ * _exec() - exec interrupt: fill the prep queue
+ * _load() - loader: run everything queued, as if the DDA played it out instantly
+ */
+
+static bool _exec()
+{
+    bool prepped = false;
+    while (_exec_can_prep()) {
+        st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK].block_type = BLOCK_TYPE_NULL;
+        if (mp_exec_move() == STAT_NOOP) {
+            st_pre.exec_idle = true;
+            break;
+        }
+        st_pre.exec_idle = false;
+        st_pre.head++;
+        prepped = true;
+    }
+    return (prepped);
+}
+
+static void _load()
+{
+    while (st_pre.head != st_pre.tail) {
+        uint8_t slot = st_pre.tail & STEPPER_PREP_QUEUE_MASK;
+        stPrepSegment_t *s = &st_pre.seg[slot];
+
+        if (s->block_type == BLOCK_TYPE_ALINE) {
+            hm.segments++;
+            host_time_us += (uint64_t)(segment[slot].time * MICROSECONDS_PER_MINUTE);
+            if (hm.segment_hook != NULL) {
+                hm.segment_hook(&segment[slot]);
+            }
+        } else if (s->block_type == BLOCK_TYPE_DWELL) {
+            host_time_us += (uint64_t)s->dwell_ticks * (1000000 / FREQUENCY_DWELL);
+        } else if (s->block_type == BLOCK_TYPE_COMMAND) {
+            hm.commands++;
+            mp_runtime_command(s->bf);
+        }
+        st_pre.tail++;
+    }
+    st_request_exec_move();
+}
+
+bool hm_service()
+{
+    bool worked = false;
+    if (fwd_plan_requested) {                               // forward plan, lowest of the three
+        fwd_plan_requested = false;
+        if (mp_forward_plan() != STAT_NOOP) {
+            st_request_exec_move();
+        }
+        worked = true;
+    }
+    if (exec_requested) {
+        exec_requested = false;
+        worked |= _exec();
+    }
+    if (st_pre.head != st_pre.tail) {
+        _load();
+        worked = true;
+    }
+    return (worked);
+}
+
+/*
+ * st_prep_*() - as stepper.cpp, keeping only what the loader above reads
+ */
+
+stat_t st_prep_line(const float target_steps[], float travel_steps[], float time)
+{
+    PROFILE_SCOPE(PROFILE_PREP);
+    uint8_t slot = st_pre.head & STEPPER_PREP_QUEUE_MASK;
+    stPrepSegment_t *s = &st_pre.seg[slot];
+
+    if ((uint8_t)(st_pre.head - st_pre.tail) >= STEPPER_PREP_QUEUE_DEPTH) {
+        return (cm_panic(STAT_INTERNAL_ERROR, "st_prep_line() prep sync error"));
+    } else if (isinf(time)) {
+        return (cm_panic(STAT_PREP_LINE_MOVE_TIME_IS_INFINITE, "st_prep_line()"));
+    } else if (isnan(time)) {
+        return (cm_panic(STAT_PREP_LINE_MOVE_TIME_IS_NAN, "st_prep_line()"));
+    }
+    s->dda_ticks = (int32_t)(time * 60 * FREQUENCY_DDA);
+    for (uint8_t motor = 0; motor < MOTORS; motor++) {
+        s->mot[motor].target_steps = target_steps[motor];
+        segment[slot].target_steps[motor] = target_steps[motor];
+    }
+    segment[slot].block = mr->run_bf;
+    segment[slot].time = time;
+    s->block_type = BLOCK_TYPE_ALINE;
+    return (STAT_OK);
+}
+
+void st_prep_null()
+{
+    st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK].block_type = BLOCK_TYPE_NULL;
+}
+
+void st_prep_command(void *bf)
+{
+    stPrepSegment_t *s = &st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK];
+    s->block_type = BLOCK_TYPE_COMMAND;
+    s->bf = (mpBuf_t *)bf;
+}
+
+void st_prep_dwell(float microseconds)
+{
+    stPrepSegment_t *s = &st_pre.seg[st_pre.head & STEPPER_PREP_QUEUE_MASK];
+    s->block_type = BLOCK_TYPE_DWELL;
+    s->dwell_ticks = std::max((uint32_t)((microseconds/1000000) * FREQUENCY_DWELL), (uint32_t)1);
+}
+
+void st_prep_out_of_band_dwell(float microseconds)
+{
+    if (!st_runtime_isbusy()) {
+        st_prep_dwell(microseconds);
+    }
+}
+
+void st_set_commanded_steps(const uint8_t motor, const float steps)
+{
+    st_pre.following_error[motor] = 0;
+}
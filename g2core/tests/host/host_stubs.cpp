@@ -0,0 +1,108 @@
+/*
+ * host_stubs.cpp - subsystems the host build leaves out
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  The pipeline build links planner, runtime, canonical machine and parser sources only.
+ *  Everything else they call lands here: config and reporting do nothing, spindle and
+ *  coolant accept any command, and alarms are counted in hm so a run can fail on them.
+ */
+
+#include "g2core.h"
+#include "config.h"
+#include "controller.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "report.h"
+#include "spindle.h"
+#include "coolant.h"
+#include "encoder.h"
+#include "temperature.h"
+#include "json_parser.h"
+#include "text_parser.h"
+#include "persistence.h"
+#include "xio.h"
+#include "host_machine.h"
+
+/**** Globals owned by the left out subsystems ****/
+
+controller_t cs;
+srSingleton_t sr;
+nvList_t nvl;
+stat_t status_code;
+const cfgItem_t cfgArray[1] = {};
+
+/**** Alarms ****/
+
+static stat_t _alarm(const stat_t status, const char *kind, const char *msg)
+{
+    hm.alarms++;
+    hm.last_alarm = status;
+    fprintf(stderr, "%s %d: %s\n", kind, status, msg);
+    return (status);
+}
+
+stat_t cm_alarm(const stat_t status, const char *msg) { return (_alarm(status, "alarm", msg)); }
+stat_t cm_panic(const stat_t status, const char *msg) { return (_alarm(status, "panic", msg)); }
+stat_t cm_is_alarmed() { return (STAT_OK); }
+
+/**** Canonical machine cycles and operations that need hardware ****/
+
+stat_t cm_homing_cycle_start(const float axes[], const bool flags[]) { return (STAT_OK); }
+stat_t cm_homing_cycle_start_no_set(const float axes[], const bool flags[]) { return (STAT_OK); }
+stat_t cm_jogging_cycle_start(uint8_t axis) { return (STAT_OK); }
+stat_t cm_straight_probe(float target[], bool flags[], bool trip_sense, bool alarm_flag) { return (STAT_OK); }
+stat_t cm_reset_encoders() { return (STAT_OK); }
+void cm_operation_init() {}
+void cm_parse_clear(const char *s) {}
+
+stat_t spindle_control_immediate(spControl control) { return (STAT_OK); }
+stat_t spindle_control_sync(spControl control) { return (STAT_OK); }
+stat_t spindle_speed_sync(float speed) { return (STAT_OK); }
+stat_t spindle_override_control(const float P_word, const bool P_flag) { return (STAT_OK); }
+stat_t coolant_control_immediate(coControl control, coSelect select) { return (STAT_OK); }
+stat_t coolant_control_sync(coControl control, coSelect select) { return (STAT_OK); }
+void temperature_reset() {}
+
+float en_read_encoder(uint8_t motor) { return (0); }
+void en_set_encoder_steps(uint8_t motor, float steps) {}
+
+/**** Config, reports and communications ****/
+
+stat_t get_nul(nvObj_t *nv) { return (STAT_OK); }
+stat_t set_nul(nvObj_t *nv) { return (STAT_OK); }
+stat_t get_float(nvObj_t *nv, const float value) { return (STAT_OK); }
+stat_t get_integer(nvObj_t *nv, const int32_t value) { return (STAT_OK); }
+stat_t set_float(nvObj_t *nv, float &value) { return (STAT_OK); }
+stat_t set_float_range(nvObj_t *nv, float &value, float low, float high) { return (STAT_OK); }
+stat_t set_integer(nvObj_t *nv, uint8_t &value, uint8_t low, uint8_t high) { return (STAT_OK); }
+index_t nv_get_index(const char *group, const char *token) { return (NO_MATCH); }
+void nv_get_nvObj(nvObj_t *nv) {}
+stat_t nv_persist(nvObj_t *nv) { return (STAT_OK); }
+stat_t nv_copy_string(nvObj_t *nv, const char *src) { return (STAT_OK); }
+nvObj_t *nv_add_object(const char *token) { return (NULL); }
+nvObj_t *nv_add_string(const char *token, const char *string) { return (NULL); }
+stat_t persistence_commit() { return (STAT_OK); }
+
+stat_t json_parser(char *str, bool suppress_response) { return (STAT_OK); }
+void json_parse_for_exec(char *str, bool execute) {}
+void text_print(nvObj_t *nv, const char *format) {}
+void text_print_str(nvObj_t *nv, const char *format) {}
+void text_print_flt_units(nvObj_t *nv, const char *format, const char *units) {}
+
+stat_t rpt_exception(stat_t status, const char *msg) { return (status); }
+stat_t sr_request_status_report(cmStatusReportRequest request_type) { return (STAT_OK); }
+void qr_init_queue_report() {}
+void qr_request_queue_report(int8_t buffers) {}
@@ -0,0 +1,142 @@
+/*
+ * test_fast_math.cpp - FAST_MATH accuracy and step output equivalence
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *    test_fast_math                        fast_sqrt() and fast_cbrt() against the library
+ *    test_fast_math fast.trace float.trace step output of a FAST_MATH=1 and a FAST_MATH=0 build
+ *
+ *  The roots are checked over every 97th positive normal float (and its negation for cbrt):
+ *  fast_sqrt() must be within 1 ULP of sqrtf() and fast_cbrt() within CBRT_TOLERANCE of cbrt().
+ *
+ *  The traces come from bench_pipeline -t (see trace.h). Each segment of the first is compared
+ *  to the second's position at the same time into the same block, interpolated along its
+ *  segments. Every motor must agree within STEP_TOLERANCE microsteps.
+ */
+
+#include "g2core.h"
+#include "util.h"
+#include "trace.h"
+
+#include <vector>
+
+#if (FAST_MATH != 1)
+#error test_fast_math must be built with FAST_MATH=1
+#endif
+
+#define CBRT_TOLERANCE  3e-7        // relative error
+#define STEP_TOLERANCE  1.0         // microsteps
+
+static int _test_roots()
+{
+    fast_math_bits u;
+    uint32_t worst_sqrt_ulp = 0;
+    double worst_cbrt = 0;
+    uint32_t count = 0;
+
+    for (uint32_t bits = 0x00800000; bits < 0x7f800000; bits += 97) {
+        u.i = bits;
+        float x = u.f;
+        fast_math_bits fast = { fast_sqrt(x) };
+        fast_math_bits ref = { sqrtf(x) };
+        uint32_t ulp = (fast.i > ref.i) ? fast.i - ref.i : ref.i - fast.i;
+        worst_sqrt_ulp = std::max(worst_sqrt_ulp, ulp);
+
+        for (float s : { x, -x }) {
+            double exact = cbrt((double)s);
+            worst_cbrt = std::max(worst_cbrt, fabs((fast_cbrt(s) - exact) / exact));
+        }
+        count++;
+    }
+    printf("fast_sqrt: %u values, worst %u ULP\n", count, worst_sqrt_ulp);
+    printf("fast_cbrt: %u values, worst relative error %.3g\n", count * 2, worst_cbrt);
+    if ((worst_sqrt_ulp > 1) || (worst_cbrt > CBRT_TOLERANCE)) {
+        printf("FAILED\n");
+        return (1);
+    }
+    return (0);
+}
+
+static bool _read_trace(const char *name, std::vector<traceRecord_t> &trace)
+{
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        perror(name);
+        return (false);
+    }
+    traceRecord_t r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        trace.push_back(r);
+    }
+    fclose(f);
+    return (true);
+}
+
+static int _test_traces(const char *name_a, const char *name_b)
+{
+    std::vector<traceRecord_t> a, b;
+    if (!_read_trace(name_a, a) || !_read_trace(name_b, b)) {
+        return (2);
+    }
+    if (a.empty() || (a.back().block != b.back().block)) {
+        printf("FAILED: traces have %u and %u blocks\n", a.empty() ? 0 : a.back().block, b.back().block);
+        return (1);
+    }
+
+    double worst = 0;
+    size_t j = 0;                                   // b segment ending at or after a's time
+    for (size_t i = 0; i < a.size(); i++) {
+        while ((j < b.size()) && (b[j].block < a[i].block)) {
+            j++;
+        }
+        while ((j + 1 < b.size()) && (b[j + 1].block == a[i].block) && (b[j].time < a[i].time)) {
+            j++;
+        }
+        // b's segment j runs from the end of segment j-1 (or the end of the previous block)
+        const traceRecord_t *end = &b[j];
+        const traceRecord_t *start = (j > 0) ? &b[j - 1] : end;
+        double t0 = (start->block == end->block) ? start->time : 0;
+        double fraction = (end->time > t0) ? (a[i].time - t0) / (end->time - t0) : 1;
+        fraction = std::min(std::max(fraction, 0.0), 1.0);
+
+        for (uint8_t motor = 0; motor < TRACE_MOTORS; motor++) {
+            double position = start->steps[motor] + fraction * (end->steps[motor] - start->steps[motor]);
+            double error = fabs(a[i].steps[motor] - position);
+            if (error > worst) {
+                worst = error;
+            }
+            if (error > STEP_TOLERANCE) {
+                printf("FAILED: block %u at %.1f us motor %u: %.3f vs %.3f steps\n",
+                       a[i].block, a[i].time, motor + 1, a[i].steps[motor], position);
+                return (1);
+            }
+        }
+    }
+    printf("step output: %zu and %zu segments over %u blocks, worst difference %.3f microsteps\n",
+           a.size(), b.size(), a.back().block, worst);
+    return (0);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3) {
+        return (_test_traces(argv[1], argv[2]));
+    }
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s [fast.trace float.trace]\n", argv[0]);
+        return (2);
+    }
+    return (_test_roots());
+}
@@ -0,0 +1,243 @@
+/*
+ * test_floattoa.cpp - floattoa() against printf, and its speed against the old floattoa()
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  Random float bit patterns at precision 0 to 6 must print exactly as printf("%.*f") does
+ *  once its trailing zeros, trailing point and "-0" are stripped - floattoa() rounds the
+ *  exact binary value, as glibc does. Exact ties are the one difference: glibc rounds them
+ *  to even, floattoa() away from zero. A few edge cases are checked by hand: maxlen
+ *  overflow, rounding up into the integer part, and the integer, hex and unsigned printers.
+ *
+ *  The timing compares floattoa() to the float math version it replaced (copied below as
+ *  _floattoa_old()) and to snprintf() on typical report values. It is printed, not checked:
+ *  the host does the old version's float math in hardware, the SAM3X8E in software.
+ */
+
+#include "g2core.h"
+#include "util.h"
+#include "xio.h"
+
+#include <chrono>
+
+#define RANDOM_CASES    3000000
+#define TIMING_CALLS    1000000
+
+static uint32_t failures;
+
+static void _expect(const char *got, const char *want, const char *what)
+{
+    if (strcmp(got, want) != 0) {
+        if (failures++ < 10) {
+            printf("%s: got \"%s\" want \"%s\"\n", what, got, want);
+        }
+    }
+}
+
+// printf("%.*f") with floattoa()'s tie rounding and zero and point suppression
+static void _reference(char *str, const size_t size, const float n, const int precision)
+{
+    double value = n;
+    double scaled = fabs(value) * pow(10, precision);       // exact - at most 24 + 20 bits
+    if ((scaled - floor(scaled)) == 0.5) {                  // a tie - nudge it away from zero
+        value = nextafter(value, (value < 0) ? -INFINITY : INFINITY);
+    }
+    snprintf(str, size, "%.*f", precision, value);
+    if (strchr(str, '.') != NULL) {
+        char *end = str + strlen(str) - 1;
+        while (*end == '0') {
+            *end-- = NUL;
+        }
+        if (*end == '.') {
+            *end = NUL;
+        }
+    }
+    if (strcmp(str, "-0") == 0) {
+        strcpy(str, "0");
+    }
+}
+
+static void _test_random()
+{
+    char got[64], want[64], what[64];
+
+    srand(1);
+    for (uint32_t k = 0; k < RANDOM_CASES; k++) {
+        fast_math_bits u;
+        u.i = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        if (isnan(u.f) || isinf(u.f)) {
+            continue;
+        }
+        int precision = k % 7;
+        int length = floattoa(got, u.f, precision, 60);
+        _reference(want, sizeof(want), u.f, precision);
+        snprintf(what, sizeof(what), "%.9g at precision %d", (double)u.f, precision);
+        _expect(got, want, what);
+        if (length != (int)strlen(got)) {
+            if (failures++ < 10) {
+                printf("%s: returned length %d for \"%s\"\n", what, length, got);
+            }
+        }
+    }
+}
+
+static void _test_cases()
+{
+    char str[64];
+
+    floattoa(str, 0.0, 3);              _expect(str, "0", "0.0");
+    floattoa(str, -0.0004, 3);          _expect(str, "0", "-0.0004 rounds to 0");
+    floattoa(str, 9.9996, 3);           _expect(str, "10", "9.9996 rounds up");
+    floattoa(str, 20.1, 3);             _expect(str, "20.1", "20.1");
+    floattoa(str, -123.456, 2);         _expect(str, "-123.46", "-123.456");
+    floattoa(str, 4294967296.0, 3, 60); _expect(str, "4294967296", "2^32");
+    floattoa(str, NAN, 3);              _expect(str, "nan", "NAN");
+    floattoa(str, -INFINITY, 3);        _expect(str, "inf", "-INFINITY");
+    floattoa(str, 123.0, 30);           _expect(str, "123", "precision over the maximum");
+
+    int length = floattoa(str, 1e20, 3, 16);
+    _expect(str, "", "1e20 in 16 characters");
+    if (length != 0) {
+        failures++;
+        printf("1e20 in 16 characters: returned length %d\n", length);
+    }
+
+    inttoa(str, -2147483647 - 1);       _expect(str, "-2147483648", "inttoa INT_MIN");
+    inttoa(str, 0);                     _expect(str, "0", "inttoa 0");
+    uinttoa(str, 4294967295UL);         _expect(str, "4294967295", "uinttoa UINT32_MAX");
+    hextoa(str, 0);                     _expect(str, "0", "hextoa 0");
+    hextoa(str, 0xdeadbeef);            _expect(str, "deadbeef", "hextoa 0xdeadbeef");
+}
+
+/**** The floattoa() this one replaced - float math, rounds once by adding half a digit ****/
+
+static const float _round_lookup[] = {
+    0.5, 0.05, 0.005, 0.0005, 0.00005, 0.000005, 0.0000005, 0.00000005, 0.000000005, 0.0000000005
+};
+
+static int _strreverse(char * const t, const int count, char hold = 0)
+{
+    return count > 1
+    ? (hold = *t, *t = *(t + (count - 1)), *(t + (count - 1)) = hold), _strreverse(t + 1, count - 2), count
+    : count;
+}
+
+static char _floattoa_old(char *str, float n, int precision, int maxlen = 16)
+{
+    if (isnan(n)) {
+        strcpy(str, "nan");
+        return (3);
+    } else if (isinf(n)) {
+        strcpy(str, "inf");
+        return (3);
+    }
+
+    int length = 0;
+    char *b = str;
+
+    if (n < 0.0) {
+        *b++ = '-';
+        return _floattoa_old(b, -n, precision, maxlen - 1) + 1;
+    }
+
+    n += _round_lookup[precision];
+    int int_length = 0;
+    int integer_part = (int)n;
+
+    while (integer_part > 0) {
+        if (length++ > maxlen) {
+            *str = 0;
+            return 0;
+        }
+        int t = integer_part / 10;
+        *b++ = '0' + (integer_part - (t * 10));
+        integer_part = t;
+        int_length++;
+    }
+    if (length > 0) {
+        _strreverse(str, int_length);
+    } else {
+        *b++ = '0';
+        int_length++;
+    }
+
+    *b++ = '.';
+    length = int_length + 1;
+
+    float frac_part = n;
+    frac_part -= (int)frac_part;
+    while (precision-- > 0) {
+        if (length++ > maxlen) {
+            *str = 0;
+            return 0;
+        }
+        frac_part *= 10.0;
+        *b++ = ('0' + (int)frac_part);
+        frac_part -= (int)frac_part;
+    }
+
+    while (*(b - 1) == '0' && length > 1) {
+        *(b--) = 0;
+        length--;
+    }
+    if (*(b - 1) == '.') {
+        *(b--) = 0;
+        length--;
+    }
+    return length;
+}
+
+/**** Timing ****/
+
+static const float values[] = { 0, 1, -12.5, 123.456, 1000.001, -0.25, 7.3333, 25400.0, 3.14159, 0.001 };
+#define VALUE_COUNT (sizeof(values) / sizeof(values[0]))
+
+template <typename F>
+static double _time_calls(F print)
+{
+    char str[32];
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < TIMING_CALLS; i++) {
+        sum += print(str, values[i % VALUE_COUNT], 3);
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (sum == 0) {                     // keep the calls
+        printf("no output\n");
+    }
+    return (std::chrono::duration<double, std::nano>(end - start).count() / TIMING_CALLS);
+}
+
+static void _time()
+{
+    double now = _time_calls([](char *s, float n, int p) { return (int)floattoa(s, n, p); });
+    double old = _time_calls([](char *s, float n, int p) { return (int)_floattoa_old(s, n, p); });
+    double lib = _time_calls([](char *s, float n, int p) { return snprintf(s, 16, "%.*f", p, (double)n); });
+    printf("ns per call at precision 3: floattoa %.1f, old floattoa %.1f, snprintf %.1f\n", now, old, lib);
+}
+
+int main()
+{
+    _test_random();
+    _test_cases();
+    printf("floattoa: %u random values at precision 0-6 and the edge cases, %u failures\n",
+           RANDOM_CASES, failures);
+    _time();
+    if (failures) {
+        printf("FAILED\n");
+        return (1);
+    }
+    return (0);
+}
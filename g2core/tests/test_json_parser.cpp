@@ -0,0 +1,225 @@
+/*
+ * test_json_parser.cpp - JSON lines parsed into the nv list, and the parse time
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  The real json_parser.cpp and config.cpp are linked against the small cfgArray below.
+ *  Lines go through json_parse_for_exec() without executing, and the nv exec list must hold
+ *  the tokens, types and values expected - numbers on the integer fast path and through
+ *  strtod(), strings normalized in place with Gcode comments kept, gets, groups and the
+ *  syntax errors. Then the HMI's multi-key write is timed.
+ */
+
+#include "g2core.h"
+#include "config.h"
+#include "controller.h"
+#include "json_parser.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "persistence.h"
+#include "report.h"
+#include "util.h"
+#include "xio.h"
+
+#include <chrono>
+
+#define TIMING_CALLS    1000000
+
+/**** A small config table - singles, one group, its uber group ****/
+
+static float values[8];
+
+const cfgItem_t cfgArray[] = {
+    { "uda","uda1", _fip, 0, nullptr, nullptr, nullptr, &values[0], 0 },
+    { "m",  "m3",   _i0,  2, nullptr, nullptr, nullptr, nullptr, 0 },
+    { "out","out4", _i0,  2, nullptr, nullptr, nullptr, nullptr, 0 },
+    { "x",  "xvm",  _fipc,0, nullptr, nullptr, nullptr, &values[1], 0 },
+    { "x",  "xjm",  _fipc,0, nullptr, nullptr, nullptr, &values[2], 0 },
+    { "",   "gc",   _f0,  0, nullptr, nullptr, nullptr, nullptr, 0 },
+    { "",   "ej",   _iip, 0, nullptr, nullptr, nullptr, nullptr, 0 },
+    { "",   "x",    _f0,  0, nullptr, nullptr, nullptr, nullptr, 0 },     // group
+    { "",   "$",    _f0,  0, nullptr, nullptr, nullptr, nullptr, 0 },     // uber group
+};
+
+#define INDEX_MAX (sizeof(cfgArray) / sizeof(cfgItem_t))
+#define INDEX_START_GROUPS (INDEX_MAX - 2)
+#define INDEX_START_UBER_GROUPS (INDEX_MAX - 1)
+
+index_t cfgIndex[INDEX_MAX];
+uint8_t cfgMark[(INDEX_MAX + 7) / 8];
+uint16_t cfgSlot[INDEX_MAX];
+
+index_t nv_index_max() { return (INDEX_MAX); }
+bool nv_index_is_single(index_t index) { return (index < INDEX_START_GROUPS); }
+bool nv_index_is_group(index_t index) { return ((index >= INDEX_START_GROUPS) && (index < INDEX_START_UBER_GROUPS)); }
+bool nv_index_lt_groups(index_t index) { return (index <= INDEX_START_GROUPS); }
+bool nv_group_is_prefixed(char *group) { return ((strcmp("sys", group) != 0) && (strcmp("sr", group) != 0)); }
+
+/**** What config.cpp and json_parser.cpp reach outside themselves ****/
+
+cfgParameters_t cfg;
+controller_t cs;
+cmMachine_t *cm;                        // util.cpp's LAGER_cm() reads these
+cmMachine_t cm1;
+stat_t status_code;
+
+stat_t cm_panic(const stat_t status, const char *msg) { return (status); }
+stat_t cm_is_alarmed() { return (STAT_OK); }
+stat_t cm_set_units_mode(const uint8_t mode) { return (STAT_OK); }
+void cm_parse_clear(const char *s) {}
+stat_t help_defa(nvObj_t *nv) { return (STAT_OK); }
+void text_print_list(stat_t status, uint8_t flags) {}
+void text_print(nvObj_t *nv, const char *format) {}
+stat_t sr_request_status_report(cmStatusReportRequest request_type) { return (STAT_OK); }
+void sr_init_status_report() {}
+bool bt_has_encoders() { return (false); }
+void rpt_print_initializing_message() {}
+void rpt_print_loading_configs_message() {}
+void persistence_clear() {}
+void persistence_suspend() {}
+void persistence_restore(nvObj_t *nv) {}
+stat_t write_persistent_value(nvObj_t *nv) { return (STAT_OK); }
+void convert_outgoing_float(nvObj_t *nv) {}
+stat_t get_integer(nvObj_t *nv, const int32_t value) { return (STAT_OK); }
+stat_t set_integer(nvObj_t *nv, uint8_t &value, uint8_t low, uint8_t high) { return (STAT_OK); }
+stat_t rpt_exception(stat_t status, const char *msg) { return (status); }
+int16_t xio_writeline_coalesced(const char *buffer, const uint8_t lines, const uint8_t time_ms) { return (0); }
+void xio_flush_coalesced() {}
+
+/**** Parse checks ****/
+
+static uint32_t failures;
+
+static void _fail(const char *line, const char *what)
+{
+    if (failures++ < 10) {
+        printf("%s: %s\n", line, what);
+    }
+}
+
+typedef struct expectedPair {
+    const char *token;
+    valueType type;
+    float value;                        // TYPE_FLOAT and TYPE_BOOLEAN
+    int32_t value_int;                  // TYPE_INTEGER
+    const char *string;                 // TYPE_STRING
+} expectedPair_t;
+
+static void _check_line(const char *line, const expectedPair_t *expect, const uint8_t count)
+{
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    json_parse_for_exec(buffer, false);
+
+    nvObj_t *nv = nv_exec;
+    for (uint8_t i = 0; i < count; i++, nv = nv->nx) {
+        const expectedPair_t *e = &expect[i];
+        if ((nv == NULL) || (strcmp(nv->token, e->token) != 0) || (nv->valuetype != e->type)) {
+            _fail(line, "wrong token or type");
+            return;
+        }
+        if (((e->type == TYPE_FLOAT) && (nv->value_flt != e->value)) ||
+            ((e->type == TYPE_INTEGER) && (nv->value_int != e->value_int)) ||
+            ((e->type == TYPE_BOOLEAN) && (nv->value_int != e->value_int)) ||
+            ((e->type == TYPE_STRING) && (strcmp(*nv->stringp, e->string) != 0))) {
+            _fail(line, "wrong value");
+            return;
+        }
+    }
+}
+
+static void _check_status(const char *line, const stat_t status)
+{
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    nv_reset_nv_list();
+    if (json_parser(buffer, true) != status) {
+        _fail(line, "wrong status");
+    }
+}
+
+static void _test_parse()
+{
+    const expectedPair_t hmi[] = {
+        { "uda1", TYPE_FLOAT, 0, 0, NULL },
+        { "m3", TYPE_INTEGER, 0, 2000, NULL },
+        { "out4", TYPE_INTEGER, 0, 1, NULL },
+    };
+    _check_line("{\"uda1\":0,\"m3\":2000,\"out4\":1}", hmi, 3);
+    _check_line("{ UDA1 : 0 , m3:2000, \"out4\" :1 }", hmi, 3);
+
+    const expectedPair_t numbers[] = {
+        { "uda1", TYPE_FLOAT, -12.5, 0, NULL },
+        { "xvm", TYPE_FLOAT, 0.1f, 0, NULL },
+        { "xjm", TYPE_FLOAT, 1.5e3, 0, NULL },
+    };
+    _check_line("{\"uda1\":-12.5,\"xvm\":0.1,\"xjm\":1.5e3}", numbers, 3);
+
+    const expectedPair_t longer[] = {
+        { "uda1", TYPE_FLOAT, (float)123456.789012, 0, NULL },      // past the fast path
+    };
+    _check_line("{\"uda1\":123456.789012}", longer, 1);
+
+    const expectedPair_t gcode[] = {
+        { "gc", TYPE_STRING, 0, 0, "g1x10.5f200(Keep This)" },
+    };
+    _check_line("{\"gc\":\"G1 X10.5 F200 (Keep This)\"}", gcode, 1);
+
+    const expectedPair_t gets[] = {
+        { "xvm", TYPE_NULL, 0, 0, NULL },
+        { "ej", TYPE_NULL, 0, 0, NULL },
+    };
+    _check_line("{xvm:n,ej:\"\"}", gets, 2);
+
+    const expectedPair_t group[] = {
+        { "x", TYPE_PARENT, 0, 0, NULL },
+        { "vm", TYPE_FLOAT, 1000, 0, NULL },     // children keep the group in nv->group
+        { "jm", TYPE_FLOAT, 50, 0, NULL },
+    };
+    _check_line("{\"x\":{\"vm\":1000,\"jm\":50}}", group, 3);
+
+    _check_status("{\"nope\":1}", STAT_UNRECOGNIZED_NAME);
+    _check_status("{\"uda1\":12x}", STAT_BAD_NUMBER_FORMAT);
+    _check_status("{\"gc\":\"g1x10}", STAT_JSON_SYNTAX_ERROR);
+}
+
+/**** Timing ****/
+
+static void _time()
+{
+    const char line[] = "{\"uda1\":0,\"m3\":2000,\"out4\":1}";
+    char buffer[sizeof(line)];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < TIMING_CALLS; i++) {
+        memcpy(buffer, line, sizeof(line));
+        json_parse_for_exec(buffer, false);
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("ns per parse of %s: %.1f\n", line,
+           std::chrono::duration<double, std::nano>(end - start).count() / TIMING_CALLS);
+}
+
+int main()
+{
+    cm = &cm1;
+    _test_parse();
+    printf("json parser: %u failures\n", failures);
+    _time();
+    if (failures) {
+        printf("FAILED\n");
+        return (1);
+    }
+    return (0);
+}
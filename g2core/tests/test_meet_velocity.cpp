@@ -0,0 +1,120 @@
+/*
+ * test_meet_velocity.cpp - _get_meet_velocity() against a bisection of the exact ramps
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  Random blocks over the velocities, lengths and jerks the planner sees. Every case where a
+ *  meet velocity exists must come back feasible - no faster than the exact (double bisection)
+ *  meet velocity, give or take float rounding - with head + body + tail = L. The velocity given
+ *  up against the exact one must stay under LOSS_MAX. The iteration histogram is printed; the
+ *  last bin counts calls that ran out of iterations and settled for the best point below L.
+ */
+
+#include "../plan_zoid.cpp"         // _get_meet_velocity() is static
+
+#define CASES           200000
+#define LENGTH_TOLERANCE 1e-4       // relative, on head + body + tail = L
+#define FEASIBLE_TOLERANCE 5e-7     // relative, 4 float ULPs - v_1 = v_m + s^2 rounds near s = 0
+#define LOSS_MAX        0.01        // relative velocity given up against the exact meet velocity
+
+// ramp length from v_0 to v_1 at constant jerk, k = q_recip_2_sqrt_j
+static double _ramp_length(const double v_0, const double v_1, const double k)
+{
+    return (k * sqrt(fabs(v_1 - v_0)) * (v_1 + v_0));
+}
+
+static double _exact_meet_velocity(const double v_0, const double v_2, const double L, const double k)
+{
+    double lo = std::max(v_0, v_2);
+    double hi = 1e8;
+    for (uint8_t i = 0; i < 200; i++) {
+        double v_1 = (lo + hi) / 2;
+        if (_ramp_length(v_0, v_1, k) + _ramp_length(v_2, v_1, k) < L) {
+            lo = v_1;
+        } else {
+            hi = v_1;
+        }
+    }
+    return (lo);
+}
+
+static double _random(const double low, const double high)
+{
+    return (low + (high - low) * rand() / (double)RAND_MAX);
+}
+
+int main()
+{
+    const float jerks[] = { 1e9, 5e9, 2e10 };   // mm/min^3 - 1000, 5000 and 20000 km/min^3
+    uint32_t cases = 0, bad_lengths = 0, infeasible = 0;
+    double worst_loss = 0, total_loss = 0;
+
+    srand(1);
+    mp_profile_reset();
+    for (uint32_t n = 0; n < CASES; n++) {
+        mpBuf_t bf;
+        mpBlockRuntimeBuf_t block;
+        bf.jerk = jerks[rand() % 3];
+        bf.q_recip_2_sqrt_j = 2.40281141413 / (2 * sqrt(bf.jerk));
+
+        float v_0 = _random(0, 20000);
+        float v_2 = _random(0, 20000);
+        if (rand() % 5 == 0) {
+            v_2 = v_0 * _random(0.95, 1.05);    // nearly symmetric
+        }
+        if (rand() % 10 == 0) {
+            v_0 = _random(0, 50);               // starting from (nearly) rest
+        }
+        float L = pow(10, _random(-2, 1.7));    // 0.01 to 50 mm
+
+        float v_1 = _get_meet_velocity(v_0, v_2, L, &bf, &block);
+
+        const double k = bf.q_recip_2_sqrt_j;
+        if (fp_EQ(v_0, v_2) || (_ramp_length(std::min(v_0, v_2), std::max(v_0, v_2), k) >= L)) {
+            continue;                           // no meet velocity - cases 1 and 2
+        }
+        cases++;
+        double length = block.head_length + block.body_length + block.tail_length;
+        if ((fabs(length - L) > LENGTH_TOLERANCE * L + EPSILON) ||
+            (block.head_length < 0) || (block.body_length < 0) || (block.tail_length < 0)) {
+            if (bad_lengths++ < 3) {
+                printf("v_0 %g v_2 %g L %g: head %g body %g tail %g\n",
+                       v_0, v_2, L, block.head_length, block.body_length, block.tail_length);
+            }
+        }
+        double exact = _exact_meet_velocity(v_0, v_2, L, k);
+        if (v_1 > exact * (1 + FEASIBLE_TOLERANCE)) {
+            if (infeasible++ < 3) {
+                printf("v_0 %g v_2 %g L %g: v_1 %.9g over the exact %.9g\n", v_0, v_2, L, v_1, exact);
+            }
+        }
+        double loss = (exact - v_1) / exact;
+        worst_loss = std::max(worst_loss, loss);
+        total_loss += fabs(loss);
+    }
+
+    printf("meet velocity: %u cases, %u bad lengths, %u infeasible, loss worst %.3g mean %.3g\n",
+           cases, bad_lengths, infeasible, worst_loss, total_loss / cases);
+    printf("iterations:");
+    for (uint8_t i = 0; i < MEET_HISTOGRAM_BINS; i++) {
+        printf(" %u:%u", i, mpf.meet[i]);
+    }
+    printf("\n");
+    if (bad_lengths || infeasible || (worst_loss > LOSS_MAX)) {
+        printf("FAILED\n");
+        return (1);
+    }
+    return (0);
+}
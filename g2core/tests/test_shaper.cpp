@@ -0,0 +1,200 @@
+/*
+ * test_shaper.cpp - residual vibration of the input shapers on a simulated resonance
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  The X axis is modelled as a mass on a spring behind the motor: a second order system
+ *  with natural frequency f and damping ratio z, driven by the X position of the segments
+ *  the loader gets (piecewise linear in time). A rapid move is run through the pipeline
+ *  once per shaper type, all designed for RESONANCE_HZ, and the peak vibration left once
+ *  motion stops is compared to the unshaped run at the design frequency and across a sweep
+ *  of actual frequencies around it.
+ *
+ *  Shapers can't be changed once the move is queued, and the lowest frequency each type
+ *  accepts follows from its longest delay: Td/2 for ZV, Td for ZVD and EI.
+ *
+ *  At the design frequency every shaper must cut the residual by at least DESIGN_RATIO.
+ *  Over the sweep the shaped residual must stay under the unshaped one wherever the shaper
+ *  type claims to work: ZV within 5%, ZVD within 15% and EI within 25% of the design.
+ */
+
+#include "g2core.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "plan_shaper.h"
+#include "host_machine.h"
+
+#include <vector>
+
+#define RESONANCE_HZ        40.0
+#define RESONANCE_DAMPING   0.05
+#define SETTLE_SECONDS      0.5         // vibration is measured over this long after motion stops
+#define STEP_SECONDS        5e-6        // oscillator integration step
+#define DESIGN_RATIO        0.1         // residual must drop to this fraction at the design frequency
+
+static const char program[] = "G21 G90 G0 X0\nG1 F12000 X10\n";
+
+typedef struct shaperCase {
+    const char *name;
+    uint8_t type;
+    float band;                         // fraction of f the shaper must still beat unshaped within
+} shaperCase_t;
+
+static const shaperCase_t cases[] = {
+    { "none", SHAPER_NONE, 0 },
+    { "ZV",   SHAPER_ZV,   0.05 },
+    { "ZVD",  SHAPER_ZVD,  0.15 },
+    { "EI",   SHAPER_EI,   0.25 },
+};
+
+static const float sweep[] = { 0.75, 0.85, 0.9, 0.95, 1.0, 1.05, 1.1, 1.15, 1.25, 1.5 };
+
+typedef struct xSample {
+    double time;                        // seconds at the end of the segment
+    double x;                           // mm
+} xSample_t;
+
+static std::vector<xSample_t> samples;
+static double sample_time;
+
+static void _record_segment(const hostSegment_t *s)
+{
+    sample_time += s->time * 60;
+    samples.push_back({ sample_time, s->target_steps[MOTOR_1] / HOST_STEPS_PER_MM });
+}
+
+// run the program with one shaper on X and keep the X position at the end of each segment
+static void _run(const uint8_t type)
+{
+    hm.segment_hook = _record_segment;
+    hm_init();
+    samples.clear();
+    sample_time = 0;
+    samples.push_back({ 0, 0 });
+    if (type != SHAPER_NONE) {
+        if (mp_shaper_set_axis(AXIS_X, type, RESONANCE_HZ, RESONANCE_DAMPING) != STAT_OK) {
+            printf("FAILED: shaper type %u at %.0f Hz was refused\n", type, RESONANCE_HZ);
+            exit(1);
+        }
+    }
+    hm_program(program);
+    if (mp_shaper_set_axis(AXIS_X, type, RESONANCE_HZ, RESONANCE_DAMPING) != STAT_COMMAND_NOT_ACCEPTED) {
+        printf("FAILED: shaper type %u was changed while moving\n", type);
+        exit(1);
+    }
+    hm_finish();
+}
+
+// peak distance of the mass from its rest position once the drive has stopped moving
+static double _residual(const double frequency, const double damping)
+{
+    const double w = 2 * M_PI * frequency;
+    const double end = samples.back().time;
+    const double rest = samples.back().x;
+    double x = 0, v = 0;                // mass position and velocity
+    double peak = 0;
+    size_t i = 1;
+
+    for (double t = 0; t < end + SETTLE_SECONDS; t += STEP_SECONDS) {
+        while ((i < samples.size() - 1) && (samples[i].time < t)) {
+            i++;
+        }
+        const xSample_t &a = samples[i - 1];
+        const xSample_t &b = samples[i];
+        double drive = (t >= b.time) ? b.x : a.x + (b.x - a.x) * (t - a.time) / (b.time - a.time);
+
+        // semi-implicit Euler - plenty at 5 us for a 60 Hz resonance
+        v += (w * w * (drive - x) - 2 * damping * w * v) * STEP_SECONDS;
+        x += v * STEP_SECONDS;
+        if (t > end) {
+            peak = std::max(peak, fabs(x - rest));
+        }
+    }
+    return (peak);
+}
+
+// lowest frequencies: the longest delay is SHAPER_DELAY_MAX_MS at damping 0
+static bool _test_limits()
+{
+    const float zv_min = 1000 / (2 * SHAPER_DELAY_MAX_MS);
+    const float zvd_min = 1000 / SHAPER_DELAY_MAX_MS;
+    const struct { uint8_t type; float frequency; stat_t status; } limits[] = {
+        { SHAPER_ZV,  zv_min * 1.01f,  STAT_OK },
+        { SHAPER_ZV,  zv_min * 0.99f,  STAT_INPUT_LESS_THAN_MIN_VALUE },
+        { SHAPER_ZVD, zv_min * 1.01f,  STAT_INPUT_LESS_THAN_MIN_VALUE },
+        { SHAPER_ZVD, zvd_min * 1.01f, STAT_OK },
+        { SHAPER_EI,  zvd_min * 0.99f, STAT_INPUT_LESS_THAN_MIN_VALUE },
+        { SHAPER_EI,  zvd_min * 1.01f, STAT_OK },
+    };
+    bool failed = false;
+
+    hm_init();
+    for (auto &l : limits) {
+        stat_t status = mp_shaper_set_axis(AXIS_X, l.type, l.frequency, 0);
+        if (status != l.status) {
+            printf("FAILED: shaper type %u at %.2f Hz returned %u\n", l.type, l.frequency, status);
+            failed = true;
+        }
+    }
+    mp_shaper_set_axis(AXIS_X, SHAPER_NONE, 0, 0);
+    return (failed);
+}
+
+int main()
+{
+    const uint8_t sweep_count = sizeof(sweep) / sizeof(sweep[0]);
+    const uint8_t case_count = sizeof(cases) / sizeof(cases[0]);
+    double residual[case_count][sweep_count];
+    bool failed = _test_limits();
+
+    printf("residual vibration (um) after a 10 mm move, shapers designed for %.0f Hz\n", RESONANCE_HZ);
+    printf("%-6s", "f/f0");
+    for (uint8_t j = 0; j < sweep_count; j++) {
+        printf("%8.2f", sweep[j]);
+    }
+    printf("\n");
+
+    for (uint8_t c = 0; c < case_count; c++) {
+        _run(cases[c].type);
+        if (hm.alarms || hm.errors) {
+            printf("FAILED: %s run raised %u alarms and %u errors\n", cases[c].name, hm.alarms, hm.errors);
+            return (1);
+        }
+        printf("%-6s", cases[c].name);
+        for (uint8_t j = 0; j < sweep_count; j++) {
+            residual[c][j] = _residual(RESONANCE_HZ * sweep[j], RESONANCE_DAMPING);
+            printf("%8.2f", residual[c][j] * 1000);
+        }
+        printf("\n");
+    }
+
+    for (uint8_t c = 1; c < case_count; c++) {
+        for (uint8_t j = 0; j < sweep_count; j++) {
+            if (fabs(sweep[j] - 1) > cases[c].band + 0.001) {
+                continue;
+            }
+            if ((sweep[j] == 1.0) && (residual[c][j] > residual[0][j] * DESIGN_RATIO)) {
+                printf("FAILED: %s leaves %.1f%% of the unshaped vibration at %.0f Hz\n",
+                       cases[c].name, 100 * residual[c][j] / residual[0][j], RESONANCE_HZ);
+                failed = true;
+            }
+            if (residual[c][j] > residual[0][j]) {
+                printf("FAILED: %s is worse than unshaped at %.1f Hz\n", cases[c].name, RESONANCE_HZ * sweep[j]);
+                failed = true;
+            }
+        }
+    }
+    return (failed ? 1 : 0);
+}
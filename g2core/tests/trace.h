@@ -0,0 +1,38 @@
+/*
+ * trace.h - segment trace written by bench_pipeline -t and read by test_fast_math
+ * This file is part of the g2core project
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRACE_H_ONCE
+#define TRACE_H_ONCE
+
+#include <stdint.h>
+
+/*
+ *  One record per segment loaded, in native byte order. Blocks are numbered in the order
+ *  they run and time restarts at each block, so two builds can be compared block by block
+ *  without the small differences in block times adding up over a program.
+ */
+
+#define TRACE_MOTORS 3                  // X, Y and Z
+
+typedef struct traceRecord {
+    const void *block_ptr;              // run buffer of the block - only compared for changes
+    uint32_t block;                     // block number, from 1
+    double time;                        // microseconds from the start of the block to the end of the segment
+    float steps[TRACE_MOTORS];          // motor positions at the end of the segment
+} traceRecord_t;
+
+#endif // End of include guard: TRACE_H_ONCE
@@ -145,12 +145,19 @@ static stat_t _text_parser_kernal(char *str, nvObj_t *nv)
     return (STAT_OK);
 }
 
+// copy a string without running past end. Returns the new end of the string
+static char *_append_string(char *p, const char *str, const char *end)
+{
+    while ((*str != NUL) && (p < end)) {
+        *p++ = *str++;
+    }
+    *p = NUL;
+    return (p);
+}
+
 /************************************************************************************
  * text_response() - text mode responses
  */
-static const char prompt_ok[] = "g2core[%s] ok> ";
-static const char prompt_err[] = "g2core[%s] err[%d]: %s: %s ";
-
 void text_response(const stat_t status, char *buf)
 {
     if (txt.text_verbosity == TV_SILENT) {    // skip all this
@@ -159,23 +166,33 @@ void text_response(const stat_t status, char *buf)
 
     char buffer[128];
     char *p = buffer;
+    char *end = &buffer[sizeof(buffer) - 2];  // leave room for the NEWLINE and NUL
 
-    char units[] = "inch";
+    // "g2core[units] ok> " or "g2core[units] err[status]: message: line " - this runs for every
+    // line received in text mode, so it's built up with copies rather than sprintf
+    str_concat(p, "g2core[");
     if (cm_get_units_mode(MODEL) != INCHES) {
-        strcpy(units, "mm");
+        str_concat(p, "mm");
+    } else {
+        str_concat(p, "inch");
     }
-
     if ((status == STAT_OK) || (status == STAT_EAGAIN) || (status == STAT_NOOP)) {
-        p += sprintf(p, prompt_ok, (char *)units);
+        str_concat(p, "] ok> ");
     } else {
-        p += sprintf(p, prompt_err, (char *)units, (int)status, get_status_message(status), buf);
+        str_concat(p, "] err[");
+        p += inttoa(p, (int)status);
+        str_concat(p, "]: ");
+        p = _append_string(p, get_status_message(status), end);
+        p = _append_string(p, ": ", end);
+        p = _append_string(p, buf, end);
+        p = _append_string(p, " ", end);
     }
     nvObj_t *nv = nv_body+1;
 
     if (nv_get_type(nv) == NV_TYPE_MESSAGE) {
-        p += sprintf(p, (char *)*nv->stringp);
+        p = _append_string(p, *nv->stringp, end);
     }
-    sprintf(p, "\n");
+    strcpy(p, "\n");
     xio_writeline(buffer);
 }
 
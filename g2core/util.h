@@ -92,11 +92,15 @@ float max4(float x1, float x2, float x3, float x4);
 
 //*** string utilities ***
 
+#define FLOATTOA_PRECISION_MAX 9                // most decimal places floattoa() will print
+
 uint8_t isnumber(char c);
 char *escape_string(char *dst, char *src);
 uint16_t compute_checksum(char const *string, const uint16_t length);
 char floattoa(char *buffer, float in, int precision, int maxlen = 16);
 char inttoa(char *str, int n);
+char uinttoa(char *str, uint32_t n);
+char hextoa(char *str, uint32_t n);
 
 //*** other utilities ***
 
@@ -151,6 +155,90 @@ inline T avg(const T a,const T b) {return (a+b)/2; }
 #define fp_TRUE(a) (a > EPSILON)
 #endif
 
+/* Fast math backend
+ *
+ *  The SAM3X8E (Due and the pm-* boards) is a Cortex-M3 with no FPU, so sqrtf() and cbrtf()
+ *  are long soft-float library calls. With FAST_MATH the planner and exec kernels use
+ *  fast_sqrt() and fast_cbrt() instead:
+ *
+ *    fast_sqrt() - square root of the mantissa in integer arithmetic: a 16 bit bitwise root
+ *                  refined by one Newton step using the M3's hardware divide. Within 1 ULP.
+ *    fast_cbrt() - exponent/3 bit seed refined by two Halley steps (2 divides vs 4 in newlib).
+ *
+ *  Zero, negative, denormal, infinite and NaN arguments fall back to the library function.
+ *  FAST_MATH defaults on for ARM parts without hardware float and off for M4F/M7 boards, which
+ *  keep the hardware instructions. Force it with DEVICE_DEFINES += FAST_MATH=0 (or 1).
+ */
+
+#ifndef FAST_MATH
+#if defined(__arm__) && !defined(__ARM_FP)
+#define FAST_MATH 1
+#else
+#define FAST_MATH 0
+#endif
+#endif
+
+#if (FAST_MATH == 1)
+
+union fast_math_bits { float f; uint32_t i; };
+
+inline uint32_t fast_isqrt32(uint32_t n)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > n) { bit >>= 2; }
+    while (bit) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (root);
+}
+
+inline float fast_sqrt(const float x)
+{
+    fast_math_bits u = { x };
+    if ((u.i - 0x00800000) >= (0x7f800000 - 0x00800000)) {    // not a positive normal number
+        return (sqrtf(x));
+    }
+    int32_t e = (int32_t)(u.i >> 23) - 127;
+    uint32_t m = (u.i & 0x007fffff) | 0x00800000;               // x = m * 2^(e-23)
+    if (e & 1) { m <<= 1; e -= 1; }                             // make the exponent even
+    uint32_t r = fast_isqrt32(m << 7);                          // top 16 bits of the root
+    uint64_t n = (uint64_t)m << 23;                             // root of n is the 24 bit mantissa
+    uint32_t root = r << 8;
+    root += (uint32_t)((n - (uint64_t)root * root) >> 9) / r;  // Newton step: (n - root^2) / (2 root)
+    if ((uint64_t)root * root > n) { root--; }
+    u.i = ((uint32_t)(e/2 + 127) << 23) + (root & 0x007fffff);
+    return (u.f);
+}
+
+inline float fast_cbrt(const float x)
+{
+    fast_math_bits u = { x };
+    if (((u.i & 0x7fffffff) - 0x00800000) >= (0x7f800000 - 0x00800000)) {
+        return (cbrtf(x));
+    }
+    u.i = ((u.i & 0x7fffffff) / 3 + 0x2a5137a0) | (u.i & 0x80000000);  // ~3% seed
+    float y = u.f;
+    float y3 = y * y * y;
+    y *= (y3 + 2*x) / (2*y3 + x);
+    y3 = y * y * y;
+    y *= (y3 + 2*x) / (2*y3 + x);
+    return (y);
+}
+
+#else
+
+inline float fast_sqrt(const float x) { return (sqrtf(x)); }
+inline float fast_cbrt(const float x) { return (cbrtf(x)); }
+
+#endif // FAST_MATH
+
 // Constants
 #define MAX_LONG (2147483647)
 #define MAX_ULONG (4294967295)
@@ -1357,6 +1357,7 @@ stat_t xio_test_assertions()
 
 size_t xio_write(const char *buffer, size_t size, bool only_to_muted /*= false*/)
 {
+    xio_flush_coalesced();                  // anything held goes out first to keep the order
     return xio.write(buffer, size, only_to_muted);
 }
 
@@ -1374,9 +1375,104 @@ char *xio_readline(devflags_t &flags, uint16_t &size)
 
 int16_t xio_writeline(const char *buffer, bool only_to_muted /*= false*/)
 {
+    xio_flush_coalesced();                  // anything held goes out first to keep the order
     return xio.writeline(buffer, only_to_muted);
 }
 
+/*
+ * xio_writeline_coalesced() - hold a line to be written together with the lines after it
+ * xio_flush_coalesced() - write any held lines now
+ * xio_coalesce_callback() - write held lines once the oldest has waited long enough
+ *
+ *  Each line written to the control channel is a USB transfer of its own, and at high
+ *  block rates the per-transfer overhead and host wakeups for one short ack per line add
+ *  up. Coalesced lines are held and go out as one write when 'lines' are held, when the
+ *  first one has been held for 'time_ms', or when the next one would not fit.
+ *
+ *  Any other write to the control channel sends the held lines first, so nothing is ever
+ *  reordered - errors, exceptions and alarms go out immediately with whatever was held
+ *  ahead of them. The deadline is checked from the controller loop at SysTick (ms)
+ *  resolution, so a line is held for between time_ms-1 and time_ms.
+ */
+
+static struct xioCoalesce {
+    uint16_t length;                        // bytes held
+    uint8_t lines;                          // lines held
+    uint32_t deadline;                      // SysTick time to send the held lines by
+    char buf[XIO_COALESCE_BUFFER_SIZE];
+} xc;
+
+int16_t xio_writeline_coalesced(const char *buffer, const uint8_t lines, const uint8_t time_ms)
+{
+    uint16_t length = strlen(buffer);
+    if ((xc.length + length) > sizeof(xc.buf)) {
+        xio_flush_coalesced();
+        if (length > sizeof(xc.buf)) {      // too long to ever hold
+            return (xio.writeline(buffer, false));
+        }
+    }
+    if (xc.lines == 0) {
+        xc.deadline = SysTickTimer_getValue() + time_ms;
+    }
+    memcpy(&xc.buf[xc.length], buffer, length);
+    xc.length += length;
+    if (++xc.lines >= lines) {
+        xio_flush_coalesced();
+    }
+    return (length);
+}
+
+void xio_flush_coalesced()
+{
+    if (xc.length == 0) {
+        return;
+    }
+    xio.write(xc.buf, xc.length, false);
+    xc.length = 0;
+    xc.lines = 0;
+}
+
+stat_t xio_coalesce_callback()
+{
+    if ((xc.lines == 0) || ((int32_t)(SysTickTimer_getValue() - xc.deadline) < 0)) {
+        return (STAT_NOOP);
+    }
+    xio_flush_coalesced();
+    return (STAT_OK);
+}
+
+/*
+ * xio_write_telemetry() - write a block to the telemetry channel
+ * xio_telemetry_connected() - return true if there is a telemetry channel to write to
+ *
+ *  The telemetry channel is USB1 while it is connected as the data channel. Responses and
+ *  reports never go there (they go to the control channel), so binary frames don't mix with
+ *  them. If USB1 is the only port connected it is the control channel and gets no telemetry.
+ *
+ *  Unlike xio_write() this makes a single write and never waits for the TX buffer to drain.
+ *  What doesn't fit is not written, so a block can go out cut short - the caller's framing
+ *  has to cope with that. Returns the bytes written or -1.
+ */
+
+int16_t xio_write_telemetry(const char *buffer, int16_t size)
+{
+#if (XIO_HAS_USB == 1) && (USB_SERIAL_PORTS_EXPOSED == 2)
+    if (xio_telemetry_connected()) {
+        return (serialUSB1Wrapper.write(buffer, size));
+    }
+#endif
+    return (-1);
+}
+
+bool xio_telemetry_connected()
+{
+#if (XIO_HAS_USB == 1) && (USB_SERIAL_PORTS_EXPOSED == 2)
+    return (serialUSB1Wrapper.isConnected() && !serialUSB1Wrapper.isCtrl());
+#else
+    return (false);
+#endif
+}
+
 /*
  * write() - return true of the device is currently "connected" (there's a fair bit of interpretation)
  */
@@ -111,6 +111,12 @@ enum xioSPIMode {
 
 #define RX_BUFFER_SIZE       512            // maximum length of recieved lines from xio_readline
 
+/**** response coalescing ****/
+
+#define XIO_COALESCE_BUFFER_SIZE 512        // bytes of held response lines
+#define XIO_COALESCE_LINES_MAX   16         // most lines that can be held
+#define XIO_COALESCE_MS_MAX      100        // longest a line can be held (in ms)
+
 /**** function prototypes ****/
 
 void xio_init(void);
@@ -119,7 +125,12 @@ stat_t xio_test_assertions(void);
 size_t xio_write(const char *buffer, size_t size, bool only_to_muted = false);
 char *xio_readline(devflags_t &flags, uint16_t &size);
 int16_t xio_writeline(const char *buffer, bool only_to_muted = false);
+int16_t xio_writeline_coalesced(const char *buffer, const uint8_t lines, const uint8_t time_ms);
+void xio_flush_coalesced(void);
+stat_t xio_coalesce_callback(void);
 bool xio_connected();
+int16_t xio_write_telemetry(const char *buffer, int16_t size);
+bool xio_telemetry_connected();
 void xio_flush_to_command();
 #if MARLIN_COMPAT_ENABLED == true
 void xio_exit_fake_bootloader();